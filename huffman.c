@@ -1,3 +1,6 @@
+#define _POSIX_C_SOURCE 200809L  // pthreads, sysconf, dup, fseeko, mmap, clock_gettime
+#define _FILE_OFFSET_BITS 64      // 64-bit off_t on 32-bit platforms
+#define _DARWIN_C_SOURCE          // Keep BSD extensions visible on macOS
 #include "huffman.h"
 
 // =============================================================================
@@ -5,17 +8,26 @@
 // =============================================================================
 
 /**
- * Creates a new Huffman tree node
+ * Prepares an empty node arena
+ * @param tree Arena to initialize
+ */
+void initTree(HuffmanTree* tree) {
+    tree->count = 0;
+}
+
+/**
+ * Takes the next Huffman tree node from the arena
+ * @param tree Arena the node belongs to
  * @param character The character to store (0 for internal nodes)
  * @param frequency The frequency of the character
- * @return Pointer to the created node or NULL on failure
+ * @return Pointer to the created node or NULL if the arena is full
  */
-HuffmanNode* createNode(unsigned char character, unsigned int frequency) {
-    HuffmanNode* node = (HuffmanNode*)malloc(sizeof(HuffmanNode));
-    if (!node) {
-        fprintf(stderr, "Error: Memory allocation failed for Huffman node\n");
+HuffmanNode* createNode(HuffmanTree* tree, unsigned char character, uint64_t frequency) {
+    if (tree->count >= MAX_TREE_NODES) {
+        reportError("Huffman tree exceeds %d nodes", MAX_TREE_NODES);
         return NULL;
     }
+    HuffmanNode* node = &tree->nodes[tree->count++];
 
     node->character = character;
     node->frequency = frequency;
@@ -26,15 +38,11 @@ HuffmanNode* createNode(unsigned char character, unsigned int frequency) {
 }
 
 /**
- * Recursively destroys the Huffman tree and frees memory
- * @param root Root of the tree to destroy
+ * Releases every node of the arena at once so it can hold a new tree
+ * @param tree Arena to reset
  */
-void destroyTree(HuffmanNode* root) {
-    if (root) {
-        destroyTree(root->left);
-        destroyTree(root->right);
-        free(root);
-    }
+void destroyTree(HuffmanTree* tree) {
+    tree->count = 0;
 }
 
 /**
@@ -62,13 +70,13 @@ void destroyHeap(MinHeap* heap) {
 MinHeap* createMinHeap(int capacity) {
     MinHeap* heap = (MinHeap*)malloc(sizeof(MinHeap));
     if (!heap) {
-        fprintf(stderr, "Error: Memory allocation failed for min-heap\n");
+        reportError("Memory allocation failed for min-heap");
         return NULL;
     }
 
     heap->nodes = (HuffmanNode**)malloc(capacity * sizeof(HuffmanNode*));
     if (!heap->nodes) {
-        fprintf(stderr, "Error: Memory allocation failed for heap nodes\n");
+        reportError("Memory allocation failed for heap nodes");
         free(heap);
         return NULL;
     }
@@ -137,7 +145,7 @@ HuffmanNode* extractMin(MinHeap* heap) {
  */
 void insertMinHeap(MinHeap* heap, HuffmanNode* node) {
     if (heap->size >= heap->capacity) {
-        fprintf(stderr, "Error: Heap overflow\n");
+        reportError("Heap overflow");
         return;
     }
 
@@ -166,39 +174,138 @@ int isHeapEmpty(MinHeap* heap) {
 // FREQUENCY CALCULATION
 // =============================================================================
 
+// Slices of one span counted in parallel, one histogram per slice
+typedef struct HistogramBatch {
+    const unsigned char* data;
+    size_t size;
+    size_t sliceSize;
+    uint64_t (*histograms)[ASCII_SIZE];
+} HistogramBatch;
+
 /**
- * Calculates character frequencies from input file
- * @param filename Path to input file
+ * Thread pool task: counts slice 'index' of a histogram batch
+ */
+static void histogramTask(void* context, size_t index) {
+    HistogramBatch* batch = (HistogramBatch*)context;
+    size_t start = index * batch->sliceSize;
+    size_t size = batch->size - start < batch->sliceSize ? batch->size - start : batch->sliceSize;
+
+    memset(batch->histograms[index], 0, sizeof(batch->histograms[index]));
+    countFrequencies(batch->data + start, size, batch->histograms[index]);
+}
+
+/**
+ * Adds the byte counts of a span to a histogram using every pool thread
+ * @param pool Thread pool
+ * @param data Bytes to count
+ * @param size Number of bytes
+ * @param frequencies Histogram to update (size ASCII_SIZE)
+ * @return 0 on success, -1 on allocation failure
+ */
+int countFrequenciesParallel(ThreadPool* pool, const unsigned char* data, size_t size,
+                             uint64_t frequencies[ASCII_SIZE]) {
+    size_t slices = (size_t)pool->threadCount + 1;
+    if (slices == 1 || size < PARALLEL_HISTOGRAM_MIN) {
+        countFrequencies(data, size, frequencies);
+        return 0;
+    }
+
+    HistogramBatch batch;
+    batch.data = data;
+    batch.size = size;
+    batch.sliceSize = (size + slices - 1) / slices;
+    batch.histograms = (uint64_t (*)[ASCII_SIZE])malloc(slices * sizeof(*batch.histograms));
+    if (!batch.histograms) {
+        reportError("Memory allocation failed for histograms");
+        return -1;
+    }
+
+    runParallel(pool, histogramTask, &batch, slices);
+
+    for (size_t slice = 0; slice < slices; slice++) {
+        for (int c = 0; c < ASCII_SIZE; c++) {
+            frequencies[c] += batch.histograms[slice][c];
+        }
+    }
+
+    free(batch.histograms);
+    return 0;
+}
+
+/**
+ * Counts the byte frequencies of an input source from its current position
+ * Mapped sources are split across threads when more than one is requested.
+ * @param source Input source
  * @param frequencies Array to store frequencies (size ASCII_SIZE)
- * @return File size in bytes, or -1 on error
+ * @param threads Number of threads (0 = all cores)
+ * @return Number of bytes counted, or -1 on error
  */
-int calculateFrequencies(const char* filename, unsigned int frequencies[ASCII_SIZE]) {
-    FILE* file = fopen(filename, "rb");
-    if (!file) {
-        fprintf(stderr, "Error: Cannot open file '%s' for reading\n", filename);
+static int64_t countSourceFrequencies(InputSource* source, uint64_t frequencies[ASCII_SIZE],
+                                      int threads) {
+    memset(frequencies, 0, ASCII_SIZE * sizeof(uint64_t));
+
+    threads = resolveThreadCount(threads);
+    if (source->map && threads > 1) {
+        size_t size;
+        const unsigned char* data = readInputSpan(source, NULL, SIZE_MAX, &size);
+
+        ThreadPool* pool = createThreadPool(threads);
+        if (!pool) {
+            return -1;
+        }
+        int result = countFrequenciesParallel(pool, data, size, frequencies);
+        destroyThreadPool(pool);
+
+        return result == 0 ? (int64_t)size : -1;
+    }
+
+    unsigned char* buffer = (unsigned char*)malloc(IO_BUFFER_SIZE);
+    if (!buffer) {
+        reportError("Memory allocation failed for input buffer");
         return -1;
     }
 
-    // Initialize frequency array
-    memset(frequencies, 0, ASCII_SIZE * sizeof(unsigned int));
+    int64_t total = 0;
+    size_t count;
+    const unsigned char* data;
 
-    int ch;
-    int fileSize = 0;
+    while ((data = readInputSpan(source, buffer, IO_BUFFER_SIZE, &count)), count > 0) {
+        countFrequencies(data, count, frequencies);
+        total += (int64_t)count;
+    }
+
+    free(buffer);
 
-    // Read file character by character and count frequencies
-    while ((ch = fgetc(file)) != EOF) {
-        frequencies[(unsigned char)ch]++;
-        fileSize++;
+    if (ferror(source->file)) {
+        reportError("Failed to read input data");
+        return -1;
+    }
+    return total;
+}
+
+/**
+ * Calculates character frequencies from input file
+ * @param filename Path to input file
+ * @param frequencies Array to store frequencies (size ASCII_SIZE)
+ * @return File size in bytes, or -1 on error
+ */
+int64_t calculateFrequencies(const char* filename, uint64_t frequencies[ASCII_SIZE]) {
+    InputSource source;
+    if (openInputSource(&source, filename, IO_BACKEND_MMAP) != 0) {
+        return -1;
     }
 
-    fclose(file);
+    int64_t fileSize = countSourceFrequencies(&source, frequencies, 1);
+    closeInputSource(&source);
 
     if (fileSize == 0) {
-        fprintf(stderr, "Error: Input file is empty\n");
+        reportError("Input file is empty");
         return -1;
     }
 
-    printf("File size: %d bytes\n", fileSize);
+    if (fileSize > 0) {
+        printf("File size: %lld bytes\n", (long long)fileSize);
+    }
     return fileSize;
 }
 
@@ -208,10 +315,11 @@ int calculateFrequencies(const char* filename, unsigned int frequencies[ASCII_SI
 
 /**
  * Builds the Huffman tree from character frequencies
+ * @param tree Empty arena that receives the nodes
  * @param frequencies Array of character frequencies
  * @return Root of the constructed Huffman tree or NULL on error
  */
-HuffmanNode* buildHuffmanTree(unsigned int frequencies[ASCII_SIZE]) {
+HuffmanNode* buildHuffmanTree(HuffmanTree* tree, uint64_t frequencies[ASCII_SIZE]) {
     // Count number of unique characters
     int uniqueChars = 0;
     for (int i = 0; i < ASCII_SIZE; i++) {
@@ -221,7 +329,7 @@ HuffmanNode* buildHuffmanTree(unsigned int frequencies[ASCII_SIZE]) {
     }
 
     if (uniqueChars == 0) {
-        fprintf(stderr, "Error: No characters found in input\n");
+        reportError("No characters found in input");
         return NULL;
     }
 
@@ -229,27 +337,21 @@ HuffmanNode* buildHuffmanTree(unsigned int frequencies[ASCII_SIZE]) {
     if (uniqueChars == 1) {
         for (int i = 0; i < ASCII_SIZE; i++) {
             if (frequencies[i] > 0) {
-                HuffmanNode* root = createNode(0, frequencies[i]);
-                root->left = createNode((unsigned char)i, frequencies[i]);
+                HuffmanNode* root = createNode(tree, 0, frequencies[i]);
+                root->left = createNode(tree, (unsigned char)i, frequencies[i]);
                 return root;
             }
         }
     }
 
-    // Create min-heap and populate with leaf nodes
-    MinHeap* heap = createMinHeap(uniqueChars);
-    if (!heap) {
-        return NULL;
-    }
+    // Populate a min-heap over local slots with the leaf nodes
+    HuffmanNode* slots[ASCII_SIZE];
+    MinHeap queue = { 0, uniqueChars, slots };
+    MinHeap* heap = &queue;
 
     for (int i = 0; i < ASCII_SIZE; i++) {
         if (frequencies[i] > 0) {
-            HuffmanNode* node = createNode((unsigned char)i, frequencies[i]);
-            if (!node) {
-                destroyHeap(heap);
-                return NULL;
-            }
-            insertMinHeap(heap, node);
+            insertMinHeap(heap, createNode(tree, (unsigned char)i, frequencies[i]));
         }
     }
 
@@ -260,17 +362,12 @@ HuffmanNode* buildHuffmanTree(unsigned int frequencies[ASCII_SIZE]) {
         HuffmanNode* right = extractMin(heap);
 
         if (!left || !right) {
-            fprintf(stderr, "Error: Failed to extract nodes from heap\n");
-            destroyHeap(heap);
+            reportError("Failed to extract nodes from heap");
             return NULL;
         }
 
         // Create new internal node
-        HuffmanNode* merged = createNode(0, left->frequency + right->frequency);
-        if (!merged) {
-            destroyHeap(heap);
-            return NULL;
-        }
+        HuffmanNode* merged = createNode(tree, 0, left->frequency + right->frequency);
 
         merged->left = left;
         merged->right = right;
@@ -280,9 +377,7 @@ HuffmanNode* buildHuffmanTree(unsigned int frequencies[ASCII_SIZE]) {
 
     // Extract root node
     HuffmanNode* root = extractMin(heap);
-    destroyHeap(heap);
 
-    printf("Huffman tree constructed successfully\n");
     return root;
 }
 
@@ -331,6 +426,7 @@ void buildCodeTable(HuffmanNode* root, CodeEntry codes[ASCII_SIZE]) {
     for (int i = 0; i < ASCII_SIZE; i++) {
         codes[i].code[0] = '\0';
         codes[i].length = 0;
+        codes[i].bits = 0;
     }
 
     if (!root) return;
@@ -340,406 +436,5900 @@ void buildCodeTable(HuffmanNode* root, CodeEntry codes[ASCII_SIZE]) {
         codes[root->character].code[0] = '0';
         codes[root->character].code[1] = '\0';
         codes[root->character].length = 1;
+        codes[root->character].bits = 0;
         return;
     }
 
     char currentCode[MAX_CODE_LENGTH];
     generateCodes(root, codes, currentCode, 0);
 
-    printf("Huffman codes generated successfully\n");
+    // Pack each code for the 64-bit bit writer
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        codes[i].bits = 0;
+        for (int j = 0; j < codes[i].length && j < 64; j++) {
+            codes[i].bits = (codes[i].bits << 1) | (codes[i].code[j] == '1');
+        }
+    }
 }
 
 // =============================================================================
-// BIT OPERATIONS
+// CANONICAL CODES
 // =============================================================================
 
 /**
- * Writes a single bit to file using bit buffer
- * @param file Output file pointer
- * @param bitBuffer Buffer for bit operations
- * @param bit Bit to write (0 or 1)
+ * Lists the used symbols in ascending frequency order, ties by character
+ * A stable LSD radix sort over the frequency bytes; passes stop after
+ * the highest byte any frequency uses.
+ * @param frequencies Array of character frequencies
+ * @param symbols Array to store the sorted symbols
+ * @return Number of used symbols
  */
-void writeBit(FILE* file, BitBuffer* bitBuffer, int bit) {
-    bitBuffer->buffer = (bitBuffer->buffer << 1) | (bit & 1);
-    bitBuffer->bitCount++;
-
-    if (bitBuffer->bitCount == 8) {
-        fputc(bitBuffer->buffer, file);
-        bitBuffer->buffer = 0;
-        bitBuffer->bitCount = 0;
+static int sortSymbolsByFrequency(const uint64_t frequencies[ASCII_SIZE], int symbols[ASCII_SIZE]) {
+    int n = 0;
+    uint64_t maxFrequency = 0;
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        if (frequencies[i] > 0) {
+            symbols[n++] = i;
+            if (frequencies[i] > maxFrequency) maxFrequency = frequencies[i];
+        }
     }
-}
 
-/**
- * Flushes remaining bits in buffer to file
- * @param file Output file pointer
- * @param bitBuffer Buffer for bit operations
- */
-void flushBits(FILE* file, BitBuffer* bitBuffer) {
-    if (bitBuffer->bitCount > 0) {
-        bitBuffer->buffer <<= (8 - bitBuffer->bitCount);
-        fputc(bitBuffer->buffer, file);
-    }
-}
+    int scratch[ASCII_SIZE];
+    int* from = symbols;
+    int* to = scratch;
+    for (int shift = 0; shift < 64 && (maxFrequency >> shift) > 0; shift += 8) {
+        int offsets[256] = {0};
+        for (int k = 0; k < n; k++) {
+            offsets[(frequencies[from[k]] >> shift) & 0xFF]++;
+        }
+        if (offsets[(frequencies[from[0]] >> shift) & 0xFF] == n) {
+            continue;  // Every frequency shares this byte
+        }
 
-/**
- * Reads a single bit from file
- * @param file Input file pointer
- * @param currentByte Current byte being processed
- * @param bitPosition Current bit position in byte
- * @return Bit value (0 or 1) or -1 on EOF
- */
-int readBit(FILE* file, unsigned char* currentByte, int* bitPosition) {
-    if (*bitPosition == 0) {
-        int ch = fgetc(file);
-        if (ch == EOF) {
-            return -1;
+        int position = 0;
+        for (int digit = 0; digit < 256; digit++) {
+            int count = offsets[digit];
+            offsets[digit] = position;
+            position += count;
         }
-        *currentByte = (unsigned char)ch;
-        *bitPosition = 8;
+        for (int k = 0; k < n; k++) {
+            to[offsets[(frequencies[from[k]] >> shift) & 0xFF]++] = from[k];
+        }
+
+        int* swap = from;
+        from = to;
+        to = swap;
     }
 
-    (*bitPosition)--;
-    return (*currentByte >> *bitPosition) & 1;
+    if (from != symbols) {
+        memcpy(symbols, from, (size_t)n * sizeof(int));
+    }
+    return n;
 }
 
-// =============================================================================
-// COMPRESSION FUNCTIONS
-// =============================================================================
-
 /**
- * Writes file header to compressed file
- * @param file Output file pointer
- * @param header Header structure to write
+ * Turns ascending weights into optimal code lengths in place (Moffat-Katajainen)
+ * The first pass merges leaves and internal nodes as two queues, storing
+ * parent indices; the second turns those into internal node depths and the
+ * third hands out leaf depths level by level.
+ * @param weights Ascending leaf weights; receives each leaf's code length
+ * @param n Number of leaves (at least 2)
  */
-void writeFileHeader(FILE* file, FileHeader* header) {
-    fwrite(&header->magic, sizeof(uint32_t), 1, file);
-    fwrite(&header->original_size, sizeof(uint32_t), 1, file);
-    fwrite(&header->compressed_size, sizeof(uint32_t), 1, file);
-    fwrite(&header->frequency_count, sizeof(uint32_t), 1, file);
-    fwrite(&header->padding_bits, sizeof(uint8_t), 1, file);
-}
+static void computeCodeLengthsInPlace(uint64_t* weights, int n) {
+    uint64_t* a = weights;
+    int root = 0;
+    int leaf = 2;
+
+    a[0] += a[1];
+    for (int next = 1; next < n - 1; next++) {
+        // First child: lightest internal node or leaf
+        if (leaf >= n || a[root] < a[leaf]) {
+            a[next] = a[root];
+            a[root++] = (uint64_t)next;
+        } else {
+            a[next] = a[leaf++];
+        }
 
-/**
- * Writes character frequencies to compressed file
- * @param file Output file pointer
- * @param frequencies Array of character frequencies
- */
-void writeFrequencies(FILE* file, unsigned int frequencies[ASCII_SIZE]) {
-    for (int i = 0; i < ASCII_SIZE; i++) {
-        if (frequencies[i] > 0) {
-            fputc((unsigned char)i, file);
-            fwrite(&frequencies[i], sizeof(unsigned int), 1, file);
+        // Second child
+        if (leaf >= n || (root < next && a[root] < a[leaf])) {
+            a[next] += a[root];
+            a[root++] = (uint64_t)next;
+        } else {
+            a[next] += a[leaf++];
         }
     }
-}
-
-/**
- * Encodes input data and writes to output file
- * @param inputFile Input file pointer
- * @param outputFile Output file pointer
- * @param codes Array of Huffman codes
- */
-void encodeAndWrite(FILE* inputFile, FILE* outputFile, CodeEntry codes[ASCII_SIZE]) {
-    BitBuffer bitBuffer = {0, 0};
-    int ch;
-
-    rewind(inputFile);
 
-    while ((ch = fgetc(inputFile)) != EOF) {
-        unsigned char character = (unsigned char)ch;
+    // Parent indices to internal node depths
+    a[n - 2] = 0;
+    for (int next = n - 3; next >= 0; next--) {
+        a[next] = a[a[next]] + 1;
+    }
 
-        if (codes[character].length == 0) {
-            fprintf(stderr, "Error: No code found for character %d\n", character);
-            continue;
+    // Internal node depths to leaf depths, shallowest leaves last
+    int available = 1;
+    int used = 0;
+    uint64_t depth = 0;
+    int node = n - 2;
+    int next = n - 1;
+    while (available > 0) {
+        while (node >= 0 && a[node] == depth) {
+            used++;
+            node--;
         }
-
-        // Write each bit of the character's code
-        for (int i = 0; i < codes[character].length; i++) {
-            int bit = (codes[character].code[i] == '1') ? 1 : 0;
-            writeBit(outputFile, &bitBuffer, bit);
+        while (available > used) {
+            a[next--] = depth;
+            available--;
         }
+        available = 2 * used;
+        depth++;
+        used = 0;
     }
-
-    flushBits(outputFile, &bitBuffer);
 }
 
 /**
- * Compresses a file using Huffman coding
- * @param inputFile Path to input file
- * @param outputFile Path to output file
+ * Computes optimal code lengths no longer than maxLength
+ * Unrestricted Huffman lengths come first; only when they exceed the
+ * limit does package-merge run. Each of its level lists merges the sorted
+ * leaves with packages of adjacent pairs from the level below; the
+ * cheapest 2n-2 items of the top list decide how many levels each leaf
+ * appears in, which is its code length.
+ * @param frequencies Array of character frequencies
+ * @param maxLength Maximum code length (1 to MAX_CANONICAL_CODE_LENGTH)
+ * @param lengths Array to store the code length per character
  * @return 0 on success, -1 on error
  */
-int compressFile(const char* inputFile, const char* outputFile) {
-    printf("\n=== COMPRESSION STARTED ===\n");
-    printf("Input file: %s\n", inputFile);
-    printf("Output file: %s\n", outputFile);
+int computeLimitedCodeLengths(const uint64_t frequencies[ASCII_SIZE], int maxLength,
+                              uint8_t lengths[ASCII_SIZE]) {
+    memset(lengths, 0, ASCII_SIZE);
 
-    // Calculate frequencies
-    unsigned int frequencies[ASCII_SIZE];
-    int originalSize = calculateFrequencies(inputFile, frequencies);
-    if (originalSize < 0) {
+    int symbols[ASCII_SIZE];
+    int n = sortSymbolsByFrequency(frequencies, symbols);
+
+    if (n == 0) {
+        reportError("No characters found in input");
         return -1;
     }
 
-    // Build Huffman tree
-    HuffmanNode* root = buildHuffmanTree(frequencies);
-    if (!root) {
-        fprintf(stderr, "Error: Failed to build Huffman tree\n");
+    // Handle single character case
+    if (n == 1) {
+        lengths[symbols[0]] = 1;
+        return 0;
+    }
+
+    if (maxLength < 1 || maxLength > MAX_CANONICAL_CODE_LENGTH || (1 << maxLength) < n) {
+        reportError("Cannot fit %d symbols into %d-bit codes", n, maxLength);
         return -1;
     }
 
-    // Generate codes
-    CodeEntry codes[ASCII_SIZE];
-    buildCodeTable(root, codes);
+    // The lightest leaf gets the longest code; keep it if it fits
+    uint64_t weights[ASCII_SIZE];
+    for (int k = 0; k < n; k++) {
+        weights[k] = frequencies[symbols[k]];
+    }
+    computeCodeLengthsInPlace(weights, n);
+    if (weights[0] <= (uint64_t)maxLength) {
+        for (int k = 0; k < n; k++) {
+            lengths[symbols[k]] = (uint8_t)weights[k];
+        }
+        return 0;
+    }
 
-    // Open files
-    FILE* inFile = fopen(inputFile, "rb");
-    FILE* outFile = fopen(outputFile, "wb");
+    // isLeaf[level][k]: whether item k of that level's sorted list is a leaf
+    uint8_t isLeaf[MAX_CANONICAL_CODE_LENGTH][2 * ASCII_SIZE];
+    uint64_t previous[2 * ASCII_SIZE];
+    uint64_t current[2 * ASCII_SIZE];
 
-    if (!inFile || !outFile) {
-        fprintf(stderr, "Error: Cannot open files for compression\n");
-        if (inFile) fclose(inFile);
-        if (outFile) fclose(outFile);
-        destroyTree(root);
-        return -1;
+    // Deepest level holds only the leaves
+    int previousCount = n;
+    for (int k = 0; k < n; k++) {
+        previous[k] = frequencies[symbols[k]];
+        isLeaf[maxLength - 1][k] = 1;
     }
 
-    // Count unique characters for header
-    uint32_t frequencyCount = 0;
-    for (int i = 0; i < ASCII_SIZE; i++) {
-        if (frequencies[i] > 0) {
-            frequencyCount++;
+    for (int level = maxLength - 2; level >= 0; level--) {
+        int packages = previousCount / 2;
+        int leaf = 0;
+        int package = 0;
+        int count = 0;
+
+        while (leaf < n || package < packages) {
+            uint64_t packageWeight = package < packages
+                ? previous[2 * package] + previous[2 * package + 1] : 0;
+
+            if (package >= packages ||
+                (leaf < n && frequencies[symbols[leaf]] <= packageWeight)) {
+                current[count] = frequencies[symbols[leaf++]];
+                isLeaf[level][count++] = 1;
+            } else {
+                current[count] = packageWeight;
+                isLeaf[level][count++] = 0;
+                package++;
+            }
         }
+
+        memcpy(previous, current, (size_t)count * sizeof(uint64_t));
+        previousCount = count;
     }
 
-    // Write header (placeholder, will be updated later)
-    FileHeader header = {
-        .magic = MAGIC_NUMBER,
-        .original_size = (uint32_t)originalSize,
-        .compressed_size = 0,
-        .frequency_count = frequencyCount,
-        .padding_bits = 0
-    };
+    // Take the cheapest 2n-2 items; the packages among them select items one level down
+    int take = 2 * n - 2;
+    for (int level = 0; level < maxLength && take > 0; level++) {
+        int leaves = 0;
+        for (int k = 0; k < take; k++) {
+            leaves += isLeaf[level][k];
+        }
+        for (int k = 0; k < leaves; k++) {
+            lengths[symbols[k]]++;
+        }
+        take = 2 * (take - leaves);
+    }
 
-    writeFileHeader(outFile, &header);
-    writeFrequencies(outFile, frequencies);
+    return 0;
+}
+
+/**
+ * Assigns canonical codes from code lengths
+ * Codes of each length are consecutive integers in symbol order, so the
+ * lengths alone are enough to rebuild the code table.
+ * @param lengths Code length per character (0 for unused characters)
+ * @param codes Array to store the generated codes
+ * @return 0 on success, -1 if the lengths do not describe a prefix code
+ */
+int assignCanonicalCodes(const uint8_t lengths[ASCII_SIZE], CodeEntry codes[ASCII_SIZE]) {
+    int lengthCount[MAX_CANONICAL_CODE_LENGTH + 1] = {0};
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        if (lengths[i] > MAX_CANONICAL_CODE_LENGTH) {
+            reportError("Code length %d exceeds %d bits", lengths[i], MAX_CANONICAL_CODE_LENGTH);
+            return -1;
+        }
+        lengthCount[lengths[i]]++;
+    }
 
-    // Encode and write data
-    long dataStart = ftell(outFile);
-    encodeAndWrite(inFile, outFile, codes);
-    long dataEnd = ftell(outFile);
+    // Kraft inequality: the code space used may not exceed 2^MAX
+    uint32_t codeSpace = 0;
+    for (int len = 1; len <= MAX_CANONICAL_CODE_LENGTH; len++) {
+        codeSpace += (uint32_t)lengthCount[len] << (MAX_CANONICAL_CODE_LENGTH - len);
+    }
+    if (codeSpace > (1u << MAX_CANONICAL_CODE_LENGTH)) {
+        reportError("Invalid code lengths (over-subscribed)");
+        return -1;
+    }
 
-    // Calculate padding bits
-    header.compressed_size = (uint32_t)(dataEnd - dataStart);
+    // First code of each length
+    uint64_t nextCode[MAX_CANONICAL_CODE_LENGTH + 1];
+    uint64_t code = 0;
+    lengthCount[0] = 0;
+    for (int len = 1; len <= MAX_CANONICAL_CODE_LENGTH; len++) {
+        code = (code + (uint64_t)lengthCount[len - 1]) << 1;
+        nextCode[len] = code;
+    }
 
-    // Update header with actual compressed size
-    fseek(outFile, 0, SEEK_SET);
-    writeFileHeader(outFile, &header);
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        int len = lengths[i];
+        codes[i].length = len;
+        codes[i].bits = 0;
+        codes[i].code[0] = '\0';
+        if (len == 0) continue;
 
-    fclose(inFile);
-    fclose(outFile);
-    destroyTree(root);
+        codes[i].bits = nextCode[len]++;
+        for (int j = 0; j < len; j++) {
+            codes[i].code[j] = ((codes[i].bits >> (len - 1 - j)) & 1) ? '1' : '0';
+        }
+        codes[i].code[len] = '\0';
+    }
 
-    printf("=== COMPRESSION COMPLETED ===\n");
     return 0;
 }
 
-// =============================================================================
-// DECOMPRESSION FUNCTIONS
-// =============================================================================
+/**
+ * Packs 4-bit code lengths for the used character range
+ * Layout: first character, last character, then one nibble per character
+ * (high nibble first)
+ * @param lengths Code length per character
+ * @param output Buffer of at least 2 + ASCII_SIZE / 2 bytes
+ * @return Number of bytes written
+ */
+size_t packCodeLengths(const uint8_t lengths[ASCII_SIZE], unsigned char* output) {
+    int first = 0;
+    int last = ASCII_SIZE - 1;
+    while (first < last && lengths[first] == 0) first++;
+    while (last > first && lengths[last] == 0) last--;
+
+    size_t size = 0;
+    output[size++] = (unsigned char)first;
+    output[size++] = (unsigned char)last;
+
+    for (int i = first; i <= last; i += 2) {
+        int high = lengths[i];
+        int low = (i + 1 <= last) ? lengths[i + 1] : 0;
+        output[size++] = (unsigned char)((high << 4) | low);
+    }
+
+    return size;
+}
 
 /**
- * Reads file header from compressed file
- * @param file Input file pointer
- * @param header Header structure to populate
+ * Unpacks code lengths written by packCodeLengths
+ * @param input Packed code lengths
+ * @param size Number of bytes available
+ * @param lengths Array to populate with code lengths
+ * @param consumed Set to the number of bytes used
  * @return 0 on success, -1 on error
  */
-int readFileHeader(FILE* file, FileHeader* header) {
-    if (fread(&header->magic, sizeof(uint32_t), 1, file) != 1 ||
-        fread(&header->original_size, sizeof(uint32_t), 1, file) != 1 ||
-        fread(&header->compressed_size, sizeof(uint32_t), 1, file) != 1 ||
-        fread(&header->frequency_count, sizeof(uint32_t), 1, file) != 1 ||
-        fread(&header->padding_bits, sizeof(uint8_t), 1, file) != 1) {
+int unpackCodeLengths(const unsigned char* input, size_t size, uint8_t lengths[ASCII_SIZE],
+                      size_t* consumed) {
+    memset(lengths, 0, ASCII_SIZE);
+
+    if (size < 2 || input[0] > input[1]) {
+        reportError("Invalid code length header");
         return -1;
     }
 
-    if (header->magic != MAGIC_NUMBER) {
-        fprintf(stderr, "Error: Invalid file format (magic number mismatch)\n");
+    int first = input[0];
+    int last = input[1];
+    size_t needed = 2 + (size_t)(last - first + 2) / 2;
+    if (size < needed) {
+        reportError("Unexpected end of data while reading code lengths");
         return -1;
     }
 
+    const unsigned char* packed = input + 2;
+    for (int i = first; i <= last; i += 2) {
+        lengths[i] = (uint8_t)(*packed >> 4);
+        if (i + 1 <= last) {
+            lengths[i + 1] = (uint8_t)(*packed & 0x0F);
+        }
+        packed++;
+    }
+
+    *consumed = needed;
     return 0;
 }
 
 /**
- * Reads character frequencies from compressed file
+ * Writes 4-bit code lengths for the used character range
+ * @param file Output file pointer
+ * @param lengths Code length per character
+ */
+void writeCodeLengths(FILE* file, const uint8_t lengths[ASCII_SIZE]) {
+    unsigned char packed[2 + ASCII_SIZE / 2];
+    size_t size = packCodeLengths(lengths, packed);
+    fwrite(packed, 1, size, file);
+}
+
+/**
+ * Reads 4-bit code lengths written by writeCodeLengths
  * @param file Input file pointer
- * @param frequencies Array to populate with frequencies
- * @param count Number of unique characters to read
+ * @param lengths Array to populate with code lengths
  * @return 0 on success, -1 on error
  */
-int readFrequencies(FILE* file, unsigned int frequencies[ASCII_SIZE], int count) {
-    memset(frequencies, 0, ASCII_SIZE * sizeof(unsigned int));
-
-    for (int i = 0; i < count; i++) {
-        int ch = fgetc(file);
-        if (ch == EOF) {
-            fprintf(stderr, "Error: Unexpected end of file while reading frequencies\n");
-            return -1;
-        }
+int readCodeLengths(FILE* file, uint8_t lengths[ASCII_SIZE]) {
+    unsigned char packed[2 + ASCII_SIZE / 2];
+    if (fread(packed, 1, 2, file) != 2 || packed[0] > packed[1]) {
+        reportError("Invalid code length header");
+        return -1;
+    }
 
-        unsigned char character = (unsigned char)ch;
-        if (fread(&frequencies[character], sizeof(unsigned int), 1, file) != 1) {
-            fprintf(stderr, "Error: Failed to read frequency data\n");
-            return -1;
-        }
+    size_t remaining = (size_t)(packed[1] - packed[0] + 2) / 2;
+    if (fread(packed + 2, 1, remaining, file) != remaining) {
+        reportError("Unexpected end of file while reading code lengths");
+        return -1;
     }
 
-    return 0;
+    size_t consumed;
+    return unpackCodeLengths(packed, 2 + remaining, lengths, &consumed);
 }
 
 /**
- * Decodes compressed data and writes to output file
+ * Builds a Huffman tree that matches a code table
+ * Used by the reference tree-walk decoder for canonical streams.
+ * @param tree Empty arena that receives the nodes
+ * @param codes Array of codes with packed bits
+ * @return Root of the tree or NULL on failure
+ */
+HuffmanNode* buildTreeFromCodes(HuffmanTree* tree, CodeEntry codes[ASCII_SIZE]) {
+    HuffmanNode* root = createNode(tree, 0, 0);
+    if (!root) return NULL;
+
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        HuffmanNode* node = root;
+        for (int j = codes[i].length - 1; j >= 0; j--) {
+            HuffmanNode** child = ((codes[i].bits >> j) & 1) ? &node->right : &node->left;
+            if (!*child) {
+                *child = createNode(tree, 0, 0);
+                if (!*child) {
+                    destroyTree(tree);
+                    return NULL;
+                }
+            }
+            node = *child;
+        }
+        if (codes[i].length > 0) {
+            node->character = (unsigned char)i;
+        }
+    }
+
+    return root;
+}
+
+// =============================================================================
+// BIT OPERATIONS
+// =============================================================================
+
+/**
+ * Writes a single bit to file using bit buffer
+ * @param file Output file pointer
+ * @param bitBuffer Buffer for bit operations
+ * @param bit Bit to write (0 or 1)
+ */
+void writeBit(FILE* file, BitBuffer* bitBuffer, int bit) {
+    bitBuffer->buffer = (bitBuffer->buffer << 1) | (bit & 1);
+    bitBuffer->bitCount++;
+
+    if (bitBuffer->bitCount == 8) {
+        fputc(bitBuffer->buffer, file);
+        bitBuffer->buffer = 0;
+        bitBuffer->bitCount = 0;
+    }
+}
+
+/**
+ * Flushes remaining bits in buffer to file
+ * @param file Output file pointer
+ * @param bitBuffer Buffer for bit operations
+ */
+void flushBits(FILE* file, BitBuffer* bitBuffer) {
+    if (bitBuffer->bitCount > 0) {
+        bitBuffer->buffer <<= (8 - bitBuffer->bitCount);
+        fputc(bitBuffer->buffer, file);
+    }
+}
+
+/**
+ * Reads a single bit from file
+ * @param file Input file pointer
+ * @param currentByte Current byte being processed
+ * @param bitPosition Current bit position in byte
+ * @return Bit value (0 or 1) or -1 on EOF
+ */
+int readBit(FILE* file, unsigned char* currentByte, int* bitPosition) {
+    if (*bitPosition == 0) {
+        int ch = fgetc(file);
+        if (ch == EOF) {
+            return -1;
+        }
+        *currentByte = (unsigned char)ch;
+        *bitPosition = 8;
+    }
+
+    (*bitPosition)--;
+    return (*currentByte >> *bitPosition) & 1;
+}
+
+/**
+ * Initializes a bit reader over the remaining contents of a file
+ * @param reader Reader to initialize
+ * @param file Input file pointer positioned at the bit stream
+ * @param storage Refill buffer of IO_BUFFER_SIZE bytes
+ */
+void initBitReader(BitReader* reader, FILE* file, unsigned char* storage) {
+    reader->file = file;
+    reader->storage = storage;
+    reader->data = storage;
+    reader->position = 0;
+    reader->length = 0;
+    reader->bits = 0;
+    reader->bitCount = 0;
+    reader->overrunBytes = 0;
+    reader->lookups = 0;
+    reader->longCodes = 0;
+}
+
+/**
+ * Initializes a bit reader over a bit stream held in memory
+ * @param reader Reader to initialize
+ * @param data Start of the bit stream
+ * @param size Size of the bit stream in bytes
+ */
+void initBitReaderMemory(BitReader* reader, const unsigned char* data, size_t size) {
+    reader->file = NULL;
+    reader->storage = NULL;
+    reader->data = data;
+    reader->position = 0;
+    reader->length = size;
+    reader->bits = 0;
+    reader->bitCount = 0;
+    reader->overrunBytes = 0;
+    reader->lookups = 0;
+    reader->longCodes = 0;
+}
+
+/**
+ * Tops up the bit reservoir to at least 56 bits
+ * Past the end of input, zero bytes are shifted in and counted in overrunBytes
+ * @param reader Bit reader to refill
+ */
+void refillBits(BitReader* reader) {
+    if (reader->bitCount >= 56) return;
+
+    // Fast path: one unaligned 8-byte load. Bits past the counted bytes are
+    // exactly the bits of the following bytes, so re-ORing them later is harmless.
+    if (reader->length - reader->position >= 8) {
+        reader->bits |= load64BE(reader->data + reader->position) >> reader->bitCount;
+        reader->position += (size_t)((63 - reader->bitCount) >> 3);
+        reader->bitCount |= 56;
+        return;
+    }
+
+    while (reader->bitCount < 56) {
+        if (reader->position == reader->length) {
+            reader->position = 0;
+            reader->length = reader->file
+                ? fread(reader->storage, 1, IO_BUFFER_SIZE, reader->file) : 0;
+            reader->data = reader->storage;
+            if (reader->length == 0) {
+                reader->overrunBytes++;
+                reader->bitCount += 8;
+                continue;
+            }
+        }
+        reader->bits |= (uint64_t)reader->data[reader->position++] << (56 - reader->bitCount);
+        reader->bitCount += 8;
+    }
+}
+
+/**
+ * Initializes a bit writer
+ * With a file the buffer is written out whenever it fills up; without one
+ * the buffer must hold the whole stream plus 8 bytes of slack.
+ * @param writer Writer to initialize
+ * @param file Output file pointer, or NULL to write to memory only
+ * @param buffer Output buffer
+ * @param capacity Size of the output buffer in bytes
+ */
+void initBitWriter(BitWriter* writer, FILE* file, unsigned char* buffer, size_t capacity) {
+    writer->file = file;
+    writer->buffer = buffer;
+    writer->capacity = capacity;
+    writer->position = 0;
+    writer->bits = 0;
+    writer->bitCount = 0;
+    writer->flushed = 0;
+}
+
+/**
+ * Moves all complete bytes from the accumulator into the output buffer
+ * Leaves fewer than 8 pending bits; writes a file buffer out when it fills up
+ * @param writer Bit writer to drain
+ */
+void drainBits(BitWriter* writer) {
+    int bytes = writer->bitCount >> 3;
+
+    // One 8-byte store; only 'bytes' of it are kept
+    store64BE(writer->buffer + writer->position, writer->bits);
+    writer->position += (size_t)bytes;
+    writer->bits = bytes == 8 ? 0 : writer->bits << (bytes * 8);
+    writer->bitCount &= 7;
+
+    if (writer->file && writer->position > writer->capacity - 8) {
+        fwrite(writer->buffer, 1, writer->position, writer->file);
+        writer->flushed += writer->position;
+        writer->position = 0;
+    }
+}
+
+/**
+ * Writes all pending bits, zero-padding the last byte, and flushes the buffer
+ * In memory mode 'position' is left at the size of the finished stream.
+ * @param writer Bit writer to finish
+ * @return 0 on success, -1 on write error
+ */
+int finishBitWriter(BitWriter* writer) {
+    drainBits(writer);
+
+    if (writer->bitCount > 0) {
+        writer->buffer[writer->position++] = (unsigned char)(writer->bits >> 56);
+        writer->bits = 0;
+        writer->bitCount = 0;
+    }
+
+    if (!writer->file) {
+        return 0;
+    }
+
+    if (fwrite(writer->buffer, 1, writer->position, writer->file) != writer->position) {
+        reportError("Failed to write compressed data");
+        return -1;
+    }
+    writer->flushed += writer->position;
+    writer->position = 0;
+
+    return 0;
+}
+
+// =============================================================================
+// COMPRESSION FUNCTIONS
+// =============================================================================
+
+/**
+ * Writes file header to compressed file
+ * The layout follows the magic number: 32-bit fields for HUFF/HUFC,
+ * version, flags and 64-bit sizes for HUFV.
+ * @param file Output file pointer
+ * @param header Header structure to write
+ */
+void writeFileHeader(FILE* file, FileHeader* header) {
+    fwrite(&header->magic, sizeof(uint32_t), 1, file);
+
+    if (header->magic == MAGIC_VERSIONED) {
+        uint16_t reserved = 0;
+        fwrite(&header->version, sizeof(uint8_t), 1, file);
+        fwrite(&header->flags, sizeof(uint8_t), 1, file);
+        fwrite(&reserved, sizeof(uint16_t), 1, file);
+        fwrite(&header->original_size, sizeof(uint64_t), 1, file);
+        fwrite(&header->compressed_size, sizeof(uint64_t), 1, file);
+    } else {
+        uint32_t originalSize = (uint32_t)header->original_size;
+        uint32_t compressedSize = (uint32_t)header->compressed_size;
+        fwrite(&originalSize, sizeof(uint32_t), 1, file);
+        fwrite(&compressedSize, sizeof(uint32_t), 1, file);
+    }
+
+    fwrite(&header->frequency_count, sizeof(uint32_t), 1, file);
+    fwrite(&header->padding_bits, sizeof(uint8_t), 1, file);
+}
+
+/**
+ * Writes the sync point table that follows a canonical bit stream
+ * @param file Output file pointer
+ * @param interval Output bytes between sync points
+ * @param points Bit offset of the code starting at byte k * interval, in entry k - 1
+ * @param count Number of sync points
+ */
+void writeSyncTable(FILE* file, uint32_t interval, const uint64_t* points, uint32_t count) {
+    fwrite(&interval, sizeof(uint32_t), 1, file);
+    fwrite(&count, sizeof(uint32_t), 1, file);
+    fwrite(points, sizeof(uint64_t), count, file);
+}
+
+/**
+ * Writes character frequencies to compressed file
+ * @param file Output file pointer
+ * @param frequencies Array of character frequencies
+ * @param wide Non-zero to store 64-bit counts (HUFV), otherwise 32-bit
+ */
+void writeFrequencies(FILE* file, const uint64_t frequencies[ASCII_SIZE], int wide) {
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        if (frequencies[i] > 0) {
+            fputc((unsigned char)i, file);
+            if (wide) {
+                fwrite(&frequencies[i], sizeof(uint64_t), 1, file);
+            } else {
+                uint32_t count = (uint32_t)frequencies[i];
+                fwrite(&count, sizeof(uint32_t), 1, file);
+            }
+        }
+    }
+}
+
+/**
+ * Encodes input data and writes to output file
  * @param inputFile Input file pointer
  * @param outputFile Output file pointer
- * @param root Root of Huffman tree
- * @param originalSize Original file size in bytes
- * @param paddingBits Number of padding bits in last byte
+ * @param codes Array of Huffman codes
+ */
+void encodeAndWrite(FILE* inputFile, FILE* outputFile, CodeEntry codes[ASCII_SIZE]) {
+    BitBuffer bitBuffer = {0, 0};
+    int ch;
+
+    rewind(inputFile);
+
+    while ((ch = fgetc(inputFile)) != EOF) {
+        unsigned char character = (unsigned char)ch;
+
+        if (codes[character].length == 0) {
+            reportError("No code found for character %d", character);
+            continue;
+        }
+
+        // Write each bit of the character's code
+        for (int i = 0; i < codes[character].length; i++) {
+            int bit = (codes[character].code[i] == '1') ? 1 : 0;
+            writeBit(outputFile, &bitBuffer, bit);
+        }
+    }
+
+    flushBits(outputFile, &bitBuffer);
+}
+
+/**
+ * Encodes a block into one bit stream or INTERLEAVED_STREAMS sub-streams
+ * Interleaved blocks split the input into consecutive segments coded
+ * independently, preceded by the byte sizes of all sub-streams but the last.
+ * @param codes Array of Huffman codes with packed bits
+ * @param input Bytes to encode
+ * @param size Number of bytes
+ * @param streams 1 or INTERLEAVED_STREAMS
+ * @param output Output buffer, including 8 bytes of bit writer slack
+ * @param capacity Size of the output buffer
+ * @param written Receives the number of bytes produced
+ * @return 0 on success, -1 if a byte has no code
+ */
+int encodeStreams(const CodeEntry codes[ASCII_SIZE], const unsigned char* input, size_t size,
+                  int streams, unsigned char* output, size_t capacity, size_t* written) {
+    size_t position = streams == 1 ? 0 : STREAM_JUMP_TABLE_SIZE;
+    size_t segment = streams == 1 ? size : interleavedSegmentSize(size);
+
+    for (int k = 0; k < streams; k++) {
+        size_t start = (size_t)k * segment < size ? (size_t)k * segment : size;
+        size_t count = size - start < segment ? size - start : segment;
+
+        BitWriter writer;
+        initBitWriter(&writer, NULL, output + position, capacity - position);
+        if (encodeSymbols(&writer, codes, input + start, count) != 0) {
+            return -1;
+        }
+        finishBitWriter(&writer);
+
+        if (k < streams - 1) {
+            uint32_t streamSize = (uint32_t)writer.position;
+            memcpy(output + (size_t)k * sizeof(uint32_t), &streamSize, sizeof(uint32_t));
+        }
+        position += writer.position;
+    }
+
+    *written = position;
+    return 0;
+}
+
+/**
+ * Encodes input data with packed codes and a 64-bit bit writer
+ * Input is consumed in spans; falls back to encodeAndWrite for codes too long to pack.
+ * Spans end at every sync point, where the bit offset of the next code is recorded.
+ * @param input Input source, read from the start
+ * @param outputFile Output file pointer
+ * @param codes Array of Huffman codes with packed bits
+ * @param syncInterval Input bytes between sync points (0 = none)
+ * @param syncPoints Receives the bit offset at byte k * syncInterval in entry k - 1
+ * @param syncCount Number of sync points
+ * @return 0 on success, -1 on error
+ */
+int encodeWithPackedCodes(InputSource* input, FILE* outputFile, CodeEntry codes[ASCII_SIZE],
+                          uint32_t syncInterval, uint64_t* syncPoints, uint32_t syncCount) {
+    for (int i = 0; syncCount == 0 && i < ASCII_SIZE; i++) {
+        if (codes[i].length > MAX_PACKED_CODE_LENGTH) {
+            encodeAndWrite(input->file, outputFile, codes);
+            return 0;
+        }
+    }
+
+    unsigned char* output = (unsigned char*)malloc(IO_BUFFER_SIZE);
+    unsigned char* buffer = (unsigned char*)malloc(IO_BUFFER_SIZE);
+    if (!output || !buffer) {
+        reportError("Memory allocation failed for encode buffers");
+        free(output);
+        free(buffer);
+        return -1;
+    }
+
+    BitWriter writer;
+    initBitWriter(&writer, outputFile, output, IO_BUFFER_SIZE);
+
+    int result = rewindInputSource(input);
+    size_t count;
+    const unsigned char* data;
+    uint64_t consumed = 0;
+    uint32_t nextPoint = 0;
+    uint64_t nextSync = syncCount > 0 ? syncInterval : UINT64_MAX;
+
+    while (result == 0) {
+        size_t span = nextSync - consumed < IO_BUFFER_SIZE
+            ? (size_t)(nextSync - consumed) : IO_BUFFER_SIZE;
+        data = readInputSpan(input, buffer, span, &count);
+        if (count == 0) break;
+
+        if (encodeSymbols(&writer, codes, data, count) != 0) {
+            result = -1;
+        }
+        consumed += count;
+
+        if (consumed == nextSync) {
+            syncPoints[nextPoint++] =
+                (writer.flushed + writer.position) * 8 + (uint64_t)writer.bitCount;
+            nextSync = nextPoint < syncCount ? nextSync + syncInterval : UINT64_MAX;
+        }
+    }
+
+    if (ferror(input->file)) {
+        reportError("Failed to read input data");
+        result = -1;
+    } else if (result == 0 && nextPoint < syncCount) {
+        reportError("Input changed while it was being compressed");
+        result = -1;
+    }
+
+    if (finishBitWriter(&writer) != 0) {
+        result = -1;
+    }
+
+    free(output);
+    free(buffer);
+    return result;
+}
+
+/**
+ * Initializes compression options with defaults
+ * @param options Options structure to initialize
+ */
+void initCompressOptions(CompressOptions* options) {
+    options->format = FORMAT_BLOCKS;
+    options->ioBackend = IO_BACKEND_MMAP;
+    options->maxCodeLength = DEFAULT_MAX_CODE_LENGTH;
+    options->threads = 1;
+    options->blockSize = DEFAULT_BLOCK_SIZE;
+    options->streams = INTERLEAVED_STREAMS;
+    options->splitLevel = 0;
+    options->contextModel = 0;
+    options->checksums = 0;
+    options->syncInterval = 0;
+    options->pipelined = 0;
+    options->table = NULL;
+    options->quiet = 0;
+    options->atomicOutput = 0;
+    options->workspace = NULL;
+    options->stats = NULL;
+}
+
+/**
+ * Computes the size of a single-stream file
+ * @param header File header with sizes and frequency_count set
+ * @param lengths Code lengths of a canonical stream, or NULL for a frequency table
+ * @return Bytes of the header, code table and bit stream
+ */
+static uint64_t singleStreamFileSize(const FileHeader* header, const uint8_t* lengths) {
+    int versioned = header->magic == MAGIC_VERSIONED;
+    uint64_t size = sizeof(uint32_t) + (versioned ? 20 : 8) + sizeof(uint32_t) + 1;
+    if (lengths) {
+        unsigned char packed[2 + ASCII_SIZE / 2];
+        size += packCodeLengths(lengths, packed);
+    } else {
+        size += (uint64_t)header->frequency_count * (1 + (versioned ? 8 : 4));
+    }
+    return size + header->compressed_size;
+}
+
+/**
+ * Compresses a file using Huffman coding with default options
+ * @param inputFile Path to input file
+ * @param outputFile Path to output file
+ * @return 0 on success, -1 on error
+ */
+int compressFile(const char* inputFile, const char* outputFile) {
+    CompressOptions options;
+    initCompressOptions(&options);
+    return compressFileWithOptions(inputFile, outputFile, &options);
+}
+
+/**
+ * Compresses a file in the selected format
+ * @param inputFile Path to input file
+ * @param outputFile Path to output file
+ * @param options Compression options
+ * @return 0 on success, -1 on error
+ */
+static int compressFileFormat(const char* inputFile, const char* outputFile,
+                              const CompressOptions* options) {
+    if (!options->quiet) {
+        printf("\n=== COMPRESSION STARTED ===\n");
+        printf("Input file: %s\n", inputFile);
+        printf("Output file: %s\n", outputFile);
+    }
+
+    // Single streams read the input twice: once to count, once to encode
+    if ((options->format == FORMAT_CANONICAL || options->format == FORMAT_LEGACY) &&
+        isStdioPath(inputFile)) {
+        reportError("Single-stream formats need a seekable input; "
+                    "omit --canonical/--legacy to stream");
+        return -1;
+    }
+
+    if (options->syncInterval != 0 &&
+        (options->format != FORMAT_CANONICAL || options->syncInterval < MIN_SYNC_INTERVAL ||
+         options->syncInterval > MAX_SYNC_INTERVAL)) {
+        reportError("Sync points need a canonical stream and an interval of "
+                    "%u to %u bytes", MIN_SYNC_INTERVAL, MAX_SYNC_INTERVAL);
+        return -1;
+    }
+
+    InputSource source;
+    if (openInputSource(&source, inputFile, options->ioBackend) != 0) {
+        return -1;
+    }
+
+    // Trained table: the whole input becomes one message coded with it
+    if (options->format == FORMAT_TABLE) {
+        FILE* outFile = openOutputStream(outputFile);
+        if (!outFile) {
+            closeInputSource(&source);
+            return -1;
+        }
+
+        int result = compressWithCodeTable(&source, outFile, options);
+        closeInputSource(&source);
+        if (closeStream(outFile) != 0) {
+            result = -1;
+        }
+
+        if (result != 0) {
+            return -1;
+        }
+
+        if (!options->quiet) {
+            printf("=== COMPRESSION COMPLETED ===\n");
+        }
+        return 0;
+    }
+
+    // Block container: each block is counted and coded on its own
+    if (options->format == FORMAT_BLOCKS) {
+        FILE* outFile = openOutputStream(outputFile);
+        if (!outFile) {
+            closeInputSource(&source);
+            return -1;
+        }
+
+        // Pipes cannot report their size; the container then marks it as
+        // streamed and the blocks alone determine the length
+        if (options->quiet) {
+            // Progress messages suppressed
+        } else if (source.size == STREAM_SIZE_UNKNOWN) {
+            printf("File size: unknown (streaming input)\n");
+        } else {
+            printf("File size: %llu bytes\n", (unsigned long long)source.size);
+        }
+
+        int result = compressContainer(&source, outFile, options);
+        closeInputSource(&source);
+        if (closeStream(outFile) != 0) {
+            result = -1;
+        }
+
+        if (result != 0) {
+            return -1;
+        }
+
+        if (!options->quiet) {
+            printf("=== COMPRESSION COMPLETED ===\n");
+        }
+        return 0;
+    }
+
+    // Calculate frequencies
+    BlockStats* stats = options->stats ? &options->stats->work : NULL;
+    double mark = stats ? wallClockSeconds() : 0;
+    uint64_t frequencies[ASCII_SIZE];
+    int64_t originalSize = countSourceFrequencies(&source, frequencies, options->threads);
+    CHARGE_PHASE(stats, histogramSeconds, mark);
+    if (originalSize <= 0) {
+        if (originalSize == 0) {
+            reportError("Input file is empty");
+        }
+        closeInputSource(&source);
+        return -1;
+    }
+    if (!options->quiet) {
+        printf("File size: %lld bytes\n", (long long)originalSize);
+    }
+
+    HuffmanTree tree;
+    initTree(&tree);
+    CodeEntry codes[ASCII_SIZE];
+    uint8_t lengths[ASCII_SIZE];
+
+    if (options->format == FORMAT_CANONICAL) {
+        // Length-limited code lengths straight from the frequencies
+        if (computeLimitedCodeLengths(frequencies, options->maxCodeLength, lengths) != 0 ||
+            assignCanonicalCodes(lengths, codes) != 0) {
+            reportError("Failed to build canonical codes");
+            closeInputSource(&source);
+            return -1;
+        }
+        if (!options->quiet) {
+            printf("Canonical codes generated (max %d bits)\n", options->maxCodeLength);
+        }
+    } else {
+        // Build Huffman tree
+        HuffmanNode* root = buildHuffmanTree(&tree, frequencies);
+        if (!root) {
+            reportError("Failed to build Huffman tree");
+            closeInputSource(&source);
+            return -1;
+        }
+
+        // Generate codes
+        buildCodeTable(root, codes);
+        if (!options->quiet) {
+            printf("Huffman tree constructed successfully\n");
+            printf("Huffman codes generated successfully\n");
+        }
+    }
+
+    CHARGE_PHASE(stats, treeSeconds, mark);
+
+    // Open output
+    FILE* outFile = openOutputStream(outputFile);
+    if (!outFile) {
+        closeInputSource(&source);
+        destroyTree(&tree);
+        return -1;
+    }
+
+    // Count unique characters and the exact bit stream size, so the
+    // header is written once and never patched
+    uint32_t frequencyCount = 0;
+    uint64_t totalBits = 0;
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        if (frequencies[i] > 0) {
+            frequencyCount++;
+            totalBits += frequencies[i] * (uint64_t)codes[i].length;
+        }
+    }
+
+    // Canonical streams and inputs past 4 GiB need the versioned header;
+    // smaller legacy streams keep the original HUFF layout
+    uint32_t magic = MAGIC_NUMBER;
+    uint8_t flags = 0;
+    if (options->format == FORMAT_CANONICAL) {
+        magic = MAGIC_VERSIONED;
+        flags = FILE_FLAG_CANONICAL;
+    } else if ((uint64_t)originalSize > UINT32_MAX || (totalBits + 7) / 8 > UINT32_MAX) {
+        magic = MAGIC_VERSIONED;
+    }
+
+    // One sync point starts every interval after the first
+    uint64_t syncCount = options->syncInterval
+        ? ((uint64_t)originalSize - 1) / options->syncInterval : 0;
+    uint64_t* syncPoints = NULL;
+    if (syncCount > UINT32_MAX) {
+        reportError("Too many sync points; use a larger sync interval");
+    } else if (syncCount > 0 &&
+               !(syncPoints = (uint64_t*)malloc((size_t)syncCount * sizeof(uint64_t)))) {
+        reportError("Memory allocation failed for sync points");
+    }
+    if (syncCount > 0 && !syncPoints) {
+        closeInputSource(&source);
+        closeStream(outFile);
+        destroyTree(&tree);
+        return -1;
+    }
+    if (syncPoints) {
+        flags |= FILE_FLAG_SYNC_POINTS;
+    }
+
+    FileHeader header = {
+        .magic = magic,
+        .version = magic == MAGIC_VERSIONED ? FILE_HEADER_VERSION : 1,
+        .flags = flags,
+        .original_size = (uint64_t)originalSize,
+        .compressed_size = (totalBits + 7) / 8,
+        .frequency_count = frequencyCount,
+        .padding_bits = (uint8_t)((8 - totalBits % 8) % 8)
+    };
+
+    writeFileHeader(outFile, &header);
+    if (options->format == FORMAT_CANONICAL) {
+        writeCodeLengths(outFile, lengths);
+    } else {
+        writeFrequencies(outFile, frequencies, magic == MAGIC_VERSIONED);
+    }
+
+    // Encode and write data; the sync points follow the bit stream
+#ifdef HUFFMAN_REFERENCE_ENCODER
+    if (!syncPoints) {
+        encodeAndWrite(source.file, outFile, codes);
+    } else
+#endif
+    if (encodeWithPackedCodes(&source, outFile, codes, options->syncInterval, syncPoints,
+                              (uint32_t)syncCount) != 0) {
+        closeInputSource(&source);
+        closeStream(outFile);
+        destroyTree(&tree);
+        free(syncPoints);
+        return -1;
+    }
+    if (syncPoints) {
+        writeSyncTable(outFile, options->syncInterval, syncPoints, (uint32_t)syncCount);
+        if (!options->quiet) {
+            printf("Sync points: %llu (every %u bytes)\n", (unsigned long long)syncCount,
+                   options->syncInterval);
+        }
+    }
+    CHARGE_PHASE(stats, encodeSeconds, mark);
+
+    closeInputSource(&source);
+    int result = closeStream(outFile);
+    destroyTree(&tree);
+    free(syncPoints);
+
+    if (result != 0) {
+        reportError("Failed to write compressed data");
+        return -1;
+    }
+
+    if (stats) {
+        stats->blocks++;
+        options->stats->threadBlocks[0]++;
+        options->stats->bytesIn += header.original_size;
+        options->stats->bytesOut +=
+            singleStreamFileSize(&header, options->format == FORMAT_CANONICAL ? lengths : NULL);
+        if (syncCount > 0) {
+            options->stats->bytesOut += SYNC_TABLE_HEADER_SIZE + syncCount * sizeof(uint64_t);
+        }
+    }
+
+    if (!options->quiet) {
+        printf("=== COMPRESSION COMPLETED ===\n");
+    }
+    return 0;
+}
+
+/**
+ * Compresses a file using Huffman coding
+ * With options->stats set, the counters and phase times are reset first
+ * and the wall-clock time is recorded once the output is closed. With
+ * options->atomicOutput set, an existing output is only replaced on success.
+ * @param inputFile Path to input file
+ * @param outputFile Path to output file
+ * @param options Compression options
+ * @return 0 on success, -1 on error
+ */
+int compressFileWithOptions(const char* inputFile, const char* outputFile,
+                            const CompressOptions* options) {
+    beginCodecStats(options->stats);
+    char* temporary = options->atomicOutput ? createTemporaryOutput(outputFile) : NULL;
+    int result = compressFileFormat(inputFile, temporary ? temporary : outputFile, options);
+    result = finishTemporaryOutput(temporary, outputFile, result);
+    endCodecStats(options->stats);
+    return result;
+}
+
+// =============================================================================
+// TABLE-DRIVEN DECODING
+// =============================================================================
+
+/**
+ * Computes the height of a Huffman (sub)tree
+ * @param node Root of the subtree
+ * @return Number of edges on the longest path to a leaf
+ */
+static int treeHeight(const HuffmanNode* node) {
+    if (!node || (!node->left && !node->right)) {
+        return 0;
+    }
+
+    int left = treeHeight(node->left);
+    int right = treeHeight(node->right);
+    return 1 + (left > right ? left : right);
+}
+
+/**
+ * Computes the width of the subtable needed below an internal node
+ * @param node Internal node at a table boundary
+ * @return Number of index bits for the subtable
+ */
+static int subtableBits(const HuffmanNode* node) {
+    int height = treeHeight(node);
+    return height < DECODE_SUBTABLE_BITS ? height : DECODE_SUBTABLE_BITS;
+}
+
+/**
+ * Counts the subtable entries required below a node
+ * @param node Current node
+ * @param depth Depth of the node relative to the current table level
+ * @param width Index width of the current table level
+ * @return Number of entries in all subtables reachable from this node
+ */
+static int countSubtableEntries(const HuffmanNode* node, int depth, int width) {
+    if (!node || (!node->left && !node->right)) {
+        return 0;
+    }
+
+    if (depth == width) {
+        int bits = subtableBits(node);
+        return (1 << bits) + countSubtableEntries(node, 0, bits);
+    }
+
+    return countSubtableEntries(node->left, depth + 1, width) +
+           countSubtableEntries(node->right, depth + 1, width);
+}
+
+/**
+ * Recursively fills decode entries for all codes below a node
+ * @param table Table being filled
+ * @param node Current node
+ * @param base Offset of the current table level
+ * @param width Index width of the current table level
+ * @param prefix Bits consumed from the start of this level
+ * @param depth Number of bits in prefix
+ * @param nextFree Offset of the next unallocated subtable entry
+ */
+static void fillDecodeEntries(DecodeTable* table, const HuffmanNode* node, int base,
+                              int width, int prefix, int depth, int* nextFree) {
+    if (!node) return; // Unused code space stays marked invalid
+
+    // Leaf node - replicate the symbol over every index sharing this prefix
+    if (!node->left && !node->right) {
+        int span = 1 << (width - depth);
+        DecodeEntry* entry = &table->entries[base + (prefix << (width - depth))];
+        for (int i = 0; i < span; i++) {
+            entry[i].symbols[0] = node->character;
+            entry[i].length = (uint8_t)depth;
+            entry[i].firstLength = (uint8_t)depth;
+            entry[i].count = 1;
+        }
+        return;
+    }
+
+    // Code continues past this level - link to a subtable
+    if (depth == width) {
+        int bits = subtableBits(node);
+        DecodeEntry* link = &table->entries[base + prefix];
+        link->next = (uint16_t)*nextFree;
+        link->length = (uint8_t)width;
+        link->subBits = (uint8_t)bits;
+        link->count = 0;
+
+        int subBase = *nextFree;
+        *nextFree += 1 << bits;
+        fillDecodeEntries(table, node, subBase, bits, 0, 0, nextFree);
+        return;
+    }
+
+    fillDecodeEntries(table, node->left, base, width, prefix << 1, depth + 1, nextFree);
+    fillDecodeEntries(table, node->right, base, width, (prefix << 1) | 1, depth + 1, nextFree);
+}
+
+/**
+ * Pairs up short codes in the primary table
+ * The bits left over after the first code index the second symbol.
+ * @param table Table with single-symbol primary entries
+ */
+static void pairDecodeEntries(DecodeTable* table) {
+    const int primarySize = 1 << table->primaryBits;
+
+    for (int i = 0; i < primarySize; i++) {
+        DecodeEntry* entry = &table->entries[i];
+        if (entry->count != 1 || entry->firstLength >= table->primaryBits) {
+            continue;
+        }
+
+        const DecodeEntry* second =
+            &table->entries[(i << entry->firstLength) & (primarySize - 1)];
+        if (second->count > 0 &&
+            second->firstLength <= table->primaryBits - entry->firstLength) {
+            entry->symbols[1] = second->symbols[0];
+            entry->length = (uint8_t)(entry->firstLength + second->firstLength);
+            entry->count = 2;
+        }
+    }
+}
+
+/**
+ * Builds a multi-level decode table from a Huffman tree
+ * Primary entries whose code leaves room for a second complete code
+ * resolve both symbols in one lookup.
+ * @param root Root of the Huffman tree
+ * @return Pointer to the created table or NULL on failure
+ */
+DecodeTable* createDecodeTable(HuffmanNode* root) {
+    if (!root || (!root->left && !root->right)) {
+        reportError("Cannot build decode table from empty tree");
+        return NULL;
+    }
+
+    DecodeTable* table = (DecodeTable*)malloc(sizeof(DecodeTable));
+    if (!table) {
+        reportError("Memory allocation failed for decode table");
+        return NULL;
+    }
+
+    int primarySize = 1 << DECODE_TABLE_BITS;
+    table->primaryBits = DECODE_TABLE_BITS;
+    table->size = primarySize + countSubtableEntries(root, 0, DECODE_TABLE_BITS);
+    table->entries = (DecodeEntry*)calloc((size_t)table->size, sizeof(DecodeEntry));
+    if (!table->entries) {
+        reportError("Memory allocation failed for decode entries");
+        free(table);
+        return NULL;
+    }
+
+    int nextFree = primarySize;
+    fillDecodeEntries(table, root, 0, DECODE_TABLE_BITS, 0, 0, &nextFree);
+    pairDecodeEntries(table);
+
+    return table;
+}
+
+/**
+ * Builds a decode table directly from canonical code lengths
+ * No tree is needed: each code fills a contiguous range of the primary
+ * table, and codes longer than the primary width share one subtable per
+ * primary prefix.
+ * @param lengths Code length per character (at most MAX_CANONICAL_CODE_LENGTH)
+ * @return Pointer to the created table or NULL on failure
+ */
+DecodeTable* createCanonicalDecodeTable(const uint8_t lengths[ASCII_SIZE]) {
+    CodeEntry codes[ASCII_SIZE];
+    if (assignCanonicalCodes(lengths, codes) != 0) {
+        return NULL;
+    }
+
+    const int primaryBits = DECODE_TABLE_BITS;
+    const int primarySize = 1 << primaryBits;
+
+    // Longest code below each primary prefix decides its subtable width
+    uint8_t longest[1 << DECODE_TABLE_BITS] = {0};
+    int used = 0;
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        int len = codes[i].length;
+        if (len == 0) continue;
+        used++;
+        if (len > primaryBits) {
+            int prefix = (int)(codes[i].bits >> (len - primaryBits));
+            if (len > longest[prefix]) longest[prefix] = (uint8_t)len;
+        }
+    }
+
+    if (used == 0) {
+        reportError("Cannot build decode table without codes");
+        return NULL;
+    }
+
+    int size = primarySize;
+    for (int prefix = 0; prefix < primarySize; prefix++) {
+        if (longest[prefix] > 0) {
+            size += 1 << (longest[prefix] - primaryBits);
+        }
+    }
+
+    DecodeTable* table = (DecodeTable*)malloc(sizeof(DecodeTable));
+    if (!table) {
+        reportError("Memory allocation failed for decode table");
+        return NULL;
+    }
+
+    table->primaryBits = primaryBits;
+    table->size = size;
+    table->entries = (DecodeEntry*)calloc((size_t)size, sizeof(DecodeEntry));
+    if (!table->entries) {
+        reportError("Memory allocation failed for decode entries");
+        free(table);
+        return NULL;
+    }
+
+    // Allocate subtables and link them from the primary table
+    int nextFree = primarySize;
+    for (int prefix = 0; prefix < primarySize; prefix++) {
+        if (longest[prefix] > 0) {
+            DecodeEntry* link = &table->entries[prefix];
+            link->next = (uint16_t)nextFree;
+            link->length = (uint8_t)primaryBits;
+            link->subBits = (uint8_t)(longest[prefix] - primaryBits);
+            nextFree += 1 << link->subBits;
+        }
+    }
+
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        int len = codes[i].length;
+        if (len == 0) continue;
+
+        DecodeEntry* entry;
+        int span;
+        int symbolBits;
+        if (len <= primaryBits) {
+            entry = &table->entries[codes[i].bits << (primaryBits - len)];
+            span = 1 << (primaryBits - len);
+            symbolBits = len;
+        } else {
+            const DecodeEntry* link = &table->entries[codes[i].bits >> (len - primaryBits)];
+            int subLen = len - primaryBits;
+            uint64_t suffix = codes[i].bits & ((1u << subLen) - 1);
+            entry = &table->entries[link->next + (suffix << (link->subBits - subLen))];
+            span = 1 << (link->subBits - subLen);
+            symbolBits = subLen;
+        }
+
+        for (int j = 0; j < span; j++) {
+            entry[j].symbols[0] = (unsigned char)i;
+            entry[j].length = (uint8_t)symbolBits;
+            entry[j].firstLength = (uint8_t)symbolBits;
+            entry[j].count = 1;
+        }
+    }
+
+    pairDecodeEntries(table);
+    return table;
+}
+
+/**
+ * Destroys a decode table and frees associated memory
+ * @param table Pointer to the table to destroy
+ */
+void destroyDecodeTable(DecodeTable* table) {
+    if (table) {
+        free(table->entries);
+        free(table);
+    }
+}
+
+/**
+ * Checks that decoding did not run past the end of the input
+ * Consuming any of the zero bytes shifted in past the end means the data was cut short.
+ * @param reader Bit reader after decoding
+ * @return 0 if all consumed bits were real input, -1 otherwise
+ */
+int checkBitReaderOverrun(const BitReader* reader) {
+    if (reader->overrunBytes > reader->bitCount / 8) {
+        reportError("Compressed data is truncated");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Adds the lookups made by a block's bit readers to its statistics
+ * @param stats Block statistics, or NULL
+ * @param readers Bit readers after decoding
+ * @param streams Number of readers
+ * @param symbols Symbols they decoded
+ */
+static void countDecodeLookups(BlockStats* stats, const BitReader* readers, int streams,
+                               size_t symbols) {
+    if (!stats) return;
+
+    stats->symbols += symbols;
+    for (int k = 0; k < streams; k++) {
+        stats->lookups += readers[k].lookups;
+        stats->longCodes += readers[k].longCodes;
+    }
+}
+
+/**
+ * Decodes a block written by encodeStreams
+ * @param table Decode table for the block
+ * @param input Encoded bytes (the jump table, when interleaved, then the streams)
+ * @param size Number of encoded bytes
+ * @param streams 1 or INTERLEAVED_STREAMS
+ * @param output Buffer receiving the symbols
+ * @param count Number of symbols to decode
+ * @param stats Receives the symbol and lookup counts, or NULL
+ * @return 0 on success, -1 on corrupted or truncated data
+ */
+int decodeStreams(const DecodeTable* table, const unsigned char* input, size_t size,
+                  int streams, unsigned char* output, size_t count, BlockStats* stats) {
+    BitReader readers[INTERLEAVED_STREAMS];
+
+    if (streams == 1) {
+        initBitReaderMemory(&readers[0], input, size);
+        if (decodeSymbols(&readers[0], table, output, count) != 0) {
+            return -1;
+        }
+        countDecodeLookups(stats, readers, 1, count);
+        return checkBitReaderOverrun(&readers[0]);
+    }
+
+    if (size < STREAM_JUMP_TABLE_SIZE) {
+        reportError("Compressed data is truncated");
+        return -1;
+    }
+
+    size_t position = STREAM_JUMP_TABLE_SIZE;
+    for (int k = 0; k < INTERLEAVED_STREAMS; k++) {
+        size_t streamSize = size - position;
+        if (k < INTERLEAVED_STREAMS - 1) {
+            uint32_t recorded;
+            memcpy(&recorded, input + (size_t)k * sizeof(uint32_t), sizeof(uint32_t));
+            if (recorded > streamSize) {
+                reportError("Sub-stream sizes exceed the block");
+                return -1;
+            }
+            streamSize = recorded;
+        }
+        initBitReaderMemory(&readers[k], input + position, streamSize);
+        position += streamSize;
+    }
+
+    if (decodeInterleaved(readers, table, output, count) != 0) {
+        return -1;
+    }
+    countDecodeLookups(stats, readers, INTERLEAVED_STREAMS, count);
+    for (int k = 0; k < INTERLEAVED_STREAMS; k++) {
+        if (checkBitReaderOverrun(&readers[k]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Decodes compressed data using the lookup table and writes to the output
+ * Mapped inputs are decoded in place; mapped outputs receive the symbols directly.
+ * @param input Input source positioned at the bit stream
+ * @param output Output sink
+ * @param table Decode table built from the Huffman tree
+ * @param originalSize Original file size in bytes
+ * @param stats Receives the decode time and lookup counts, or NULL
+ * @return 0 on success, -1 on corrupted or truncated input
+ */
+int decodeWithTable(InputSource* input, OutputSink* output, const DecodeTable* table,
+                    uint64_t originalSize, BlockStats* stats) {
+    unsigned char* storage = input->map ? NULL : (unsigned char*)malloc(IO_BUFFER_SIZE);
+    unsigned char* buffer = (unsigned char*)malloc(IO_BUFFER_SIZE);
+    if ((!input->map && !storage) || !buffer) {
+        reportError("Memory allocation failed for decode buffers");
+        free(storage);
+        free(buffer);
+        return -1;
+    }
+
+    BitReader reader;
+    if (input->map) {
+        size_t available;
+        const unsigned char* data = readInputSpan(input, NULL, SIZE_MAX, &available);
+        initBitReaderMemory(&reader, data, available);
+    } else {
+        initBitReader(&reader, input->file, storage);
+    }
+
+    uint64_t remaining = originalSize;
+    int result = 0;
+    double mark = stats ? wallClockSeconds() : 0;
+
+    while (remaining > 0) {
+        size_t count = remaining < IO_BUFFER_SIZE ? remaining : IO_BUFFER_SIZE;
+        unsigned char* destination = reserveOutput(output, buffer, count);
+        if (!destination ||
+            decodeSymbols(&reader, table, destination, count) != 0 ||
+            checkBitReaderOverrun(&reader) != 0 ||
+            commitOutput(output, destination, count) != 0) {
+            result = -1;
+            break;
+        }
+        remaining -= count;
+    }
+
+    if (result == 0) {
+        countDecodeLookups(stats, &reader, 1, originalSize);
+    }
+    CHARGE_PHASE(stats, decodeSeconds, mark);
+
+    free(storage);
+    free(buffer);
+    return result;
+}
+
+// One segment of a canonical stream, from one sync point to the next
+typedef struct SyncSegment {
+    int result;        // 0, -1 on a decode error, SYNC_MISMATCH if it ends off its successor
+    BlockStats stats;  // Decode time and lookups (when collected)
+} SyncSegment;
+
+#define SYNC_MISMATCH (-2)
+
+// Segments of a canonical stream decoded in parallel, one task per segment
+typedef struct SyncDecodeBatch {
+    const DecodeTable* table;
+    const unsigned char* stream;
+    uint64_t streamSize;
+    const uint64_t* bounds;    // Bit offset of every segment, then of the end of the stream
+    uint32_t interval;
+    uint64_t originalSize;
+    size_t first;              // Segment decoded by task 0
+    unsigned char* output;     // Receives the bytes of the batch's segments
+    SyncSegment* segments;     // One per task
+    int collectStats;
+} SyncDecodeBatch;
+
+/**
+ * Thread pool task: decodes segment first + index of a sync decode batch
+ * A segment must end exactly at the next sync point, which catches
+ * corrupted bit streams and sync tables alike.
+ */
+static void syncDecodeTask(void* context, size_t index) {
+    SyncDecodeBatch* batch = (SyncDecodeBatch*)context;
+    SyncSegment* segment = &batch->segments[index];
+    size_t number = batch->first + index;
+    uint64_t start = (uint64_t)number * batch->interval;
+    size_t count = batch->originalSize - start < batch->interval
+        ? (size_t)(batch->originalSize - start) : batch->interval;
+    double mark = batch->collectStats ? wallClockSeconds() : 0;
+
+    // Start at the sync point's byte and drop the bits before it
+    uint64_t bit = batch->bounds[number];
+    size_t byte = (size_t)(bit >> 3);
+    BitReader reader;
+    initBitReaderMemory(&reader, batch->stream + byte, (size_t)batch->streamSize - byte);
+    refillBits(&reader);
+    reader.bits <<= bit & 7;
+    reader.bitCount -= (int)(bit & 7);
+
+    segment->result = decodeSymbols(&reader, batch->table,
+                                    batch->output + index * (size_t)batch->interval, count);
+    if (segment->result == 0) {
+        // An exhausted memory reader restarts its position at 0 and counts zero bytes
+        uint64_t loaded = reader.overrunBytes > 0
+            ? batch->streamSize + (uint64_t)reader.overrunBytes : byte + (uint64_t)reader.position;
+        uint64_t end = loaded * 8 - (uint64_t)reader.bitCount;
+        if (end != batch->bounds[number + 1]) {
+            segment->result = SYNC_MISMATCH;
+        }
+    }
+
+    if (batch->collectStats) {
+        memset(&segment->stats, 0, sizeof(segment->stats));
+        segment->stats.blocks = 1;
+        countDecodeLookups(&segment->stats, &reader, 1, count);
+        CHARGE_PHASE(&segment->stats, decodeSeconds, mark);
+    }
+}
+
+/**
+ * Decodes a canonical stream with sync points on several threads
+ * The sync table after the bit stream splits it into segments that are
+ * decoded in parallel, a window of them at a time, and written in order;
+ * mapped outputs receive the symbols directly.
+ * @param input Mapped input source positioned at the bit stream
+ * @param output Output sink
+ * @param table Decode table of the stream
+ * @param header File header (sizes and padding bits)
+ * @param pool Thread pool
+ * @param stats Receives decode times and lookup counts, one block per segment, or NULL
+ * @return 0 on success, -1 on corrupted or truncated input
+ */
+int decodeWithSyncPoints(InputSource* input, OutputSink* output, const DecodeTable* table,
+                         const FileHeader* header, ThreadPool* pool, BlockStats* stats) {
+    size_t available;
+    const unsigned char* data = readInputSpan(input, NULL, SIZE_MAX, &available);
+    uint64_t streamSize = header->compressed_size;
+    if (streamSize > available || available - streamSize < SYNC_TABLE_HEADER_SIZE) {
+        reportError("Sync point table is truncated");
+        return -1;
+    }
+
+    uint32_t interval, count;
+    memcpy(&interval, data + streamSize, sizeof(uint32_t));
+    memcpy(&count, data + streamSize + sizeof(uint32_t), sizeof(uint32_t));
+    uint64_t tableBytes = available - streamSize - SYNC_TABLE_HEADER_SIZE;
+    if (interval < MIN_SYNC_INTERVAL || interval > MAX_SYNC_INTERVAL ||
+        header->original_size == 0 || count != (header->original_size - 1) / interval ||
+        tableBytes < (uint64_t)count * sizeof(uint64_t) || streamSize * 8 < header->padding_bits) {
+        reportError("Invalid sync point table");
+        return -1;
+    }
+
+    // Segment k starts at bounds[k]; the last bound is the end of the codes
+    size_t segments = (size_t)count + 1;
+    uint64_t* bounds = (uint64_t*)malloc((segments + 1) * sizeof(uint64_t));
+    size_t window = (size_t)(pool->threadCount + 1) * BLOCKS_PER_THREAD;
+    if (window > segments) window = segments;
+    SyncSegment* results = (SyncSegment*)malloc(window * sizeof(SyncSegment));
+    unsigned char* buffer = output->map ? NULL : (unsigned char*)malloc(window * interval);
+    if (!bounds || !results || (!output->map && !buffer)) {
+        reportError("Memory allocation failed for sync decoding");
+        free(bounds);
+        free(results);
+        free(buffer);
+        return -1;
+    }
+
+    bounds[0] = 0;
+    memcpy(bounds + 1, data + streamSize + SYNC_TABLE_HEADER_SIZE, count * sizeof(uint64_t));
+    bounds[segments] = streamSize * 8 - header->padding_bits;
+    int result = 0;
+    for (size_t k = 0; k < segments; k++) {
+        if (bounds[k] > bounds[k + 1]) {
+            reportError("Invalid sync point table");
+            result = -1;
+            break;
+        }
+    }
+
+    SyncDecodeBatch batch = {
+        .table = table,
+        .stream = data,
+        .streamSize = streamSize,
+        .bounds = bounds,
+        .interval = interval,
+        .originalSize = header->original_size,
+        .segments = results,
+        .collectStats = stats != NULL
+    };
+
+    for (size_t first = 0; result == 0 && first < segments; first += window) {
+        size_t tasks = segments - first < window ? segments - first : window;
+        uint64_t offset = (uint64_t)first * interval;
+        size_t bytes = header->original_size - offset < (uint64_t)tasks * interval
+            ? (size_t)(header->original_size - offset) : tasks * (size_t)interval;
+
+        batch.first = first;
+        batch.output = reserveOutput(output, buffer, bytes);
+        if (!batch.output) {
+            result = -1;
+            break;
+        }
+        runParallel(pool, syncDecodeTask, &batch, tasks);
+
+        for (size_t i = 0; i < tasks && result == 0; i++) {
+            if (results[i].result == SYNC_MISMATCH) {
+                reportError("Segment %zu does not end at its sync point", first + i);
+            }
+            result = results[i].result == 0 ? 0 : -1;
+            if (stats) {
+                addBlockStats(stats, &results[i].stats);
+            }
+        }
+        if (result == 0) {
+            result = commitOutput(output, batch.output, bytes);
+        }
+    }
+
+    free(bounds);
+    free(results);
+    free(buffer);
+    return result;
+}
+
+// =============================================================================
+// DECOMPRESSION FUNCTIONS
+// =============================================================================
+
+/**
+ * Reads file header from compressed file
+ * @param file Input file pointer
+ * @param header Header structure to populate
+ * @return 0 on success, -1 on error
+ */
+int readFileHeader(FILE* file, FileHeader* header) {
+    if (fread(&header->magic, sizeof(uint32_t), 1, file) != 1) {
+        return -1;
+    }
+
+    return readFileHeaderFields(file, header);
+}
+
+/**
+ * Reads the file header fields that follow the magic number
+ * @param file Input file pointer positioned after the magic number
+ * @param header Header structure with magic already set
+ * @return 0 on success, -1 on error
+ */
+int readFileHeaderFields(FILE* file, FileHeader* header) {
+    if (header->magic == MAGIC_VERSIONED) {
+        uint16_t reserved;
+        if (fread(&header->version, sizeof(uint8_t), 1, file) != 1 ||
+            fread(&header->flags, sizeof(uint8_t), 1, file) != 1 ||
+            fread(&reserved, sizeof(uint16_t), 1, file) != 1 ||
+            fread(&header->original_size, sizeof(uint64_t), 1, file) != 1 ||
+            fread(&header->compressed_size, sizeof(uint64_t), 1, file) != 1) {
+            return -1;
+        }
+
+        if (header->version != FILE_HEADER_VERSION) {
+            reportError("Unsupported file header version %u", header->version);
+            return -1;
+        }
+
+        if ((header->flags & ~(FILE_FLAG_CANONICAL | FILE_FLAG_SYNC_POINTS)) ||
+            (header->flags & FILE_FLAG_SYNC_POINTS && !(header->flags & FILE_FLAG_CANONICAL))) {
+            reportError("Unsupported file header flags 0x%02x", header->flags);
+            return -1;
+        }
+    } else if (header->magic == MAGIC_NUMBER || header->magic == MAGIC_CANONICAL) {
+        uint32_t originalSize, compressedSize;
+        if (fread(&originalSize, sizeof(uint32_t), 1, file) != 1 ||
+            fread(&compressedSize, sizeof(uint32_t), 1, file) != 1) {
+            return -1;
+        }
+
+        header->version = 1;
+        header->flags = header->magic == MAGIC_CANONICAL ? FILE_FLAG_CANONICAL : 0;
+        header->original_size = originalSize;
+        header->compressed_size = compressedSize;
+    } else {
+        reportError("Invalid file format (magic number mismatch)");
+        return -1;
+    }
+
+    if (fread(&header->frequency_count, sizeof(uint32_t), 1, file) != 1 ||
+        fread(&header->padding_bits, sizeof(uint8_t), 1, file) != 1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Reads character frequencies from compressed file
+ * @param file Input file pointer
+ * @param frequencies Array to populate with frequencies
+ * @param count Number of unique characters to read
+ * @param wide Non-zero if counts are stored in 64 bits (HUFV), otherwise 32-bit
+ * @return 0 on success, -1 on error
+ */
+int readFrequencies(FILE* file, uint64_t frequencies[ASCII_SIZE], int count, int wide) {
+    memset(frequencies, 0, ASCII_SIZE * sizeof(uint64_t));
+
+    for (int i = 0; i < count; i++) {
+        int ch = fgetc(file);
+        if (ch == EOF) {
+            reportError("Unexpected end of file while reading frequencies");
+            return -1;
+        }
+
+        unsigned char character = (unsigned char)ch;
+        uint32_t narrow = 0;
+        size_t read = wide ? fread(&frequencies[character], sizeof(uint64_t), 1, file)
+                           : fread(&narrow, sizeof(uint32_t), 1, file);
+        if (read != 1) {
+            reportError("Failed to read frequency data");
+            return -1;
+        }
+        if (!wide) {
+            frequencies[character] = narrow;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Decodes compressed data and writes to output file
+ * @param inputFile Input file pointer
+ * @param outputFile Output file pointer
+ * @param root Root of Huffman tree
+ * @param originalSize Original file size in bytes
+ * @param paddingBits Number of padding bits in last byte
+ * @return 0 on success, -1 on an invalid bit sequence or truncated data
+ */
+int decodeAndWrite(FILE* inputFile, FILE* outputFile, HuffmanNode* root,
+                   uint64_t originalSize, int paddingBits) {
+    if (!root) return -1;
+
+    HuffmanNode* currentNode = root;
+    unsigned char currentByte = 0;
+    int bitPosition = 0;
+    uint64_t decodedBytes = 0;
+
+    while (decodedBytes < originalSize) {
+        int bit = readBit(inputFile, &currentByte, &bitPosition);
+        if (bit == -1) {
+            reportError("Compressed data is truncated");
+            return -1;
+        }
+
+        // Navigate tree based on bit
+        if (bit == 0) {
+            currentNode = currentNode->left;
+        } else {
+            currentNode = currentNode->right;
+        }
+
+        if (!currentNode) {
+            reportError("Invalid bit sequence encountered during decoding");
+            return -1;
+        }
+
+        // Check if we reached a leaf node
+        if (!currentNode->left && !currentNode->right) {
+            fputc(currentNode->character, outputFile);
+            decodedBytes++;
+            currentNode = root; // Reset to root for next character
+        }
+    }
+    return 0;
+}
+
+/**
+ * Initializes decompression options with defaults
+ * @param options Options structure to initialize
+ */
+void initDecompressOptions(DecompressOptions* options) {
+    options->ioBackend = IO_BACKEND_MMAP;
+    options->threads = 1;
+    options->pipelined = 0;
+    options->table = NULL;
+    options->quiet = 0;
+    options->atomicOutput = 0;
+    options->workspace = NULL;
+    options->stats = NULL;
+}
+
+/**
+ * Decompresses a Huffman-encoded file with default options
+ * @param inputFile Path to compressed file
+ * @param outputFile Path to output file
+ * @return 0 on success, -1 on error
+ */
+int decompressFile(const char* inputFile, const char* outputFile) {
+    DecompressOptions options;
+    initDecompressOptions(&options);
+    return decompressFileWithOptions(inputFile, outputFile, &options);
+}
+
+/**
+ * Decompresses a Huffman-encoded file in the format its magic number selects
+ * @param inputFile Path to compressed file
+ * @param outputFile Path to output file
+ * @param options Decompression options
+ * @return 0 on success, -1 on error
+ */
+static int decompressFileFormat(const char* inputFile, const char* outputFile,
+                                const DecompressOptions* options) {
+    if (!options->quiet) {
+        printf("\n=== DECOMPRESSION STARTED ===\n");
+        printf("Input file: %s\n", inputFile);
+        printf("Output file: %s\n", outputFile);
+    }
+
+    InputSource source;
+    if (openInputSource(&source, inputFile, options->ioBackend) != 0) {
+        return -1;
+    }
+    FILE* inFile = source.file;
+
+    // Read header; the magic number selects the format
+    FileHeader header;
+    if (fread(&header.magic, sizeof(uint32_t), 1, inFile) != 1) {
+        reportError("Invalid file format (file too short)");
+        closeInputSource(&source);
+        return -1;
+    }
+
+    if (header.magic == MAGIC_BLOCKS || header.magic == MAGIC_TABLE_MESSAGE) {
+        OutputSink sink;
+        if (openOutputSink(&sink, outputFile, options->ioBackend) != 0) {
+            closeInputSource(&source);
+            return -1;
+        }
+
+        int result = header.magic == MAGIC_BLOCKS
+            ? decompressContainer(&source, &sink, options)
+            : decompressWithCodeTable(&source, &sink, options);
+        closeInputSource(&source);
+        if (closeOutputSink(&sink) != 0) {
+            result = -1;
+        }
+
+        if (result != 0) {
+            return -1;
+        }
+
+        if (!options->quiet) {
+            printf("=== DECOMPRESSION COMPLETED ===\n");
+        }
+        return 0;
+    }
+
+    if (readFileHeaderFields(inFile, &header) != 0) {
+        closeInputSource(&source);
+        return -1;
+    }
+
+    if (!options->quiet) {
+        printf("Original size: %llu bytes\n", (unsigned long long)header.original_size);
+        printf("Compressed size: %llu bytes\n", (unsigned long long)header.compressed_size);
+        printf("Unique characters: %u\n", header.frequency_count);
+    }
+
+    // Every symbol takes at least one bit, so a larger original size is
+    // corrupt; rejecting it here keeps it from sizing the output
+    uint64_t payloadBytes = header.compressed_size;
+    if (source.size != STREAM_SIZE_UNKNOWN && source.size < payloadBytes) {
+        payloadBytes = source.size;
+    }
+    if (payloadBytes < UINT64_MAX / 8 && header.original_size > payloadBytes * 8) {
+        reportError("Original size %llu exceeds the %llu bits of compressed data",
+                    (unsigned long long)header.original_size,
+                    (unsigned long long)(payloadBytes * 8));
+        closeInputSource(&source);
+        return -1;
+    }
+
+    // Rebuild the code: canonical streams carry code lengths, older
+    // streams carry the frequency table and need the full tree build. A
+    // workspace's cache skips both when an earlier file had the same header.
+    BlockStats* stats = options->stats ? &options->stats->work : NULL;
+    double mark = stats ? wallClockSeconds() : 0;
+    HuffmanTree tree;
+    initTree(&tree);
+    HuffmanNode* root = NULL;
+#ifndef HUFFMAN_REFERENCE_DECODER
+    DecodeTableCache* cache = options->workspace ? options->workspace->tables : NULL;
+    const DecodeTable* table = NULL;
+#endif
+    DecodeTable* owned = NULL;  // Table built for this file only
+    uint8_t lengths[ASCII_SIZE];
+    int canonical = (header.flags & FILE_FLAG_CANONICAL) != 0;
+    int segmented = 0;  // Decoded in parallel from sync points
+
+    if (canonical) {
+        if (readCodeLengths(inFile, lengths) != 0) {
+            closeInputSource(&source);
+            return -1;
+        }
+#ifdef HUFFMAN_REFERENCE_DECODER
+        CodeEntry codes[ASCII_SIZE];
+        if (assignCanonicalCodes(lengths, codes) == 0) {
+            root = buildTreeFromCodes(&tree, codes);
+        }
+#else
+        table = acquireCanonicalDecodeTable(cache, lengths, &owned, stats);
+#endif
+    } else {
+        uint64_t frequencies[ASCII_SIZE];
+        if (readFrequencies(inFile, frequencies, header.frequency_count,
+                            header.magic == MAGIC_VERSIONED) != 0) {
+            closeInputSource(&source);
+            return -1;
+        }
+
+#ifdef HUFFMAN_REFERENCE_DECODER
+        root = buildHuffmanTree(&tree, frequencies);
+#else
+        table = findCachedDecodeTable(cache, frequencies, sizeof(frequencies));
+        if (table) {
+            if (stats) stats->cachedTables++;
+        } else {
+            root = buildHuffmanTree(&tree, frequencies);
+        }
+#endif
+        if (root && !options->quiet) {
+            printf("Huffman tree constructed successfully\n");
+        }
+        CHARGE_PHASE(stats, treeSeconds, mark);
+#ifndef HUFFMAN_REFERENCE_DECODER
+        if (root) {
+            owned = createDecodeTable(root);
+            table = owned;
+            if (insertCachedDecodeTable(cache, frequencies, sizeof(frequencies), owned)) {
+                owned = NULL;
+            }
+        }
+#endif
+    }
+
+#ifdef HUFFMAN_REFERENCE_DECODER
+    if (!root) {
+#else
+    if (!table) {
+#endif
+        reportError("Failed to rebuild Huffman tree");
+        closeInputSource(&source);
+        destroyTree(&tree);
+        return -1;
+    }
+    CHARGE_PHASE(stats, tableSeconds, mark);
+
+    // Open output file (the reference decoder writes one byte at a time through stdio)
+#ifdef HUFFMAN_REFERENCE_DECODER
+    IoBackend outputBackend = IO_BACKEND_STDIO;
+#else
+    IoBackend outputBackend = options->ioBackend;
+#endif
+    OutputSink sink;
+    if (openOutputSink(&sink, outputFile, outputBackend) != 0) {
+        closeInputSource(&source);
+        destroyTree(&tree);
+        destroyDecodeTable(owned);
+        return -1;
+    }
+
+    // Decode data
+#ifdef HUFFMAN_REFERENCE_DECODER
+    int result = decodeAndWrite(inFile, sink.file, root, header.original_size,
+                                header.padding_bits);
+#else
+    preallocateOutput(&sink, header.original_size);
+
+    // Sync points let every thread decode its own segments of a mapped
+    // stream; otherwise the stream is decoded in one pass, ignoring them
+    ContainerWorkspace* workspace = options->workspace;
+    int threads = workspace ? workspace->threads : resolveThreadCount(options->threads);
+    segmented = (header.flags & FILE_FLAG_SYNC_POINTS) && source.map && threads > 1;
+    int result = -1;
+    if (segmented) {
+        ThreadPool* pool = workspace ? workspace->pool : createThreadPool(threads);
+        if (pool) {
+            resetPoolStats(pool);
+            result = decodeWithSyncPoints(&source, &sink, table, &header, pool, stats);
+            if (options->stats) {
+                collectPoolStats(options->stats, pool);
+            }
+            if (!workspace) {
+                destroyThreadPool(pool);
+            }
+        }
+    } else {
+        result = decodeWithTable(&source, &sink, table, header.original_size, stats);
+    }
+    destroyDecodeTable(owned);
+#endif
+
+    closeInputSource(&source);
+    if (closeOutputSink(&sink) != 0) {
+        result = -1;
+    }
+    destroyTree(&tree);
+
+    if (result != 0) {
+        return -1;
+    }
+
+    if (stats) {
+        if (!segmented) {
+            stats->blocks++;
+            options->stats->threadBlocks[0]++;
+        }
+        // The sync table is only read by the segmented decoder, so a regular
+        // input's size stands in for it
+        options->stats->bytesIn += (header.flags & FILE_FLAG_SYNC_POINTS) &&
+                                   source.size != STREAM_SIZE_UNKNOWN
+            ? source.size : singleStreamFileSize(&header, canonical ? lengths : NULL);
+        options->stats->bytesOut += header.original_size;
+    }
+
+    if (!options->quiet) {
+        printf("=== DECOMPRESSION COMPLETED ===\n");
+    }
+    return 0;
+}
+
+/**
+ * Decompresses a Huffman-encoded file of any supported format
+ * With options->stats set, the counters and phase times are reset first
+ * and the wall-clock time is recorded once the output is closed. With
+ * options->atomicOutput set, an existing output is only replaced on success.
+ * @param inputFile Path to compressed file
+ * @param outputFile Path to output file
+ * @param options Decompression options
+ * @return 0 on success, -1 on error
+ */
+int decompressFileWithOptions(const char* inputFile, const char* outputFile,
+                              const DecompressOptions* options) {
+    beginCodecStats(options->stats);
+    char* temporary = options->atomicOutput ? createTemporaryOutput(outputFile) : NULL;
+    int result = decompressFileFormat(inputFile, temporary ? temporary : outputFile, options);
+    result = finishTemporaryOutput(temporary, outputFile, result);
+    endCodecStats(options->stats);
+    return result;
+}
+
+// =============================================================================
+// THREAD POOL
+// =============================================================================
+
+/**
+ * Resolves a requested thread count
+ * @param requested Number of threads, or 0 for all online processors
+ * @return Number of threads to use (at least 1)
+ */
+int resolveThreadCount(int requested) {
+    if (requested > 0) {
+        return requested;
+    }
+
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    return online > 0 ? (int)online : 1;
+}
+
+/**
+ * Runs tasks of the current batch until none are left
+ * Called and returns with the pool mutex held.
+ * @param pool Thread pool
+ * @param slot tasksRun entry of the calling thread
+ */
+static void runPoolTasks(ThreadPool* pool, int slot) {
+    while (pool->nextTask < pool->taskCount) {
+        size_t index = pool->nextTask++;
+        pool->tasksRun[slot]++;
+        TaskFunction function = pool->function;
+        void* context = pool->context;
+
+        pthread_mutex_unlock(&pool->mutex);
+        function(context, index);
+        pthread_mutex_lock(&pool->mutex);
+
+        if (--pool->pendingTasks == 0) {
+            pthread_cond_broadcast(&pool->workDone);
+        }
+    }
+}
+
+/**
+ * Worker thread: waits for a new batch, helps run it, repeats
+ * @param arg Thread pool
+ * @return NULL
+ */
+static void* threadPoolWorker(void* arg) {
+    ThreadPool* pool = (ThreadPool*)arg;
+    unsigned long seenGeneration = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    int slot = ++pool->slots;
+    while (1) {
+        while (!pool->shutdown && pool->generation == seenGeneration) {
+            pthread_cond_wait(&pool->workReady, &pool->mutex);
+        }
+        if (pool->shutdown) break;
+
+        seenGeneration = pool->generation;
+        runPoolTasks(pool, slot);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+/**
+ * Creates a thread pool
+ * @param threads Total number of threads including the caller of runParallel
+ * @return Pointer to created pool or NULL on failure
+ */
+ThreadPool* createThreadPool(int threads) {
+    ThreadPool* pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+    if (!pool) {
+        reportError("Memory allocation failed for thread pool");
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->workReady, NULL);
+    pthread_cond_init(&pool->workDone, NULL);
+
+    int workers = threads > 1 ? threads - 1 : 0;
+    pool->tasksRun = (uint64_t*)calloc((size_t)workers + 1, sizeof(uint64_t));
+    if (!pool->tasksRun) {
+        reportError("Memory allocation failed for thread pool");
+        destroyThreadPool(pool);
+        return NULL;
+    }
+    if (workers > 0) {
+        pool->threads = (pthread_t*)malloc((size_t)workers * sizeof(pthread_t));
+        if (!pool->threads) {
+            reportError("Memory allocation failed for worker threads");
+            destroyThreadPool(pool);
+            return NULL;
+        }
+    }
+
+    // Running with fewer workers than requested is still correct
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&pool->threads[i], NULL, threadPoolWorker, pool) != 0) {
+            reportWarning("Started only %d of %d worker threads", i, workers);
+            break;
+        }
+        pool->threadCount++;
+    }
+
+    return pool;
+}
+
+/**
+ * Runs function(context, i) for i in [0, count) across the pool and waits
+ * @param pool Thread pool
+ * @param function Task function
+ * @param context Context passed to every task
+ * @param count Number of tasks
+ */
+void runParallel(ThreadPool* pool, TaskFunction function, void* context, size_t count) {
+    if (count == 0) return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->function = function;
+    pool->context = context;
+    pool->taskCount = count;
+    pool->nextTask = 0;
+    pool->pendingTasks = count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->workReady);
+
+    runPoolTasks(pool, 0);
+    while (pool->pendingTasks > 0) {
+        pthread_cond_wait(&pool->workDone, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * Stops all worker threads and frees the pool
+ * @param pool Pointer to the pool to destroy
+ */
+void destroyThreadPool(ThreadPool* pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->workReady);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->threadCount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->workReady);
+    pthread_cond_destroy(&pool->workDone);
+    free(pool->threads);
+    free(pool->tasksRun);
+    free(pool);
+}
+
+// =============================================================================
+// CONTEXT MODELING
+// =============================================================================
+
+/**
+ * Base-2 logarithm in 16.16 fixed point
+ * @param value Value (at least 1)
+ * @return log2(value) * 65536, rounded down
+ */
+static uint64_t fixedLog2(uint64_t value) {
+    int integer = 0;
+    while (value >> (integer + 1)) integer++;
+
+    // Mantissa in [1, 2) with 31 fraction bits; each squaring yields one result bit
+    uint64_t mantissa = integer >= 31 ? value >> (integer - 31) : value << (31 - integer);
+    uint64_t result = (uint64_t)integer << 16;
+    for (int bit = 15; bit >= 0; bit--) {
+        mantissa = (mantissa * mantissa) >> 31;
+        if (mantissa >= (2ull << 31)) {
+            mantissa >>= 1;
+            result |= 1ull << bit;
+        }
+    }
+    return result;
+}
+
+/**
+ * Estimates the coded size of a histogram, in 16.16 fixed-point bits
+ * Levels below MAX_SPLIT_LEVEL use the entropy bound; the top level
+ * builds the limited code lengths and returns their exact cost.
+ * @param frequencies Byte counts
+ * @param level Split level (1 to MAX_SPLIT_LEVEL)
+ * @param maxCodeLength Length limit for the codes
+ * @return Estimated bits * 65536
+ */
+static uint64_t estimateCodedBits(const uint64_t frequencies[ASCII_SIZE], int level,
+                                  int maxCodeLength) {
+    uint64_t total = 0;
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        total += frequencies[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t bits = 0;
+    if (level >= MAX_SPLIT_LEVEL) {
+        uint8_t lengths[ASCII_SIZE];
+        if (computeLimitedCodeLengths(frequencies, maxCodeLength, lengths) == 0) {
+            for (int i = 0; i < ASCII_SIZE; i++) {
+                bits += frequencies[i] * lengths[i];
+            }
+            return bits << 16;
+        }
+    }
+
+    // Sum of f * log2(total / f)
+    uint64_t logTotal = fixedLog2(total);
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        if (frequencies[i] != 0) {
+            bits += frequencies[i] * (logTotal - fixedLog2(frequencies[i]));
+        }
+    }
+    return bits;
+}
+
+/**
+ * Seeds the context clustering with a character class per previous byte
+ * @param byte Previous byte
+ * @return Class index below MAX_CONTEXT_TABLES
+ */
+static int contextClass(int byte) {
+    if (byte >= 0x80) return 14;
+    if (byte == '\n' || byte == '\r') return 1;
+    if (byte == ' ' || byte == '\t') return 2;
+    if (byte < 0x20 || byte == 0x7F) return 0;
+    if (byte >= '0' && byte <= '9') return 3;
+    if (byte >= 'a' && byte <= 'z') return 4;
+    if (byte >= 'A' && byte <= 'Z') return 5;
+
+    switch (byte) {
+        case '"': case '\'': case '`':
+            return 6;
+        case '(': case '[': case '{': case '<':
+            return 7;
+        case ')': case ']': case '}': case '>':
+            return 8;
+        case ',': case ';': case '|':
+            return 9;
+        case ':': case '=':
+            return 10;
+        case '.':
+            return 11;
+        case '-': case '_': case '/': case '\\':
+            return 12;
+        default:
+            return 13;
+    }
+}
+
+// Order-1 statistics of a block: the (symbol, count) pairs seen after each
+// previous byte, stored row by row
+typedef struct ContextCounts {
+    uint32_t rowStart[ASCII_SIZE + 1];
+    uint8_t* symbols;
+    uint32_t* counts;
+    int active[ASCII_SIZE];  // Previous bytes with at least one successor
+    int activeCount;
+} ContextCounts;
+
+/**
+ * Counts each byte under its previous byte, walking the sub-streams as
+ * the encoder does (each one starts with a previous byte of 0)
+ * The successors of each context are gathered first, so only the rows of
+ * contexts that occur are counted and no 256 x 256 table is needed.
+ * @param input Block bytes (at least 1)
+ * @param size Number of bytes
+ * @param streams 1 or INTERLEAVED_STREAMS
+ * @param counts Receives the nonzero pairs; free symbols and counts afterwards
+ * @return 0 on success, -1 on allocation failure
+ */
+static int countContexts(const unsigned char* input, size_t size, int streams,
+                         ContextCounts* counts) {
+    size_t segment = streams == 1 ? size : interleavedSegmentSize(size);
+    uint32_t rowSize[ASCII_SIZE] = {0};
+    for (size_t start = 0; start < size; start += segment) {
+        rowSize[0]++;
+        size_t end = size - start < segment ? size : start + segment;
+        for (size_t i = start; i + 1 < end; i++) {
+            rowSize[input[i]]++;
+        }
+    }
+
+    unsigned char* successors = (unsigned char*)malloc(size);
+    counts->symbols = (uint8_t*)malloc(size);
+    counts->counts = (uint32_t*)malloc(size * sizeof(uint32_t));
+    if (!successors || !counts->symbols || !counts->counts) {
+        reportError("Memory allocation failed for context statistics");
+        free(successors);
+        free(counts->symbols);
+        free(counts->counts);
+        return -1;
+    }
+
+    uint32_t next[ASCII_SIZE];
+    uint32_t position = 0;
+    for (int context = 0; context < ASCII_SIZE; context++) {
+        next[context] = position;
+        position += rowSize[context];
+    }
+    for (size_t start = 0; start < size; start += segment) {
+        size_t end = size - start < segment ? size : start + segment;
+        unsigned previous = 0;
+        for (size_t i = start; i < end; i++) {
+            successors[next[previous]++] = input[i];
+            previous = input[i];
+        }
+    }
+
+    position = 0;
+    uint32_t row = 0;
+    counts->activeCount = 0;
+    for (int context = 0; context < ASCII_SIZE; context++) {
+        counts->rowStart[context] = position;
+        if (rowSize[context] == 0) continue;
+
+        uint32_t histogram[ASCII_SIZE] = {0};
+        for (uint32_t i = row; i < row + rowSize[context]; i++) {
+            histogram[successors[i]]++;
+        }
+        row += rowSize[context];
+        for (int symbol = 0; symbol < ASCII_SIZE; symbol++) {
+            if (histogram[symbol] == 0) continue;
+            counts->symbols[position] = (uint8_t)symbol;
+            counts->counts[position++] = histogram[symbol];
+        }
+        counts->active[counts->activeCount++] = context;
+    }
+    counts->rowStart[ASCII_SIZE] = position;
+
+    free(successors);
+    return 0;
+}
+
+/**
+ * Sums the rows of each group's contexts into one histogram per group
+ * @param counts Order-1 statistics
+ * @param map Group per previous byte
+ * @param tables Number of groups
+ * @param groups Receives the histograms
+ */
+static void sumContextGroups(const ContextCounts* counts, const uint8_t map[ASCII_SIZE],
+                             int tables, uint64_t groups[][ASCII_SIZE]) {
+    memset(groups, 0, (size_t)tables * sizeof(groups[0]));
+    for (int k = 0; k < counts->activeCount; k++) {
+        int context = counts->active[k];
+        uint64_t* group = groups[map[context]];
+        for (uint32_t p = counts->rowStart[context]; p < counts->rowStart[context + 1]; p++) {
+            group[counts->symbols[p]] += counts->counts[p];
+        }
+    }
+}
+
+/**
+ * Renumbers groups 0..n-1 in order of first use, dropping empty ones
+ * @param counts Order-1 statistics
+ * @param map Group per previous byte, updated in place
+ * @return Number of groups left
+ */
+static int compactContextGroups(const ContextCounts* counts, uint8_t map[ASCII_SIZE]) {
+    int renumber[MAX_CONTEXT_TABLES];
+    for (int g = 0; g < MAX_CONTEXT_TABLES; g++) {
+        renumber[g] = -1;
+    }
+
+    int tables = 0;
+    for (int k = 0; k < counts->activeCount; k++) {
+        int context = counts->active[k];
+        if (renumber[map[context]] < 0) {
+            renumber[map[context]] = tables++;
+        }
+        map[context] = (uint8_t)renumber[map[context]];
+    }
+
+    // Contexts that never precede a byte are never looked up
+    for (int context = 0; context < ASCII_SIZE; context++) {
+        if (counts->rowStart[context] == counts->rowStart[context + 1]) {
+            map[context] = 0;
+        }
+    }
+    return tables;
+}
+
+/**
+ * Moves every context to the group that codes its successors in the fewest
+ * bits, k-means style, until no context moves or the passes run out
+ * Group costs are smoothed so that symbols a group has not seen yet are
+ * expensive but not impossible.
+ * @param counts Order-1 statistics
+ * @param map Group per previous byte, updated in place
+ * @param tables Number of groups
+ * @return Number of groups left
+ */
+static int reassignContexts(const ContextCounts* counts, uint8_t map[ASCII_SIZE], int tables) {
+    uint64_t groups[MAX_CONTEXT_TABLES][ASCII_SIZE];
+    uint32_t cost[MAX_CONTEXT_TABLES][ASCII_SIZE];
+
+    for (int pass = 0; pass < CONTEXT_CLUSTER_PASSES && tables > 1; pass++) {
+        sumContextGroups(counts, map, tables, groups);
+        for (int g = 0; g < tables; g++) {
+            uint64_t total = 0;
+            for (int s = 0; s < ASCII_SIZE; s++) {
+                total += groups[g][s];
+            }
+            uint64_t base = fixedLog2(2 * total + ASCII_SIZE);
+            for (int s = 0; s < ASCII_SIZE; s++) {
+                cost[g][s] = (uint32_t)(groups[g][s] ? base - fixedLog2(2 * groups[g][s] + 1)
+                                                     : base);
+            }
+        }
+
+        int moved = 0;
+        for (int k = 0; k < counts->activeCount; k++) {
+            int context = counts->active[k];
+            uint64_t bestBits = UINT64_MAX;
+            int best = map[context];
+            for (int g = 0; g < tables; g++) {
+                uint64_t bits = 0;
+                for (uint32_t p = counts->rowStart[context]; p < counts->rowStart[context + 1];
+                     p++) {
+                    bits += (uint64_t)counts->counts[p] * cost[g][counts->symbols[p]];
+                }
+                if (bits < bestBits) {
+                    bestBits = bits;
+                    best = g;
+                }
+            }
+            moved += best != map[context];
+            map[context] = (uint8_t)best;
+        }
+
+        tables = compactContextGroups(counts, map);
+        if (!moved) break;
+    }
+    return tables;
+}
+
+/**
+ * Bytes taken by a packed code-length table for a histogram
+ * @param frequencies Histogram
+ * @return Size written by packCodeLengths
+ */
+static uint64_t packedTableSize(const uint64_t frequencies[ASCII_SIZE]) {
+    int first = 0;
+    int last = ASCII_SIZE - 1;
+    while (first < last && frequencies[first] == 0) first++;
+    while (last > first && frequencies[last] == 0) last--;
+    return 2 + (uint64_t)(last - first + 2) / 2;
+}
+
+/**
+ * Estimates what merging two groups saves: the code table it removes
+ * minus the bits it adds
+ * @param a Histogram of the first group
+ * @param b Histogram of the second group
+ * @param bitsA Estimated bits of the first group (16.16 fixed point)
+ * @param bitsB Estimated bits of the second group (16.16 fixed point)
+ * @param maxCodeLength Length limit for the codes
+ * @param mergedBits Receives the estimated bits of the merged group
+ * @return Saving in 16.16 fixed-point bits (negative: not worth it)
+ */
+static int64_t contextMergeSaving(const uint64_t a[ASCII_SIZE], const uint64_t b[ASCII_SIZE],
+                                  uint64_t bitsA, uint64_t bitsB, int maxCodeLength,
+                                  uint64_t* mergedBits) {
+    uint64_t merged[ASCII_SIZE];
+    for (int s = 0; s < ASCII_SIZE; s++) {
+        merged[s] = a[s] + b[s];
+    }
+    *mergedBits = estimateCodedBits(merged, 1, maxCodeLength);
+
+    int64_t tableBytes = (int64_t)packedTableSize(a) + (int64_t)packedTableSize(b) -
+                         (int64_t)packedTableSize(merged);
+    int64_t tableBits = tableBytes * (8 << 16);
+    return tableBits - ((int64_t)*mergedBits - (int64_t)bitsA - (int64_t)bitsB);
+}
+
+/**
+ * Merges groups while the bits a merge adds cost less than the code
+ * table it removes, always taking the cheapest merge first
+ * @param counts Order-1 statistics
+ * @param map Group per previous byte, updated in place
+ * @param tables Number of groups
+ * @param maxCodeLength Length limit for the codes
+ * @return Number of groups left
+ */
+static int mergeContextGroups(const ContextCounts* counts, uint8_t map[ASCII_SIZE], int tables,
+                              int maxCodeLength) {
+    uint64_t groups[MAX_CONTEXT_TABLES][ASCII_SIZE];
+    uint64_t bits[MAX_CONTEXT_TABLES];
+    uint64_t mergedBits[MAX_CONTEXT_TABLES][MAX_CONTEXT_TABLES];
+    int64_t saving[MAX_CONTEXT_TABLES][MAX_CONTEXT_TABLES];
+    int alive[MAX_CONTEXT_TABLES];
+
+    sumContextGroups(counts, map, tables, groups);
+    for (int a = 0; a < tables; a++) {
+        bits[a] = estimateCodedBits(groups[a], 1, maxCodeLength);
+        alive[a] = 1;
+    }
+    for (int a = 0; a < tables; a++) {
+        for (int b = a + 1; b < tables; b++) {
+            saving[a][b] = contextMergeSaving(groups[a], groups[b], bits[a], bits[b],
+                                              maxCodeLength, &mergedBits[a][b]);
+        }
+    }
+
+    while (1) {
+        int64_t bestSaving = 0;
+        int bestA = -1;
+        int bestB = -1;
+        for (int a = 0; a < tables; a++) {
+            if (!alive[a]) continue;
+            for (int b = a + 1; b < tables; b++) {
+                if (alive[b] && saving[a][b] > bestSaving) {
+                    bestSaving = saving[a][b];
+                    bestA = a;
+                    bestB = b;
+                }
+            }
+        }
+        if (bestA < 0) break;
+
+        // Fold bestB into bestA and refresh bestA's merges
+        for (int s = 0; s < ASCII_SIZE; s++) {
+            groups[bestA][s] += groups[bestB][s];
+        }
+        bits[bestA] = mergedBits[bestA][bestB];
+        alive[bestB] = 0;
+        for (int context = 0; context < ASCII_SIZE; context++) {
+            if (map[context] == bestB) map[context] = (uint8_t)bestA;
+        }
+        for (int c = 0; c < tables; c++) {
+            if (!alive[c] || c == bestA) continue;
+            int a = c < bestA ? c : bestA;
+            int b = c < bestA ? bestA : c;
+            saving[a][b] = contextMergeSaving(groups[a], groups[b], bits[a], bits[b],
+                                              maxCodeLength, &mergedBits[a][b]);
+        }
+    }
+
+    return compactContextGroups(counts, map);
+}
+
+/**
+ * Builds an order-1 context model for a block
+ * The 256 previous-byte contexts start in character-class groups, move to
+ * the group that codes their successors best, and groups are merged while
+ * a merge saves more than its code table costs. Each group then gets
+ * length-limited codes for the bytes that follow its contexts.
+ * @param input Block bytes (at least 1)
+ * @param size Number of bytes
+ * @param streams 1 or INTERLEAVED_STREAMS sub-streams
+ * @param maxCodeLength Length limit for the codes
+ * @param model Receives the model; tables < 2 means a context block cannot help
+ * @return 0 on success, -1 on error
+ */
+int buildContextModel(const unsigned char* input, size_t size, int streams, int maxCodeLength,
+                      ContextModel* model) {
+    ContextCounts counts;
+    if (countContexts(input, size, streams, &counts) != 0) {
+        return -1;
+    }
+
+    memset(model, 0, sizeof(*model));
+    for (int context = 0; context < ASCII_SIZE; context++) {
+        model->map[context] = (uint8_t)contextClass(context);
+    }
+    int tables = compactContextGroups(&counts, model->map);
+    tables = reassignContexts(&counts, model->map, tables);
+    tables = mergeContextGroups(&counts, model->map, tables, maxCodeLength);
+    tables = reassignContexts(&counts, model->map, tables);
+    model->tables = tables;
+
+    int result = 0;
+    if (tables > 1) {
+        uint64_t groups[MAX_CONTEXT_TABLES][ASCII_SIZE];
+        sumContextGroups(&counts, model->map, tables, groups);
+
+        // Exact header and bits, plus at most one padding byte per sub-stream
+        unsigned char packedMap[2 + ASCII_SIZE / 2];
+        uint64_t header = 1 + packCodeLengths(model->map, packedMap);
+        uint64_t bits = 0;
+        for (int g = 0; g < tables && result == 0; g++) {
+            result = computeLimitedCodeLengths(groups[g], maxCodeLength, model->lengths[g]);
+            for (int s = 0; s < ASCII_SIZE; s++) {
+                bits += groups[g][s] * model->lengths[g][s];
+            }
+            header += packedTableSize(groups[g]);
+        }
+
+        model->payloadBound = header + (streams > 1 ? STREAM_JUMP_TABLE_SIZE : 0) +
+                              (bits + 7) / 8 + (uint64_t)streams;
+    }
+
+    free(counts.symbols);
+    free(counts.counts);
+    return result;
+}
+
+/**
+ * Encodes a block with a context model
+ * Layout: table count, packed context map, packed code lengths of each
+ * table, then the bit stream(s) as written by encodeStreams.
+ * @param model Model from buildContextModel (at least 2 tables)
+ * @param input Block bytes
+ * @param size Number of bytes
+ * @param streams 1 or INTERLEAVED_STREAMS
+ * @param output Output buffer, including 8 bytes of bit writer slack
+ * @param capacity Size of the output buffer
+ * @param written Receives the number of bytes produced
+ * @return 0 on success, -1 on error
+ */
+int encodeContextBlock(const ContextModel* model, const unsigned char* input, size_t size,
+                       int streams, unsigned char* output, size_t capacity, size_t* written) {
+    size_t position = 0;
+    if (capacity < 1 + (size_t)(model->tables + 1) * (2 + ASCII_SIZE / 2) +
+                   STREAM_JUMP_TABLE_SIZE) {
+        reportError("Context block buffer is too small");
+        return -1;
+    }
+
+    output[position++] = (unsigned char)model->tables;
+    position += packCodeLengths(model->map, output + position);
+
+    uint32_t bits[MAX_CONTEXT_TABLES][ASCII_SIZE];
+    for (int g = 0; g < model->tables; g++) {
+        CodeEntry codes[ASCII_SIZE];
+        if (assignCanonicalCodes(model->lengths[g], codes) != 0) {
+            return -1;
+        }
+        for (int s = 0; s < ASCII_SIZE; s++) {
+            bits[g][s] = (uint32_t)codes[s].bits;
+        }
+        position += packCodeLengths(model->lengths[g], output + position);
+    }
+
+    unsigned char* streamData = output + position;
+    size_t streamPosition = streams == 1 ? 0 : STREAM_JUMP_TABLE_SIZE;
+    size_t segment = streams == 1 ? size : interleavedSegmentSize(size);
+
+    for (int k = 0; k < streams; k++) {
+        size_t start = (size_t)k * segment < size ? (size_t)k * segment : size;
+        size_t count = size - start < segment ? size - start : segment;
+
+        BitWriter writer;
+        initBitWriter(&writer, NULL, streamData + streamPosition,
+                      capacity - position - streamPosition);
+        unsigned previous = 0;
+        for (size_t i = start; i < start + count; i++) {
+            int table = model->map[previous];
+            int length = model->lengths[table][input[i]];
+            if (length == 0) {
+                reportError("No context code found for character %d", input[i]);
+                return -1;
+            }
+            putBits(&writer, bits[table][input[i]], length);
+            previous = input[i];
+        }
+        finishBitWriter(&writer);
+
+        if (k < streams - 1) {
+            uint32_t streamSize = (uint32_t)writer.position;
+            memcpy(streamData + (size_t)k * sizeof(uint32_t), &streamSize, sizeof(uint32_t));
+        }
+        streamPosition += writer.position;
+    }
+
+    *written = position + streamPosition;
+    return 0;
+}
+
+// Resolves one code with the table of the lane's previous byte and makes
+// the symbol the next context; subtable codes are counted in 'longCodes',
+// and an invalid code sets 'invalid' and consumes nothing
+#define DECODE_CONTEXT_LANE(r, out, previous) \
+    do { \
+        const DecodeEntry* entries = contexts[previous]; \
+        const DecodeEntry* entry = &entries[(r).bits >> shift]; \
+        int skipped = 0; \
+        if (entry->count == 0 && entry->length > 0) { \
+            longCodes++; \
+            skipped = entry->length; \
+            entry = &entries[entry->next + (((r).bits << skipped) >> (64 - entry->subBits))]; \
+        } \
+        if (entry->count > 0) { \
+            (previous) = entry->symbols[0]; \
+            *(out)++ = entry->symbols[0]; \
+            (r).bits <<= skipped + entry->firstLength; \
+            (r).bitCount -= skipped + entry->firstLength; \
+        } else { \
+            invalid = 1; \
+        } \
+    } while (0)
+
+/**
+ * Decodes a fixed number of symbols of one context-modeled sub-stream
+ * Only the first symbol of paired decode entries is used, since the
+ * second one belongs to the next context's table.
+ * @param reader Bit reader positioned at the next code
+ * @param contexts Decode entries per previous byte
+ * @param previous Previous byte of the first symbol
+ * @param output Buffer receiving the symbols
+ * @param count Number of symbols to decode
+ * @return 0 on success, -1 on an invalid bit sequence
+ */
+static int decodeContextSymbols(BitReader* reader, const DecodeEntry* const contexts[ASCII_SIZE],
+                                unsigned previous, unsigned char* output, size_t count) {
+    const int shift = 64 - DECODE_TABLE_BITS;
+    unsigned char* end = output + count;
+    int invalid = 0;
+    uint64_t longCodes = 0;
+
+    while (output < end && !invalid) {
+        refillBits(reader);
+
+        // A refill holds three codes of at most 15 bits
+        for (int step = 0; step < 3 && output < end && !invalid; step++) {
+            DECODE_CONTEXT_LANE(*reader, output, previous);
+        }
+    }
+
+    if (invalid) {
+        reportError("Invalid bit sequence encountered during decoding");
+        return -1;
+    }
+
+    // One lookup per symbol: paired entries are not used across contexts
+    reader->lookups += count;
+    reader->longCodes += longCodes;
+    return 0;
+}
+
+/**
+ * Decodes INTERLEAVED_STREAMS context-modeled sub-streams in lockstep
+ * @param readers Bit readers, one per sub-stream
+ * @param contexts Decode entries per previous byte
+ * @param output Buffer receiving all symbols of the block
+ * @param size Number of symbols in the block
+ * @return 0 on success, -1 on an invalid bit sequence
+ */
+static int decodeContextInterleaved(BitReader readers[INTERLEAVED_STREAMS],
+                                    const DecodeEntry* const contexts[ASCII_SIZE],
+                                    unsigned char* output, size_t size) {
+    const int shift = 64 - DECODE_TABLE_BITS;
+    const size_t slack = 3;  // Three single-symbol lookups
+    size_t segment = interleavedSegmentSize(size);
+
+    unsigned char* first[INTERLEAVED_STREAMS];
+    unsigned char* out[INTERLEAVED_STREAMS];
+    unsigned char* end[INTERLEAVED_STREAMS];
+    for (int k = 0; k < INTERLEAVED_STREAMS; k++) {
+        size_t start = (size_t)k * segment < size ? (size_t)k * segment : size;
+        first[k] = out[k] = output + start;
+        end[k] = output + (size - start < segment ? size : start + segment);
+    }
+
+    BitReader r0 = readers[0], r1 = readers[1], r2 = readers[2], r3 = readers[3];
+    unsigned char* o0 = out[0];
+    unsigned char* o1 = out[1];
+    unsigned char* o2 = out[2];
+    unsigned char* o3 = out[3];
+    unsigned p0 = 0, p1 = 0, p2 = 0, p3 = 0;
+    int invalid = 0;
+    uint64_t longCodes = 0;
+
+    while (!invalid &&
+           (size_t)(end[0] - o0) >= slack && (size_t)(end[1] - o1) >= slack &&
+           (size_t)(end[2] - o2) >= slack && (size_t)(end[3] - o3) >= slack &&
+           r0.length - r0.position >= 8 && r1.length - r1.position >= 8 &&
+           r2.length - r2.position >= 8 && r3.length - r3.position >= 8) {
+        REFILL_LANE(r0);
+        REFILL_LANE(r1);
+        REFILL_LANE(r2);
+        REFILL_LANE(r3);
+
+        for (int step = 0; step < 3; step++) {
+            DECODE_CONTEXT_LANE(r0, o0, p0);
+            DECODE_CONTEXT_LANE(r1, o1, p1);
+            DECODE_CONTEXT_LANE(r2, o2, p2);
+            DECODE_CONTEXT_LANE(r3, o3, p3);
+        }
+    }
+
+    if (invalid) {
+        reportError("Invalid bit sequence encountered during decoding");
+        return -1;
+    }
+
+    readers[0] = r0;
+    readers[1] = r1;
+    readers[2] = r2;
+    readers[3] = r3;
+    out[0] = o0;
+    out[1] = o1;
+    out[2] = o2;
+    out[3] = o3;
+    unsigned previous[INTERLEAVED_STREAMS] = { p0, p1, p2, p3 };
+
+    for (int k = 0; k < INTERLEAVED_STREAMS; k++) {
+        readers[k].lookups += (uint64_t)(out[k] - first[k]);
+    }
+    readers[0].longCodes += longCodes;
+
+    for (int k = 0; k < INTERLEAVED_STREAMS; k++) {
+        if (decodeContextSymbols(&readers[k], contexts, previous[k], out[k],
+                                 (size_t)(end[k] - out[k])) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#undef DECODE_CONTEXT_LANE
+
+/**
+ * Decodes a block written by encodeContextBlock
+ * @param payload Payload after the block type byte
+ * @param size Payload size in bytes
+ * @param streams 1 or INTERLEAVED_STREAMS
+ * @param output Buffer receiving the symbols
+ * @param count Number of symbols to decode
+ * @param stats Receives table and decode times and lookup counts, or NULL
+ * @return 0 on success, -1 on corrupted or truncated data
+ */
+int decodeContextBlock(const unsigned char* payload, size_t size, int streams,
+                       unsigned char* output, size_t count, BlockStats* stats) {
+    double mark = stats ? wallClockSeconds() : 0;
+    if (size < 1 || payload[0] < 2 || payload[0] > MAX_CONTEXT_TABLES) {
+        reportError("Invalid context block header");
+        return -1;
+    }
+
+    int tables = payload[0];
+    size_t position = 1;
+    size_t consumed;
+    uint8_t map[ASCII_SIZE];
+    if (unpackCodeLengths(payload + position, size - position, map, &consumed) != 0) {
+        return -1;
+    }
+    position += consumed;
+    for (int context = 0; context < ASCII_SIZE; context++) {
+        if (map[context] >= tables) {
+            reportError("Invalid context map");
+            return -1;
+        }
+    }
+
+    DecodeTable* decoders[MAX_CONTEXT_TABLES] = {0};
+    int result = 0;
+    for (int g = 0; g < tables && result == 0; g++) {
+        uint8_t lengths[ASCII_SIZE];
+        if (unpackCodeLengths(payload + position, size - position, lengths, &consumed) != 0) {
+            result = -1;
+            break;
+        }
+        position += consumed;
+        decoders[g] = createCanonicalDecodeTable(lengths);
+        if (!decoders[g]) {
+            result = -1;
+        }
+    }
+
+    CHARGE_PHASE(stats, tableSeconds, mark);
+
+    if (result == 0) {
+        const DecodeEntry* contexts[ASCII_SIZE];
+        for (int context = 0; context < ASCII_SIZE; context++) {
+            contexts[context] = decoders[map[context]]->entries;
+        }
+
+        const unsigned char* input = payload + position;
+        size_t inputSize = size - position;
+        BitReader readers[INTERLEAVED_STREAMS];
+
+        if (streams == 1) {
+            initBitReaderMemory(&readers[0], input, inputSize);
+            result = decodeContextSymbols(&readers[0], contexts, 0, output, count);
+        } else if (inputSize < STREAM_JUMP_TABLE_SIZE) {
+            reportError("Compressed data is truncated");
+            result = -1;
+        } else {
+            size_t streamPosition = STREAM_JUMP_TABLE_SIZE;
+            for (int k = 0; k < INTERLEAVED_STREAMS && result == 0; k++) {
+                size_t streamSize = inputSize - streamPosition;
+                if (k < INTERLEAVED_STREAMS - 1) {
+                    uint32_t recorded;
+                    memcpy(&recorded, input + (size_t)k * sizeof(uint32_t), sizeof(uint32_t));
+                    if (recorded > streamSize) {
+                        reportError("Sub-stream sizes exceed the block");
+                        result = -1;
+                        break;
+                    }
+                    streamSize = recorded;
+                }
+                initBitReaderMemory(&readers[k], input + streamPosition, streamSize);
+                streamPosition += streamSize;
+            }
+            if (result == 0) {
+                result = decodeContextInterleaved(readers, contexts, output, count);
+            }
+        }
+
+        for (int k = 0; k < streams && result == 0; k++) {
+            result = checkBitReaderOverrun(&readers[k]);
+        }
+        if (result == 0) {
+            countDecodeLookups(stats, readers, streams, count);
+        }
+        CHARGE_PHASE(stats, decodeSeconds, mark);
+    }
+
+    for (int g = 0; g < tables; g++) {
+        destroyDecodeTable(decoders[g]);
+    }
+    return result;
+}
+
+// =============================================================================
+// BLOCK CONTAINER
+// =============================================================================
+
+/**
+ * Upper bound on the payload size of a block
+ * @param rawSize Uncompressed size of the block
+ * @return Code lengths, jump table and the longest possible bit streams, with bit writer
+ *         slack, and the checksum
+ */
+size_t blockPayloadBound(size_t rawSize) {
+    return 1 + 2 + ASCII_SIZE / 2 + STREAM_JUMP_TABLE_SIZE +
+           (rawSize * MAX_CANONICAL_CODE_LENGTH + 7) / 8 + (INTERLEAVED_STREAMS - 1) + 8 +
+           BLOCK_CHECKSUM_SIZE;
+}
+
+/**
+ * Output buffer size for compressing a block job of up to rawSize bytes
+ * Covers every split into MAX_BLOCK_PARTS container blocks with headers.
+ * @param rawSize Uncompressed bytes per job
+ * @return Buffer size in bytes
+ */
+size_t blockJobOutputBound(size_t rawSize) {
+    return BLOCK_HEADER_SIZE + blockPayloadBound(rawSize) +
+           (MAX_BLOCK_PARTS - 1) * (BLOCK_HEADER_SIZE + blockPayloadBound(0) + 1);
+}
+
+/**
+ * Upper bound on the size of a container
+ * The worst case is the smallest block size, split as finely as possible,
+ * with every block stored: its raw bytes plus the type byte, checksum,
+ * block header and both index entries.
+ * @param size Uncompressed size
+ * @return Container size in bytes
+ */
+size_t containerBound(size_t size) {
+    size_t blocks = size / MIN_BLOCK_SIZE + 1 + size / MIN_SPLIT_SEGMENT;
+    return CONTAINER_HEADER_SIZE + BLOCK_HEADER_SIZE + INDEX_TRAILER_SIZE +
+           blocks * (BLOCK_HEADER_SIZE + 2 * sizeof(uint64_t) + 1 + BLOCK_CHECKSUM_SIZE) +
+           size;
+}
+
+/**
+ * Picks a block's type from its histogram before anything is encoded
+ * A block of one repeated byte is run-length coded. Otherwise the exact
+ * Huffman cost of the histogram under the block's code lengths decides
+ * whether coding can beat storing the bytes as they are.
+ * @param frequencies Byte counts of the block
+ * @param size Block size in bytes (at least 1)
+ * @param maxCodeLength Length limit for the block's codes
+ * @param lengths Receives the code lengths when BLOCK_TYPE_HUFFMAN is chosen
+ * @param cost Receives the estimated Huffman payload size (type byte excluded)
+ * @return BLOCK_TYPE_HUFFMAN, BLOCK_TYPE_STORED or BLOCK_TYPE_RLE, or -1 on error
+ */
+static int selectBlockType(const uint64_t frequencies[ASCII_SIZE], size_t size,
+                           int maxCodeLength, uint8_t lengths[ASCII_SIZE], uint64_t* cost) {
+    int used = 0;
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        used += frequencies[i] != 0;
+    }
+    if (used == 1) {
+        *cost = 1;
+        return BLOCK_TYPE_RLE;
+    }
+
+    if (computeLimitedCodeLengths(frequencies, maxCodeLength, lengths) != 0) {
+        return -1;
+    }
+
+    uint64_t bits = 0;
+    int first = -1;
+    int last = 0;
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        if (lengths[i] == 0) continue;
+        bits += frequencies[i] * lengths[i];
+        if (first < 0) first = i;
+        last = i;
+    }
+
+    // Code lengths, jump table and per-stream padding on top of the bits
+    *cost = 2 + (uint64_t)(last - first + 2) / 2 + STREAM_JUMP_TABLE_SIZE +
+            INTERLEAVED_STREAMS + bits / 8;
+    return *cost < size ? BLOCK_TYPE_HUFFMAN : BLOCK_TYPE_STORED;
+}
+
+/**
+ * Codes one container block: its header, a type byte and the payload
+ * Huffman blocks hold code lengths followed by their bit stream(s),
+ * context blocks a context map and one code table per context group,
+ * stored blocks the raw bytes and RLE blocks the single repeated byte.
+ * With checksums the payload ends with the CRC32C of the block's bytes.
+ * @param input Block bytes (at least 1)
+ * @param size Number of bytes
+ * @param frequencies Byte counts of the block
+ * @param maxCodeLength Length limit for the block's codes
+ * @param streams 1 or INTERLEAVED_STREAMS sub-streams
+ * @param contextModel Non-zero to use a context block where it is smaller
+ * @param checksums Non-zero to append a checksum
+ * @param output Buffer of at least BLOCK_HEADER_SIZE + blockPayloadBound(size) bytes
+ * @param written Receives the number of bytes written, header included
+ * @param stats Receives phase times, or NULL
+ * @return 0 on success, -1 on error
+ */
+static int compressBlockPart(const unsigned char* input, size_t size,
+                             const uint64_t frequencies[ASCII_SIZE], int maxCodeLength,
+                             int streams, int contextModel, int checksums,
+                             unsigned char* output, size_t* written, BlockStats* stats) {
+    double mark = stats ? wallClockSeconds() : 0;
+    uint8_t lengths[ASCII_SIZE];
+    uint64_t cost;
+    int type = selectBlockType(frequencies, size, maxCodeLength, lengths, &cost);
+    if (type < 0) {
+        return -1;
+    }
+
+    ContextModel model;
+    if (contextModel && type != BLOCK_TYPE_RLE && size >= MIN_CONTEXT_BLOCK) {
+        if (buildContextModel(input, size, streams, maxCodeLength, &model) != 0) {
+            return -1;
+        }
+        if (model.tables > 1 && model.payloadBound < (cost < size ? cost : size)) {
+            type = BLOCK_TYPE_CONTEXT;
+        }
+    }
+
+    CHARGE_PHASE(stats, treeSeconds, mark);
+
+    unsigned char* payload = output + BLOCK_HEADER_SIZE;
+    size_t payloadSize = 0;
+
+    if (type == BLOCK_TYPE_HUFFMAN) {
+        CodeEntry codes[ASCII_SIZE];
+        if (assignCanonicalCodes(lengths, codes) != 0) {
+            return -1;
+        }
+
+        payload[0] = BLOCK_TYPE_HUFFMAN;
+        size_t headerSize = 1 + packCodeLengths(lengths, payload + 1);
+        CHARGE_PHASE(stats, treeSeconds, mark);
+
+        size_t streamSize;
+        if (encodeStreams(codes, input, size, streams, payload + headerSize,
+                          blockPayloadBound(size) - headerSize, &streamSize) != 0) {
+            return -1;
+        }
+        payloadSize = headerSize + streamSize;
+
+        // The estimate includes worst-case padding, so this is only a safety net
+        if (payloadSize > size) {
+            type = BLOCK_TYPE_STORED;
+        }
+    }
+
+    if (type == BLOCK_TYPE_CONTEXT) {
+        payload[0] = BLOCK_TYPE_CONTEXT;
+        if (encodeContextBlock(&model, input, size, streams, payload + 1,
+                               blockPayloadBound(size) - 1, &payloadSize) != 0) {
+            return -1;
+        }
+        payloadSize += 1;
+    }
+
+    if (type == BLOCK_TYPE_STORED || type == BLOCK_TYPE_RLE) {
+        payload[0] = (unsigned char)type;
+        if (type == BLOCK_TYPE_RLE) {
+            payload[1] = input[0];
+            payloadSize = 2;
+        } else {
+            memcpy(payload + 1, input, size);
+            payloadSize = 1 + size;
+        }
+    }
+    CHARGE_PHASE(stats, encodeSeconds, mark);
+
+    if (checksums) {
+        uint32_t checksum = computeCrc32c(input, size);
+        memcpy(payload + payloadSize, &checksum, BLOCK_CHECKSUM_SIZE);
+        payloadSize += BLOCK_CHECKSUM_SIZE;
+        CHARGE_PHASE(stats, checksumSeconds, mark);
+    }
+    if (stats) {
+        stats->blocks++;
+    }
+
+    uint32_t header[2] = { (uint32_t)size, (uint32_t)payloadSize };
+    memcpy(output, header, BLOCK_HEADER_SIZE);
+    *written = BLOCK_HEADER_SIZE + payloadSize;
+    return 0;
+}
+
+/**
+ * Estimates the bytes a container block adds besides its coded bits
+ * @param frequencies Byte counts of the block
+ * @return Block header, index entry, type byte, code lengths, jump table and padding
+ */
+static uint64_t blockOverhead(const uint64_t frequencies[ASCII_SIZE]) {
+    int first = 0;
+    int last = ASCII_SIZE - 1;
+    while (first < last && frequencies[first] == 0) first++;
+    while (last > first && frequencies[last] == 0) last--;
+    return BLOCK_HEADER_SIZE + sizeof(uint64_t) + 1 + 2 + (uint64_t)(last - first + 2) / 2 +
+           STREAM_JUMP_TABLE_SIZE + INTERLEAVED_STREAMS / 2;
+}
+
+/**
+ * Compresses one block job into one or more container blocks
+ * With a split level, the block is cut into 4 << level sub-blocks (of at
+ * least MIN_SPLIT_SEGMENT bytes) that are merged greedily: each sub-block
+ * either extends the current run or, when coding it with its own table
+ * saves more than that table costs, starts a new container block.
+ * @param job Block job with input set and output of blockJobOutputBound bytes
+ * @param maxCodeLength Length limit for the blocks' codes
+ * @param streams 1 or INTERLEAVED_STREAMS sub-streams
+ * @param splitLevel 0 (one container block) to MAX_SPLIT_LEVEL
+ * @param contextModel Non-zero to try order-1 context blocks
+ * @param checksums Non-zero to end every container block with a checksum
+ * @param stats Receives block counts and phase times, or NULL
+ * @return 0 on success, -1 on error
+ */
+int compressBlock(BlockJob* job, int maxCodeLength, int streams, int splitLevel,
+                  int contextModel, int checksums, BlockStats* stats) {
+    double mark = stats ? wallClockSeconds() : 0;
+    size_t size = job->inputSize;
+    size_t segments = splitLevel > 0 ? (size_t)4 << splitLevel : 1;
+    if (segments > size / MIN_SPLIT_SEGMENT) {
+        segments = size / MIN_SPLIT_SEGMENT;
+    }
+    if (segments < 2) {
+        segments = 1;
+    }
+    size_t segmentSize = (size + segments - 1) / segments;
+
+    uint64_t run[ASCII_SIZE] = {0};
+    uint64_t next[ASCII_SIZE];
+    uint64_t merged[ASCII_SIZE];
+    size_t runStart = 0;
+    uint64_t runBits = 0;
+
+    job->parts = 0;
+    job->outputSize = 0;
+    countFrequencies(job->input, segments > 1 ? segmentSize : size, run);
+    CHARGE_PHASE(stats, histogramSeconds, mark);
+    if (segments > 1) {
+        runBits = estimateCodedBits(run, splitLevel, maxCodeLength);
+        CHARGE_PHASE(stats, treeSeconds, mark);
+    }
+
+    size_t start = segments > 1 ? segmentSize : size;
+    size_t length = 0;
+    while (1) {
+        int split = start == size;
+
+        if (!split) {
+            length = size - start < segmentSize ? size - start : segmentSize;
+            memset(next, 0, sizeof(next));
+            countFrequencies(job->input + start, length, next);
+            for (int i = 0; i < ASCII_SIZE; i++) {
+                merged[i] = run[i] + next[i];
+            }
+            CHARGE_PHASE(stats, histogramSeconds, mark);
+
+            // Separate tables win when they save more bits than a block costs
+            uint64_t nextBits = estimateCodedBits(next, splitLevel, maxCodeLength);
+            uint64_t mergedBits = estimateCodedBits(merged, splitLevel, maxCodeLength);
+            uint64_t saving = mergedBits > runBits + nextBits
+                ? (mergedBits - runBits - nextBits) >> 19 : 0;
+            split = saving > blockOverhead(next) && job->parts + 1 < MAX_BLOCK_PARTS;
+            CHARGE_PHASE(stats, treeSeconds, mark);
+
+            if (!split) {
+                memcpy(run, merged, sizeof(run));
+                runBits = mergedBits;
+                start += length;
+                continue;
+            }
+            runBits = nextBits;
+        }
+
+        size_t written;
+        if (compressBlockPart(job->input + runStart, start - runStart, run, maxCodeLength,
+                              streams, contextModel, checksums,
+                              job->output + job->outputSize, &written, stats) != 0) {
+            return -1;
+        }
+        if (stats) {
+            mark = wallClockSeconds();
+        }
+        job->partSizes[job->parts] = (uint32_t)written;
+        job->partRawSizes[job->parts++] = (uint32_t)(start - runStart);
+        job->outputSize += written;
+
+        if (start == size) break;
+        runStart = start;
+        start += length;
+        memcpy(run, next, sizeof(run));
+    }
+
+    return 0;
+}
+
+/**
+ * Decompresses one Huffman-coded block payload
+ * The job's cache supplies the decode table when an earlier block (of this
+ * or an earlier container) had the same code lengths.
+ * @param job Block job with the payload as input and outputSize set to the raw size
+ * @param payload Code lengths and bit stream(s)
+ * @param size Payload size in bytes
+ * @param streams 1 or INTERLEAVED_STREAMS sub-streams
+ * @param stats Receives table and decode times and lookup counts, or NULL
+ * @return 0 on success, -1 on corrupted data
+ */
+static int decompressHuffmanBlock(BlockJob* job, const unsigned char* payload, size_t size,
+                                  int streams, BlockStats* stats) {
+    double mark = stats ? wallClockSeconds() : 0;
+    uint8_t lengths[ASCII_SIZE];
+    size_t consumed;
+    if (unpackCodeLengths(payload, size, lengths, &consumed) != 0) {
+        return -1;
+    }
+
+    // Without a cache (allocation failed) every block builds its own table
+    if (!job->tables) {
+        job->tables = createDecodeTableCache();
+    }
+    DecodeTable* owned;
+    const DecodeTable* table = acquireCanonicalDecodeTable(job->tables, lengths, &owned, stats);
+    if (!table) {
+        return -1;
+    }
+    CHARGE_PHASE(stats, tableSeconds, mark);
+
+    int result = decodeStreams(table, payload + consumed, size - consumed,
+                               streams, job->output, job->outputSize, stats);
+    CHARGE_PHASE(stats, decodeSeconds, mark);
+
+    destroyDecodeTable(owned);
+    return result;
+}
+
+/**
+ * Decodes one block payload of the given kind
+ * @param job Block job with the payload as input and outputSize set to the raw size
+ * @param input Payload without its checksum
+ * @param inputSize Payload size in bytes
+ * @param streams 1 or INTERLEAVED_STREAMS sub-streams
+ * @param typed Non-zero if the payload starts with a block type byte
+ *        (CONTAINER_FLAG_BLOCK_TYPES); older containers hold Huffman blocks only
+ * @param stats Receives table and decode times and lookup counts, or NULL
+ * @return 0 on success, -1 on corrupted data
+ */
+static int decodeBlockPayload(BlockJob* job, const unsigned char* input, size_t inputSize,
+                              int streams, int typed, BlockStats* stats) {
+    if (!typed) {
+        return decompressHuffmanBlock(job, input, inputSize, streams, stats);
+    }
+
+    if (inputSize == 0) {
+        reportError("Empty block payload");
+        return -1;
+    }
+
+    const unsigned char* payload = input + 1;
+    size_t size = inputSize - 1;
+    switch (input[0]) {
+        case BLOCK_TYPE_HUFFMAN:
+            return decompressHuffmanBlock(job, payload, size, streams, stats);
+
+        case BLOCK_TYPE_STORED: {
+            if (size != job->outputSize) break;
+            double mark = stats ? wallClockSeconds() : 0;
+            memcpy(job->output, payload, size);
+            CHARGE_PHASE(stats, decodeSeconds, mark);
+            return 0;
+        }
+
+        case BLOCK_TYPE_RLE: {
+            if (size != 1) break;
+            double mark = stats ? wallClockSeconds() : 0;
+            memset(job->output, payload[0], job->outputSize);
+            CHARGE_PHASE(stats, decodeSeconds, mark);
+            return 0;
+        }
+
+        case BLOCK_TYPE_CONTEXT:
+            return decodeContextBlock(payload, size, streams, job->output, job->outputSize,
+                                      stats);
+
+        default:
+            reportError("Unknown block type %u", input[0]);
+            return -1;
+    }
+
+    reportError("Invalid %s block payload", input[0] == BLOCK_TYPE_STORED ? "stored" : "RLE");
+    return -1;
+}
+
+/**
+ * Decompresses one block payload
+ * With checksums the decoded bytes are checked against the CRC32C at the
+ * end of the payload while they are still in cache.
+ * @param job Block job with the payload as input and outputSize set to the raw size
+ * @param streams 1 or INTERLEAVED_STREAMS sub-streams
+ * @param typed Non-zero if the payload starts with a block type byte
+ *        (CONTAINER_FLAG_BLOCK_TYPES); older containers hold Huffman blocks only
+ * @param checksums Non-zero if the payload ends with a checksum (CONTAINER_FLAG_CHECKSUMS)
+ * @param stats Receives block counts, phase times and lookup counts, or NULL
+ * @return 0 on success, -1 on corrupted data
+ */
+int decompressBlock(BlockJob* job, int streams, int typed, int checksums, BlockStats* stats) {
+    size_t size = job->inputSize;
+    if (checksums) {
+        if (size < BLOCK_CHECKSUM_SIZE) {
+            reportError("Block payload is too short for its checksum");
+            return -1;
+        }
+        size -= BLOCK_CHECKSUM_SIZE;
+    }
+
+    if (decodeBlockPayload(job, job->input, size, streams, typed, stats) != 0) {
+        return -1;
+    }
+
+    if (checksums) {
+        double mark = stats ? wallClockSeconds() : 0;
+        uint32_t expected;
+        memcpy(&expected, job->input + size, BLOCK_CHECKSUM_SIZE);
+        if (computeCrc32c(job->output, job->outputSize) != expected) {
+            reportError("Block checksum mismatch (corrupted data)");
+            return -1;
+        }
+        CHARGE_PHASE(stats, checksumSeconds, mark);
+    }
+    if (stats) {
+        stats->blocks++;
+    }
+    return 0;
+}
+
+/**
+ * Thread pool task: compresses block 'index' of a batch
+ * @param context BlockBatch
+ * @param index Job index
+ */
+void compressBlockTask(void* context, size_t index) {
+    BlockBatch* batch = (BlockBatch*)context;
+    BlockJob* job = &batch->jobs[index];
+    BlockStats* stats = batch->stats ? &job->stats : NULL;
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+    }
+    job->result = compressBlock(job, batch->maxCodeLength, batch->streams, batch->splitLevel,
+                                batch->contextModel, batch->checksums, stats);
+}
+
+/**
+ * Thread pool task: decompresses block 'index' of a batch
+ * @param context BlockBatch
+ * @param index Job index
+ */
+void decompressBlockTask(void* context, size_t index) {
+    BlockBatch* batch = (BlockBatch*)context;
+    BlockJob* job = &batch->jobs[index];
+    BlockStats* stats = batch->stats ? &job->stats : NULL;
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+    }
+    job->result = decompressBlock(job, batch->streams, batch->blockTypes, batch->checksums,
+                                  stats);
+}
+
+/**
+ * Allocates job buffers for a batch
+ * @param count Number of jobs
+ * @param inputCapacity Input buffer size per job
+ * @param outputCapacity Output buffer size per job
+ * @return Array of jobs or NULL on failure
+ */
+BlockJob* createBlockJobs(size_t count, size_t inputCapacity, size_t outputCapacity) {
+    BlockJob* jobs = (BlockJob*)calloc(count, sizeof(BlockJob));
+    if (!jobs) {
+        reportError("Memory allocation failed for block jobs");
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        jobs[i].inputBuffer = (unsigned char*)malloc(inputCapacity);
+        jobs[i].outputBuffer = (unsigned char*)malloc(outputCapacity);
+        jobs[i].input = jobs[i].inputBuffer;
+        jobs[i].output = jobs[i].outputBuffer;
+        jobs[i].outputCapacity = outputCapacity;
+        if (!jobs[i].inputBuffer || !jobs[i].outputBuffer) {
+            reportError("Memory allocation failed for block buffers");
+            for (size_t j = 0; j <= i; j++) {
+                free(jobs[j].inputBuffer);
+                free(jobs[j].outputBuffer);
+            }
+            free(jobs);
+            return NULL;
+        }
+    }
+
+    return jobs;
+}
+
+/**
+ * Frees job buffers for a batch
+ * @param jobs Array of jobs
+ * @param count Number of jobs
+ */
+void destroyBlockJobs(BlockJob* jobs, size_t count) {
+    if (!jobs) return;
+
+    for (size_t i = 0; i < count; i++) {
+        free(jobs[i].inputBuffer);
+        free(jobs[i].outputBuffer);
+        destroyDecodeTableCache(jobs[i].tables);
+    }
+    free(jobs);
+}
+
+/**
+ * Initializes an empty block index for a container's first block
+ * @param index Index to initialize
+ */
+void initContainerIndex(ContainerIndex* index) {
+    memset(index, 0, sizeof(ContainerIndex));
+    index->offset = CONTAINER_HEADER_SIZE;
+}
+
+/**
+ * Records the next block in a block index
+ * @param index Block index
+ * @param blockBytes Container bytes of the block, header included
+ * @param rawSize Uncompressed bytes of the block
+ * @return 0 on success, -1 on allocation failure
+ */
+int appendIndexEntry(ContainerIndex* index, uint64_t blockBytes, uint32_t rawSize) {
+    if (index->count == index->capacity) {
+        size_t newCapacity = index->capacity ? index->capacity * 2 : 64;
+        uint64_t* offsets = (uint64_t*)realloc(index->offsets, newCapacity * sizeof(uint64_t));
+        if (offsets) {
+            index->offsets = offsets;
+        }
+        uint64_t* rawOffsets = offsets
+            ? (uint64_t*)realloc(index->rawOffsets, newCapacity * sizeof(uint64_t)) : NULL;
+        if (!rawOffsets) {
+            reportError("Memory allocation failed for block index");
+            return -1;
+        }
+        index->rawOffsets = rawOffsets;
+        index->capacity = newCapacity;
+    }
+
+    index->offsets[index->count] = index->offset;
+    index->rawOffsets[index->count++] = index->rawOffset;
+    index->offset += blockBytes;
+    index->rawOffset += rawSize;
+    return 0;
+}
+
+/**
+ * Frees the arrays of a block index
+ * @param index Block index
+ */
+void destroyContainerIndex(ContainerIndex* index) {
+    free(index->offsets);
+    free(index->rawOffsets);
+    index->offsets = NULL;
+    index->rawOffsets = NULL;
+}
+
+/**
+ * Writes the block container header
+ * @param file Output file pointer
+ * @param header Header structure to write
+ */
+void writeContainerHeader(FILE* file, const ContainerHeader* header) {
+    fwrite(&header->magic, sizeof(uint32_t), 1, file);
+    fwrite(&header->version, sizeof(uint8_t), 1, file);
+    fwrite(&header->flags, sizeof(uint8_t), 1, file);
+    fwrite(&header->reserved, sizeof(uint16_t), 1, file);
+    fwrite(&header->block_size, sizeof(uint32_t), 1, file);
+    fwrite(&header->original_size, sizeof(uint64_t), 1, file);
+}
+
+/**
+ * Reads the block container header fields that follow the magic number
+ * @param file Input file pointer positioned after the magic number
+ * @param header Header structure to populate
+ * @return 0 on success, -1 on error
+ */
+int readContainerHeader(FILE* file, ContainerHeader* header) {
+    header->magic = MAGIC_BLOCKS;
+    if (fread(&header->version, sizeof(uint8_t), 1, file) != 1 ||
+        fread(&header->flags, sizeof(uint8_t), 1, file) != 1 ||
+        fread(&header->reserved, sizeof(uint16_t), 1, file) != 1 ||
+        fread(&header->block_size, sizeof(uint32_t), 1, file) != 1 ||
+        fread(&header->original_size, sizeof(uint64_t), 1, file) != 1) {
+        reportError("Unexpected end of file while reading container header");
+        return -1;
+    }
+
+    return validateContainerHeader(header);
+}
+
+/**
+ * Checks the version, flags and block size of a container header
+ * @param header Header to check
+ * @return 0 if the container can be decoded, -1 otherwise
+ */
+int validateContainerHeader(const ContainerHeader* header) {
+    if (header->version != BLOCK_FORMAT_VERSION) {
+        reportError("Unsupported container version %u", header->version);
+        return -1;
+    }
+
+    if (header->flags & ~(CONTAINER_FLAG_STREAMED | CONTAINER_FLAG_INTERLEAVED |
+                          CONTAINER_FLAG_BLOCK_TYPES | CONTAINER_FLAG_RAW_OFFSETS |
+                          CONTAINER_FLAG_CHECKSUMS)) {
+        reportError("Unsupported container flags 0x%02x", header->flags);
+        return -1;
+    }
+
+    if (header->block_size < MIN_BLOCK_SIZE || header->block_size > MAX_BLOCK_SIZE) {
+        reportError("Invalid block size %u", header->block_size);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Records the container blocks of a compressed job in the block index
+ * @param index Block index
+ * @param job Compressed block job
+ * @return 0 on success, -1 on error
+ */
+static int indexBlockParts(ContainerIndex* index, const BlockJob* job) {
+    for (size_t i = 0; i < job->parts; i++) {
+        if (appendIndexEntry(index, job->partSizes[i], job->partRawSizes[i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Writes the container blocks of one compressed job
+ * @param outputFile Output file pointer
+ * @param index Block index; records each block's offset
+ * @param job Compressed block job
+ * @return 0 on success, -1 on error
+ */
+static int writeCompressedBlock(FILE* outputFile, ContainerIndex* index, const BlockJob* job) {
+    if (indexBlockParts(index, job) != 0) {
+        return -1;
+    }
+
+    if (fwrite(job->output, 1, job->outputSize, outputFile) != job->outputSize) {
+        reportError("Failed to write compressed data");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Reads the next block header and payload of a container
+ * The payload is consumed in place from mapped inputs, and the decoded
+ * block's destination is reserved in the output sink.
+ * @param input Input source positioned at a block header
+ * @param output Output sink
+ * @param header Container header
+ * @param index Block index; records the block's offset
+ * @param job Job receiving the payload, raw size and output destination
+ * @return 1 if a block was read, 0 at the end marker, -1 on error
+ */
+static int readCompressedBlock(InputSource* input, OutputSink* output,
+                               const ContainerHeader* header, ContainerIndex* index,
+                               BlockJob* job) {
+    BlockHeader block;
+    if (fread(&block.raw_size, sizeof(uint32_t), 1, input->file) != 1 ||
+        fread(&block.payload_size, sizeof(uint32_t), 1, input->file) != 1) {
+        reportError("Compressed data is truncated");
+        return -1;
+    }
+
+    if (block.raw_size == 0) {
+        return 0;
+    }
+
+    if (block.raw_size > header->block_size ||
+        block.payload_size > blockPayloadBound(block.raw_size)) {
+        reportError("Invalid block header at offset %llu", (unsigned long long)index->offset);
+        return -1;
+    }
+
+    job->inputSize = block.payload_size;
+    job->outputSize = block.raw_size;
+    size_t bytes;
+    job->input = readInputSpan(input, job->inputBuffer, job->inputSize, &bytes);
+    if (bytes != job->inputSize) {
+        reportError("Compressed data is truncated");
+        return -1;
+    }
+    job->output = reserveOutput(output, job->outputBuffer, job->outputSize);
+    if (!job->output) {
+        return -1;
+    }
+
+    if (appendIndexEntry(index, BLOCK_HEADER_SIZE + block.payload_size, block.raw_size) != 0) {
+        return -1;
+    }
+    return 1;
+}
+
+/**
+ * Compresses all blocks in batches: read a batch, code it in parallel, write it
+ * @param input Input source
+ * @param outputFile Output file pointer
+ * @param options Compression options
+ * @param pool Thread pool
+ * @param window Blocks per batch
+ * @param index Block index
+ * @return 0 on success, -1 on error
+ */
+static int compressBlocksBatched(InputSource* input, FILE* outputFile,
+                                 const CompressOptions* options, ThreadPool* pool,
+                                 size_t window, ContainerIndex* index) {
+    uint32_t blockSize = options->blockSize;
+    ContainerWorkspace* workspace = options->workspace;
+    BlockJob* jobs = workspace
+        ? acquireWorkspaceJobs(workspace, window, blockSize, blockJobOutputBound(blockSize))
+        : createBlockJobs(window, blockSize, blockJobOutputBound(blockSize));
+    if (!jobs) {
+        return -1;
+    }
+
+    CodecStats* stats = options->stats;
+    BlockBatch batch = { jobs, options->maxCodeLength, options->streams, 1,
+                         options->splitLevel, options->contextModel, options->checksums,
+                         stats != NULL };
+    int endOfInput = 0;
+    int result = 0;
+
+    while (!endOfInput && result == 0) {
+        double mark = stats ? wallClockSeconds() : 0;
+        size_t count = 0;
+        while (count < window) {
+            size_t bytes;
+            jobs[count].input = readInputSpan(input, jobs[count].inputBuffer, blockSize, &bytes);
+            if (bytes > 0) {
+                jobs[count++].inputSize = bytes;
+            }
+            if (bytes < blockSize) {
+                endOfInput = 1;
+                break;
+            }
+        }
+
+        CHARGE_PHASE(stats, ioWaitSeconds, mark);
+
+        runParallel(pool, compressBlockTask, &batch, count);
+        if (stats) {
+            collectBlockStats(stats, jobs, count);
+            mark = wallClockSeconds();
+        }
+
+        for (size_t i = 0; i < count && result == 0; i++) {
+            if (jobs[i].result != 0 || writeCompressedBlock(outputFile, index, &jobs[i]) != 0) {
+                result = -1;
+            }
+        }
+        CHARGE_PHASE(stats, ioWaitSeconds, mark);
+    }
+
+    if (!workspace) {
+        destroyBlockJobs(jobs, window);
+    }
+    return result;
+}
+
+/**
+ * Decompresses all blocks in batches: read a batch, decode it in parallel, commit it
+ * @param input Input source positioned at the first block header
+ * @param output Output sink
+ * @param header Container header
+ * @param pool Thread pool
+ * @param window Blocks per batch
+ * @param index Block index
+ * @param decodedSize Receives the number of bytes decoded
+ * @param workspace Reused block buffers, or NULL to allocate them for this call
+ * @param stats Receives the blocks' work and the time spent reading and writing, or NULL
+ * @return 0 on success, -1 on error
+ */
+static int decompressBlocksBatched(InputSource* input, OutputSink* output,
+                                   const ContainerHeader* header, ThreadPool* pool,
+                                   size_t window, ContainerIndex* index,
+                                   uint64_t* decodedSize, ContainerWorkspace* workspace,
+                                   CodecStats* stats) {
+    size_t inputCapacity = blockPayloadBound(header->block_size);
+    BlockJob* jobs = workspace
+        ? acquireWorkspaceJobs(workspace, window, inputCapacity, header->block_size)
+        : createBlockJobs(window, inputCapacity, header->block_size);
+    if (!jobs) {
+        return -1;
+    }
+
+    int streams = (header->flags & CONTAINER_FLAG_INTERLEAVED) ? INTERLEAVED_STREAMS : 1;
+    int typed = (header->flags & CONTAINER_FLAG_BLOCK_TYPES) != 0;
+    int checksums = (header->flags & CONTAINER_FLAG_CHECKSUMS) != 0;
+    BlockBatch batch = { jobs, 0, streams, typed, 0, 0, checksums, stats != NULL };
+    int endOfBlocks = 0;
+    int result = 0;
+
+    while (!endOfBlocks && result == 0) {
+        double mark = stats ? wallClockSeconds() : 0;
+        size_t count = 0;
+        while (count < window) {
+            int status = readCompressedBlock(input, output, header, index, &jobs[count]);
+            if (status <= 0) {
+                endOfBlocks = 1;
+                result = status;
+                break;
+            }
+            count++;
+        }
+
+        if (result != 0) break;
+        CHARGE_PHASE(stats, ioWaitSeconds, mark);
+
+        runParallel(pool, decompressBlockTask, &batch, count);
+        if (stats) {
+            collectBlockStats(stats, jobs, count);
+            mark = wallClockSeconds();
+        }
+
+        for (size_t i = 0; i < count && result == 0; i++) {
+            if (jobs[i].result != 0 ||
+                commitOutput(output, jobs[i].output, jobs[i].outputSize) != 0) {
+                result = -1;
+            }
+            *decodedSize += jobs[i].outputSize;
+        }
+        CHARGE_PHASE(stats, ioWaitSeconds, mark);
+    }
+
+    if (!workspace) {
+        destroyBlockJobs(jobs, window);
+    }
+    return result;
+}
+
+/**
+ * Compresses a stream into the block container
+ * Blocks are compressed in parallel and written in order, followed by an
+ * end marker, the block index and its trailer. By default blocks move in
+ * batches; the pipelined mode overlaps reading, coding and writing.
+ * Mapped inputs are compressed in place without copying the blocks.
+ * @param input Input source; a size of STREAM_SIZE_UNKNOWN marks the container as streamed
+ * @param outputFile Output file pointer
+ * @param options Compression options
+ * @return 0 on success, -1 on error
+ */
+int compressContainer(InputSource* input, FILE* outputFile, const CompressOptions* options) {
+    ContainerWorkspace* workspace = options->workspace;
+    int threads = workspace ? workspace->threads : resolveThreadCount(options->threads);
+    size_t window = (size_t)threads * BLOCKS_PER_THREAD;
+    uint32_t blockSize = options->blockSize;
+
+    ThreadPool* pool = workspace ? workspace->pool : createThreadPool(threads);
+    if (!pool) {
+        return -1;
+    }
+    resetPoolStats(pool);
+
+    uint64_t originalSize = input->size;
+    int streamed = originalSize == STREAM_SIZE_UNKNOWN;
+    ContainerHeader header = {
+        .magic = MAGIC_BLOCKS,
+        .version = BLOCK_FORMAT_VERSION,
+        .flags = (streamed ? CONTAINER_FLAG_STREAMED : 0) |
+                 (options->streams > 1 ? CONTAINER_FLAG_INTERLEAVED : 0) |
+                 (options->checksums ? CONTAINER_FLAG_CHECKSUMS : 0) |
+                 CONTAINER_FLAG_BLOCK_TYPES | CONTAINER_FLAG_RAW_OFFSETS,
+        .reserved = 0,
+        .block_size = blockSize,
+        .original_size = streamed ? 0 : originalSize
+    };
+    writeContainerHeader(outputFile, &header);
+
+    ContainerIndex index;
+    initContainerIndex(&index);
+    int pipelined = options->pipelined || options->ioBackend == IO_BACKEND_URING;
+    int result = pipelined
+        ? compressBlocksPipelined(input, outputFile, options, pool, window, &index)
+        : compressBlocksBatched(input, outputFile, options, pool, window, &index);
+
+    if (ferror(input->file)) {
+        reportError("Failed to read input data");
+        result = -1;
+    }
+
+    if (result == 0) {
+        // End marker, then the block index and trailer
+        BlockHeader end = { 0, 0 };
+        fwrite(&end.raw_size, sizeof(uint32_t), 1, outputFile);
+        fwrite(&end.payload_size, sizeof(uint32_t), 1, outputFile);
+
+        if (index.count > 0) {
+            fwrite(index.offsets, sizeof(uint64_t), index.count, outputFile);
+            fwrite(index.rawOffsets, sizeof(uint64_t), index.count, outputFile);
+        }
+
+        IndexTrailer trailer = {
+            .index_offset = index.offset + BLOCK_HEADER_SIZE,
+            .block_count = (uint32_t)index.count,
+            .magic = MAGIC_BLOCK_INDEX
+        };
+        fwrite(&trailer.index_offset, sizeof(uint64_t), 1, outputFile);
+        fwrite(&trailer.block_count, sizeof(uint32_t), 1, outputFile);
+        fwrite(&trailer.magic, sizeof(uint32_t), 1, outputFile);
+
+        if (ferror(outputFile)) {
+            reportError("Failed to write compressed data");
+            result = -1;
+        }
+
+        if (!options->quiet) {
+            printf("Blocks: %zu (block size %u bytes, %d streams, %d threads%s)\n",
+                   index.count, blockSize, options->streams, threads,
+                   pipelined ? ", pipelined" : "");
+        }
+    }
+
+    if (options->stats) {
+        options->stats->bytesIn += index.rawOffset;
+        options->stats->bytesOut += index.offset + BLOCK_HEADER_SIZE +
+                                    index.count * 2 * sizeof(uint64_t) + INDEX_TRAILER_SIZE;
+        collectPoolStats(options->stats, pool);
+    }
+
+    destroyContainerIndex(&index);
+    if (!workspace) {
+        destroyThreadPool(pool);
+    }
+    return result;
+}
+
+/**
+ * Decompresses a block container whose magic number has already been read
+ * Blocks are decoded in parallel and written in order, in batches or
+ * pipelined as for compression; the block index is checked against the
+ * offsets seen while reading.
+ * Mapped inputs are decoded in place, and a known original size lets
+ * mapped outputs receive each block directly.
+ * @param input Input source positioned after the magic number
+ * @param output Output sink
+ * @param options Decompression options
+ * @return 0 on success, -1 on error
+ */
+int decompressContainer(InputSource* input, OutputSink* output, const DecompressOptions* options) {
+    FILE* inputFile = input->file;
+    ContainerHeader header;
+    if (readContainerHeader(inputFile, &header) != 0) {
+        return -1;
+    }
+
+    int streamed = (header.flags & CONTAINER_FLAG_STREAMED) != 0;
+    if (options->quiet) {
+        // Progress messages suppressed
+    } else if (streamed) {
+        printf("Original size: unknown (streamed)\n");
+        printf("Block size: %u bytes\n", header.block_size);
+    } else {
+        printf("Original size: %llu bytes\n", (unsigned long long)header.original_size);
+        printf("Block size: %u bytes\n", header.block_size);
+    }
+
+    if (!streamed) {
+        preallocateOutput(output, header.original_size);
+    }
+
+    ContainerWorkspace* workspace = options->workspace;
+    int threads = workspace ? workspace->threads : resolveThreadCount(options->threads);
+    size_t window = (size_t)threads * BLOCKS_PER_THREAD;
+
+    ThreadPool* pool = workspace ? workspace->pool : createThreadPool(threads);
+    if (!pool) {
+        return -1;
+    }
+    resetPoolStats(pool);
+
+    ContainerIndex index;
+    initContainerIndex(&index);
+    uint64_t decodedSize = 0;
+    int pipelined = options->pipelined || options->ioBackend == IO_BACKEND_URING;
+    int result = pipelined
+        ? decompressBlocksPipelined(input, output, &header, options, pool, window,
+                                    &index, &decodedSize)
+        : decompressBlocksBatched(input, output, &header, pool, window, &index, &decodedSize,
+                                  workspace, options->stats);
+
+    // The index must list exactly the blocks that were decoded
+    int rawOffsets = (header.flags & CONTAINER_FLAG_RAW_OFFSETS) != 0;
+    for (size_t i = 0; result == 0 && i < index.count * (rawOffsets ? 2 : 1); i++) {
+        uint64_t entry;
+        uint64_t expected = i < index.count ? index.offsets[i]
+                                            : index.rawOffsets[i - index.count];
+        if (fread(&entry, sizeof(uint64_t), 1, inputFile) != 1 || entry != expected) {
+            reportError("Block index does not match the blocks");
+            result = -1;
+        }
+    }
+
+    if (result == 0) {
+        IndexTrailer trailer;
+        if (fread(&trailer.index_offset, sizeof(uint64_t), 1, inputFile) != 1 ||
+            fread(&trailer.block_count, sizeof(uint32_t), 1, inputFile) != 1 ||
+            fread(&trailer.magic, sizeof(uint32_t), 1, inputFile) != 1 ||
+            trailer.magic != MAGIC_BLOCK_INDEX ||
+            trailer.block_count != index.count ||
+            trailer.index_offset != index.offset + BLOCK_HEADER_SIZE) {
+            reportError("Invalid block index trailer");
+            result = -1;
+        }
+    }
+
+    if (result == 0 && !streamed && decodedSize != header.original_size) {
+        reportError("Decompressed size %llu does not match original size %llu",
+                    (unsigned long long)decodedSize, (unsigned long long)header.original_size);
+        result = -1;
+    }
+
+    if (result == 0 && !options->quiet) {
+        printf("Blocks: %zu (%d threads%s)\n", index.count, threads,
+               pipelined ? ", pipelined" : "");
+    }
+
+    if (options->stats) {
+        options->stats->bytesIn += index.offset + BLOCK_HEADER_SIZE +
+                                   index.count * (rawOffsets ? 2 : 1) * sizeof(uint64_t) +
+                                   INDEX_TRAILER_SIZE;
+        options->stats->bytesOut += decodedSize;
+        collectPoolStats(options->stats, pool);
+    }
+
+    destroyContainerIndex(&index);
+    if (!workspace) {
+        destroyThreadPool(pool);
+    }
+    return result;
+}
+
+// =============================================================================
+// RANDOM ACCESS
+// =============================================================================
+
+/**
+ * Reads the header and block index of a container held in memory
+ * Containers without CONTAINER_FLAG_RAW_OFFSETS get their uncompressed
+ * offsets from the block headers. On success index->offset is the end
+ * marker's offset and index->rawOffset the decompressed size.
+ * @param data Container bytes
+ * @param size Number of bytes
+ * @param header Receives the container header
+ * @param index Receives the block index (release with destroyContainerIndex)
+ * @return 0 on success, -1 on invalid or truncated data
+ */
+int readContainerIndex(const unsigned char* data, size_t size, ContainerHeader* header,
+                       ContainerIndex* index) {
+    initContainerIndex(index);
+    if (size < CONTAINER_HEADER_SIZE + BLOCK_HEADER_SIZE + 16) {
+        reportError("Compressed data is truncated");
+        return -1;
+    }
+
+    memcpy(&header->magic, data, sizeof(uint32_t));
+    header->version = data[4];
+    header->flags = data[5];
+    memcpy(&header->reserved, data + 6, sizeof(uint16_t));
+    memcpy(&header->block_size, data + 8, sizeof(uint32_t));
+    memcpy(&header->original_size, data + 12, sizeof(uint64_t));
+    if (header->magic != MAGIC_BLOCKS) {
+        reportError("Random access needs a block container");
+        return -1;
+    }
+    if (validateContainerHeader(header) != 0) {
+        return -1;
+    }
+
+    IndexTrailer trailer;
+    const unsigned char* end = data + size - 16;
+    memcpy(&trailer.index_offset, end, sizeof(uint64_t));
+    memcpy(&trailer.block_count, end + 8, sizeof(uint32_t));
+    memcpy(&trailer.magic, end + 12, sizeof(uint32_t));
+
+    int rawOffsets = (header->flags & CONTAINER_FLAG_RAW_OFFSETS) != 0;
+    uint64_t indexSize = (uint64_t)trailer.block_count * sizeof(uint64_t) * (rawOffsets ? 2 : 1);
+    if (trailer.magic != MAGIC_BLOCK_INDEX ||
+        trailer.index_offset < CONTAINER_HEADER_SIZE + BLOCK_HEADER_SIZE ||
+        trailer.index_offset > size - 16 || size - 16 - trailer.index_offset != indexSize) {
+        reportError("Invalid block index trailer");
+        return -1;
+    }
+
+    size_t count = trailer.block_count;
+    index->offsets = (uint64_t*)malloc((count ? count : 1) * sizeof(uint64_t));
+    index->rawOffsets = (uint64_t*)malloc((count ? count : 1) * sizeof(uint64_t));
+    if (!index->offsets || !index->rawOffsets) {
+        reportError("Memory allocation failed for block index");
+        destroyContainerIndex(index);
+        return -1;
+    }
+    index->count = count;
+    index->capacity = count;
+    index->offset = trailer.index_offset - BLOCK_HEADER_SIZE;
+
+    const unsigned char* entries = data + trailer.index_offset;
+    memcpy(index->offsets, entries, count * sizeof(uint64_t));
+    if (rawOffsets) {
+        memcpy(index->rawOffsets, entries + count * sizeof(uint64_t), count * sizeof(uint64_t));
+    }
+
+    // Offsets must climb through the blocks; each block header is read to
+    // size the last block (and every block of an older container)
+    uint64_t rawOffset = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t offset = index->offsets[i];
+        uint64_t next = i + 1 < count ? index->offsets[i + 1] : index->offset;
+        if (offset < (i ? index->offsets[i - 1] + BLOCK_HEADER_SIZE : CONTAINER_HEADER_SIZE) ||
+            next < offset + BLOCK_HEADER_SIZE || next > index->offset) {
+            reportError("Block index does not match the blocks");
+            destroyContainerIndex(index);
+            return -1;
+        }
+
+        if (!rawOffsets) {
+            index->rawOffsets[i] = rawOffset;
+        } else if (index->rawOffsets[i] < rawOffset || (i == 0 && index->rawOffsets[0] != 0)) {
+            reportError("Block index does not match the blocks");
+            destroyContainerIndex(index);
+            return -1;
+        }
+
+        if (!rawOffsets || i + 1 == count) {
+            uint32_t rawSize;
+            memcpy(&rawSize, data + offset, sizeof(uint32_t));
+            rawOffset = index->rawOffsets[i] + rawSize;
+        } else {
+            rawOffset = index->rawOffsets[i];
+        }
+    }
+    index->rawOffset = rawOffset;
+    return 0;
+}
+
+/**
+ * Decodes bytes [start, start + length) of a container held in memory
+ * Only the blocks covering the range are decoded, in parallel batches;
+ * blocks entirely inside the range are decoded straight into output.
+ * @param data Container bytes
+ * @param header Container header from readContainerIndex
+ * @param index Block index from readContainerIndex
+ * @param pool Thread pool
+ * @param start First uncompressed byte
+ * @param length Number of bytes; start + length must not exceed index->rawOffset
+ * @param output Buffer receiving length bytes
+ * @param stats Receives the blocks' work and compressed bytes read, or NULL
+ * @return 0 on success, -1 on corrupted data or allocation failure
+ */
+int decodeContainerRange(const unsigned char* data, const ContainerHeader* header,
+                         const ContainerIndex* index, ThreadPool* pool, uint64_t start,
+                         size_t length, unsigned char* output, CodecStats* stats) {
+    if (length == 0) {
+        return 0;
+    }
+
+    // Last block starting at or before start
+    size_t low = 0;
+    size_t high = index->count;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (index->rawOffsets[middle] <= start) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    size_t window = (size_t)(pool->threadCount + 1) * BLOCKS_PER_THREAD;
+    BlockJob* jobs = createBlockJobs(window, 1, header->block_size);
+    if (!jobs) {
+        return -1;
+    }
+
+    int streams = (header->flags & CONTAINER_FLAG_INTERLEAVED) ? INTERLEAVED_STREAMS : 1;
+    int typed = (header->flags & CONTAINER_FLAG_BLOCK_TYPES) != 0;
+    int checksums = (header->flags & CONTAINER_FLAG_CHECKSUMS) != 0;
+    BlockBatch batch = { jobs, 0, streams, typed, 0, 0, checksums, stats != NULL };
+    uint64_t end = start + length;
+    size_t block = low;
+    int result = 0;
+
+    while (result == 0 && block < index->count && index->rawOffsets[block] < end) {
+        size_t count = 0;
+        for (; count < window && block < index->count && index->rawOffsets[block] < end;
+             count++, block++) {
+            uint64_t offset = index->offsets[block];
+            uint64_t next = block + 1 < index->count ? index->offsets[block + 1] : index->offset;
+            uint64_t rawStart = index->rawOffsets[block];
+            uint64_t rawEnd = block + 1 < index->count ? index->rawOffsets[block + 1]
+                                                       : index->rawOffset;
+            BlockHeader blockHeader;
+            memcpy(&blockHeader.raw_size, data + offset, sizeof(uint32_t));
+            memcpy(&blockHeader.payload_size, data + offset + 4, sizeof(uint32_t));
+            if (blockHeader.raw_size == 0 || blockHeader.raw_size > header->block_size ||
+                rawEnd - rawStart != blockHeader.raw_size ||
+                next - offset != BLOCK_HEADER_SIZE + (uint64_t)blockHeader.payload_size) {
+                reportError("Invalid block header at offset %llu", (unsigned long long)offset);
+                result = -1;
+                break;
+            }
+
+            BlockJob* job = &jobs[count];
+            job->input = data + offset + BLOCK_HEADER_SIZE;
+            job->inputSize = blockHeader.payload_size;
+            job->outputSize = blockHeader.raw_size;
+            job->output = rawStart >= start && rawEnd <= end
+                ? output + (rawStart - start) : job->outputBuffer;
+        }
+
+        if (result != 0) break;
+
+        runParallel(pool, decompressBlockTask, &batch, count);
+        if (stats) {
+            collectBlockStats(stats, jobs, count);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            BlockJob* job = &jobs[i];
+            if (stats) {
+                stats->bytesIn += BLOCK_HEADER_SIZE + job->inputSize;
+            }
+            if (job->result != 0) {
+                result = -1;
+                break;
+            }
+
+            // Partial blocks at either end of the range were decoded aside
+            if (job->output == job->outputBuffer) {
+                uint64_t rawStart = index->rawOffsets[block - count + i];
+                uint64_t from = start > rawStart ? start - rawStart : 0;
+                uint64_t to = end - rawStart < job->outputSize ? end - rawStart : job->outputSize;
+                memcpy(output + (rawStart + from - start), job->outputBuffer + from,
+                       (size_t)(to - from));
+            }
+        }
+    }
+
+    destroyBlockJobs(jobs, window);
+    return result;
+}
+
+/**
+ * Decompresses one byte range of a container mapped from a file
+ * @param inputFile Path to a compressed regular file
+ * @param outputFile Path to output file
+ * @param start First uncompressed byte
+ * @param length Number of bytes (clipped to the end of the data)
+ * @param options Decompression options (threads)
+ * @return 0 on success, -1 on error
+ */
+static int decompressIndexedRange(const char* inputFile, const char* outputFile,
+                                  uint64_t start, uint64_t length,
+                                  const DecompressOptions* options) {
+    if (!options->quiet) {
+        printf("\n=== RANGE DECOMPRESSION STARTED ===\n");
+        printf("Input file: %s\n", inputFile);
+        printf("Output file: %s\n", outputFile);
+    }
+
+    // The index is read in place, so the input is always mapped
+    InputSource source;
+    if (openInputSource(&source, inputFile, IO_BACKEND_MMAP) != 0) {
+        return -1;
+    }
+    if (!source.map) {
+        reportError("Range decompression needs a compressed regular file");
+        closeInputSource(&source);
+        return -1;
+    }
+    posix_madvise((void*)source.map, (size_t)source.size, POSIX_MADV_RANDOM);
+
+    ContainerHeader header;
+    ContainerIndex index;
+    if (readContainerIndex(source.map, (size_t)source.size, &header, &index) != 0) {
+        closeInputSource(&source);
+        return -1;
+    }
+
+    if (start > index.rawOffset) {
+        reportError("Range starts at %llu, past the end of the data (%llu bytes)",
+                    (unsigned long long)start, (unsigned long long)index.rawOffset);
+        destroyContainerIndex(&index);
+        closeInputSource(&source);
+        return -1;
+    }
+    if (length > index.rawOffset - start) {
+        length = index.rawOffset - start;
+    }
+    if (!options->quiet) {
+        printf("Range: %llu bytes at offset %llu of %llu\n", (unsigned long long)length,
+               (unsigned long long)start, (unsigned long long)index.rawOffset);
+    }
+
+    int threads = resolveThreadCount(options->threads);
+    ThreadPool* pool = createThreadPool(threads);
+    OutputSink sink;
+    if (!pool || openOutputSink(&sink, outputFile, options->ioBackend) != 0) {
+        destroyThreadPool(pool);
+        destroyContainerIndex(&index);
+        closeInputSource(&source);
+        return -1;
+    }
+    preallocateOutput(&sink, length);
+
+    size_t piece = (size_t)threads * BLOCKS_PER_THREAD * header.block_size;
+    unsigned char* buffer = sink.map ? NULL : (unsigned char*)malloc(piece);
+    int result = sink.map || buffer ? 0 : -1;
+    if (result != 0) {
+        reportError("Memory allocation failed for output buffer");
+    }
+
+    for (uint64_t done = 0; result == 0 && done < length; ) {
+        size_t count = length - done < piece ? (size_t)(length - done) : piece;
+        unsigned char* destination = reserveOutput(&sink, buffer, count);
+        if (!destination ||
+            decodeContainerRange(source.map, &header, &index, pool, start + done, count,
+                                 destination, options->stats) != 0 ||
+            commitOutput(&sink, destination, count) != 0) {
+            result = -1;
+        }
+        done += count;
+    }
+
+    free(buffer);
+    if (closeOutputSink(&sink) != 0) {
+        result = -1;
+    }
+    if (options->stats) {
+        options->stats->bytesOut += result == 0 ? length : 0;
+        collectPoolStats(options->stats, pool);
+    }
+    destroyThreadPool(pool);
+    destroyContainerIndex(&index);
+    closeInputSource(&source);
+
+    if (result != 0) {
+        return -1;
+    }
+    if (!options->quiet) {
+        printf("=== RANGE DECOMPRESSION COMPLETED ===\n");
+    }
+    return 0;
+}
+
+/**
+ * Decompresses one byte range of a block container
+ * The block index locates the blocks covering the range, so only they are
+ * read and decoded; the range is written in pieces of a few blocks.
+ * @param inputFile Path to a compressed regular file
+ * @param outputFile Path to output file
+ * @param start First uncompressed byte
+ * @param length Number of bytes (clipped to the end of the data)
+ * @param options Decompression options (threads, stats, atomicOutput)
+ * @return 0 on success, -1 on error
+ */
+int decompressFileRange(const char* inputFile, const char* outputFile, uint64_t start,
+                        uint64_t length, const DecompressOptions* options) {
+    beginCodecStats(options->stats);
+    char* temporary = options->atomicOutput ? createTemporaryOutput(outputFile) : NULL;
+    int result = decompressIndexedRange(inputFile, temporary ? temporary : outputFile, start,
+                                        length, options);
+    result = finishTemporaryOutput(temporary, outputFile, result);
+    endCodecStats(options->stats);
+    return result;
+}
+
+// =============================================================================
+// BLOCK PIPELINE
+// =============================================================================
+
+/**
+ * Allocates a pipeline ring of PIPELINE_DEPTH batches
+ * @param pipeline Pipeline to initialize
+ * @param window Blocks coded per batch
+ * @param inputCapacity Input buffer size per block
+ * @param outputCapacity Output buffer size per block
+ * @return 0 on success, -1 on error
+ */
+static int initPipeline(BlockPipeline* pipeline, size_t window, size_t inputCapacity,
+                        size_t outputCapacity) {
+    memset(pipeline, 0, sizeof(BlockPipeline));
+    pipeline->window = window;
+    pipeline->capacity = window * PIPELINE_DEPTH;
+    pipeline->jobs = createBlockJobs(pipeline->capacity, inputCapacity, outputCapacity);
+    if (!pipeline->jobs) {
+        return -1;
+    }
+
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->changed, NULL);
+    return 0;
+}
+
+/**
+ * Frees a pipeline's ring
+ * @param pipeline Pipeline whose stages have all stopped
+ */
+static void destroyPipeline(BlockPipeline* pipeline) {
+    pthread_cond_destroy(&pipeline->changed);
+    pthread_mutex_destroy(&pipeline->lock);
+    destroyBlockJobs(pipeline->jobs, pipeline->capacity);
+}
+
+/**
+ * Publishes a stage's progress (or a failure) and wakes the other stages
+ * @param pipeline Pipeline
+ * @param counter Counter owned by the calling stage, or NULL
+ * @param value New counter value
+ * @param failed Non-zero to stop the pipeline
+ */
+static void advancePipeline(BlockPipeline* pipeline, size_t* counter, size_t value, int failed) {
+    pthread_mutex_lock(&pipeline->lock);
+    if (counter) *counter = value;
+    if (failed) pipeline->failed = 1;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+/**
+ * Reader stage: waits until the ring has a free slot
+ * @param pipeline Pipeline
+ * @param slots Slots the reader wants to have claimed (filled plus in flight, plus one)
+ * @return 0 when a slot is free, -1 once the pipeline has failed
+ */
+static int waitForFreeSlot(BlockPipeline* pipeline, size_t slots) {
+    pthread_mutex_lock(&pipeline->lock);
+    while (!pipeline->failed && slots > pipeline->drained + pipeline->capacity) {
+        pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+    }
+    int failed = pipeline->failed;
+    pthread_mutex_unlock(&pipeline->lock);
+    return failed ? -1 : 0;
+}
+
+/**
+ * Writer stage: waits for coded blocks beyond 'next'
+ * @param pipeline Pipeline
+ * @param next Number of blocks the writer has taken so far
+ * @param block Whether to sleep until something changes
+ * @return Blocks coded so far, or 0 once the pipeline failed or completed
+ */
+static size_t waitForCodedBlocks(BlockPipeline* pipeline, size_t next, int block) {
+    pthread_mutex_lock(&pipeline->lock);
+    while (block && !pipeline->failed && pipeline->coded == next &&
+           !(pipeline->endOfInput && pipeline->filled == next)) {
+        pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+    }
+    size_t coded = pipeline->failed ? 0 : pipeline->coded;
+    pthread_mutex_unlock(&pipeline->lock);
+    return coded;
+}
+
+/**
+ * Coder stage, run on the calling thread: codes ready blocks on the pool
+ * Each round takes every filled block up to one window (without wrapping
+ * around the ring) so the pool stays busy while the other stages do I/O.
+ * With statistics, time spent waiting for the reader counts as I/O wait.
+ * @param pipeline Pipeline
+ * @param pool Thread pool
+ * @param task compressBlockTask or decompressBlockTask
+ * @param batch Batch parameters; its jobs pointer is set per round
+ */
+static void runPipelineCoders(BlockPipeline* pipeline, ThreadPool* pool, TaskFunction task,
+                              BlockBatch* batch) {
+    CodecStats* stats = pipeline->stats;
+    pthread_mutex_lock(&pipeline->lock);
+    while (1) {
+        double mark = stats ? wallClockSeconds() : 0;
+        while (!pipeline->failed && pipeline->filled == pipeline->coded &&
+               !pipeline->endOfInput) {
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        }
+        CHARGE_PHASE(stats, ioWaitSeconds, mark);
+        if (pipeline->failed || pipeline->filled == pipeline->coded) break;
+
+        size_t start = pipeline->coded % pipeline->capacity;
+        size_t count = pipeline->filled - pipeline->coded;
+        if (count > pipeline->window) count = pipeline->window;
+        if (count > pipeline->capacity - start) count = pipeline->capacity - start;
+        pthread_mutex_unlock(&pipeline->lock);
+
+        batch->jobs = &pipeline->jobs[start];
+        runParallel(pool, task, batch, count);
+        if (stats) {
+            collectBlockStats(stats, batch->jobs, count);
+        }
+
+        int failed = 0;
+        for (size_t i = 0; i < count; i++) {
+            failed |= batch->jobs[i].result != 0;
+        }
+
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->coded += count;
+        if (failed) pipeline->failed = 1;
+        pthread_cond_broadcast(&pipeline->changed);
+    }
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+/**
+ * Checks whether a descriptor takes positioned writes and reads
+ * @param fd File descriptor
+ * @param writing Non-zero for an output descriptor
+ * @return 1 for regular files (not opened for appending), 0 otherwise
+ */
+static int positionedIoAllowed(int fd, int writing) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        return 0;
+    }
+    int flags = fcntl(fd, F_GETFL);
+    return !(writing && (flags < 0 || (flags & O_APPEND)));
+}
+
+/**
+ * Finishes a short positioned transfer synchronously
+ * @param fd File descriptor
+ * @param buffer Whole transfer buffer
+ * @param size Whole transfer size
+ * @param offset File offset of the transfer
+ * @param done Bytes already transferred
+ * @param writing Non-zero for a write
+ * @return 0 on success, -1 on error or unexpected end of file
+ */
+static int completeTransfer(int fd, unsigned char* buffer, size_t size, uint64_t offset,
+                            size_t done, int writing) {
+    while (done < size) {
+        ssize_t count = writing
+            ? pwrite(fd, buffer + done, size - done, (off_t)(offset + done))
+            : pread(fd, buffer + done, size - done, (off_t)(offset + done));
+        if (count <= 0) {
+            reportError("Failed to %s data", writing ? "write" : "read");
+            return -1;
+        }
+        done += (size_t)count;
+    }
+    return 0;
+}
+
+/**
+ * Compression reader on io_uring: keeps a read in flight for every free slot
+ * Reads complete in any order but are handed to the coders in order.
+ * @param pipeline Pipeline over a regular, unmapped input file
+ * @param ring Ring with at least capacity entries
+ * @return 0 on success, -1 on error
+ */
+static int readBlocksWithRing(BlockPipeline* pipeline, IoRing* ring) {
+    InputSource* input = pipeline->input;
+    int fd = fileno(input->file);
+    uint64_t start = (uint64_t)ftello(input->file);
+    uint64_t remaining = input->size > start ? input->size - start : 0;
+    size_t total = (size_t)((remaining + pipeline->blockSize - 1) / pipeline->blockSize);
+
+    uint8_t* done = (uint8_t*)calloc(pipeline->capacity, 1);
+    if (!done) {
+        reportError("Memory allocation failed for read tracking");
+        return -1;
+    }
+
+    size_t submitted = 0;
+    size_t filled = 0;
+    size_t inFlight = 0;
+    int result = 0;
+
+    while (filled < total && result == 0) {
+        // One read per free slot
+        pthread_mutex_lock(&pipeline->lock);
+        size_t limit = pipeline->drained + pipeline->capacity;
+        result = pipeline->failed ? -1 : 0;
+        pthread_mutex_unlock(&pipeline->lock);
+        if (result != 0) break;
+
+        while (submitted < total && submitted < limit) {
+            BlockJob* job = &pipeline->jobs[submitted % pipeline->capacity];
+            uint64_t offset = start + (uint64_t)submitted * pipeline->blockSize;
+            job->input = job->inputBuffer;
+            job->inputSize = input->size - offset < pipeline->blockSize
+                ? (size_t)(input->size - offset) : pipeline->blockSize;
+            if (submitRingRead(ring, fd, job->inputBuffer, job->inputSize, offset,
+                               submitted) != 0) {
+                result = -1;
+                break;
+            }
+            submitted++;
+            inFlight++;
+        }
+        if (result != 0) break;
+
+        if (inFlight == 0) {
+            result = waitForFreeSlot(pipeline, submitted + 1);
+            continue;
+        }
+
+        uint64_t tag;
+        int64_t bytes;
+        if (waitRingCompletion(ring, &tag, &bytes) != 0) {
+            result = -1;
+            break;
+        }
+        inFlight--;
+
+        BlockJob* job = &pipeline->jobs[tag % pipeline->capacity];
+        if (bytes < 0 ||
+            completeTransfer(fd, job->inputBuffer, job->inputSize,
+                             start + tag * pipeline->blockSize, (size_t)bytes, 0) != 0) {
+            if (bytes < 0) reportError("Failed to read input data");
+            result = -1;
+            break;
+        }
+        done[tag % pipeline->capacity] = 1;
+
+        // Hand over the completed prefix
+        size_t ready = filled;
+        while (ready < submitted && done[ready % pipeline->capacity]) {
+            done[ready++ % pipeline->capacity] = 0;
+        }
+        if (ready != filled) {
+            filled = ready;
+            advancePipeline(pipeline, &pipeline->filled, filled, 0);
+        }
+    }
+
+    // Buffers must outlive every read the kernel still owns
+    while (inFlight > 0) {
+        uint64_t tag;
+        int64_t bytes;
+        if (waitRingCompletion(ring, &tag, &bytes) != 0) break;
+        inFlight--;
+    }
+
+    free(done);
+    fseeko(input->file, (off_t)(start + remaining), SEEK_SET);
+    return result;
+}
+
+/**
+ * Compression reader stage
+ * @param context BlockPipeline
+ * @return NULL
+ */
+static void* compressReaderThread(void* context) {
+    BlockPipeline* pipeline = (BlockPipeline*)context;
+    InputSource* input = pipeline->input;
+    int result = 0;
+
+    IoRing* ring = NULL;
+    if (pipeline->ioBackend == IO_BACKEND_URING && input->size != STREAM_SIZE_UNKNOWN &&
+        !input->map && positionedIoAllowed(fileno(input->file), 0)) {
+        ring = createIoRing((unsigned)pipeline->capacity);
+    }
+
+    if (ring) {
+        result = readBlocksWithRing(pipeline, ring);
+        destroyIoRing(ring);
+    } else {
+        size_t filled = 0;
+        while (result == 0) {
+            result = waitForFreeSlot(pipeline, filled + 1);
+            if (result != 0) break;
+
+            BlockJob* job = &pipeline->jobs[filled % pipeline->capacity];
+            size_t bytes;
+            job->input = readInputSpan(input, job->inputBuffer, pipeline->blockSize, &bytes);
+            job->inputSize = bytes;
+            if (ferror(input->file)) {
+                reportError("Failed to read input data");
+                result = -1;
+                break;
+            }
+
+            if (bytes > 0) {
+                advancePipeline(pipeline, &pipeline->filled, ++filled, 0);
+            }
+            if (bytes < pipeline->blockSize) break;
+        }
+    }
+
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->endOfInput = 1;
+    if (result != 0) pipeline->failed = 1;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+/**
+ * Decompression reader stage: parses block headers and claims payloads
+ * @param context BlockPipeline
+ * @return NULL
+ */
+static void* decompressReaderThread(void* context) {
+    BlockPipeline* pipeline = (BlockPipeline*)context;
+    size_t filled = 0;
+    int result = 0;
+
+    while (result == 0) {
+        result = waitForFreeSlot(pipeline, filled + 1);
+        if (result != 0) break;
+
+        BlockJob* job = &pipeline->jobs[filled % pipeline->capacity];
+        int status = readCompressedBlock(pipeline->input, pipeline->sink, pipeline->header,
+                                         pipeline->index, job);
+        if (status <= 0) {
+            result = status;
+            break;
+        }
+        advancePipeline(pipeline, &pipeline->filled, ++filled, 0);
+    }
+
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->endOfInput = 1;
+    if (result != 0) pipeline->failed = 1;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+/**
+ * Writer on io_uring: submits every coded job's output at its final offset
+ * Slots are released in order once their writes have completed.
+ * @param pipeline Pipeline over a regular output file
+ * @param ring Ring with at least capacity entries
+ * @param fd Output file descriptor
+ * @param base File offset of the first block
+ * @return 0 on success, -1 on error
+ */
+static int writeBlocksWithRing(BlockPipeline* pipeline, IoRing* ring, int fd, uint64_t base) {
+    uint8_t* pending = (uint8_t*)calloc(pipeline->capacity, 1);
+    uint64_t* offsets = (uint64_t*)calloc(pipeline->capacity, sizeof(uint64_t));
+    if (!pending || !offsets) {
+        reportError("Memory allocation failed for write tracking");
+        free(pending);
+        free(offsets);
+        return -1;
+    }
+
+    uint64_t position = base;
+    size_t submitted = 0;
+    size_t drained = 0;
+    size_t inFlight = 0;
+    int result = 0;
+
+    while (result == 0) {
+        size_t coded = waitForCodedBlocks(pipeline, submitted, inFlight == 0);
+        if (coded == 0 || (coded == submitted && inFlight == 0)) {
+            pthread_mutex_lock(&pipeline->lock);
+            result = pipeline->failed ? -1 : 0;
+            pthread_mutex_unlock(&pipeline->lock);
+            if (result != 0 || coded == submitted) break;
+        }
+
+        for (; submitted < coded && result == 0; submitted++) {
+            size_t slot = submitted % pipeline->capacity;
+            BlockJob* job = &pipeline->jobs[slot];
+            offsets[slot] = position;
+
+            if (pipeline->sink) {
+                pipeline->decodedSize += job->outputSize;
+            } else if (indexBlockParts(pipeline->index, job) != 0) {
+                result = -1;
+                break;
+            }
+
+            result = submitRingWrite(ring, fd, job->output, job->outputSize, position, submitted);
+            position += job->outputSize;
+            pending[slot] = 1;
+            inFlight++;
+        }
+        if (result != 0 || inFlight == 0) continue;
+
+        uint64_t tag;
+        int64_t bytes;
+        if (waitRingCompletion(ring, &tag, &bytes) != 0) {
+            result = -1;
+            break;
+        }
+        inFlight--;
+
+        size_t slot = (size_t)tag % pipeline->capacity;
+        BlockJob* job = &pipeline->jobs[slot];
+        if (bytes < 0 || completeTransfer(fd, job->output, job->outputSize, offsets[slot],
+                                          (size_t)bytes, 1) != 0) {
+            if (bytes < 0) reportError("Failed to write output data");
+            result = -1;
+            break;
+        }
+        pending[slot] = 0;
+
+        size_t released = drained;
+        while (released < submitted && pending[released % pipeline->capacity] == 0) {
+            released++;
+        }
+        if (released != drained) {
+            drained = released;
+            advancePipeline(pipeline, &pipeline->drained, drained, 0);
+        }
+    }
+
+    while (inFlight > 0) {
+        uint64_t tag;
+        int64_t bytes;
+        if (waitRingCompletion(ring, &tag, &bytes) != 0) break;
+        inFlight--;
+    }
+
+    free(pending);
+    free(offsets);
+    return result;
+}
+
+/**
+ * Writer stage for both directions, in block order
+ * @param context BlockPipeline
+ * @return NULL
+ */
+static void* writerThread(void* context) {
+    BlockPipeline* pipeline = (BlockPipeline*)context;
+    FILE* file = pipeline->sink ? pipeline->sink->file : pipeline->outputFile;
+    int result = 0;
+
+    IoRing* ring = NULL;
+    if (pipeline->ioBackend == IO_BACKEND_URING && !(pipeline->sink && pipeline->sink->map) &&
+        positionedIoAllowed(fileno(file), 1)) {
+        ring = createIoRing((unsigned)pipeline->capacity);
+    }
+
+    if (ring) {
+        fflush(file);
+        uint64_t base = (uint64_t)ftello(file);
+        // When decompressing, the index belongs to the reader
+        uint64_t start = pipeline->sink ? pipeline->decodedSize : pipeline->index->offset;
+
+        result = writeBlocksWithRing(pipeline, ring, fileno(file), base);
+        destroyIoRing(ring);
+
+        uint64_t written = (pipeline->sink ? pipeline->decodedSize
+                                           : pipeline->index->offset) - start;
+        fseeko(file, (off_t)(base + written), SEEK_SET);
+        if (pipeline->sink) pipeline->sink->position += written;
+    } else {
+        size_t drained = 0;
+        while (result == 0) {
+            size_t coded = waitForCodedBlocks(pipeline, drained, 1);
+            if (coded <= drained) break;
+
+            for (; drained < coded && result == 0; drained++) {
+                BlockJob* job = &pipeline->jobs[drained % pipeline->capacity];
+                if (pipeline->sink) {
+                    result = commitOutput(pipeline->sink, job->output, job->outputSize);
+                    pipeline->decodedSize += job->outputSize;
+                } else {
+                    result = writeCompressedBlock(pipeline->outputFile, pipeline->index, job);
+                }
+            }
+            advancePipeline(pipeline, &pipeline->drained, drained, result != 0);
+        }
+
+        pthread_mutex_lock(&pipeline->lock);
+        if (pipeline->failed) result = -1;
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+
+    advancePipeline(pipeline, NULL, 0, result != 0);
+    return NULL;
+}
+
+/**
+ * Runs a pipeline: reader and writer threads around the coders on this thread
+ * @param pipeline Initialized pipeline
+ * @param reader Reader stage
+ * @param pool Thread pool for the coders
+ * @param task Coder task
+ * @param batch Batch parameters
+ * @return 0 on success, -1 on error
+ */
+static int runPipeline(BlockPipeline* pipeline, void* (*reader)(void*), ThreadPool* pool,
+                       TaskFunction task, BlockBatch* batch) {
+    pthread_t readerThread;
+    pthread_t writer;
+    if (pthread_create(&readerThread, NULL, reader, pipeline) != 0) {
+        reportError("Failed to start pipeline reader");
+        return -1;
+    }
+    if (pthread_create(&writer, NULL, writerThread, pipeline) != 0) {
+        reportError("Failed to start pipeline writer");
+        advancePipeline(pipeline, NULL, 0, 1);
+        pthread_join(readerThread, NULL);
+        return -1;
+    }
+
+    runPipelineCoders(pipeline, pool, task, batch);
+
+    pthread_join(readerThread, NULL);
+    pthread_join(writer, NULL);
+    return pipeline->failed ? -1 : 0;
+}
+
+/**
+ * Compresses all blocks with overlapped reading, coding and writing
+ * @param input Input source
+ * @param outputFile Output file pointer
+ * @param options Compression options
+ * @param pool Thread pool
+ * @param window Blocks per coding round
+ * @param index Block index
+ * @return 0 on success, -1 on error
+ */
+int compressBlocksPipelined(InputSource* input, FILE* outputFile, const CompressOptions* options,
+                            ThreadPool* pool, size_t window, ContainerIndex* index) {
+    BlockPipeline pipeline;
+    if (initPipeline(&pipeline, window, options->blockSize,
+                     blockJobOutputBound(options->blockSize)) != 0) {
+        return -1;
+    }
+
+    pipeline.input = input;
+    pipeline.outputFile = outputFile;
+    pipeline.ioBackend = options->ioBackend;
+    pipeline.blockSize = options->blockSize;
+    pipeline.index = index;
+    pipeline.stats = options->stats;
+
+    BlockBatch batch = { NULL, options->maxCodeLength, options->streams, 1,
+                         options->splitLevel, options->contextModel, options->checksums,
+                         options->stats != NULL };
+    int result = runPipeline(&pipeline, compressReaderThread, pool, compressBlockTask, &batch);
+
+    destroyPipeline(&pipeline);
+    return result;
+}
+
+/**
+ * Decompresses all blocks with overlapped reading, decoding and writing
+ * @param input Input source positioned at the first block header
+ * @param output Output sink
+ * @param header Container header
+ * @param options Decompression options
+ * @param pool Thread pool
+ * @param window Blocks per decoding round
+ * @param index Block index
+ * @param decodedSize Receives the number of bytes decoded
+ * @return 0 on success, -1 on error
+ */
+int decompressBlocksPipelined(InputSource* input, OutputSink* output,
+                              const ContainerHeader* header, const DecompressOptions* options,
+                              ThreadPool* pool, size_t window, ContainerIndex* index,
+                              uint64_t* decodedSize) {
+    BlockPipeline pipeline;
+    if (initPipeline(&pipeline, window, blockPayloadBound(header->block_size),
+                     header->block_size) != 0) {
+        return -1;
+    }
+
+    pipeline.input = input;
+    pipeline.sink = output;
+    pipeline.header = header;
+    pipeline.ioBackend = options->ioBackend;
+    pipeline.index = index;
+    pipeline.stats = options->stats;
+
+    int streams = (header->flags & CONTAINER_FLAG_INTERLEAVED) ? INTERLEAVED_STREAMS : 1;
+    int typed = (header->flags & CONTAINER_FLAG_BLOCK_TYPES) != 0;
+    int checksums = (header->flags & CONTAINER_FLAG_CHECKSUMS) != 0;
+    BlockBatch batch = { NULL, 0, streams, typed, 0, 0, checksums, options->stats != NULL };
+    int result = runPipeline(&pipeline, decompressReaderThread, pool, decompressBlockTask,
+                             &batch);
+
+    *decodedSize = pipeline.decodedSize;
+    destroyPipeline(&pipeline);
+    return result;
+}
+
+// =============================================================================
+// INPUT SOURCES AND OUTPUT SINKS
+// =============================================================================
+
+/**
+ * Opens an input source
+ * With IO_BACKEND_MMAP a regular file is also mapped read-only so bulk
+ * data can be consumed in place; pipes and stdin always use stdio.
+ * @param source Source to initialize
+ * @param path File path, or "-" for stdin
+ * @param backend Requested I/O backend
+ * @return 0 on success, -1 on error
+ */
+int openInputSource(InputSource* source, const char* path, IoBackend backend) {
+    memset(source, 0, sizeof(InputSource));
+    source->size = STREAM_SIZE_UNKNOWN;
+
+    source->file = openInputStream(path);
+    if (!source->file) {
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fileno(source->file), &info) != 0 || !S_ISREG(info.st_mode)) {
+        return 0;
+    }
+    source->size = (uint64_t)info.st_size;
+
+    // Empty files cannot be mapped and need no data access anyway
+    if ((backend != IO_BACKEND_MMAP && backend != IO_BACKEND_DIRECT) || info.st_size == 0 ||
+        (uint64_t)info.st_size > (uint64_t)SIZE_MAX) {
+        return 0;
+    }
+
+    void* map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE,
+                     fileno(source->file), 0);
+    if (map == MAP_FAILED) {
+        return 0;  // Fall back to stdio
+    }
+
+    posix_madvise(map, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL);
+    source->map = (const unsigned char*)map;
+    return 0;
+}
+
+/**
+ * Reads up to size bytes of bulk data
+ * Mapped sources return a pointer into the mapping and leave buffer
+ * untouched; stdio sources fill buffer. The source's FILE position
+ * advances either way, so header reads through source->file can follow.
+ * @param source Input source
+ * @param buffer Buffer of at least size bytes (used by the stdio backend)
+ * @param size Maximum number of bytes
+ * @param count Receives the number of bytes available (short only at end of input)
+ * @return Pointer to the data
+ */
+const unsigned char* readInputSpan(InputSource* source, unsigned char* buffer,
+                                   size_t size, size_t* count) {
+    if (!source->map) {
+        *count = fread(buffer, 1, size, source->file);
+        return buffer;
+    }
+
+    off_t position = ftello(source->file);
+    uint64_t available = position >= 0 && (uint64_t)position < source->size
+        ? source->size - (uint64_t)position : 0;
+    *count = available < size ? (size_t)available : size;
+
+    fseeko(source->file, position + (off_t)*count, SEEK_SET);
+    return source->map + position;
+}
+
+/**
+ * Rewinds an input source for a second pass
+ * @param source Input source
+ * @return 0 on success, -1 if the input cannot be rewound
+ */
+int rewindInputSource(InputSource* source) {
+    return fseeko(source->file, 0, SEEK_SET) == 0 ? 0 : -1;
+}
+
+/**
+ * Closes an input source and releases its mapping
+ * @param source Input source
+ */
+void closeInputSource(InputSource* source) {
+    if (source->map) {
+        munmap((void*)source->map, (size_t)source->size);
+        source->map = NULL;
+    }
+    if (source->file) {
+        closeStream(source->file);
+        source->file = NULL;
+    }
+}
+
+/**
+ * Opens an output sink
+ * With IO_BACKEND_MMAP a regular output file may later be preallocated
+ * and mapped by preallocateOutput once the decoded size is known.
+ * IO_BACKEND_DIRECT writes regular files with O_DIRECT instead, where the
+ * file system supports it. With either, pipes and stream sockets (such as
+ * standard output) are fed with vmsplice from the sink's own buffers.
+ * @param sink Sink to initialize
+ * @param path File path, or "-" for stdout
+ * @param backend Requested I/O backend
+ * @return 0 on success, -1 on error
+ */
+int openOutputSink(OutputSink* sink, const char* path, IoBackend backend) {
+    memset(sink, 0, sizeof(OutputSink));
+    int zeroCopy = backend == IO_BACKEND_MMAP || backend == IO_BACKEND_DIRECT;
+
+    if (!zeroCopy || isStdioPath(path)) {
+        sink->file = openOutputStream(path);
+        if (sink->file && zeroCopy) {
+            fflush(sink->file);  // The splice path writes the descriptor directly
+            sink->splice = createSpliceOutput(fileno(sink->file));
+        }
+        return sink->file ? 0 : -1;
+    }
+
+    // Mapping needs read-write access to the file
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    sink->file = fd >= 0 ? fdopen(fd, "w+b") : NULL;
+    if (!sink->file) {
+        reportError("Cannot create output file '%s'", path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && !S_ISREG(info.st_mode)) {
+        sink->splice = createSpliceOutput(fd);  // Named pipe or socket
+    } else if (backend == IO_BACKEND_DIRECT) {
+        sink->direct = createDirectOutput(path, fd);  // NULL: written through stdio
+    } else {
+        sink->mappable = 1;
+    }
+    return 0;
+}
+
+/**
+ * Opens a sink that decodes straight into a caller's buffer
+ * Reservations point into the buffer, so committing them copies nothing;
+ * bytes reserved elsewhere are copied in when committed.
+ * @param sink Sink to initialize (closeOutputSink leaves the buffer alone)
+ * @param buffer Destination buffer
+ * @param capacity Buffer size in bytes
+ */
+void openBufferSink(OutputSink* sink, unsigned char* buffer, size_t capacity) {
+    memset(sink, 0, sizeof(OutputSink));
+    sink->map = buffer;
+    sink->mapSize = capacity;
+    sink->borrowed = 1;
+}
+
+/**
+ * Preallocates and maps the output when its final size is known
+ * Does nothing for stdio sinks; on failure the sink keeps using stdio.
+ * @param sink Output sink with nothing written yet
+ * @param size Final output size in bytes
+ */
+void preallocateOutput(OutputSink* sink, uint64_t size) {
+    if (sink->direct && size > 0) {
+        posix_fallocate(fileno(sink->file), 0, (off_t)size);  // Best effort, trimmed on close
+        return;
+    }
+    if (!sink->mappable || sink->map || size == 0 || size > (uint64_t)SIZE_MAX) {
+        return;
+    }
+
+    int fd = fileno(sink->file);
+    if (ftruncate(fd, (off_t)size) != 0) {
+        return;
+    }
+#ifdef __linux__
+    posix_fallocate(fd, 0, (off_t)size);  // Best effort: reserve blocks up front
+#endif
+
+    void* map = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        ftruncate(fd, 0);
+        return;
+    }
+
+    posix_madvise(map, (size_t)size, POSIX_MADV_SEQUENTIAL);
+    sink->map = (unsigned char*)map;
+    sink->mapSize = size;
+}
+
+/**
+ * Reserves space for the next size bytes of output
+ * Reservations are handed out in order; mapped and buffer sinks return the
+ * destination in the mapping, splice and O_DIRECT sinks one of their own
+ * buffers while they have one free, stdio sinks return buffer.
+ * @param sink Output sink
+ * @param buffer Buffer of at least size bytes (used by the stdio backend)
+ * @param size Number of bytes
+ * @return Destination for the bytes, or NULL if they exceed the preallocated size
  */
-void decodeAndWrite(FILE* inputFile, FILE* outputFile, HuffmanNode* root, 
-                   unsigned int originalSize, int paddingBits) {
-    if (!root) return;
+unsigned char* reserveOutput(OutputSink* sink, unsigned char* buffer, size_t size) {
+    if (sink->splice || sink->direct) {
+        unsigned char* destination = sink->splice ? reserveSpliceOutput(sink->splice, size)
+                                                  : reserveDirectOutput(sink->direct, size);
+        return destination ? destination : buffer;
+    }
+    if (!sink->map) {
+        return buffer;
+    }
 
-    HuffmanNode* currentNode = root;
-    unsigned char currentByte = 0;
-    int bitPosition = 0;
-    int decodedBytes = 0;
+    if (size > sink->mapSize - sink->reserved) {
+        reportError("Output exceeds its preallocated size");
+        return NULL;
+    }
 
-    while (decodedBytes < originalSize) {
-        int bit = readBit(inputFile, &currentByte, &bitPosition);
-        if (bit == -1) break;
+    unsigned char* destination = sink->map + sink->reserved;
+    sink->reserved += size;
+    return destination;
+}
 
-        // Navigate tree based on bit
-        if (bit == 0) {
-            currentNode = currentNode->left;
-        } else {
-            currentNode = currentNode->right;
+/**
+ * Commits reserved output in order
+ * @param sink Output sink
+ * @param data Data returned by reserveOutput (buffer sinks also take other bytes)
+ * @param size Number of bytes
+ * @return 0 on success, -1 on write error
+ */
+int commitOutput(OutputSink* sink, const unsigned char* data, size_t size) {
+    if (sink->splice || sink->direct) {
+        int result = sink->splice ? writeSpliceOutput(sink->splice, data, size)
+                                  : writeDirectOutput(sink->direct, data, size);
+        if (result != 0) {
+            reportError("Failed to write decompressed data");
+            return -1;
+        }
+        sink->position += size;
+        return 0;
+    }
+    if (sink->borrowed) {
+        if (size > sink->mapSize - sink->position) {
+            reportError("Output exceeds its buffer");
+            return -1;
+        }
+        if (data != sink->map + sink->position) {
+            memmove(sink->map + sink->position, data, size);
         }
+        sink->position += size;
+        if (sink->reserved < sink->position) sink->reserved = sink->position;
+        return 0;
+    }
+    if (sink->map) {
+        sink->position += size;
+        return 0;
+    }
 
-        // Check if we reached a leaf node
-        if (!currentNode->left && !currentNode->right) {
-            fputc(currentNode->character, outputFile);
-            decodedBytes++;
-            currentNode = root; // Reset to root for next character
+    if (fwrite(data, 1, size, sink->file) != size) {
+        reportError("Failed to write decompressed data");
+        return -1;
+    }
+    sink->position += size;
+    return 0;
+}
+
+/**
+ * Closes an output sink
+ * A mapped file is trimmed to the bytes actually committed.
+ * @param sink Output sink
+ * @return 0 on success, -1 on error
+ */
+int closeOutputSink(OutputSink* sink) {
+    int result = 0;
+
+    if (sink->borrowed) {
+        return 0;
+    }
+    destroySpliceOutput(sink->splice);
+    sink->splice = NULL;
+    if (sink->direct) {
+        if (destroyDirectOutput(sink->direct) != 0 ||
+            ftruncate(fileno(sink->file), (off_t)sink->position) != 0) {
+            result = -1;
         }
+        sink->direct = NULL;
+    }
 
-        if (!currentNode) {
-            fprintf(stderr, "Error: Invalid bit sequence encountered during decoding\n");
-            break;
+    if (sink->map) {
+        if (munmap(sink->map, (size_t)sink->mapSize) != 0) {
+            result = -1;
+        }
+        if (sink->position < sink->mapSize &&
+            ftruncate(fileno(sink->file), (off_t)sink->position) != 0) {
+            result = -1;
         }
+        sink->map = NULL;
     }
+
+    if (sink->file && closeStream(sink->file) != 0) {
+        result = -1;
+    }
+    sink->file = NULL;
+    return result;
 }
 
 /**
- * Decompresses a Huffman-encoded file
- * @param inputFile Path to compressed file
- * @param outputFile Path to output file
- * @return 0 on success, -1 on error
+ * Creates an empty temporary file next to an output file
+ * The temporary shares the output's directory so finishTemporaryOutput can
+ * rename it into place, and takes over the mode of an existing output.
+ * Standard output, devices and pipes are written in place.
+ * @param path Output path
+ * @return Allocated temporary path, or NULL to write the output in place
  */
-int decompressFile(const char* inputFile, const char* outputFile) {
-    printf("\n=== DECOMPRESSION STARTED ===\n");
-    printf("Input file: %s\n", inputFile);
-    printf("Output file: %s\n", outputFile);
+char* createTemporaryOutput(const char* path) {
+    static unsigned counter = 0;
 
-    FILE* inFile = fopen(inputFile, "rb");
-    if (!inFile) {
-        fprintf(stderr, "Error: Cannot open input file '%s'\n", inputFile);
-        return -1;
+    struct stat info;
+    int exists = lstat(path, &info) == 0;
+    if (isStdioPath(path) || (exists && !S_ISREG(info.st_mode))) {
+        return NULL;
     }
 
-    // Read header
-    FileHeader header;
-    if (readFileHeader(inFile, &header) != 0) {
-        fclose(inFile);
+    size_t capacity = strlen(path) + 40;
+    char* temporary = (char*)malloc(capacity);
+    if (!temporary) {
+        return NULL;
+    }
+
+    for (int attempt = 0; attempt < 16; attempt++) {
+        unsigned serial = __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+        snprintf(temporary, capacity, "%s.%ld.%u.tmp", path, (long)getpid(), serial);
+
+        int fd = open(temporary, O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (fd >= 0) {
+            if (exists) fchmod(fd, info.st_mode & 07777);
+            close(fd);
+            return temporary;
+        }
+    }
+
+    // The directory is not writable: the in-place open reports the error
+    free(temporary);
+    return NULL;
+}
+
+/**
+ * Moves a finished temporary file over the output, or removes it on failure
+ * @param temporary Path from createTemporaryOutput (NULL = written in place; freed)
+ * @param path Output path
+ * @param result Result of writing the temporary file
+ * @return result, or -1 if the output could not be replaced
+ */
+int finishTemporaryOutput(char* temporary, const char* path, int result) {
+    if (!temporary) {
+        return result;
+    }
+
+    if (result == 0 && rename(temporary, path) != 0) {
+        reportError("Cannot replace output file '%s'", path);
+        result = -1;
+    }
+    if (result != 0) {
+        unlink(temporary);
+    }
+    free(temporary);
+    return result;
+}
+
+// =============================================================================
+// BENCHMARK
+// =============================================================================
+
+// Names of the synthetic corpora, indexed by CorpusKind
+static const char* const corpusNames[CORPUS_COUNT] = {
+    "text", "binary", "skewed", "uniform", "single"
+};
+
+/**
+ * Advances a xorshift64 generator
+ * @param state Generator state (non-zero)
+ * @return Next pseudo-random value
+ */
+static uint64_t nextRandom(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+/**
+ * Fills a buffer with a deterministic synthetic corpus
+ * @param kind Corpus to generate
+ * @param buffer Destination buffer
+ * @param size Number of bytes to generate
+ */
+void generateCorpus(CorpusKind kind, unsigned char* buffer, size_t size) {
+    static const char* const words[] = {
+        "the", "of", "and", "to", "in", "a", "is", "that", "for", "it",
+        "as", "was", "with", "be", "by", "on", "not", "he", "this", "are",
+        "or", "his", "from", "at", "which", "but", "have", "an", "had", "they",
+        "compression", "huffman"
+    };
+    const int wordCount = (int)(sizeof(words) / sizeof(words[0]));
+    uint64_t state = 0x9E3779B97F4A7C15ull + (uint64_t)kind;
+    size_t i = 0;
+
+    switch (kind) {
+        case CORPUS_TEXT: {
+            // Zipf-like word choice, spaces and occasional line breaks
+            int column = 0;
+            while (i < size) {
+                uint64_t r = nextRandom(&state);
+                const char* word = words[(r % wordCount) % ((r >> 32) % wordCount + 1)];
+                for (const char* c = word; *c && i < size; c++) {
+                    buffer[i++] = (unsigned char)*c;
+                }
+                if (i < size) {
+                    column++;
+                    buffer[i++] = column % 12 == 0 ? '\n' : ' ';
+                }
+            }
+            break;
+        }
+
+        case CORPUS_BINARY:
+            // 32-byte records: counter, 8 random bytes, zero padding
+            for (uint32_t record = 0; i < size; record++) {
+                uint64_t r = nextRandom(&state);
+                for (int k = 0; k < 32 && i < size; k++, i++) {
+                    if (k < 4) {
+                        buffer[i] = (unsigned char)(record >> (8 * k));
+                    } else if (k < 12) {
+                        buffer[i] = (unsigned char)(r >> (8 * (k - 4)));
+                    } else {
+                        buffer[i] = 0;
+                    }
+                }
+            }
+            break;
+
+        case CORPUS_SKEWED:
+            // Geometric distribution: value k has probability 2^-(k+1)
+            for (; i < size; i++) {
+                uint64_t r = nextRandom(&state) | (1ull << 63);
+                int value = 0;
+                while (!(r & 1)) {
+                    r >>= 1;
+                    value++;
+                }
+                buffer[i] = (unsigned char)value;
+            }
+            break;
+
+        case CORPUS_UNIFORM:
+            for (; i < size; i++) {
+                buffer[i] = (unsigned char)(nextRandom(&state) >> 56);
+            }
+            break;
+
+        case CORPUS_SINGLE:
+        default:
+            memset(buffer, 'A', size);
+            break;
+    }
+}
+
+/**
+ * Compresses and decompresses a buffer in memory through the block container
+ * The container is written to and read from memory streams, so block type
+ * selection, splitting, checksums and threading run as in a -c/-d run,
+ * without file I/O or progress output. The round trip times keep their
+ * fastest wall-clock time over all iterations, each phase its smallest
+ * thread time, and every iteration's output is verified.
+ * @param data Bytes to benchmark
+ * @param size Number of bytes (at least 1)
+ * @param iterations Number of round trips
+ * @param compressOptions Container options (block size, code limit, streams, threads, ...)
+ * @param decompressOptions Decompression threads and pipelining
+ * @param result Receives sizes and per-phase timings
+ * @return 0 on success, -1 on error or round-trip mismatch
+ */
+int benchmarkBuffer(const unsigned char* data, size_t size, int iterations,
+                    const CompressOptions* compressOptions,
+                    const DecompressOptions* decompressOptions, BenchmarkResult* result) {
+    // One spare byte for the terminator fmemopen writes on close
+    size_t capacity = containerBound(size) + 1;
+    unsigned char* compressed = (unsigned char*)malloc(capacity);
+    unsigned char* decoded = (unsigned char*)malloc(size);
+    if (!compressed || !decoded) {
+        reportError("Memory allocation failed for benchmark buffers");
+        free(compressed);
+        free(decoded);
         return -1;
     }
 
-    printf("Original size: %u bytes\n", header.original_size);
-    printf("Compressed size: %u bytes\n", header.compressed_size);
-    printf("Unique characters: %u\n", header.frequency_count);
+    // Memory streams have no descriptor, so they are always read as mappings
+    CompressOptions compression = *compressOptions;
+    compression.ioBackend = IO_BACKEND_MMAP;
+    compression.quiet = 1;
+    DecompressOptions decompression = *decompressOptions;
+    decompression.ioBackend = IO_BACKEND_MMAP;
+    decompression.quiet = 1;
+
+    memset(result, 0, sizeof(BenchmarkResult));
+    result->inputSize = size;
+    result->iterations = iterations;
+    result->streams = compression.streams;
+    result->threads = resolveThreadCount(compression.threads);
+
+    int status = 0;
+    for (int iteration = 0; iteration < iterations && status == 0; iteration++) {
+        CodecStats compressStats;
+        CodecStats decompressStats;
+        compression.stats = &compressStats;
+        decompression.stats = &decompressStats;
+
+        InputSource source = { fmemopen((void*)data, size, "rb"), data, size };
+        FILE* output = fmemopen(compressed, capacity, "wb");
+        if (!source.file || !output) {
+            reportError("Cannot open benchmark memory streams");
+            if (source.file) fclose(source.file);
+            if (output) fclose(output);
+            status = -1;
+            break;
+        }
 
-    // Read frequencies
-    unsigned int frequencies[ASCII_SIZE];
-    if (readFrequencies(inFile, frequencies, header.frequency_count) != 0) {
-        fclose(inFile);
+        beginCodecStats(&compressStats);
+        status = compressContainer(&source, output, &compression);
+        fflush(output);
+        endCodecStats(&compressStats);
+        off_t compressedSize = ftello(output);
+        fclose(source.file);
+        fclose(output);
+        if (status != 0 || compressedSize < 0) {
+            status = -1;
+            break;
+        }
+
+        // decompressContainer expects the magic number to have been read
+        InputSource container = { fmemopen(compressed, (size_t)compressedSize, "rb"),
+                                  compressed, (uint64_t)compressedSize };
+        if (!container.file) {
+            reportError("Cannot open benchmark memory streams");
+            status = -1;
+            break;
+        }
+        OutputSink sink;
+        openBufferSink(&sink, decoded, size);
+
+        beginCodecStats(&decompressStats);
+        uint32_t magic;
+        status = fread(&magic, sizeof(uint32_t), 1, container.file) == 1 && magic == MAGIC_BLOCKS
+            ? decompressContainer(&container, &sink, &decompression) : -1;
+        endCodecStats(&decompressStats);
+        fclose(container.file);
+
+        if (status != 0 || sink.position != size || memcmp(data, decoded, size) != 0) {
+            reportError("Benchmark round trip does not match the input");
+            status = -1;
+            break;
+        }
+
+        double times[8] = {
+            compressStats.wallSeconds, decompressStats.wallSeconds,
+            compressStats.work.histogramSeconds, compressStats.work.treeSeconds,
+            compressStats.work.encodeSeconds, decompressStats.work.tableSeconds,
+            decompressStats.work.decodeSeconds,
+            compressStats.work.checksumSeconds + decompressStats.work.checksumSeconds
+        };
+        double* best[8] = {
+            &result->compressSeconds, &result->decompressSeconds,
+            &result->histogramSeconds, &result->treeSeconds, &result->encodeSeconds,
+            &result->tableSeconds, &result->decodeSeconds, &result->checksumSeconds
+        };
+        for (int p = 0; p < 8; p++) {
+            if (iteration == 0 || times[p] < *best[p]) {
+                *best[p] = times[p];
+            }
+        }
+        result->compressedSize = (size_t)compressedSize;
+        result->blocks = compressStats.work.blocks;
+    }
+
+    free(compressed);
+    free(decoded);
+    return status;
+}
+
+/**
+ * Prints one benchmark result as a single machine-readable line
+ * @param name Corpus or file name
+ * @param result Benchmark result
+ */
+void printBenchmarkResult(const char* name, const BenchmarkResult* result) {
+    double megabytes = (double)result->inputSize / 1e6;
+
+    printf("BENCH corpus=%s bytes=%zu compressed=%zu ratio=%.4f iterations=%d blocks=%llu "
+           "threads=%d streams=%d kernels=%s compress_mbps=%.1f decompress_mbps=%.1f "
+           "histogram_ms=%.3f tree_ms=%.3f table_ms=%.3f encode_ms=%.3f decode_ms=%.3f "
+           "checksum_ms=%.3f\n",
+           name, result->inputSize, result->compressedSize,
+           (double)result->compressedSize / (double)result->inputSize, result->iterations,
+           (unsigned long long)result->blocks, result->threads, result->streams,
+           codecKernels()->name,
+           result->compressSeconds > 0 ? megabytes / result->compressSeconds : 0.0,
+           result->decompressSeconds > 0 ? megabytes / result->decompressSeconds : 0.0,
+           result->histogramSeconds * 1e3, result->treeSeconds * 1e3,
+           result->tableSeconds * 1e3, result->encodeSeconds * 1e3,
+           result->decodeSeconds * 1e3, result->checksumSeconds * 1e3);
+}
+
+/**
+ * Runs the benchmark over a file, or over every synthetic corpus
+ * @param inputFile Path to a regular file, or NULL for the synthetic corpora
+ * @param iterations Number of round trips per input
+ * @param compressOptions Container options, as for -c
+ * @param decompressOptions Decompression options, as for -d
+ * @return 0 on success, -1 on error
+ */
+int runBenchmark(const char* inputFile, int iterations, const CompressOptions* compressOptions,
+                 const DecompressOptions* decompressOptions) {
+    BenchmarkResult result;
+
+    if (!inputFile) {
+        unsigned char* buffer = (unsigned char*)malloc(BENCH_CORPUS_SIZE);
+        if (!buffer) {
+            reportError("Memory allocation failed for benchmark corpus");
+            return -1;
+        }
+
+        int status = 0;
+        for (int kind = 0; kind < CORPUS_COUNT && status == 0; kind++) {
+            generateCorpus((CorpusKind)kind, buffer, BENCH_CORPUS_SIZE);
+            status = benchmarkBuffer(buffer, BENCH_CORPUS_SIZE, iterations,
+                                     compressOptions, decompressOptions, &result);
+            if (status == 0) {
+                printBenchmarkResult(corpusNames[kind], &result);
+            }
+        }
+
+        free(buffer);
+        return status;
+    }
+
+    InputSource source;
+    if (openInputSource(&source, inputFile, IO_BACKEND_MMAP) != 0) {
         return -1;
     }
 
-    // Rebuild Huffman tree
-    HuffmanNode* root = buildHuffmanTree(frequencies);
-    if (!root) {
-        fprintf(stderr, "Error: Failed to rebuild Huffman tree\n");
-        fclose(inFile);
+    if (source.size == STREAM_SIZE_UNKNOWN || source.size == 0 ||
+        source.size > (uint64_t)SIZE_MAX) {
+        reportError("Benchmark input must be a non-empty regular file");
+        closeInputSource(&source);
         return -1;
     }
 
-    // Open output file
-    FILE* outFile = fopen(outputFile, "wb");
-    if (!outFile) {
-        fprintf(stderr, "Error: Cannot create output file '%s'\n", outputFile);
-        fclose(inFile);
-        destroyTree(root);
+    size_t size = (size_t)source.size;
+    unsigned char* buffer = source.map ? NULL : (unsigned char*)malloc(size);
+    if (!source.map && !buffer) {
+        reportError("Memory allocation failed for benchmark input");
+        closeInputSource(&source);
         return -1;
     }
 
-    // Decode data
-    decodeAndWrite(inFile, outFile, root, header.original_size, header.padding_bits);
+    size_t count;
+    const unsigned char* data = readInputSpan(&source, buffer, size, &count);
+    int status = -1;
+    if (count == size) {
+        status = benchmarkBuffer(data, size, iterations, compressOptions, decompressOptions,
+                                 &result);
+        if (status == 0) {
+            printBenchmarkResult(inputFile, &result);
+        }
+    } else {
+        reportError("Failed to read input data");
+    }
 
-    fclose(inFile);
-    fclose(outFile);
-    destroyTree(root);
+    free(buffer);
+    closeInputSource(&source);
+    return status;
+}
 
-    printf("=== DECOMPRESSION COMPLETED ===\n");
-    return 0;
+// =============================================================================
+// ERROR REPORTING
+// =============================================================================
+
+// Process-wide message handler (setLogHandler); without one, failures show
+// only in the return values
+static pthread_mutex_t logLock = PTHREAD_MUTEX_INITIALIZER;
+static LogHandler logHandler;
+static void* logHandlerUser;
+
+/**
+ * Installs the handler that receives error and warning messages
+ * @param handler Handler, or NULL to discard messages
+ * @param user Pointer passed to handler
+ */
+void setLogHandler(LogHandler handler, void* user) {
+    pthread_mutex_lock(&logLock);
+    logHandler = handler;
+    logHandlerUser = user;
+    pthread_mutex_unlock(&logLock);
+}
+
+/**
+ * Formats a message and hands it to the installed handler
+ * @param level LOG_LEVEL_ERROR or LOG_LEVEL_WARNING
+ * @param format printf format
+ * @param arguments Format arguments
+ */
+static void reportMessage(int level, const char* format, va_list arguments) {
+    pthread_mutex_lock(&logLock);
+    LogHandler handler = logHandler;
+    void* user = logHandlerUser;
+    pthread_mutex_unlock(&logLock);
+    if (!handler) return;
+
+    char message[LOG_MESSAGE_SIZE];
+    vsnprintf(message, sizeof(message), format, arguments);
+    handler(user, level, message);
+}
+
+/**
+ * Reports why an operation failed
+ * @param format printf format of the message (no "Error:" prefix or newline)
+ */
+void reportError(const char* format, ...) {
+    va_list arguments;
+    va_start(arguments, format);
+    reportMessage(LOG_LEVEL_ERROR, format, arguments);
+    va_end(arguments);
+}
+
+/**
+ * Reports a problem the operation worked around
+ * @param format printf format of the message (no "Warning:" prefix or newline)
+ */
+void reportWarning(const char* format, ...) {
+    va_list arguments;
+    va_start(arguments, format);
+    reportMessage(LOG_LEVEL_WARNING, format, arguments);
+    va_end(arguments);
 }
 
 // =============================================================================
 // UTILITY FUNCTIONS
 // =============================================================================
 
+/**
+ * Reads a monotonic wall clock
+ * @return Seconds since an arbitrary fixed point
+ */
+double wallClockSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
 /**
  * Prints compression statistics
  * @param inputFile Path to original file
  * @param outputFile Path to compressed file
  */
 void printCompressionStats(const char* inputFile, const char* outputFile) {
+    if (isStdioPath(inputFile) || isStdioPath(outputFile)) {
+        return;
+    }
+
     FILE* inFile = fopen(inputFile, "rb");
     FILE* outFile = fopen(outputFile, "rb");
 
     if (!inFile || !outFile) {
-        fprintf(stderr, "Error: Cannot open files for statistics\n");
+        reportError("Cannot open files for statistics");
         if (inFile) fclose(inFile);
         if (outFile) fclose(outFile);
         return;
     }
 
     // Get file sizes
-    fseek(inFile, 0, SEEK_END);
-    long originalSize = ftell(inFile);
+    fseeko(inFile, 0, SEEK_END);
+    off_t originalSize = ftello(inFile);
 
-    fseek(outFile, 0, SEEK_END);
-    long compressedSize = ftell(outFile);
+    fseeko(outFile, 0, SEEK_END);
+    off_t compressedSize = ftello(outFile);
 
     fclose(inFile);
     fclose(outFile);
 
-    double compressionRatio = (double)compressedSize / originalSize;
-    double spaceSaving = ((double)(originalSize - compressedSize) / originalSize) * 100;
+    printCompressionSummary((uint64_t)originalSize, (uint64_t)compressedSize);
+}
+
+/**
+ * Prints the compression ratio and space saved for two sizes
+ * @param originalSize Uncompressed bytes
+ * @param compressedSize Compressed bytes
+ */
+void printCompressionSummary(uint64_t originalSize, uint64_t compressedSize) {
+    double compressionRatio = originalSize ? (double)compressedSize / originalSize : 0;
+    double spaceSaving = originalSize
+        ? ((double)originalSize - (double)compressedSize) / originalSize * 100 : 0;
 
     printf("\n=== COMPRESSION STATISTICS ===\n");
-    printf("Original size:    %ld bytes\n", originalSize);
-    printf("Compressed size:  %ld bytes\n", compressedSize);
+    printf("Original size:    %llu bytes\n", (unsigned long long)originalSize);
+    printf("Compressed size:  %llu bytes\n", (unsigned long long)compressedSize);
     printf("Compression ratio: %.2f\n", compressionRatio);
     printf("Space saved:      %.2f%%\n", spaceSaving);
     printf("===============================\n");
@@ -771,21 +6361,27 @@ void printHuffmanCodes(CodeEntry codes[ASCII_SIZE]) {
  */
 int validateFiles(const char* inputFile, const char* outputFile) {
     if (!inputFile || !outputFile) {
-        fprintf(stderr, "Error: File paths cannot be NULL\n");
+        reportError("File paths cannot be NULL");
         return -1;
     }
 
-    FILE* inFile = fopen(inputFile, "rb");
-    if (!inFile) {
-        fprintf(stderr, "Error: Cannot access input file '%s'\n", inputFile);
-        return -1;
+    if (!isStdioPath(inputFile)) {
+        FILE* inFile = fopen(inputFile, "rb");
+        if (!inFile) {
+            reportError("Cannot access input file '%s'", inputFile);
+            return -1;
+        }
+        fclose(inFile);
+    }
+
+    if (isStdioPath(outputFile)) {
+        return 0;
     }
-    fclose(inFile);
 
     // Check if output file can be created
     FILE* outFile = fopen(outputFile, "wb");
     if (!outFile) {
-        fprintf(stderr, "Error: Cannot create output file '%s'\n", outputFile);
+        reportError("Cannot create output file '%s'", outputFile);
         return -1;
     }
     fclose(outFile);
@@ -794,199 +6390,71 @@ int validateFiles(const char* inputFile, const char* outputFile) {
 }
 
 /**
- * Prints usage information
- * @param programName Name of the program
+ * Checks whether a path names standard input/output
+ * @param path File path
+ * @return 1 for "-", 0 otherwise
  */
-void printUsage(const char* programName) {
-    printf("\n=== HUFFMAN CODING COMPRESSION TOOL ===\n");
-    printf("Usage: %s [OPTIONS]\n", programName);
-    printf("\nOptions:\n");
-    printf("  -c <input> <output>    Compress input file to output file\n");
-    printf("  -d <input> <output>    Decompress input file to output file\n");
-    printf("  -s <original> <compressed>  Show compression statistics\n");
-    printf("  -h                     Show this help message\n");
-    printf("\nExamples:\n");
-    printf("  %s -c document.txt document.huf\n", programName);
-    printf("  %s -d document.huf document_restored.txt\n", programName);
-    printf("  %s -s document.txt document.huf\n", programName);
-    printf("=====================================\n");
+int isStdioPath(const char* path) {
+    return strcmp(path, STDIO_PATH) == 0;
 }
 
-// =============================================================================
-// MAIN FUNCTION AND COMMAND LINE INTERFACE
-// =============================================================================
-
 /**
- * Interactive menu for user input
+ * Opens an input file, or stdin for "-"
+ * @param path File path
+ * @return File pointer or NULL on error
  */
-void interactiveMenu() {
-    char inputFile[256], outputFile[256];
-    int choice;
-
-    while (1) {
-        printf("\n=== HUFFMAN CODING TOOL ===\n");
-        printf("1. Compress a file\n");
-        printf("2. Decompress a file\n");
-        printf("3. Show compression statistics\n");
-        printf("4. Exit\n");
-        printf("Enter your choice (1-4): ");
-
-        if (scanf("%d", &choice) != 1) {
-            printf("Invalid input. Please enter a number.\n");
-            while (getchar() != '\n'); // Clear input buffer
-            continue;
-        }
-
-        switch (choice) {
-            case 1:
-                printf("Enter input file path: ");
-                scanf("%255s", inputFile);
-                printf("Enter output file path: ");
-                scanf("%255s", outputFile);
-
-                if (validateFiles(inputFile, outputFile) == 0) {
-                    clock_t start = clock();
-                    if (compressFile(inputFile, outputFile) == 0) {
-                        clock_t end = clock();
-                        double time = ((double)(end - start)) / CLOCKS_PER_SEC;
-                        printf("Compression completed in %.2f seconds\n", time);
-                        printCompressionStats(inputFile, outputFile);
-                    }
-                }
-                break;
-
-            case 2:
-                printf("Enter compressed file path: ");
-                scanf("%255s", inputFile);
-                printf("Enter output file path: ");
-                scanf("%255s", outputFile);
-
-                if (validateFiles(inputFile, outputFile) == 0) {
-                    clock_t start = clock();
-                    if (decompressFile(inputFile, outputFile) == 0) {
-                        clock_t end = clock();
-                        double time = ((double)(end - start)) / CLOCKS_PER_SEC;
-                        printf("Decompression completed in %.2f seconds\n", time);
-                    }
-                }
-                break;
-
-            case 3:
-                printf("Enter original file path: ");
-                scanf("%255s", inputFile);
-                printf("Enter compressed file path: ");
-                scanf("%255s", outputFile);
-                printCompressionStats(inputFile, outputFile);
-                break;
-
-            case 4:
-                printf("Thank you for using Huffman Coding Tool!\n");
-                return;
+FILE* openInputStream(const char* path) {
+    if (isStdioPath(path)) {
+        return stdin;
+    }
 
-            default:
-                printf("Invalid choice. Please enter 1-4.\n");
-        }
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        reportError("Cannot open input file '%s'", path);
     }
+    return file;
 }
 
 /**
- * Main function with command-line argument parsing
+ * Opens an output file, or stdout for "-"
+ * When writing to stdout the compressed data gets its own copy of the
+ * descriptor and stdout is pointed at stderr, so progress messages never
+ * end up in the data stream.
+ * @param path File path
+ * @return File pointer or NULL on error
  */
-int main(int argc, char* argv[]) {
-    printf("Huffman Coding Compression Tool v1.0\n");
-    printf("=====================================\n");
-
-    // Interactive menu if no arguments provided
-    if (argc == 1) {
-        interactiveMenu();
-        return 0;
-    }
-
-    // Command line argument parsing
-    if (argc < 2) {
-        printUsage(argv[0]);
-        return 1;
-    }
-
-    char* option = argv[1];
-
-    // Help option
-    if (strcmp(option, "-h") == 0) {
-        printUsage(argv[0]);
-        return 0;
-    }
-
-    // Compression option
-    else if (strcmp(option, "-c") == 0) {
-        if (argc != 4) {
-            fprintf(stderr, "Error: Compression requires input and output file paths\n");
-            printUsage(argv[0]);
-            return 1;
-        }
-
-        char* inputFile = argv[2];
-        char* outputFile = argv[3];
-
-        if (validateFiles(inputFile, outputFile) != 0) {
-            return 1;
+FILE* openOutputStream(const char* path) {
+    if (!isStdioPath(path)) {
+        FILE* file = fopen(path, "wb");
+        if (!file) {
+            reportError("Cannot create output file '%s'", path);
         }
-
-        clock_t start = clock();
-        int result = compressFile(inputFile, outputFile);
-        clock_t end = clock();
-
-        if (result == 0) {
-            double time = ((double)(end - start)) / CLOCKS_PER_SEC;
-            printf("Compression completed in %.2f seconds\n", time);
-            printCompressionStats(inputFile, outputFile);
-        }
-
-        return result;
+        return file;
     }
 
-    // Decompression option
-    else if (strcmp(option, "-d") == 0) {
-        if (argc != 4) {
-            fprintf(stderr, "Error: Decompression requires input and output file paths\n");
-            printUsage(argv[0]);
-            return 1;
-        }
-
-        char* inputFile = argv[2];
-        char* outputFile = argv[3];
-
-        if (validateFiles(inputFile, outputFile) != 0) {
-            return 1;
-        }
-
-        clock_t start = clock();
-        int result = decompressFile(inputFile, outputFile);
-        clock_t end = clock();
-
-        if (result == 0) {
-            double time = ((double)(end - start)) / CLOCKS_PER_SEC;
-            printf("Decompression completed in %.2f seconds\n", time);
+    // Anything printf buffered so far is flushed later, to stderr
+    int dataFd = dup(STDOUT_FILENO);
+    FILE* file = dataFd >= 0 ? fdopen(dataFd, "wb") : NULL;
+    if (!file || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        reportError("Cannot write to standard output");
+        if (file) {
+            fclose(file);
+        } else if (dataFd >= 0) {
+            close(dataFd);
         }
-
-        return result;
+        return NULL;
     }
+    return file;
+}
 
-    // Statistics option
-    else if (strcmp(option, "-s") == 0) {
-        if (argc != 4) {
-            fprintf(stderr, "Error: Statistics requires original and compressed file paths\n");
-            printUsage(argv[0]);
-            return 1;
-        }
-
-        printCompressionStats(argv[2], argv[3]);
+/**
+ * Closes a stream opened by openInputStream or openOutputStream
+ * @param file File pointer
+ * @return 0 on success, -1 if buffered data could not be written
+ */
+int closeStream(FILE* file) {
+    if (file == stdin) {
         return 0;
     }
-
-    // Invalid option
-    else {
-        fprintf(stderr, "Error: Unknown option '%s'\n", option);
-        printUsage(argv[0]);
-        return 1;
-    }
-}
\ No newline at end of file
+    return fclose(file) == 0 ? 0 : -1;
+}
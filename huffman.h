@@ -2,23 +2,98 @@
 #define HUFFMAN_H
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define MAX_CODE_LENGTH 256
 #define ASCII_SIZE 256
+#define MAX_TREE_NODES (2 * ASCII_SIZE - 1)  // 256 leaves and 255 internal nodes
 #define MAGIC_NUMBER 0x48554646  // "HUFF" in hex
+#define MAGIC_CANONICAL 0x48554643  // "HUFC" in hex: code-length header
+#define MAGIC_VERSIONED 0x48554656  // "HUFV" in hex: versioned header with 64-bit sizes
+#define FILE_HEADER_VERSION 2
+#define FILE_FLAG_CANONICAL 0x01    // Versioned stream carries code lengths instead of frequencies
+#define FILE_FLAG_SYNC_POINTS 0x02  // Canonical stream is followed by a table of sync points
+#define SYNC_TABLE_HEADER_SIZE 8    // Sync interval and point count (u32 each)
+#define MIN_SYNC_INTERVAL (1u << 12)  // Output bytes between sync points
+#define MAX_SYNC_INTERVAL (1u << 26)
+#define MAX_CANONICAL_CODE_LENGTH 15  // Code lengths are stored as 4-bit values
+#define DEFAULT_MAX_CODE_LENGTH 12    // Keeps canonical decode tables within L1 cache
+#define IO_BUFFER_SIZE (1 << 16)
+#define MAX_OVERRUN_BYTES 8       // Zero bytes a bit reader may shift in past the end of its input
+#define DECODE_TABLE_BITS 11      // Bits resolved by the primary decode table
+#define DECODE_SUBTABLE_BITS 7    // Maximum bits resolved by a subtable (keeps offsets in 16 bits)
+#define MAX_PACKED_CODE_LENGTH 57 // Longest code the 64-bit bit writer accepts in one put
+#define HISTOGRAM_TABLES 4        // Interleaved sub-tables in countFrequencies
+#define HISTOGRAM_CHUNK (1u << 30)          // Bytes per pass; keeps 32-bit sub-table counts safe
+#define PARALLEL_HISTOGRAM_MIN (1u << 22)   // Smaller inputs are counted on one thread
+#define BENCH_CORPUS_SIZE (1u << 23)        // Bytes per synthetic benchmark corpus
+#define DEFAULT_BENCH_ITERATIONS 5
+#define MAGIC_BLOCKS 0x48554642       // "HUFB" in hex: block container
+#define MAGIC_BLOCK_INDEX 0x48554649  // "HUFI" in hex: block index trailer
+#define BLOCK_FORMAT_VERSION 1
+#define CONTAINER_FLAG_STREAMED 0x01   // original_size unknown when the header was written
+#define CONTAINER_FLAG_INTERLEAVED 0x02  // Blocks hold INTERLEAVED_STREAMS sub-streams
+#define CONTAINER_FLAG_BLOCK_TYPES 0x04  // Payloads start with a BlockType byte
+#define CONTAINER_FLAG_RAW_OFFSETS 0x08  // Block index also lists uncompressed offsets
+#define CONTAINER_FLAG_CHECKSUMS 0x10  // Payloads end with a CRC32C of the block's raw bytes
+#define BLOCK_CHECKSUM_SIZE 4
+#define STREAM_SIZE_UNKNOWN UINT64_MAX
+#define STDIO_PATH "-"                 // File path naming stdin or stdout
+#define DEFAULT_BLOCK_SIZE (1u << 20)
+#define MIN_BLOCK_SIZE (1u << 12)
+#define MAX_BLOCK_SIZE (1u << 26)
+#define BLOCKS_PER_THREAD 2       // Blocks held in memory per worker thread
+#define MAX_THREADS 1024          // Largest -j count the command line accepts
+#define SINK_SLOTS 64             // Output buffers a pipe, socket or O_DIRECT sink hands out at once
+#define DIRECT_ALIGNMENT 4096     // Buffer, offset and length alignment of O_DIRECT writes
+#define DIRECT_BOUNCE_SIZE (1u << 20)  // Aligned copy buffer for output the sink did not hand out
+#define PIPELINE_DEPTH 3          // Coding windows held by the pipeline ring (read, code, write)
+#define INTERLEAVED_STREAMS 4     // Sub-streams per block of an interleaved container
+#define STREAM_JUMP_TABLE_SIZE 12 // Sizes of the first three sub-streams (u32 each)
+#define CONTAINER_HEADER_SIZE 20  // Bytes written by writeContainerHeader
+#define BLOCK_HEADER_SIZE 8
+#define INDEX_TRAILER_SIZE 16     // Index offset (u64), block count and magic (u32 each)
+#define MAX_SPLIT_LEVEL 3         // Adaptive splitting: 4 << level sub-blocks are compared per block
+#define MAX_BLOCK_PARTS (4 << MAX_SPLIT_LEVEL)  // Container blocks one block job may split into
+#define MIN_SPLIT_SEGMENT (1u << 10)  // Smallest sub-block compared by adaptive splitting
+#define MAX_CONTEXT_TABLES 16     // Code tables per context block (the context map holds 4-bit indices)
+#define DECODE_CACHE_ENTRIES 8    // Decode tables kept per cache, least recently used replaced
+#define DECODE_CACHE_KEY_SIZE (ASCII_SIZE * sizeof(uint64_t))  // Largest key: a frequency table
+#define MIN_CONTEXT_BLOCK (1u << 12)  // Smaller blocks are not worth a context model
+#define CONTEXT_CLUSTER_PASSES 4  // Reassignment passes when clustering contexts
+#define MAGIC_TABLE 0x48554654          // "HUFT" in hex: trained code table file
+#define MAGIC_TABLE_MESSAGE 0x48554644  // "HUFD" in hex: message coded with a trained table
+#define CODE_TABLE_VERSION 1
+#define CODE_TABLE_FILE_SIZE 142        // Header (12 bytes) and packed lengths of all 256 bytes
+#define TABLE_MESSAGE_HEADER_MAX 19     // Magic, table ID, LEB128 size (up to 10 bytes), type
+#define MAX_STATS_THREADS 256     // Threads listed separately in CodecStats; later ones share the last slot
+#define LOG_LEVEL_ERROR 0         // The operation failed
+#define LOG_LEVEL_WARNING 1       // The operation went on without something
+#define LOG_MESSAGE_SIZE 512      // Longest message passed to a LogHandler, terminator included
 
 // Huffman Tree Node Structure
 typedef struct HuffmanNode {
     unsigned char character;
-    unsigned int frequency;
+    uint64_t frequency;
     struct HuffmanNode *left;
     struct HuffmanNode *right;
 } HuffmanNode;
 
+// Node arena holding one tree; nodes are handed out in order and released together
+typedef struct HuffmanTree {
+    HuffmanNode nodes[MAX_TREE_NODES];
+    int count;
+} HuffmanTree;
+
 // Min-Heap Structure for Priority Queue
 typedef struct MinHeap {
     int size;
@@ -30,22 +105,428 @@ typedef struct MinHeap {
 typedef struct CodeEntry {
     char code[MAX_CODE_LENGTH];
     int length;
+    uint64_t bits;  // Same code packed into the low 'length' bits, first bit most significant
 } CodeEntry;
 
 // File Header Structure
+// HUFF and HUFC store the sizes in 32 bits; HUFV adds version and flags
+// bytes and stores sizes (and frequencies) in 64 bits
 typedef struct FileHeader {
     uint32_t magic;
-    uint32_t original_size;
-    uint32_t compressed_size;
+    uint8_t version;         // 1 for HUFF/HUFC, FILE_HEADER_VERSION for HUFV
+    uint8_t flags;           // FILE_FLAG_* (HUFV only)
+    uint64_t original_size;
+    uint64_t compressed_size;
     uint32_t frequency_count;
     uint8_t padding_bits;
 } FileHeader;
 
+// Output Formats
+typedef enum OutputFormat {
+    FORMAT_BLOCKS,     // Block container with per-block code lengths (default)
+    FORMAT_CANONICAL,  // Single stream with a code-length header
+    FORMAT_LEGACY,     // Single stream with a frequency table
+    FORMAT_TABLE       // One message coded with a trained table (CompressOptions.table)
+} OutputFormat;
+
+// I/O Backends
+typedef enum IoBackend {
+    IO_BACKEND_STDIO,  // Buffered FILE* reads and writes
+    IO_BACKEND_MMAP,   // Map regular files; falls back to stdio for pipes (default)
+    IO_BACKEND_URING,  // Pipelined positioned I/O through io_uring (Linux; implies pipelining)
+    IO_BACKEND_DIRECT  // Decompressed output written with O_DIRECT in aligned pieces (Linux);
+                       // inputs are mapped as with IO_BACKEND_MMAP
+} IoBackend;
+
+// Compression Options
+typedef struct CompressOptions {
+    OutputFormat format;
+    IoBackend ioBackend;
+    int maxCodeLength;   // Length limit for canonical codes
+    int threads;         // Worker threads for the block container (0 = all cores)
+    uint32_t blockSize;  // Uncompressed bytes per block
+    int streams;         // Sub-streams per block: 1 or INTERLEAVED_STREAMS
+    int splitLevel;      // Adaptive block splitting: 0 (fixed blocks) to MAX_SPLIT_LEVEL
+    int pipelined;       // Overlap reading, coding and writing of container blocks
+    int contextModel;    // Try order-1 context blocks (code tables chosen by the previous byte)
+    int checksums;       // End every container block with a CRC32C of its raw bytes
+    uint32_t syncInterval;  // Canonical streams: bytes between sync points (0 = none)
+    const struct CodeTable* table;  // Trained table for FORMAT_TABLE
+    int quiet;           // Suppress progress messages
+    int atomicOutput;    // Write a temporary file and rename it over the output on success
+    struct ContainerWorkspace* workspace;  // Reused pool and block buffers (NULL = per call)
+    struct CodecStats* stats;  // Receives counters and phase times (NULL = not collected)
+} CompressOptions;
+
+// Decompression Options
+typedef struct DecompressOptions {
+    IoBackend ioBackend;
+    int threads;         // Worker threads for the block container (0 = all cores)
+    int pipelined;       // Overlap reading, decoding and writing of container blocks
+    const struct CodeTable* table;  // Trained table for table-coded inputs
+    int quiet;           // Suppress progress messages
+    int atomicOutput;    // Write a temporary file and rename it over the output on success
+    struct ContainerWorkspace* workspace;  // Reused pool and block buffers (NULL = per call)
+    struct CodecStats* stats;  // Receives counters and phase times (NULL = not collected)
+} DecompressOptions;
+
+// Block Container Header
+typedef struct ContainerHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t block_size;
+    uint64_t original_size;
+} ContainerHeader;
+
+// Block Header (raw_size == 0 marks the end of the blocks)
+typedef struct BlockHeader {
+    uint32_t raw_size;
+    uint32_t payload_size;
+} BlockHeader;
+
+// Container Block Types
+typedef enum BlockType {
+    BLOCK_TYPE_HUFFMAN = 0,  // Code lengths and bit stream(s)
+    BLOCK_TYPE_STORED = 1,   // Raw bytes, for incompressible data
+    BLOCK_TYPE_RLE = 2,      // One byte repeated raw_size times
+    BLOCK_TYPE_CONTEXT = 3   // Context map, one code table per context group and bit stream(s)
+} BlockType;
+
+// Block Index Trailer (follows block_count 64-bit block offsets)
+typedef struct IndexTrailer {
+    uint64_t index_offset;
+    uint32_t block_count;
+    uint32_t magic;
+} IndexTrailer;
+
+// Work done on blocks: thread time per phase, in seconds, and decoder counters
+typedef struct BlockStats {
+    uint64_t blocks;          // Container blocks coded
+    double histogramSeconds;
+    double treeSeconds;       // Block type, code lengths, context model and canonical codes
+    double encodeSeconds;
+    double tableSeconds;      // Code length headers and decode tables
+    double decodeSeconds;
+    double checksumSeconds;
+    uint64_t symbols;         // Symbols decoded through decode tables
+    uint64_t lookups;         // Decode table lookups (a primary entry may hold two symbols)
+    uint64_t longCodes;       // Codes longer than the primary table, resolved through a subtable
+    uint64_t cachedTables;    // Decode tables taken from a cache instead of being built
+} BlockStats;
+
+// Codec Statistics for one compression or decompression
+// Phase times add up every thread's time, so with several threads they
+// can exceed wallSeconds.
+typedef struct CodecStats {
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    double wallSeconds;
+    double ioWaitSeconds;     // Coders idle while blocks were read or written
+    BlockStats work;
+    int threads;              // Threads coding blocks, the calling thread included
+    uint64_t threadBlocks[MAX_STATS_THREADS];  // Block jobs run by each thread, the caller first
+} CodecStats;
+
+// Unit of work for block compression and decompression
+// input and output point into the owned buffers or into mapped files.
+// Compression output is one or more complete container blocks (header and
+// payload), listed in partSizes; decompression input is one block's payload.
+typedef struct BlockJob {
+    const unsigned char* input;
+    unsigned char* inputBuffer;
+    size_t inputSize;
+    unsigned char* output;
+    unsigned char* outputBuffer;
+    size_t outputSize;
+    size_t outputCapacity;
+    size_t parts;
+    uint32_t partSizes[MAX_BLOCK_PARTS];  // Bytes of each container block, header included
+    uint32_t partRawSizes[MAX_BLOCK_PARTS];  // Uncompressed bytes of each container block
+    BlockStats stats;      // Work on this job, when the batch collects statistics
+    struct DecodeTableCache* tables;  // Decode tables of recent blocks, created on first use
+    int result;
+} BlockJob;
+
+// Batch of block jobs shared by the worker tasks
+typedef struct BlockBatch {
+    BlockJob* jobs;
+    int maxCodeLength;
+    int streams;         // Sub-streams per block
+    int blockTypes;      // Payloads start with a BlockType byte
+    int splitLevel;      // Adaptive block splitting level (compression)
+    int contextModel;    // Try order-1 context blocks (compression)
+    int checksums;       // Payloads end with a CRC32C of the raw bytes
+    int stats;           // Fill each job's BlockStats
+} BlockBatch;
+
+// Order-1 Context Model: the previous byte selects one of 'tables' code tables
+// (each sub-stream starts with a previous byte of 0)
+typedef struct ContextModel {
+    int tables;
+    uint8_t map[ASCII_SIZE];                          // Table index per previous byte
+    uint8_t lengths[MAX_CONTEXT_TABLES][ASCII_SIZE];  // Code lengths per table
+    uint64_t payloadBound;  // Upper bound on the coded payload, type byte excluded
+} ContextModel;
+
+// Thread Pool (the calling thread also runs tasks)
+typedef void (*TaskFunction)(void* context, size_t index);
+
+// Receives one error or warning message (see setLogHandler)
+typedef void (*LogHandler)(void* user, int level, const char* message);
+
+typedef struct ThreadPool {
+    pthread_t* threads;
+    int threadCount;
+    pthread_mutex_t mutex;
+    pthread_cond_t workReady;
+    pthread_cond_t workDone;
+    TaskFunction function;
+    void* context;
+    size_t taskCount;
+    size_t nextTask;
+    size_t pendingTasks;
+    unsigned long generation;
+    int shutdown;
+    uint64_t* tasksRun;  // Tasks run by each thread, the caller first
+    int slots;           // tasksRun entries handed out to workers
+} ThreadPool;
+
+// Codec context: thread pool, block buffers and decode tables reused across
+// calls (batch mode, huff_context). Each job caches the tables of the blocks
+// it decoded; single-stream files share the workspace's own cache.
+typedef struct ContainerWorkspace {
+    ThreadPool* pool;
+    int threads;            // Threads running blocks, the calling thread included
+    BlockJob* jobs;
+    size_t window;          // Number of allocated jobs
+    size_t inputCapacity;   // Input buffer size per job
+    size_t outputCapacity;  // Output buffer size per job
+    struct DecodeTableCache* tables;  // Decode tables of single-stream files
+} ContainerWorkspace;
+
+// Batch Entry (one file to compress or decompress)
+typedef struct BatchEntry {
+    char* input;
+    char* output;
+} BatchEntry;
+
+// Batch File List
+typedef struct BatchList {
+    BatchEntry* entries;
+    size_t count;
+    size_t capacity;
+} BatchList;
+
+// Decode Table Entry
+// count > 0: up to two symbols, 'length' total bits, 'firstLength' bits for symbols[0]
+// count == 0 && length > 0: link to a subtable at 'next' indexed by 'subBits' bits
+// count == 0 && length == 0: invalid bit sequence
+typedef struct DecodeEntry {
+    uint16_t next;
+    uint8_t symbols[2];
+    uint8_t length;
+    uint8_t firstLength;
+    uint8_t count;
+    uint8_t subBits;
+} DecodeEntry;
+
+// Multi-level Decode Table (primary table followed by subtables)
+typedef struct DecodeTable {
+    DecodeEntry* entries;
+    int size;
+    int primaryBits;
+} DecodeTable;
+
+// Trained Code Table (every byte has a code; the decoder is built once and reused)
+typedef struct CodeTable {
+    uint32_t id;                  // Hash of the code lengths, recorded in every message
+    uint8_t lengths[ASCII_SIZE];
+    CodeEntry codes[ASCII_SIZE];
+    DecodeTable* decoder;
+} CodeTable;
+
+// Decode Table Cache: tables keyed by the code lengths (or, for legacy
+// streams, the frequencies) they were built from, so repeated headers skip
+// table construction. Not thread-safe; each block job has its own.
+typedef struct CachedDecodeTable {
+    DecodeTable* table;     // NULL = empty slot
+    uint64_t hash;
+    uint64_t lastUse;
+    size_t keySize;
+    unsigned char key[DECODE_CACHE_KEY_SIZE];
+} CachedDecodeTable;
+
+typedef struct DecodeTableCache {
+    CachedDecodeTable entries[DECODE_CACHE_ENTRIES];
+    uint64_t clock;         // Advanced on every use
+    uint64_t hits;
+    uint64_t misses;
+} DecodeTableCache;
+
+// Buffered 64-bit Bit Reservoir (MSB-first, next bit is bit 63)
+typedef struct BitReader {
+    FILE* file;                 // NULL when reading from memory
+    unsigned char* storage;     // Refill buffer for file input
+    const unsigned char* data;  // Bytes currently being consumed
+    size_t position;
+    size_t length;
+    uint64_t bits;
+    int bitCount;
+    int overrunBytes;           // Zero bytes shifted in past the end of the input
+    uint64_t lookups;           // Decode table lookups made through this reader
+    uint64_t longCodes;         // Codes among them resolved through a subtable
+} BitReader;
+
+// Input Source (the FILE* is always open; map is set for mapped regular files)
+typedef struct InputSource {
+    FILE* file;
+    const unsigned char* map;
+    uint64_t size;             // STREAM_SIZE_UNKNOWN unless the input is a regular file
+} InputSource;
+
+// Output Sink: decoders reserve each piece of output, decode into the
+// destination they get back and commit it in order. map is set once
+// preallocateOutput has mapped the file, or by openBufferSink to a caller's
+// buffer; pipes, sockets and O_DIRECT files hand out buffers of their own.
+typedef struct OutputSink {
+    FILE* file;                // NULL for buffer sinks
+    unsigned char* map;
+    uint64_t mapSize;
+    uint64_t reserved;         // Bytes handed out by reserveOutput
+    uint64_t position;         // Bytes committed
+    int mappable;
+    int borrowed;              // map is the caller's buffer (not unmapped on close)
+    struct SpliceOutput* splice;  // Pipe or socket fed with vmsplice, or NULL
+    struct DirectOutput* direct;  // File written with O_DIRECT, or NULL
+} OutputSink;
+
+// Block offsets of a container being written or read
+typedef struct ContainerIndex {
+    uint64_t* offsets;
+    uint64_t* rawOffsets;  // Uncompressed offset of each block
+    size_t count;
+    size_t capacity;
+    uint64_t offset;       // Offset of the next block header
+    uint64_t rawOffset;    // Uncompressed offset of the next block
+} ContainerIndex;
+
+// Compressed Scan: blocks of a container held in memory are decoded piece by
+// piece into one buffer and searched as they are produced. The buffer starts
+// with the last patternSize - 1 bytes of the previous piece, so matches that
+// cross a piece boundary are found.
+typedef struct ContainerScan {
+    const unsigned char* data;   // Container bytes
+    ContainerHeader header;
+    ContainerIndex index;
+    ThreadPool* pool;
+    unsigned char* pattern;      // Owned copy of the pattern
+    size_t patternSize;
+    unsigned char* buffer;
+    size_t piece;                // Uncompressed bytes decoded per refill
+    size_t filled;               // Valid bytes in buffer
+    size_t position;             // Next buffer position a match may start at
+    uint64_t bufferOffset;       // Uncompressed offset of buffer[0]
+    uint64_t next;               // Next uncompressed byte to decode
+    uint64_t end;                // End of the scanned range
+    uint64_t matches;            // Matches returned so far
+    CodecStats* stats;           // Receives the blocks' work, or NULL
+} ContainerScan;
+
+// Block Pipeline: a ring of jobs passed from a reader thread to the coders
+// (on the calling thread) to a writer thread. The counters only grow; block
+// n lives in jobs[n % capacity] and drained <= coded <= filled <= drained + capacity.
+typedef struct BlockPipeline {
+    BlockJob* jobs;
+    size_t capacity;           // Slots in the ring (PIPELINE_DEPTH windows)
+    size_t window;             // Most blocks coded per round
+    size_t filled;             // Blocks read
+    size_t coded;              // Blocks coded
+    size_t drained;            // Blocks written; their slots are free again
+    int endOfInput;
+    int failed;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    InputSource* input;
+    FILE* outputFile;          // Compression output
+    OutputSink* sink;          // Decompression output (NULL when compressing)
+    IoBackend ioBackend;
+    uint32_t blockSize;
+    const ContainerHeader* header;
+    ContainerIndex* index;
+    uint64_t decodedSize;
+    CodecStats* stats;         // Receives the coders' work and idle time (NULL = not collected)
+} BlockPipeline;
+
+// io_uring submission and completion queues (opaque; see huffman_uring.c)
+typedef struct IoRing IoRing;
+
+// Zero-copy output paths of an OutputSink (opaque; see huffman_sink.c)
+typedef struct SpliceOutput SpliceOutput;
+typedef struct DirectOutput DirectOutput;
+
+// Synthetic Benchmark Corpora
+typedef enum CorpusKind {
+    CORPUS_TEXT,     // Words with Zipf-like frequencies
+    CORPUS_BINARY,   // Fixed-size records with zero padding
+    CORPUS_SKEWED,   // Geometric byte distribution
+    CORPUS_UNIFORM,  // Uniformly random bytes
+    CORPUS_SINGLE,   // One repeated symbol
+    CORPUS_COUNT
+} CorpusKind;
+
+// Benchmark Result: fastest wall-clock round trip, and the smallest thread
+// time of each phase over all iterations, in seconds
+typedef struct BenchmarkResult {
+    size_t inputSize;
+    size_t compressedSize;
+    int iterations;
+    int threads;
+    int streams;
+    uint64_t blocks;         // Container blocks written per compression
+    double compressSeconds;
+    double decompressSeconds;
+    double histogramSeconds;
+    double treeSeconds;      // Block type, code lengths, context model and canonical codes
+    double tableSeconds;     // Code length headers and decode tables
+    double encodeSeconds;
+    double decodeSeconds;
+    double checksumSeconds;  // Computing and verifying block checksums
+} BenchmarkResult;
+
+// Buffered 64-bit Bit Accumulator (MSB-first, pending bits are left-aligned)
+typedef struct BitWriter {
+    FILE* file;             // NULL when writing to memory
+    unsigned char* buffer;
+    size_t capacity;
+    size_t position;
+    uint64_t bits;
+    int bitCount;
+    uint64_t flushed;       // Bytes already written to file
+} BitWriter;
+
+// Codec Kernel Set: the inner loops built for one instruction set, chosen once per process
+typedef struct CodecKernels {
+    const char* name;
+    void (*countFrequencies)(const unsigned char* data, size_t size,
+                             uint64_t frequencies[ASCII_SIZE]);
+    int (*encodeSymbols)(BitWriter* writer, const CodeEntry codes[ASCII_SIZE],
+                         const unsigned char* input, size_t count);
+    int (*decodeSymbols)(BitReader* reader, const DecodeTable* table,
+                         unsigned char* output, size_t count);
+    int (*decodeInterleaved)(BitReader readers[INTERLEAVED_STREAMS], const DecodeTable* table,
+                             unsigned char* output, size_t size);
+    uint32_t (*crc32c)(uint32_t crc, const unsigned char* data, size_t size);
+} CodecKernels;
+
 // Function Declarations
 
 // Memory Management
-HuffmanNode* createNode(unsigned char character, unsigned int frequency);
-void destroyTree(HuffmanNode* root);
+void initTree(HuffmanTree* tree);
+HuffmanNode* createNode(HuffmanTree* tree, unsigned char character, uint64_t frequency);
+void destroyTree(HuffmanTree* tree);
 void destroyHeap(MinHeap* heap);
 
 // Min-Heap Operations
@@ -56,33 +537,247 @@ void insertMinHeap(MinHeap* heap, HuffmanNode* node);
 int isHeapEmpty(MinHeap* heap);
 
 // Frequency Calculation
-int calculateFrequencies(const char* filename, unsigned int frequencies[ASCII_SIZE]);
+int64_t calculateFrequencies(const char* filename, uint64_t frequencies[ASCII_SIZE]);
+void countFrequencies(const unsigned char* data, size_t size, uint64_t frequencies[ASCII_SIZE]);
+int countFrequenciesParallel(ThreadPool* pool, const unsigned char* data, size_t size,
+                             uint64_t frequencies[ASCII_SIZE]);
 
 // Huffman Tree Construction
-HuffmanNode* buildHuffmanTree(unsigned int frequencies[ASCII_SIZE]);
+HuffmanNode* buildHuffmanTree(HuffmanTree* tree, uint64_t frequencies[ASCII_SIZE]);
 
 // Code Generation
 void generateCodes(HuffmanNode* root, CodeEntry codes[ASCII_SIZE], char* currentCode, int depth);
 void buildCodeTable(HuffmanNode* root, CodeEntry codes[ASCII_SIZE]);
 
 // Compression
+void initCompressOptions(CompressOptions* options);
 int compressFile(const char* inputFile, const char* outputFile);
+int compressFileWithOptions(const char* inputFile, const char* outputFile,
+                            const CompressOptions* options);
 void writeFileHeader(FILE* file, FileHeader* header);
-void writeFrequencies(FILE* file, unsigned int frequencies[ASCII_SIZE]);
+void writeFrequencies(FILE* file, const uint64_t frequencies[ASCII_SIZE], int wide);
+void writeSyncTable(FILE* file, uint32_t interval, const uint64_t* points, uint32_t count);
 void encodeAndWrite(FILE* inputFile, FILE* outputFile, CodeEntry codes[ASCII_SIZE]);
+int encodeWithPackedCodes(InputSource* input, FILE* outputFile, CodeEntry codes[ASCII_SIZE],
+                          uint32_t syncInterval, uint64_t* syncPoints, uint32_t syncCount);
+int encodeSymbols(BitWriter* writer, const CodeEntry codes[ASCII_SIZE],
+                  const unsigned char* input, size_t count);
+int encodeStreams(const CodeEntry codes[ASCII_SIZE], const unsigned char* input, size_t size,
+                  int streams, unsigned char* output, size_t capacity, size_t* written);
 
 // Decompression
+void initDecompressOptions(DecompressOptions* options);
 int decompressFile(const char* inputFile, const char* outputFile);
+int decompressFileWithOptions(const char* inputFile, const char* outputFile,
+                              const DecompressOptions* options);
 int readFileHeader(FILE* file, FileHeader* header);
-int readFrequencies(FILE* file, unsigned int frequencies[ASCII_SIZE], int count);
-void decodeAndWrite(FILE* inputFile, FILE* outputFile, HuffmanNode* root, 
-                   unsigned int originalSize, int paddingBits);
+int readFileHeaderFields(FILE* file, FileHeader* header);
+int readFrequencies(FILE* file, uint64_t frequencies[ASCII_SIZE], int count, int wide);
+int decodeAndWrite(FILE* inputFile, FILE* outputFile, HuffmanNode* root,
+                   uint64_t originalSize, int paddingBits);
+
+// Canonical Codes
+int computeLimitedCodeLengths(const uint64_t frequencies[ASCII_SIZE], int maxLength,
+                              uint8_t lengths[ASCII_SIZE]);
+int assignCanonicalCodes(const uint8_t lengths[ASCII_SIZE], CodeEntry codes[ASCII_SIZE]);
+size_t packCodeLengths(const uint8_t lengths[ASCII_SIZE], unsigned char* output);
+int unpackCodeLengths(const unsigned char* input, size_t size, uint8_t lengths[ASCII_SIZE],
+                      size_t* consumed);
+void writeCodeLengths(FILE* file, const uint8_t lengths[ASCII_SIZE]);
+int readCodeLengths(FILE* file, uint8_t lengths[ASCII_SIZE]);
+HuffmanNode* buildTreeFromCodes(HuffmanTree* tree, CodeEntry codes[ASCII_SIZE]);
+
+// Table-driven Decoding
+DecodeTable* createDecodeTable(HuffmanNode* root);
+DecodeTable* createCanonicalDecodeTable(const uint8_t lengths[ASCII_SIZE]);
+void destroyDecodeTable(DecodeTable* table);
+DecodeTableCache* createDecodeTableCache(void);
+void destroyDecodeTableCache(DecodeTableCache* cache);
+const DecodeTable* findCachedDecodeTable(DecodeTableCache* cache, const void* key,
+                                         size_t keySize);
+int insertCachedDecodeTable(DecodeTableCache* cache, const void* key, size_t keySize,
+                            DecodeTable* table);
+const DecodeTable* acquireCanonicalDecodeTable(DecodeTableCache* cache,
+                                               const uint8_t lengths[ASCII_SIZE],
+                                               DecodeTable** owned, BlockStats* stats);
+int decodeWithTable(InputSource* input, OutputSink* output, const DecodeTable* table,
+                    uint64_t originalSize, BlockStats* stats);
+int decodeWithSyncPoints(InputSource* input, OutputSink* output, const DecodeTable* table,
+                         const FileHeader* header, ThreadPool* pool, BlockStats* stats);
+int decodeSymbols(BitReader* reader, const DecodeTable* table,
+                  unsigned char* output, size_t count);
+int decodeInterleaved(BitReader readers[INTERLEAVED_STREAMS], const DecodeTable* table,
+                      unsigned char* output, size_t size);
+int decodeStreams(const DecodeTable* table, const unsigned char* input, size_t size,
+                  int streams, unsigned char* output, size_t count, BlockStats* stats);
+
+// Context Modeling
+int buildContextModel(const unsigned char* input, size_t size, int streams, int maxCodeLength,
+                      ContextModel* model);
+int encodeContextBlock(const ContextModel* model, const unsigned char* input, size_t size,
+                       int streams, unsigned char* output, size_t capacity, size_t* written);
+int decodeContextBlock(const unsigned char* payload, size_t size, int streams,
+                       unsigned char* output, size_t count, BlockStats* stats);
+
+// Block Container
+size_t blockPayloadBound(size_t rawSize);
+size_t blockJobOutputBound(size_t rawSize);
+size_t containerBound(size_t size);
+int compressBlock(BlockJob* job, int maxCodeLength, int streams, int splitLevel,
+                  int contextModel, int checksums, BlockStats* stats);
+int decompressBlock(BlockJob* job, int streams, int typed, int checksums, BlockStats* stats);
+void writeContainerHeader(FILE* file, const ContainerHeader* header);
+int readContainerHeader(FILE* file, ContainerHeader* header);
+int validateContainerHeader(const ContainerHeader* header);
+void compressBlockTask(void* context, size_t index);
+void decompressBlockTask(void* context, size_t index);
+BlockJob* createBlockJobs(size_t count, size_t inputCapacity, size_t outputCapacity);
+void destroyBlockJobs(BlockJob* jobs, size_t count);
+void initContainerIndex(ContainerIndex* index);
+int appendIndexEntry(ContainerIndex* index, uint64_t blockBytes, uint32_t rawSize);
+void destroyContainerIndex(ContainerIndex* index);
+int readContainerIndex(const unsigned char* data, size_t size, ContainerHeader* header,
+                       ContainerIndex* index);
+int decodeContainerRange(const unsigned char* data, const ContainerHeader* header,
+                         const ContainerIndex* index, ThreadPool* pool, uint64_t start,
+                         size_t length, unsigned char* output, CodecStats* stats);
+int compressContainer(InputSource* input, FILE* outputFile, const CompressOptions* options);
+int decompressContainer(InputSource* input, OutputSink* output, const DecompressOptions* options);
+int decompressFileRange(const char* inputFile, const char* outputFile, uint64_t start,
+                        uint64_t length, const DecompressOptions* options);
+
+// Compressed Scan
+int openContainerScan(ContainerScan* scan, const unsigned char* data, size_t size,
+                      const unsigned char* pattern, size_t patternSize, uint64_t start,
+                      uint64_t length, int threads, CodecStats* stats);
+int nextScanMatch(ContainerScan* scan, uint64_t* offset);
+void closeContainerScan(ContainerScan* scan);
+int scanFile(const char* inputFile, const unsigned char* pattern, size_t patternSize,
+             uint64_t start, uint64_t length, const DecompressOptions* options,
+             uint64_t* matches);
+
+// Block Pipeline
+int compressBlocksPipelined(InputSource* input, FILE* outputFile, const CompressOptions* options,
+                            ThreadPool* pool, size_t window, ContainerIndex* index);
+int decompressBlocksPipelined(InputSource* input, OutputSink* output,
+                              const ContainerHeader* header, const DecompressOptions* options,
+                              ThreadPool* pool, size_t window, ContainerIndex* index,
+                              uint64_t* decodedSize);
+
+// Trained Code Tables
+int createCodeTable(CodeTable* table, const uint64_t frequencies[ASCII_SIZE], int maxCodeLength);
+void destroyCodeTable(CodeTable* table);
+void serializeCodeTable(const CodeTable* table, unsigned char* output);
+int parseCodeTable(CodeTable* table, const unsigned char* data, size_t size);
+int trainCodeTable(const char* path, int maxCodeLength, int quiet, CodeTable* table);
+int saveCodeTable(const CodeTable* table, const char* path);
+int loadCodeTable(CodeTable* table, const char* path);
+size_t tableMessageBound(size_t size);
+int encodeTableMessage(const CodeTable* table, const unsigned char* input, size_t size,
+                       unsigned char* output, size_t* written);
+int readTableMessageFields(const unsigned char* input, size_t size, uint32_t* id,
+                           uint64_t* originalSize, size_t* consumed);
+int decodeTableMessage(const CodeTable* table, const unsigned char* input, size_t size,
+                       unsigned char* output, size_t capacity, size_t* decoded);
+int compressWithCodeTable(InputSource* input, FILE* outputFile, const CompressOptions* options);
+int decompressWithCodeTable(InputSource* input, OutputSink* output,
+                            const DecompressOptions* options);
+
+// Batch Mode
+int initContainerWorkspace(ContainerWorkspace* workspace, int threads);
+BlockJob* acquireWorkspaceJobs(ContainerWorkspace* workspace, size_t window,
+                               size_t inputCapacity, size_t outputCapacity);
+void destroyContainerWorkspace(ContainerWorkspace* workspace);
+int readBatchManifest(BatchList* list, const char* path, int decompress);
+int collectBatchDirectory(BatchList* list, const char* directory, int decompress);
+void destroyBatchList(BatchList* list);
+int runBatch(const BatchList* list, int workers, int decompress,
+             const CompressOptions* compressOptions, const DecompressOptions* decompressOptions,
+             FILE* statsFile);
+
+// io_uring Queue
+IoRing* createIoRing(unsigned entries);
+int submitRingRead(IoRing* ring, int fd, void* buffer, size_t size, uint64_t offset,
+                   uint64_t tag);
+int submitRingWrite(IoRing* ring, int fd, const void* buffer, size_t size, uint64_t offset,
+                    uint64_t tag);
+int waitRingCompletion(IoRing* ring, uint64_t* tag, int64_t* result);
+void destroyIoRing(IoRing* ring);
+int ioRingAvailable(void);
+
+// Zero-copy Output
+SpliceOutput* createSpliceOutput(int fd);
+unsigned char* reserveSpliceOutput(SpliceOutput* output, size_t size);
+int writeSpliceOutput(SpliceOutput* output, const unsigned char* data, size_t size);
+void destroySpliceOutput(SpliceOutput* output);
+DirectOutput* createDirectOutput(const char* path, int fd);
+unsigned char* reserveDirectOutput(DirectOutput* output, size_t size);
+int writeDirectOutput(DirectOutput* output, const unsigned char* data, size_t size);
+int destroyDirectOutput(DirectOutput* output);
+int directOutputAvailable(void);
+
+// Input Sources and Output Sinks
+int openInputSource(InputSource* source, const char* path, IoBackend backend);
+const unsigned char* readInputSpan(InputSource* source, unsigned char* buffer,
+                                   size_t size, size_t* count);
+int rewindInputSource(InputSource* source);
+void closeInputSource(InputSource* source);
+int openOutputSink(OutputSink* sink, const char* path, IoBackend backend);
+void openBufferSink(OutputSink* sink, unsigned char* buffer, size_t capacity);
+void preallocateOutput(OutputSink* sink, uint64_t size);
+unsigned char* reserveOutput(OutputSink* sink, unsigned char* buffer, size_t size);
+int commitOutput(OutputSink* sink, const unsigned char* data, size_t size);
+int closeOutputSink(OutputSink* sink);
+char* createTemporaryOutput(const char* path);
+int finishTemporaryOutput(char* temporary, const char* path, int result);
+
+// Thread Pool
+int resolveThreadCount(int requested);
+ThreadPool* createThreadPool(int threads);
+void runParallel(ThreadPool* pool, TaskFunction function, void* context, size_t count);
+void destroyThreadPool(ThreadPool* pool);
+
+// Benchmark
+void generateCorpus(CorpusKind kind, unsigned char* buffer, size_t size);
+int benchmarkBuffer(const unsigned char* data, size_t size, int iterations,
+                    const CompressOptions* compressOptions,
+                    const DecompressOptions* decompressOptions, BenchmarkResult* result);
+void printBenchmarkResult(const char* name, const BenchmarkResult* result);
+int runBenchmark(const char* inputFile, int iterations, const CompressOptions* compressOptions,
+                 const DecompressOptions* decompressOptions);
+
+// Kernel Dispatch
+const CodecKernels* codecKernels(void);
+int selectCodecKernels(const char* name);
+void listCodecKernels(FILE* file);
+int codecKernelNames(const char* names[4]);
+uint32_t computeCrc32c(const unsigned char* data, size_t size);
+
+// Statistics
+void beginCodecStats(CodecStats* stats);
+void endCodecStats(CodecStats* stats);
+void addBlockStats(BlockStats* total, const BlockStats* part);
+void collectBlockStats(CodecStats* stats, const BlockJob* jobs, size_t count);
+void resetPoolStats(ThreadPool* pool);
+void collectPoolStats(CodecStats* stats, ThreadPool* pool);
+void writeStatsJson(FILE* file, const char* operation, const char* inputFile,
+                    const char* outputFile, int result, const CodecStats* stats);
+
+// Error Reporting
+void setLogHandler(LogHandler handler, void* user);
+void reportError(const char* format, ...);
+void reportWarning(const char* format, ...);
 
 // Utility Functions
+double wallClockSeconds(void);
 void printCompressionStats(const char* inputFile, const char* outputFile);
+void printCompressionSummary(uint64_t originalSize, uint64_t compressedSize);
 void printHuffmanCodes(CodeEntry codes[ASCII_SIZE]);
-void printUsage(const char* programName);
 int validateFiles(const char* inputFile, const char* outputFile);
+int isStdioPath(const char* path);
+FILE* openInputStream(const char* path);
+FILE* openOutputStream(const char* path);
+int closeStream(FILE* file);
 
 // Bit Operations
 typedef struct BitBuffer {
@@ -94,4 +789,84 @@ void writeBit(FILE* file, BitBuffer* bitBuffer, int bit);
 void flushBits(FILE* file, BitBuffer* bitBuffer);
 int readBit(FILE* file, unsigned char* currentByte, int* bitPosition);
 
+void initBitReader(BitReader* reader, FILE* file, unsigned char* storage);
+void initBitReaderMemory(BitReader* reader, const unsigned char* data, size_t size);
+void refillBits(BitReader* reader);
+int checkBitReaderOverrun(const BitReader* reader);
+
+void initBitWriter(BitWriter* writer, FILE* file, unsigned char* buffer, size_t capacity);
+void drainBits(BitWriter* writer);
+int finishBitWriter(BitWriter* writer);
+
+/**
+ * Loads 8 bytes as a big-endian 64-bit value
+ * @param bytes Pointer to at least 8 readable bytes
+ * @return The loaded value, first byte in the most significant position
+ */
+static inline uint64_t load64BE(const unsigned char* bytes) {
+    return ((uint64_t)bytes[0] << 56) | ((uint64_t)bytes[1] << 48) |
+           ((uint64_t)bytes[2] << 40) | ((uint64_t)bytes[3] << 32) |
+           ((uint64_t)bytes[4] << 24) | ((uint64_t)bytes[5] << 16) |
+           ((uint64_t)bytes[6] << 8)  | (uint64_t)bytes[7];
+}
+
+/**
+ * Stores a 64-bit value as 8 big-endian bytes
+ * @param bytes Pointer to at least 8 writable bytes
+ * @param value Value to store, most significant byte first
+ */
+static inline void store64BE(unsigned char* bytes, uint64_t value) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap64(value);
+    memcpy(bytes, &value, sizeof(value));
+#else
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (unsigned char)(value >> (56 - 8 * i));
+    }
+#endif
+}
+
+/**
+ * Appends a code to the accumulator
+ * @param writer Bit writer
+ * @param code Code bits, right-aligned
+ * @param length Number of bits in code (1 to MAX_PACKED_CODE_LENGTH)
+ */
+static inline void putBits(BitWriter* writer, uint64_t code, int length) {
+    if (writer->bitCount + length > 64) {
+        drainBits(writer);
+    }
+
+    writer->bits |= code << (64 - writer->bitCount - length);
+    writer->bitCount += length;
+}
+
+/**
+ * Returns the number of symbols in each interleaved sub-stream but the last
+ * @param size Number of symbols in the block
+ * @return Symbols per sub-stream; the last one holds the remainder
+ */
+static inline size_t interleavedSegmentSize(size_t size) {
+    return (size + INTERLEAVED_STREAMS - 1) / INTERLEAVED_STREAMS;
+}
+
+// Adds the time since 'mark' to a BlockStats phase and restarts 'mark'
+// (nothing without stats, so untracked calls never read the clock)
+#define CHARGE_PHASE(stats, phase, mark) \
+    do { \
+        if (stats) { \
+            double now_ = wallClockSeconds(); \
+            (stats)->phase += now_ - (mark); \
+            (mark) = now_; \
+        } \
+    } while (0)
+
+// Fast refill for a lane known to have 8 readable bytes (see refillBits)
+#define REFILL_LANE(r) \
+    do { \
+        (r).bits |= load64BE((r).data + (r).position) >> (r).bitCount; \
+        (r).position += (size_t)((63 - (r).bitCount) >> 3); \
+        (r).bitCount |= 56; \
+    } while (0)
+
 #endif // HUFFMAN_H
\ No newline at end of file
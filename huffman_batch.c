@@ -0,0 +1,438 @@
+#define _POSIX_C_SOURCE 200809L  // lstat, opendir, getline, strdup
+#include <dirent.h>
+#include "huffman.h"
+
+#define BATCH_SUFFIX ".huf"
+#define BATCH_DECODED_SUFFIX ".out"
+
+// =============================================================================
+// CONTAINER WORKSPACES
+// =============================================================================
+
+/**
+ * Creates the thread pool and decode table cache of a workspace; block
+ * buffers are allocated on first use
+ * @param workspace Workspace to initialize
+ * @param threads Threads per container call, the calling thread included
+ * @return 0 on success, -1 on error
+ */
+int initContainerWorkspace(ContainerWorkspace* workspace, int threads) {
+    memset(workspace, 0, sizeof(*workspace));
+    workspace->threads = threads > 0 ? threads : 1;
+    workspace->pool = createThreadPool(workspace->threads);
+    workspace->tables = createDecodeTableCache();
+    if (!workspace->pool || !workspace->tables) {
+        destroyContainerWorkspace(workspace);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Returns the workspace's block jobs, reallocating them only when a call
+ * needs more jobs or larger buffers than the previous ones
+ * @param workspace Workspace
+ * @param window Number of jobs needed
+ * @param inputCapacity Input buffer size needed per job
+ * @param outputCapacity Output buffer size needed per job
+ * @return Jobs with input and output reset to the owned buffers, or NULL on failure
+ */
+BlockJob* acquireWorkspaceJobs(ContainerWorkspace* workspace, size_t window,
+                               size_t inputCapacity, size_t outputCapacity) {
+    if (!workspace->jobs || window > workspace->window ||
+        inputCapacity > workspace->inputCapacity ||
+        outputCapacity > workspace->outputCapacity) {
+        size_t newWindow = window > workspace->window ? window : workspace->window;
+        size_t newInput = inputCapacity > workspace->inputCapacity
+            ? inputCapacity : workspace->inputCapacity;
+        size_t newOutput = outputCapacity > workspace->outputCapacity
+            ? outputCapacity : workspace->outputCapacity;
+
+        destroyBlockJobs(workspace->jobs, workspace->window);
+        workspace->jobs = createBlockJobs(newWindow, newInput, newOutput);
+        if (!workspace->jobs) {
+            workspace->window = workspace->inputCapacity = workspace->outputCapacity = 0;
+            return NULL;
+        }
+        workspace->window = newWindow;
+        workspace->inputCapacity = newInput;
+        workspace->outputCapacity = newOutput;
+    }
+
+    for (size_t i = 0; i < workspace->window; i++) {
+        BlockJob* job = &workspace->jobs[i];
+        job->input = job->inputBuffer;
+        job->output = job->outputBuffer;
+        job->outputCapacity = workspace->outputCapacity;
+        job->inputSize = job->outputSize = job->parts = 0;
+        job->result = 0;
+    }
+    return workspace->jobs;
+}
+
+/**
+ * Frees a workspace's thread pool, block buffers and cached decode tables
+ * @param workspace Workspace to destroy
+ */
+void destroyContainerWorkspace(ContainerWorkspace* workspace) {
+    destroyBlockJobs(workspace->jobs, workspace->window);
+    destroyThreadPool(workspace->pool);
+    destroyDecodeTableCache(workspace->tables);
+    memset(workspace, 0, sizeof(*workspace));
+}
+
+// =============================================================================
+// BATCH FILE LISTS
+// =============================================================================
+
+/**
+ * Checks whether a path ends with the compressed-file suffix
+ * @param path File path
+ * @return 1 if it does, 0 otherwise
+ */
+static int hasBatchSuffix(const char* path) {
+    size_t length = strlen(path);
+    size_t suffix = strlen(BATCH_SUFFIX);
+    return length > suffix && strcmp(path + length - suffix, BATCH_SUFFIX) == 0;
+}
+
+/**
+ * Derives the output path of a batch input
+ * Compression appends ".huf"; decompression strips it, or appends ".out"
+ * to inputs without it.
+ * @param input Input path
+ * @param decompress Nonzero for decompression
+ * @return Newly allocated output path, or NULL on failure
+ */
+static char* batchOutputPath(const char* input, int decompress) {
+    size_t length = strlen(input);
+    char* output = (char*)malloc(length + strlen(BATCH_DECODED_SUFFIX) + strlen(BATCH_SUFFIX) + 1);
+    if (!output) return NULL;
+
+    if (!decompress) {
+        snprintf(output, length + strlen(BATCH_SUFFIX) + 1, "%s%s", input, BATCH_SUFFIX);
+    } else if (hasBatchSuffix(input)) {
+        memcpy(output, input, length - strlen(BATCH_SUFFIX));
+        output[length - strlen(BATCH_SUFFIX)] = '\0';
+    } else {
+        snprintf(output, length + strlen(BATCH_DECODED_SUFFIX) + 1, "%s%s", input,
+                 BATCH_DECODED_SUFFIX);
+    }
+    return output;
+}
+
+/**
+ * Appends one file to a batch list
+ * @param list Batch list
+ * @param input Input path (copied)
+ * @param output Output path (copied), or NULL to derive it from the input
+ * @param decompress Nonzero for decompression
+ * @return 0 on success, -1 on error
+ */
+static int appendBatchEntry(BatchList* list, const char* input, const char* output,
+                            int decompress) {
+    if (isStdioPath(input) || (output && isStdioPath(output))) {
+        reportError("Batch entries cannot use standard input/output");
+        return -1;
+    }
+
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        BatchEntry* entries = (BatchEntry*)realloc(list->entries, capacity * sizeof(BatchEntry));
+        if (!entries) {
+            reportError("Memory allocation failed for batch list");
+            return -1;
+        }
+        list->entries = entries;
+        list->capacity = capacity;
+    }
+
+    BatchEntry* entry = &list->entries[list->count];
+    entry->input = strdup(input);
+    entry->output = output ? strdup(output) : batchOutputPath(input, decompress);
+    if (!entry->input || !entry->output) {
+        reportError("Memory allocation failed for batch list");
+        free(entry->input);
+        free(entry->output);
+        return -1;
+    }
+    list->count++;
+    return 0;
+}
+
+/**
+ * Reads a batch manifest: one input path per line, optionally followed by a
+ * tab and its output path. Blank lines and lines starting with '#' are skipped.
+ * @param list Batch list to append to
+ * @param path Manifest path
+ * @param decompress Nonzero for decompression (selects the derived output names)
+ * @return 0 on success, -1 on error
+ */
+int readBatchManifest(BatchList* list, const char* path, int decompress) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        reportError("Cannot open batch list '%s'", path);
+        return -1;
+    }
+
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t length;
+    int result = 0;
+
+    while (result == 0 && (length = getline(&line, &lineCapacity, file)) != -1) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        if (length == 0 || line[0] == '#') continue;
+
+        char* output = strchr(line, '\t');
+        if (output) {
+            *output++ = '\0';
+            if (*output == '\0') output = NULL;
+        }
+        if (line[0] == '\0') {
+            reportError("Batch list line has no input path");
+            result = -1;
+            break;
+        }
+        result = appendBatchEntry(list, line, output, decompress);
+    }
+
+    if (result == 0 && ferror(file)) {
+        reportError("Failed to read batch list '%s'", path);
+        result = -1;
+    }
+
+    free(line);
+    fclose(file);
+    return result;
+}
+
+/**
+ * Adds the regular files under a directory, recursively; symbolic links are
+ * not followed. Compression skips ".huf" files, decompression takes only them.
+ * @param list Batch list to append to
+ * @param directory Directory path
+ * @param decompress Nonzero for decompression
+ * @return 0 on success, -1 on error
+ */
+int collectBatchDirectory(BatchList* list, const char* directory, int decompress) {
+    DIR* dir = opendir(directory);
+    if (!dir) {
+        reportError("Cannot open directory '%s'", directory);
+        return -1;
+    }
+
+    struct dirent* entry;
+    int result = 0;
+    while (result == 0 && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        size_t length = strlen(directory) + strlen(entry->d_name) + 2;
+        char* path = (char*)malloc(length);
+        if (!path) {
+            reportError("Memory allocation failed for batch path");
+            result = -1;
+            break;
+        }
+        snprintf(path, length, "%s/%s", directory, entry->d_name);
+
+        struct stat info;
+        if (lstat(path, &info) != 0) {
+            reportWarning("Cannot access '%s', skipped", path);
+        } else if (S_ISDIR(info.st_mode)) {
+            result = collectBatchDirectory(list, path, decompress);
+        } else if (S_ISREG(info.st_mode) && hasBatchSuffix(path) == (decompress != 0)) {
+            result = appendBatchEntry(list, path, NULL, decompress);
+        }
+        free(path);
+    }
+
+    closedir(dir);
+    return result;
+}
+
+/**
+ * Frees the paths and entries of a batch list
+ * @param list Batch list
+ */
+void destroyBatchList(BatchList* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->entries[i].input);
+        free(list->entries[i].output);
+    }
+    free(list->entries);
+    memset(list, 0, sizeof(*list));
+}
+
+// =============================================================================
+// BATCH MODE
+// =============================================================================
+
+// State shared by the batch workers
+typedef struct BatchRun {
+    const BatchList* list;
+    int decompress;
+    const CompressOptions* compressOptions;
+    const DecompressOptions* decompressOptions;
+    ContainerWorkspace* workspaces;  // One per worker
+    FILE* statsFile;                 // Receives a JSON line per file, or NULL
+    pthread_mutex_t mutex;
+    size_t nextEntry;
+    size_t failures;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+} BatchRun;
+
+/**
+ * Worker task: takes files from the shared list until none are left,
+ * running each one through the worker's own workspace
+ * @param context Batch run
+ * @param index Worker number
+ */
+static void batchWorkerTask(void* context, size_t index) {
+    BatchRun* run = (BatchRun*)context;
+    ContainerWorkspace* workspace = &run->workspaces[index];
+
+    CompressOptions compressOptions = *run->compressOptions;
+    DecompressOptions decompressOptions = *run->decompressOptions;
+    compressOptions.quiet = decompressOptions.quiet = 1;
+    compressOptions.threads = decompressOptions.threads = workspace->threads;
+    compressOptions.workspace = decompressOptions.workspace = workspace;
+    CodecStats stats;
+    compressOptions.stats = decompressOptions.stats = &stats;
+
+    while (1) {
+        pthread_mutex_lock(&run->mutex);
+        size_t next = run->nextEntry++;
+        pthread_mutex_unlock(&run->mutex);
+        if (next >= run->list->count) break;
+
+        const BatchEntry* entry = &run->list->entries[next];
+        int result = run->decompress
+            ? decompressFileWithOptions(entry->input, entry->output, &decompressOptions)
+            : compressFileWithOptions(entry->input, entry->output, &compressOptions);
+
+        if (result != 0) {
+            reportError("Batch entry '%s' failed", entry->input);
+        }
+
+        pthread_mutex_lock(&run->mutex);
+        if (result != 0) {
+            run->failures++;
+        } else {
+            run->bytesIn += stats.bytesIn;
+            run->bytesOut += stats.bytesOut;
+        }
+        if (run->statsFile) {
+            writeStatsJson(run->statsFile, run->decompress ? "decompress" : "compress",
+                           entry->input, entry->output, result, &stats);
+        }
+        pthread_mutex_unlock(&run->mutex);
+    }
+}
+
+/**
+ * Prints the totals of a finished batch run
+ * @param run Batch run
+ * @param decompress Nonzero for a decompression run
+ * @param seconds Wall-clock time of the run
+ */
+static void printBatchSummary(const BatchRun* run, int decompress, double seconds) {
+    // Throughput is measured on the uncompressed side in both directions
+    uint64_t rawBytes = decompress ? run->bytesOut : run->bytesIn;
+    size_t succeeded = run->list->count - run->failures;
+    printf("Succeeded: %zu, failed: %zu\n", succeeded, run->failures);
+    printf("Input: %llu bytes, output: %llu bytes", (unsigned long long)run->bytesIn,
+           (unsigned long long)run->bytesOut);
+    if (!decompress && run->bytesIn > 0) {
+        printf(" (%.2f%%)", (double)run->bytesOut * 100.0 / (double)run->bytesIn);
+    }
+    printf("\n");
+    if (seconds > 0) {
+        printf("Time: %.3f seconds, %.2f MB/s, %.1f files/s\n", seconds,
+               (double)rawBytes / seconds / 1e6, (double)succeeded / seconds);
+    }
+    printf("=== BATCH %s COMPLETED ===\n", decompress ? "DECOMPRESSION" : "COMPRESSION");
+}
+
+/**
+ * Compresses or decompresses every file of a batch list
+ * Up to 'workers' files are processed at once. Each worker keeps one thread
+ * pool and one set of block buffers for all of its files, and the threads
+ * left over when there are fewer files than workers go to the files' blocks.
+ * @param list Files to process
+ * @param workers Files processed concurrently (0 = all cores)
+ * @param decompress Nonzero to decompress, zero to compress
+ * @param compressOptions Options for each compressed file (threads, quiet and workspace are set per worker)
+ * @param decompressOptions Options for each decompressed file (likewise)
+ * @param statsFile Receives the statistics of each file as a JSON line, or NULL
+ * @return 0 if every file succeeded, -1 otherwise
+ */
+int runBatch(const BatchList* list, int workers, int decompress,
+             const CompressOptions* compressOptions, const DecompressOptions* decompressOptions,
+             FILE* statsFile) {
+    if (list->count == 0) {
+        reportError("Batch list is empty");
+        return -1;
+    }
+
+    int threads = resolveThreadCount(workers);
+    int running = (size_t)threads < list->count ? threads : (int)list->count;
+    int threadsPerFile = threads / running;
+
+    BatchRun run = {
+        .list = list,
+        .decompress = decompress,
+        .compressOptions = compressOptions,
+        .decompressOptions = decompressOptions,
+        .statsFile = statsFile,
+        .workspaces = (ContainerWorkspace*)calloc((size_t)running, sizeof(ContainerWorkspace))
+    };
+    ThreadPool* pool = run.workspaces ? createThreadPool(running) : NULL;
+    if (!pool) {
+        if (!run.workspaces) {
+            reportError("Memory allocation failed for batch workspaces");
+        }
+        free(run.workspaces);
+        return -1;
+    }
+
+    int result = 0;
+    int initialized = 0;
+    while (initialized < running && result == 0) {
+        result = initContainerWorkspace(&run.workspaces[initialized], threadsPerFile);
+        if (result == 0) initialized++;
+    }
+
+    if (result == 0) {
+        pthread_mutex_init(&run.mutex, NULL);
+        int quiet = decompress ? decompressOptions->quiet : compressOptions->quiet;
+        if (!quiet) {
+            printf("\n=== BATCH %s STARTED ===\n", decompress ? "DECOMPRESSION" : "COMPRESSION");
+            printf("Files: %zu (%d at a time, %d thread%s each)\n", list->count, running,
+                   threadsPerFile, threadsPerFile == 1 ? "" : "s");
+        }
+
+        double start = wallClockSeconds();
+        runParallel(pool, batchWorkerTask, &run, (size_t)running);
+        double seconds = wallClockSeconds() - start;
+        pthread_mutex_destroy(&run.mutex);
+
+        if (!quiet) {
+            printBatchSummary(&run, decompress, seconds);
+        }
+
+        if (run.failures > 0) {
+            result = -1;
+        }
+    }
+
+    for (int i = 0; i < initialized; i++) {
+        destroyContainerWorkspace(&run.workspaces[i]);
+    }
+    free(run.workspaces);
+    destroyThreadPool(pool);
+    return result;
+}
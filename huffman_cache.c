@@ -0,0 +1,133 @@
+#include "huffman.h"
+
+// =============================================================================
+// DECODE TABLE CACHE
+// =============================================================================
+
+/**
+ * Hashes a cache key (64-bit FNV-1a)
+ * @param key Key bytes
+ * @param keySize Number of bytes
+ * @return Hash of the key
+ */
+static uint64_t hashCacheKey(const unsigned char* key, size_t keySize) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < keySize; i++) {
+        hash = (hash ^ key[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Creates an empty decode table cache
+ * @return Cache, or NULL on allocation failure
+ */
+DecodeTableCache* createDecodeTableCache(void) {
+    DecodeTableCache* cache = (DecodeTableCache*)calloc(1, sizeof(DecodeTableCache));
+    if (!cache) {
+        reportError("Memory allocation failed for decode table cache");
+    }
+    return cache;
+}
+
+/**
+ * Frees a cache and every table it holds
+ * @param cache Cache to destroy (may be NULL)
+ */
+void destroyDecodeTableCache(DecodeTableCache* cache) {
+    if (!cache) return;
+
+    for (int i = 0; i < DECODE_CACHE_ENTRIES; i++) {
+        destroyDecodeTable(cache->entries[i].table);
+    }
+    free(cache);
+}
+
+/**
+ * Looks up the table built from a code description
+ * The hash picks candidates; the full key is compared, so a collision
+ * never returns the wrong table.
+ * @param cache Cache (may be NULL)
+ * @param key Serialized code lengths or frequencies the table was built from
+ * @param keySize Key size (at most DECODE_CACHE_KEY_SIZE)
+ * @return Cached table, or NULL if there is none
+ */
+const DecodeTable* findCachedDecodeTable(DecodeTableCache* cache, const void* key,
+                                         size_t keySize) {
+    if (!cache || keySize > DECODE_CACHE_KEY_SIZE) {
+        return NULL;
+    }
+
+    uint64_t hash = hashCacheKey((const unsigned char*)key, keySize);
+    for (int i = 0; i < DECODE_CACHE_ENTRIES; i++) {
+        CachedDecodeTable* entry = &cache->entries[i];
+        if (entry->table && entry->hash == hash && entry->keySize == keySize &&
+            memcmp(entry->key, key, keySize) == 0) {
+            entry->lastUse = ++cache->clock;
+            cache->hits++;
+            return entry->table;
+        }
+    }
+
+    cache->misses++;
+    return NULL;
+}
+
+/**
+ * Adds a table to the cache, replacing the least recently used one
+ * Tables returned earlier by the cache stay valid until the next insert,
+ * so one caller must not hold more than DECODE_CACHE_ENTRIES - 1 of them
+ * across inserts.
+ * @param cache Cache (may be NULL)
+ * @param key Serialized code lengths or frequencies the table was built from
+ * @param keySize Key size
+ * @param table Table to add
+ * @return 1 if the cache took ownership of the table, 0 if the caller keeps it
+ */
+int insertCachedDecodeTable(DecodeTableCache* cache, const void* key, size_t keySize,
+                            DecodeTable* table) {
+    if (!cache || !table || keySize > DECODE_CACHE_KEY_SIZE) {
+        return 0;
+    }
+
+    CachedDecodeTable* victim = &cache->entries[0];
+    for (int i = 1; i < DECODE_CACHE_ENTRIES && victim->table; i++) {
+        CachedDecodeTable* entry = &cache->entries[i];
+        if (!entry->table || entry->lastUse < victim->lastUse) {
+            victim = entry;
+        }
+    }
+
+    destroyDecodeTable(victim->table);
+    victim->table = table;
+    victim->hash = hashCacheKey((const unsigned char*)key, keySize);
+    victim->keySize = keySize;
+    victim->lastUse = ++cache->clock;
+    memcpy(victim->key, key, keySize);
+    return 1;
+}
+
+/**
+ * Returns the decode table for canonical code lengths, building it only on a cache miss
+ * @param cache Cache (NULL builds a table for this call)
+ * @param lengths Code length per character
+ * @param owned Receives a table the caller must destroy, or NULL if the cache holds it
+ * @param stats Counts a reused table, or NULL
+ * @return Decode table, or NULL on invalid lengths or allocation failure
+ */
+const DecodeTable* acquireCanonicalDecodeTable(DecodeTableCache* cache,
+                                               const uint8_t lengths[ASCII_SIZE],
+                                               DecodeTable** owned, BlockStats* stats) {
+    *owned = NULL;
+    const DecodeTable* cached = findCachedDecodeTable(cache, lengths, ASCII_SIZE);
+    if (cached) {
+        if (stats) stats->cachedTables++;
+        return cached;
+    }
+
+    DecodeTable* table = createCanonicalDecodeTable(lengths);
+    if (table && !insertCachedDecodeTable(cache, lengths, ASCII_SIZE, table)) {
+        *owned = table;
+    }
+    return table;
+}
@@ -0,0 +1,765 @@
+#define _POSIX_C_SOURCE 200809L  // pthreads, fseeko
+#define _FILE_OFFSET_BITS 64      // Match the library's off_t
+#include "huffman.h"
+#include <errno.h>
+#include <limits.h>
+
+// =============================================================================
+// COMMAND LINE INTERFACE
+// =============================================================================
+
+/**
+ * Prints usage information
+ * @param programName Name of the program
+ */
+static void printUsage(const char* programName) {
+    printf("\n=== HUFFMAN CODING COMPRESSION TOOL ===\n");
+    printf("Usage: %s [OPTIONS]\n", programName);
+    printf("\nOptions:\n");
+    printf("  -c <input> <output>    Compress input file to output file\n");
+    printf("  -d <input> <output>    Decompress input file to output file\n");
+    printf("  -s <original> <compressed>  Show compression statistics\n");
+    printf("  -c|-d --batch <list>   Compress or decompress every file named in list\n");
+    printf("  -c|-d -r <dir>         Compress or decompress every file under dir\n");
+    printf("  -b [input]             Benchmark in memory (synthetic corpora if no input)\n");
+    printf("  --scan <pattern> <input>  Print the offset of every match of pattern in the\n");
+    printf("                         decompressed data, without writing it out (exit\n");
+    printf("                         status 1 if there is none)\n");
+    printf("  --train <samples> -o <table>  Train a code table on a sample file or directory\n");
+    printf("  -h                     Show this help message\n");
+    printf("  Use - as a file path to read from stdin or write to stdout\n");
+    printf("\nOptions:\n");
+    printf("  -q                     Print nothing but errors; outputs replace existing\n");
+    printf("                         files only once complete (temporary file + rename)\n");
+    printf("  -j <n>                 Use n threads for block compression/decompression\n");
+    printf("                         (0 = all cores, default 1); in batch mode, process\n");
+    printf("                         n files at a time (default all cores)\n");
+    printf("  --block-size <kib>     Uncompressed block size in KiB (default %u)\n",
+           DEFAULT_BLOCK_SIZE >> 10);
+    printf("  --max-code-len <n>     Limit codes to n bits (8-%d, default %d)\n",
+           MAX_CANONICAL_CODE_LENGTH, DEFAULT_MAX_CODE_LENGTH);
+    printf("  --streams <1|%d>        Bit streams per block; %d decode in lockstep (default %d)\n",
+           INTERLEAVED_STREAMS, INTERLEAVED_STREAMS, INTERLEAVED_STREAMS);
+    printf("  --split-level <0-%d>    Start new code tables where the statistics change;\n",
+           MAX_SPLIT_LEVEL);
+    printf("                         higher levels are slower and smaller (default 0)\n");
+    printf("  --context              Code blocks with tables chosen by the previous byte\n");
+    printf("                         where that is smaller (structured text, logs)\n");
+    printf("  --checksum             Store a CRC32C of every block, verified on decompression\n");
+    printf("  --canonical            Write a single stream with a code-length header\n");
+    printf("  --sync-interval <kib>  With --canonical, record a sync point every kib KiB so\n");
+    printf("                         -j threads can decode the one stream in parallel\n");
+    printf("  --legacy               Write a single stream with a frequency table\n");
+    printf("  --table <file>         Code small messages with a trained table; the same\n");
+    printf("                         table is needed to decompress them\n");
+    printf("  --io <stdio|mmap|uring|direct>\n");
+    printf("                         I/O backend for regular files (default mmap); uring\n");
+    printf("                         queues block reads and writes through io_uring, direct\n");
+    printf("                         writes decompressed files with O_DIRECT; mmap and\n");
+    printf("                         direct splice output into pipes and sockets\n");
+    printf("  --pipeline             Overlap reading, coding and writing of blocks\n");
+    printf("  --range <start>:<len>  Decompress (or scan) only len bytes from offset start,\n");
+    printf("                         decoding just the blocks that cover them\n");
+    printf("  --iterations <n>       Benchmark round trips per input (default %d)\n",
+           DEFAULT_BENCH_ITERATIONS);
+    printf("  --stats-json <file>    Write bytes, phase times, decoder counters and blocks\n");
+    printf("                         per thread as one JSON line per file (- = stdout)\n");
+    printf("  --kernels <name>       Force the scalar, sse42, bmi2, avx2 or neon loops\n");
+    printf("                         (default: the first of ");
+    listCodecKernels(stdout);
+    printf(")\n");
+    printf("\nExamples:\n");
+    printf("  %s -c document.txt document.huf\n", programName);
+    printf("  %s -c -j 0 document.txt document.huf\n", programName);
+    printf("  %s -c -j 4 --io uring big.log big.huf\n", programName);
+    printf("  %s -c --checksum backup.tar backup.huf\n", programName);
+    printf("  %s -c --canonical --sync-interval 256 big.log big.huf\n", programName);
+    printf("  tar cf - dir | %s -c - - > dir.tar.huf\n", programName);
+    printf("  %s -d document.huf document_restored.txt\n", programName);
+    printf("  %s -q -d document.huf document.txt\n", programName);
+    printf("  %s -d -j 4 --io direct backup.huf backup.tar\n", programName);
+    printf("  %s -d --range 1048576:4096 big.huf excerpt.txt\n", programName);
+    printf("  %s -q -j 4 --scan ERROR big.log.huf\n", programName);
+    printf("  %s -c --batch files.txt\n", programName);
+    printf("  %s -d -r logs/ -j 8\n", programName);
+    printf("  %s --train samples/ -o messages.huft\n", programName);
+    printf("  %s -c --table messages.huft message.json message.huf\n", programName);
+    printf("  %s -d --stats-json stats.json document.huf document.txt\n", programName);
+    printf("  %s -s document.txt document.huf\n", programName);
+    printf("  %s -b --iterations 10 document.txt\n", programName);
+    printf("=====================================\n");
+}
+
+/**
+ * Prints a library error or warning to stderr
+ * @param user Unused
+ * @param level LOG_LEVEL_ERROR or LOG_LEVEL_WARNING
+ * @param message Message
+ */
+static void printLogMessage(void* user, int level, const char* message) {
+    (void)user;
+    fprintf(stderr, "%s: %s\n", level == LOG_LEVEL_WARNING ? "Warning" : "Error", message);
+}
+
+/**
+ * Opens the destination of --stats-json
+ * @param path File path, or "-" for stdout
+ * @return File, or NULL on error
+ */
+static FILE* openStatsFile(const char* path) {
+    if (isStdioPath(path)) {
+        return stdout;
+    }
+
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot create statistics file '%s'\n", path);
+    }
+    return file;
+}
+
+/**
+ * Checks that --stats-json and the data output do not share stdout
+ * @param statsPath --stats-json argument, or NULL
+ * @param outputFile Output path of the operation
+ * @return 0 if they can be combined, -1 otherwise
+ */
+static int validateStatsPath(const char* statsPath, const char* outputFile) {
+    if (statsPath && isStdioPath(statsPath) && isStdioPath(outputFile)) {
+        fprintf(stderr, "Error: --stats-json - cannot be combined with output to stdout\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Parses a whole decimal argument within a range
+ * @param value Argument text
+ * @param min Smallest accepted value
+ * @param max Largest accepted value
+ * @param result Receives the value
+ * @return 0 on success, -1 if the text is not a number in [min, max]
+ */
+static int parseIntegerArgument(const char* value, long min, long max, int* result) {
+    char* end;
+    errno = 0;
+    long parsed = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || errno == ERANGE || parsed < min || parsed > max) {
+        return -1;
+    }
+    *result = (int)parsed;
+    return 0;
+}
+
+/**
+ * Closes a file opened by openStatsFile
+ * @param file File (may be NULL)
+ * @return 0 on success, -1 if the statistics could not be written
+ */
+static int closeStatsFile(FILE* file) {
+    if (!file) return 0;
+
+    int result = file == stdout ? fflush(file) : fclose(file);
+    if (result != 0) {
+        fprintf(stderr, "Error: Failed to write statistics\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Interactive menu for user input
+ */
+static void interactiveMenu(void) {
+    char inputFile[256], outputFile[256];
+    int choice;
+
+    while (1) {
+        printf("\n=== HUFFMAN CODING TOOL ===\n");
+        printf("1. Compress a file\n");
+        printf("2. Decompress a file\n");
+        printf("3. Show compression statistics\n");
+        printf("4. Exit\n");
+        printf("Enter your choice (1-4): ");
+
+        if (scanf("%d", &choice) != 1) {
+            printf("Invalid input. Please enter a number.\n");
+            while (getchar() != '\n'); // Clear input buffer
+            continue;
+        }
+
+        switch (choice) {
+            case 1:
+                printf("Enter input file path: ");
+                scanf("%255s", inputFile);
+                printf("Enter output file path: ");
+                scanf("%255s", outputFile);
+
+                if (validateFiles(inputFile, outputFile) == 0) {
+                    CompressOptions options;
+                    initCompressOptions(&options);
+                    CodecStats stats;
+                    options.stats = &stats;
+                    if (compressFileWithOptions(inputFile, outputFile, &options) == 0) {
+                        printf("Compression completed in %.2f seconds\n", stats.wallSeconds);
+                        printCompressionSummary(stats.bytesIn, stats.bytesOut);
+                    }
+                }
+                break;
+
+            case 2:
+                printf("Enter compressed file path: ");
+                scanf("%255s", inputFile);
+                printf("Enter output file path: ");
+                scanf("%255s", outputFile);
+
+                if (validateFiles(inputFile, outputFile) == 0) {
+                    double start = wallClockSeconds();
+                    if (decompressFile(inputFile, outputFile) == 0) {
+                        double end = wallClockSeconds();
+                        double time = end - start;
+                        printf("Decompression completed in %.2f seconds\n", time);
+                    }
+                }
+                break;
+
+            case 3:
+                printf("Enter original file path: ");
+                scanf("%255s", inputFile);
+                printf("Enter compressed file path: ");
+                scanf("%255s", outputFile);
+                printCompressionStats(inputFile, outputFile);
+                break;
+
+            case 4:
+                printf("Thank you for using Huffman Coding Tool!\n");
+                return;
+
+            default:
+                printf("Invalid choice. Please enter 1-4.\n");
+        }
+    }
+}
+
+/**
+ * Prints the version banner
+ */
+static void printBanner(void) {
+    printf("Huffman Coding Compression Tool v1.0\n");
+    printf("=====================================\n");
+}
+
+/**
+ * Main function with command-line argument parsing
+ */
+int main(int argc, char* argv[]) {
+    setLogHandler(printLogMessage, NULL);
+
+    // Interactive menu if no arguments provided
+    if (argc == 1) {
+        printBanner();
+        interactiveMenu();
+        return 0;
+    }
+
+    // Command line argument parsing: long options may appear anywhere,
+    // the remaining arguments are the mode followed by two file paths
+    CompressOptions options;
+    initCompressOptions(&options);
+    DecompressOptions decompressOptions;
+    initDecompressOptions(&decompressOptions);
+
+    int iterations = DEFAULT_BENCH_ITERATIONS;
+    const char* trainPath = NULL;
+    const char* tableOutput = NULL;
+    const char* tablePath = NULL;
+    const char* scanPattern = NULL;
+    int hasRange = 0;
+    uint64_t rangeStart = 0;
+    uint64_t rangeLength = 0;
+    const char* batchPath = NULL;
+    const char* batchDirectory = NULL;
+    const char* statsPath = NULL;
+    int threadsGiven = 0;
+    int maxCodeLengthGiven = 0;
+    int splitLevelGiven = 0;
+    int quiet = 0;
+
+    char* args[4] = {NULL, NULL, NULL, NULL};
+    int argCount = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--canonical") == 0) {
+            options.format = FORMAT_CANONICAL;
+        } else if (strcmp(argv[i], "--legacy") == 0) {
+            options.format = FORMAT_LEGACY;
+        } else if (strcmp(argv[i], "--train") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --train requires a sample file or directory\n");
+                return 1;
+            }
+            trainPath = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: -o requires an output file\n");
+                return 1;
+            }
+            tableOutput = argv[++i];
+        } else if (strcmp(argv[i], "--table") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --table requires a table file\n");
+                return 1;
+            }
+            tablePath = argv[++i];
+        } else if (strcmp(argv[i], "--scan") == 0) {
+            if (i + 1 >= argc || argv[i + 1][0] == '\0') {
+                fprintf(stderr, "Error: --scan requires a non-empty pattern\n");
+                return 2;
+            }
+            scanPattern = argv[++i];
+        } else if (strcmp(argv[i], "--range") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --range requires <start>:<length>\n");
+                return 1;
+            }
+            char* end;
+            const char* value = argv[++i];
+            rangeStart = strtoull(value, &end, 10);
+            if (end == value || *end != ':' || value[0] == '-') {
+                fprintf(stderr, "Error: --range must be <start>:<length>\n");
+                return 1;
+            }
+            value = end + 1;
+            rangeLength = strtoull(value, &end, 10);
+            if (end == value || *end != '\0' || value[0] == '-') {
+                fprintf(stderr, "Error: --range must be <start>:<length>\n");
+                return 1;
+            }
+            hasRange = 1;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --batch requires a list file\n");
+                return 1;
+            }
+            batchPath = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: -r requires a directory\n");
+                return 1;
+            }
+            batchDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--max-code-len") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --max-code-len requires a value\n");
+                return 1;
+            }
+            maxCodeLengthGiven = 1;
+            if (parseIntegerArgument(argv[++i], 8, MAX_CANONICAL_CODE_LENGTH,
+                                     &options.maxCodeLength) != 0) {
+                fprintf(stderr, "Error: --max-code-len must be between 8 and %d\n",
+                        MAX_CANONICAL_CODE_LENGTH);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--io") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --io requires a backend (stdio, mmap, uring or direct)\n");
+                return 1;
+            }
+            i++;
+            if (strcmp(argv[i], "stdio") == 0) {
+                options.ioBackend = IO_BACKEND_STDIO;
+            } else if (strcmp(argv[i], "mmap") == 0) {
+                options.ioBackend = IO_BACKEND_MMAP;
+            } else if (strcmp(argv[i], "uring") == 0) {
+                if (!ioRingAvailable()) {
+                    fprintf(stderr, "Error: io_uring backend is not available\n");
+                    return 1;
+                }
+                options.ioBackend = IO_BACKEND_URING;
+            } else if (strcmp(argv[i], "direct") == 0) {
+                if (!directOutputAvailable()) {
+                    fprintf(stderr, "Error: O_DIRECT backend is not available\n");
+                    return 1;
+                }
+                options.ioBackend = IO_BACKEND_DIRECT;
+            } else {
+                fprintf(stderr, "Error: Unknown I/O backend '%s'\n", argv[i]);
+                return 1;
+            }
+            decompressOptions.ioBackend = options.ioBackend;
+        } else if (strcmp(argv[i], "--stats-json") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --stats-json requires a file\n");
+                return 1;
+            }
+            statsPath = argv[++i];
+        } else if (strcmp(argv[i], "--context") == 0) {
+            options.contextModel = 1;
+        } else if (strcmp(argv[i], "--checksum") == 0) {
+            options.checksums = 1;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            options.pipelined = 1;
+            decompressOptions.pipelined = 1;
+        } else if (strcmp(argv[i], "--iterations") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --iterations requires a count\n");
+                return 1;
+            }
+            if (parseIntegerArgument(argv[++i], 1, INT_MAX, &iterations) != 0) {
+                fprintf(stderr, "Error: --iterations must be a count of at least 1\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--kernels") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --kernels requires a kernel set name\n");
+                return 1;
+            }
+            if (selectCodecKernels(argv[++i]) != 0) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-q") == 0) {
+            quiet = 1;
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: -j requires a thread count\n");
+                return 1;
+            }
+            if (parseIntegerArgument(argv[++i], 0, MAX_THREADS, &options.threads) != 0) {
+                fprintf(stderr, "Error: -j must be between 0 (all cores) and %d\n", MAX_THREADS);
+                return 1;
+            }
+            decompressOptions.threads = options.threads;
+            threadsGiven = 1;
+        } else if (strcmp(argv[i], "--block-size") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --block-size requires a size in KiB\n");
+                return 1;
+            }
+            int kib;
+            if (parseIntegerArgument(argv[++i], MIN_BLOCK_SIZE >> 10, MAX_BLOCK_SIZE >> 10,
+                                     &kib) != 0) {
+                fprintf(stderr, "Error: --block-size must be between %u and %u KiB\n",
+                        MIN_BLOCK_SIZE >> 10, MAX_BLOCK_SIZE >> 10);
+                return 1;
+            }
+            options.blockSize = (uint32_t)kib << 10;
+        } else if (strcmp(argv[i], "--sync-interval") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --sync-interval requires a size in KiB\n");
+                return 1;
+            }
+            int kib;
+            if (parseIntegerArgument(argv[++i], MIN_SYNC_INTERVAL >> 10, MAX_SYNC_INTERVAL >> 10,
+                                     &kib) != 0) {
+                fprintf(stderr, "Error: --sync-interval must be between %u and %u KiB\n",
+                        MIN_SYNC_INTERVAL >> 10, MAX_SYNC_INTERVAL >> 10);
+                return 1;
+            }
+            options.syncInterval = (uint32_t)kib << 10;
+        } else if (strcmp(argv[i], "--streams") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --streams requires a count\n");
+                return 1;
+            }
+            if (parseIntegerArgument(argv[++i], 1, INTERLEAVED_STREAMS, &options.streams) != 0 ||
+                (options.streams != 1 && options.streams != INTERLEAVED_STREAMS)) {
+                fprintf(stderr, "Error: --streams must be 1 or %d\n", INTERLEAVED_STREAMS);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--split-level") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --split-level requires a level\n");
+                return 1;
+            }
+            splitLevelGiven = 1;
+            if (parseIntegerArgument(argv[++i], 0, MAX_SPLIT_LEVEL, &options.splitLevel) != 0) {
+                fprintf(stderr, "Error: --split-level must be between 0 and %d\n",
+                        MAX_SPLIT_LEVEL);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            printUsage(argv[0]);
+            return 1;
+        } else {
+            if (argCount < 4) {
+                args[argCount] = argv[i];
+            }
+            argCount++;
+        }
+    }
+
+    if (options.syncInterval != 0 && options.format != FORMAT_CANONICAL) {
+        fprintf(stderr, "Error: --sync-interval requires --canonical\n");
+        return 1;
+    }
+    if (maxCodeLengthGiven && (options.format == FORMAT_LEGACY || tablePath)) {
+        fprintf(stderr, "Error: --max-code-len cannot be combined with --legacy or --table\n");
+        return 1;
+    }
+
+    // Block container options are refused with the other formats, which ignore them
+    int blockFormat = options.format == FORMAT_BLOCKS && !tablePath;
+    if (splitLevelGiven && !blockFormat) {
+        fprintf(stderr, "Error: --split-level cannot be combined with --canonical, "
+                "--legacy or --table\n");
+        return 1;
+    }
+    if (options.contextModel && !blockFormat) {
+        fprintf(stderr, "Error: --context cannot be combined with --canonical, "
+                "--legacy or --table\n");
+        return 1;
+    }
+    if (options.checksums && !blockFormat) {
+        fprintf(stderr, "Error: --checksum cannot be combined with --canonical, "
+                "--legacy or --table\n");
+        return 1;
+    }
+
+    // Quiet mode writes nothing but errors, and outputs replace existing
+    // files only once they are complete
+    if (quiet) {
+        options.quiet = decompressOptions.quiet = 1;
+        options.atomicOutput = decompressOptions.atomicOutput = 1;
+    } else {
+        printBanner();
+    }
+
+    // Table training: the samples and the table file are the only arguments
+    if (trainPath) {
+        if (argCount != 0 || !tableOutput) {
+            fprintf(stderr, "Error: Training requires --train <samples> -o <table>\n");
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        CodeTable table;
+        if (trainCodeTable(trainPath, options.maxCodeLength, quiet, &table) != 0) {
+            return 1;
+        }
+        int result = saveCodeTable(&table, tableOutput);
+        if (result == 0 && !quiet) {
+            printf("Table %08x written to %s (max %d bits)\n", (unsigned)table.id,
+                   tableOutput, options.maxCodeLength);
+        }
+        destroyCodeTable(&table);
+        return result == 0 ? 0 : 1;
+    }
+
+    if (argCount < 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // Compressed scan: the blocks are decoded into memory and searched, so
+    // the compressed file is the only argument; the exit status follows grep
+    if (scanPattern) {
+        if (argCount != 1 || batchPath || batchDirectory || tablePath) {
+            fprintf(stderr, "Error: Scanning takes --scan <pattern> and one compressed file\n");
+            printUsage(argv[0]);
+            return 2;
+        }
+
+        char* inputFile = args[0];
+        FILE* statsFile = NULL;
+        if (validateStatsPath(statsPath, "-") != 0 ||
+            (statsPath && !(statsFile = openStatsFile(statsPath)))) {
+            return 2;
+        }
+
+        CodecStats stats;
+        decompressOptions.stats = statsFile ? &stats : NULL;
+        uint64_t matches;
+        int result = scanFile(inputFile, (const unsigned char*)scanPattern, strlen(scanPattern),
+                              hasRange ? rangeStart : 0, hasRange ? rangeLength : UINT64_MAX,
+                              &decompressOptions, &matches);
+        if (statsFile) {
+            writeStatsJson(statsFile, "scan", inputFile, "-", result, &stats);
+        }
+        if (closeStatsFile(statsFile) != 0) {
+            result = -1;
+        }
+
+        if (result != 0) return 2;
+        return matches > 0 ? 0 : 1;
+    }
+
+    // A trained table is loaded once and serves the -c or -d run
+    CodeTable table;
+    if (tablePath) {
+        if (loadCodeTable(&table, tablePath) != 0) {
+            return 1;
+        }
+        options.format = FORMAT_TABLE;
+        options.table = &table;
+        decompressOptions.table = &table;
+    }
+
+    char* option = args[0];
+
+    // Batch mode: the list or directory replaces the file paths
+    if (batchPath || batchDirectory) {
+        int decompress = strcmp(option, "-d") == 0;
+        if ((!decompress && strcmp(option, "-c") != 0) || argCount != 1 ||
+            (batchPath && batchDirectory) || hasRange) {
+            fprintf(stderr, "Error: Batch mode takes -c or -d with --batch <list> or -r <dir>\n");
+            printUsage(argv[0]);
+            if (tablePath) {
+                destroyCodeTable(&table);
+            }
+            return 1;
+        }
+
+        BatchList list = {0};
+        int result = batchPath ? readBatchManifest(&list, batchPath, decompress)
+                               : collectBatchDirectory(&list, batchDirectory, decompress);
+        FILE* statsFile = NULL;
+        if (result == 0 && statsPath) {
+            statsFile = openStatsFile(statsPath);
+            result = statsFile ? 0 : -1;
+        }
+        if (result == 0) {
+            result = runBatch(&list, threadsGiven ? options.threads : 0, decompress,
+                              &options, &decompressOptions, statsFile);
+        }
+        if (closeStatsFile(statsFile) != 0) {
+            result = -1;
+        }
+        destroyBatchList(&list);
+        if (tablePath) {
+            destroyCodeTable(&table);
+        }
+        return result == 0 ? 0 : 1;
+    }
+
+    // Help option
+    if (strcmp(option, "-h") == 0) {
+        printUsage(argv[0]);
+        return 0;
+    }
+
+    // Compression option
+    else if (strcmp(option, "-c") == 0) {
+        if (argCount != 3) {
+            fprintf(stderr, "Error: Compression requires input and output file paths\n");
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        char* inputFile = args[1];
+        char* outputFile = args[2];
+
+        // Quiet runs leave the checks to the open calls of the compressor
+        FILE* statsFile = NULL;
+        if ((!quiet && validateFiles(inputFile, outputFile) != 0) ||
+            validateStatsPath(statsPath, outputFile) != 0 ||
+            (statsPath && !(statsFile = openStatsFile(statsPath)))) {
+            return 1;
+        }
+
+        // The summary comes from the counters, so the files are not reopened
+        CodecStats stats;
+        options.stats = !quiet || statsFile ? &stats : NULL;
+        int result = compressFileWithOptions(inputFile, outputFile, &options);
+        if (tablePath) {
+            destroyCodeTable(&table);
+        }
+
+        if (result == 0 && !quiet) {
+            printf("Compression completed in %.2f seconds\n", stats.wallSeconds);
+            printCompressionSummary(stats.bytesIn, stats.bytesOut);
+        }
+        if (statsFile) {
+            writeStatsJson(statsFile, "compress", inputFile, outputFile, result, &stats);
+        }
+        if (closeStatsFile(statsFile) != 0) {
+            result = -1;
+        }
+
+        return result;
+    }
+
+    // Decompression option
+    else if (strcmp(option, "-d") == 0) {
+        if (argCount != 3) {
+            fprintf(stderr, "Error: Decompression requires input and output file paths\n");
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        char* inputFile = args[1];
+        char* outputFile = args[2];
+
+        FILE* statsFile = NULL;
+        if ((!quiet && validateFiles(inputFile, outputFile) != 0) ||
+            validateStatsPath(statsPath, outputFile) != 0 ||
+            (statsPath && !(statsFile = openStatsFile(statsPath)))) {
+            return 1;
+        }
+
+        CodecStats stats;
+        decompressOptions.stats = statsFile ? &stats : NULL;
+        double start = wallClockSeconds();
+        int result = hasRange
+            ? decompressFileRange(inputFile, outputFile, rangeStart, rangeLength,
+                                  &decompressOptions)
+            : decompressFileWithOptions(inputFile, outputFile, &decompressOptions);
+        double end = wallClockSeconds();
+        if (tablePath) {
+            destroyCodeTable(&table);
+        }
+
+        if (result == 0 && !quiet) {
+            double time = end - start;
+            printf("Decompression completed in %.2f seconds\n", time);
+        }
+        if (statsFile) {
+            writeStatsJson(statsFile, "decompress", inputFile, outputFile, result, &stats);
+        }
+        if (closeStatsFile(statsFile) != 0) {
+            result = -1;
+        }
+
+        return result;
+    }
+
+    // Benchmark option
+    else if (strcmp(option, "-b") == 0) {
+        if (argCount > 2) {
+            fprintf(stderr, "Error: Benchmark takes at most one input file\n");
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        if (options.format != FORMAT_BLOCKS) {
+            fprintf(stderr, "Error: Benchmark runs the block container; "
+                    "omit --canonical, --legacy and --table\n");
+            if (tablePath) {
+                destroyCodeTable(&table);
+            }
+            return 1;
+        }
+
+        return runBenchmark(argCount == 2 ? args[1] : NULL, iterations,
+                            &options, &decompressOptions) == 0 ? 0 : 1;
+    }
+
+    // Statistics option
+    else if (strcmp(option, "-s") == 0) {
+        if (argCount != 3) {
+            fprintf(stderr, "Error: Statistics requires original and compressed file paths\n");
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        printCompressionStats(args[1], args[2]);
+        return 0;
+    }
+
+    // Invalid option
+    else {
+        fprintf(stderr, "Error: Unknown option '%s'\n", option);
+        printUsage(argv[0]);
+        return 1;
+    }
+}
\ No newline at end of file
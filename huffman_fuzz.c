@@ -0,0 +1,1016 @@
+#define _POSIX_C_SOURCE 200809L  // fmemopen, open_memstream, mkdtemp
+#define _FILE_OFFSET_BITS 64      // Match the library's off_t
+#include "huffman.h"
+#include "libhuffman.h"
+
+// =============================================================================
+// FUZZ AND DIFFERENTIAL TEST HARNESS
+// =============================================================================
+//
+// Every input is coded by the reference bit-by-bit coder (encodeAndWrite and
+// decodeAndWrite) and by each optimized engine, under every kernel set the CPU
+// can run. Engines that share the reference's codes must write the same bit
+// stream; every engine must restore the input exactly. The harness runs as:
+//   huffman_fuzz --diff        generated corpora, throughput of every engine
+//   huffman_fuzz FILE...       the given inputs (AFL: huffman_fuzz @@)
+//   -DHUFFMAN_LIBFUZZER        a libFuzzer target (make fuzz)
+
+#define MAX_ENGINE_RECORDS 96
+#define FUZZ_DECODE_LIMIT (1u << 24)   // Output cap when decoding arbitrary bytes
+#define DEFAULT_DIFF_INPUTS 200
+#define MAX_RANDOM_INPUT (1u << 18)
+#define THROUGHPUT_INPUT (1u << 22)    // Corpora that dominate the throughput figures
+
+// Throughput and failures of one engine under one kernel set
+typedef struct EngineRecord {
+    char name[64];
+    uint64_t inputs;
+    uint64_t bytes;
+    double encodeSeconds;
+    double decodeSeconds;
+    uint64_t failures;
+} EngineRecord;
+
+// Container parameters exercised through libhuffman
+typedef struct ContainerEngine {
+    const char* name;
+    int streams;
+    int threads;
+    int splitLevel;
+    int contextModel;
+    int checksums;
+} ContainerEngine;
+
+static const ContainerEngine containerEngines[] = {
+    { "blocks",          INTERLEAVED_STREAMS, 1, 0, 0, 0 },
+    { "blocks-1stream",  1,                   1, 0, 0, 0 },
+    { "blocks-parallel", INTERLEAVED_STREAMS, 4, 0, 0, 0 },
+    { "blocks-split",    INTERLEAVED_STREAMS, 1, MAX_SPLIT_LEVEL, 0, 0 },
+    { "blocks-context",  INTERLEAVED_STREAMS, 1, 0, 1, 0 },
+    { "blocks-checksum", INTERLEAVED_STREAMS, 4, 0, 0, 1 }
+};
+#define CONTAINER_ENGINES (sizeof(containerEngines) / sizeof(containerEngines[0]))
+
+static EngineRecord records[MAX_ENGINE_RECORDS];
+static int recordCount = 0;
+static huff_context* sharedContext = NULL;  // Codec context kept across inputs
+
+/**
+ * Records one round trip of an engine
+ * @param engine Engine name
+ * @param size Input size in bytes
+ * @param encodeSeconds Time spent compressing
+ * @param decodeSeconds Time spent decompressing
+ * @param ok Nonzero if the engine restored the input (and matched the reference)
+ * @return 0 if ok, 1 otherwise
+ */
+static int recordResult(const char* engine, size_t size, double encodeSeconds,
+                        double decodeSeconds, int ok) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s/%s", engine, codecKernels()->name);
+
+    EngineRecord* record = NULL;
+    for (int i = 0; i < recordCount && !record; i++) {
+        if (strcmp(records[i].name, name) == 0) record = &records[i];
+    }
+    if (!record && recordCount < MAX_ENGINE_RECORDS) {
+        record = &records[recordCount++];
+        memset(record, 0, sizeof(*record));
+        snprintf(record->name, sizeof(record->name), "%s", name);
+    }
+
+    if (!ok) {
+        fprintf(stderr, "MISMATCH engine=%s size=%zu\n", name, size);
+    }
+    if (record) {
+        record->inputs++;
+        record->bytes += size;
+        record->encodeSeconds += encodeSeconds;
+        record->decodeSeconds += decodeSeconds;
+        record->failures += !ok;
+    }
+    return !ok;
+}
+
+// =============================================================================
+// REFERENCE CODER
+// =============================================================================
+
+/**
+ * Encodes a buffer with the reference bit-by-bit writer
+ * @param data Input bytes
+ * @param size Number of bytes (at least 1)
+ * @param codes Codes with their bit strings
+ * @param stream Receives the allocated bit stream
+ * @param streamSize Receives its size
+ * @return 0 on success, -1 on error
+ */
+static int referenceEncode(const unsigned char* data, size_t size, CodeEntry codes[ASCII_SIZE],
+                           unsigned char** stream, size_t* streamSize) {
+    FILE* input = fmemopen((void*)data, size, "rb");
+    char* buffer = NULL;
+    size_t length = 0;
+    FILE* output = open_memstream(&buffer, &length);
+    if (!input || !output) {
+        if (input) fclose(input);
+        if (output) fclose(output);
+        free(buffer);
+        return -1;
+    }
+
+    encodeAndWrite(input, output, codes);
+    fclose(input);
+    fclose(output);
+
+    *stream = (unsigned char*)buffer;
+    *streamSize = length;
+    return 0;
+}
+
+/**
+ * Decodes a bit stream with the reference tree walk
+ * @param stream Bit stream
+ * @param streamSize Size of the bit stream
+ * @param root Root of the code tree
+ * @param size Number of symbols to decode
+ * @param expected Bytes the stream must decode to
+ * @return 1 if the stream decodes to expected, 0 otherwise
+ */
+static int referenceDecodes(const unsigned char* stream, size_t streamSize, HuffmanNode* root,
+                            size_t size, const unsigned char* expected) {
+    FILE* input = fmemopen((void*)stream, streamSize, "rb");
+    char* buffer = NULL;
+    size_t length = 0;
+    FILE* output = open_memstream(&buffer, &length);
+    int result = input && output ? decodeAndWrite(input, output, root, size, 0) : -1;
+    if (input) fclose(input);
+    if (output) fclose(output);
+
+    int ok = result == 0 && length == size && memcmp(buffer, expected, size) == 0;
+    free(buffer);
+    return ok;
+}
+
+// =============================================================================
+// SINGLE-STREAM ENGINES
+// =============================================================================
+
+/**
+ * Checks the packed encoder and the table decoders against the reference for one code
+ * The packed single stream must match the reference stream bit for bit; the
+ * interleaved streams and the table decoders must restore the input.
+ * @param engine Engine name prefix ("tree" or "canonical")
+ * @param data Input bytes
+ * @param size Number of bytes (at least 1)
+ * @param codes Codes with bit strings and packed bits
+ * @param maxLength Longest code length
+ * @param root Code tree (for the reference decoder)
+ * @param table Decode table of the same code
+ * @param reference Reference stream of the code
+ * @param referenceSize Size of the reference stream
+ * @return Number of failures
+ */
+static int checkCodeEngines(const char* engine, const unsigned char* data, size_t size,
+                            CodeEntry codes[ASCII_SIZE], int maxLength, HuffmanNode* root,
+                            const DecodeTable* table, const unsigned char* reference,
+                            size_t referenceSize) {
+    size_t capacity = size * (MAX_PACKED_CODE_LENGTH / 8 + 1) + STREAM_JUMP_TABLE_SIZE + 64;
+    unsigned char* stream = (unsigned char*)malloc(capacity);
+    unsigned char* output = (unsigned char*)malloc(size);
+    if (!stream || !output) {
+        free(stream);
+        free(output);
+        return recordResult(engine, size, 0, 0, 0);
+    }
+
+    char name[48];
+    int failures = 0;
+    for (int streams = 1; streams <= INTERLEAVED_STREAMS; streams *= INTERLEAVED_STREAMS) {
+        // The lockstep decoder takes canonical-length codes only
+        if (streams > 1 && maxLength > MAX_CANONICAL_CODE_LENGTH) break;
+
+        snprintf(name, sizeof(name), "%s-%s", engine, streams == 1 ? "packed" : "interleaved");
+
+        size_t written = 0;
+        double start = wallClockSeconds();
+        int ok = encodeStreams(codes, data, size, streams, stream, capacity, &written) == 0;
+        double encoded = wallClockSeconds();
+        ok = ok && decodeStreams(table, stream, written, streams, output, size, NULL) == 0 &&
+             memcmp(output, data, size) == 0;
+        double decoded = wallClockSeconds();
+
+        // One stream uses the reference's code, so it must match its bits and
+        // the reference tree walk must decode it
+        if (streams == 1) {
+            ok = ok && written == referenceSize && memcmp(stream, reference, written) == 0 &&
+                 referenceDecodes(stream, written, root, size, data);
+        }
+        failures += recordResult(name, size, encoded - start, decoded - encoded, ok);
+    }
+
+    free(stream);
+    free(output);
+    return failures;
+}
+
+/**
+ * Runs the reference coder and the single-stream engines for one code
+ * @param engine Engine name prefix
+ * @param data Input bytes
+ * @param size Number of bytes (at least 1)
+ * @param codes Codes of the input
+ * @param root Code tree
+ * @param table Decode table (NULL if it could not be built)
+ * @return Number of failures
+ */
+static int checkCode(const char* engine, const unsigned char* data, size_t size,
+                     CodeEntry codes[ASCII_SIZE], HuffmanNode* root, DecodeTable* table) {
+    int maxLength = 0;
+    for (int c = 0; c < ASCII_SIZE; c++) {
+        if (codes[c].length > maxLength) maxLength = codes[c].length;
+    }
+
+    unsigned char* reference = NULL;
+    size_t referenceSize = 0;
+    char name[48];
+    snprintf(name, sizeof(name), "%s-reference", engine);
+    double start = wallClockSeconds();
+    int ok = root && referenceEncode(data, size, codes, &reference, &referenceSize) == 0;
+    double encoded = wallClockSeconds();
+    ok = ok && referenceDecodes(reference, referenceSize, root, size, data);
+    int failures = recordResult(name, size, encoded - start, wallClockSeconds() - encoded, ok);
+
+    // Codes past the packed writer's limit only have the reference path
+    if (ok && maxLength <= MAX_PACKED_CODE_LENGTH) {
+        if (table) {
+            failures += checkCodeEngines(engine, data, size, codes, maxLength, root, table,
+                                         reference, referenceSize);
+        } else {
+            failures += recordResult(engine, size, 0, 0, 0);
+        }
+    }
+
+    free(reference);
+    return failures;
+}
+
+/**
+ * Checks the tree (legacy) and canonical codes of an input
+ * @param data Input bytes
+ * @param size Number of bytes (at least 1)
+ * @return Number of failures
+ */
+static int checkSingleStreams(const unsigned char* data, size_t size) {
+    uint64_t frequencies[ASCII_SIZE] = {0};
+    countFrequencies(data, size, frequencies);
+    int failures = 0;
+
+    HuffmanTree tree;
+    initTree(&tree);
+    CodeEntry codes[ASCII_SIZE];
+    HuffmanNode* root = buildHuffmanTree(&tree, frequencies);
+    buildCodeTable(root, codes);
+    DecodeTable* table = root ? createDecodeTable(root) : NULL;
+    failures += checkCode("tree", data, size, codes, root, table);
+    destroyDecodeTable(table);
+    destroyTree(&tree);
+
+    uint8_t lengths[ASCII_SIZE];
+    initTree(&tree);
+    root = NULL;
+    table = NULL;
+    if (computeLimitedCodeLengths(frequencies, DEFAULT_MAX_CODE_LENGTH, lengths) == 0 &&
+        assignCanonicalCodes(lengths, codes) == 0) {
+        root = buildTreeFromCodes(&tree, codes);
+        table = createCanonicalDecodeTable(lengths);
+    }
+    failures += checkCode("canonical", data, size, codes, root, table);
+    destroyDecodeTable(table);
+    destroyTree(&tree);
+
+    return failures;
+}
+
+// =============================================================================
+// CONTAINER ENGINES
+// =============================================================================
+
+// Caller buffer filled by a decompression stream
+typedef struct FuzzBuffer {
+    unsigned char* data;
+    size_t capacity;
+    size_t size;
+} FuzzBuffer;
+
+/**
+ * Stream write function appending to a FuzzBuffer
+ */
+static int appendToBuffer(void* user, const void* data, size_t size) {
+    FuzzBuffer* buffer = (FuzzBuffer*)user;
+    if (size > buffer->capacity - buffer->size) return -1;
+
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 0;
+}
+
+/**
+ * Decompresses a container on a number of threads
+ * @param src Compressed bytes
+ * @param size Number of compressed bytes
+ * @param threads Decoder threads
+ * @param output Receives the decompressed bytes (capacity set)
+ * @return HUFF_OK or a negative status code
+ */
+static int decompressBuffer(const unsigned char* src, size_t size, int threads,
+                            FuzzBuffer* output) {
+    output->size = 0;
+    huff_stream* stream = huff_decompress_stream_create(threads, appendToBuffer, output);
+    if (!stream) return HUFF_ERROR_OUT_OF_MEMORY;
+
+    int status = huff_stream_write(stream, src, size);
+    if (status == HUFF_OK) {
+        status = huff_stream_finish(stream);
+    }
+    huff_stream_destroy(stream);
+    return status;
+}
+
+/**
+ * Scans a container for a pattern taken from its input and compares the
+ * matches with a plain search of the input
+ * @param compressed Container of the input
+ * @param compressedSize Size of the container
+ * @param data Input bytes
+ * @param size Number of bytes
+ * @return Number of failures
+ */
+static int checkScan(const unsigned char* compressed, size_t compressedSize,
+                     const unsigned char* data, size_t size) {
+    if (size == 0) return 0;
+
+    size_t patternSize = size < 3 ? size : 3;
+    const unsigned char* pattern = data + (size - patternSize) / 2;
+    huff_scan* scan = NULL;
+    double start = wallClockSeconds();
+    int ok = huff_scan_create(compressed, compressedSize, pattern, patternSize, 2, &scan) ==
+             HUFF_OK;
+
+    size_t expected = 0;
+    uint64_t offset;
+    int found = 0;
+    while (ok && (found = huff_scan_next(scan, &offset)) == 1) {
+        while (expected < offset && memcmp(data + expected, pattern, patternSize) != 0) {
+            expected++;
+        }
+        ok = expected == offset && offset + patternSize <= size;
+        expected++;
+    }
+    for (; ok && expected + patternSize <= size; expected++) {
+        ok = memcmp(data + expected, pattern, patternSize) != 0;  // No match was missed
+    }
+    ok = ok && found == 0;
+
+    huff_scan_destroy(scan);
+    return recordResult("blocks-scan", size, 0, wallClockSeconds() - start, ok);
+}
+
+/**
+ * Round-trips an input through one container engine
+ * The smallest block size makes even short inputs span several blocks.
+ * @param engine Container parameters
+ * @param withRange Nonzero to also decode a byte range and scan the container
+ * @param data Input bytes
+ * @param size Number of bytes
+ * @return Number of failures
+ */
+static int checkContainer(const ContainerEngine* engine, int withRange,
+                          const unsigned char* data, size_t size) {
+    size_t bound = huff_compress_bound(size);
+    unsigned char* compressed = (unsigned char*)malloc(bound);
+    FuzzBuffer output = { (unsigned char*)malloc(size + 1), size + 1, 0 };
+    if (!compressed || !output.data) {
+        free(compressed);
+        free(output.data);
+        return recordResult(engine->name, size, 0, 0, 0);
+    }
+
+    huff_params params;
+    huff_params_init(&params);
+    params.block_size = MIN_BLOCK_SIZE;
+    params.streams = engine->streams;
+    params.threads = engine->threads;
+    params.split_level = engine->splitLevel;
+    params.context_model = engine->contextModel;
+    params.checksums = engine->checksums;
+
+    size_t compressedSize = bound;
+    double start = wallClockSeconds();
+    int ok = huff_compress_with(&params, data, size, compressed, &compressedSize) == HUFF_OK;
+    double encoded = wallClockSeconds();
+    ok = ok && decompressBuffer(compressed, compressedSize, engine->threads, &output) ==
+               HUFF_OK &&
+         output.size == size && memcmp(output.data, data, size) == 0;
+    int failures = recordResult(engine->name, size, encoded - start,
+                                wallClockSeconds() - encoded, ok);
+
+    // The middle third through the block index
+    if (withRange && ok) {
+        uint64_t offset = size / 3;
+        size_t length = size / 3;
+        start = wallClockSeconds();
+        ok = huff_decompress_range(compressed, compressedSize, offset, output.data,
+                                   &length) == HUFF_OK &&
+             length == size / 3 && memcmp(output.data, data + offset, length) == 0;
+        failures += recordResult("blocks-range", length, 0, wallClockSeconds() - start, ok);
+        failures += checkScan(compressed, compressedSize, data, size);
+    }
+
+    free(compressed);
+    free(output.data);
+    return failures;
+}
+
+/**
+ * Round-trips an input through a code table trained on the input itself
+ * @param data Input bytes
+ * @param size Number of bytes
+ * @return Number of failures
+ */
+static int checkTable(const unsigned char* data, size_t size) {
+    const void* samples[1] = { data };
+    huff_table* table = NULL;
+    size_t bound = huff_compress_bound(size);
+    unsigned char* compressed = (unsigned char*)malloc(bound);
+    unsigned char* output = (unsigned char*)malloc(size + 1);
+    int ok = compressed && output &&
+             huff_table_train(samples, &size, 1, DEFAULT_MAX_CODE_LENGTH, &table) == HUFF_OK;
+
+    size_t compressedSize = bound;
+    size_t length = size + 1;
+    double start = wallClockSeconds();
+    ok = ok && huff_table_compress(table, data, size, compressed, &compressedSize) == HUFF_OK;
+    double encoded = wallClockSeconds();
+    ok = ok && huff_table_decompress(table, compressed, compressedSize, output, &length) ==
+               HUFF_OK &&
+         length == size && memcmp(output, data, size) == 0;
+    int failures = recordResult("table", size, encoded - start, wallClockSeconds() - encoded, ok);
+
+    huff_table_destroy(table);
+    free(compressed);
+    free(output);
+    return failures;
+}
+
+/**
+ * Frees the shared codec context
+ */
+static void destroySharedContext(void) {
+    huff_context_destroy(sharedContext);
+    sharedContext = NULL;
+}
+
+/**
+ * Round-trips an input through one codec context kept across every input
+ * The input is decoded twice, so the second pass runs on decode tables
+ * cached by the first, and the cache also holds tables of earlier inputs.
+ * @param data Input bytes
+ * @param size Number of bytes
+ * @return Number of failures
+ */
+static int checkContext(const unsigned char* data, size_t size) {
+    if (!sharedContext) {
+        sharedContext = huff_context_create(2);
+        if (sharedContext) {
+            atexit(destroySharedContext);
+        }
+    }
+
+    size_t bound = huff_compress_bound(size);
+    unsigned char* compressed = (unsigned char*)malloc(bound);
+    unsigned char* output = (unsigned char*)malloc(size + 1);
+    huff_params params;
+    huff_params_init(&params);
+    params.block_size = MIN_BLOCK_SIZE;
+
+    size_t compressedSize = bound;
+    double start = wallClockSeconds();
+    int ok = sharedContext && compressed && output &&
+             huff_context_compress(sharedContext, &params, data, size, compressed,
+                                   &compressedSize) == HUFF_OK;
+    double encoded = wallClockSeconds();
+    for (int pass = 0; pass < 2 && ok; pass++) {
+        size_t length = size + 1;
+        ok = huff_context_decompress(sharedContext, compressed, compressedSize, output,
+                                     &length) == HUFF_OK &&
+             length == size && memcmp(output, data, size) == 0;
+    }
+    int failures = recordResult("codec-context", size, encoded - start,
+                                (wallClockSeconds() - encoded) / 2, ok);
+
+    free(compressed);
+    free(output);
+    return failures;
+}
+
+// =============================================================================
+// SYNC-POINT ENGINE
+// =============================================================================
+
+// Left out of the libFuzzer entry, which stays in memory
+#ifndef HUFFMAN_LIBFUZZER
+
+static char workDirectory[64];  // Files of the sync-point engine ("" = not created)
+
+/**
+ * Removes the sync-point engine's work directory
+ */
+static void removeWorkDirectory(void) {
+    char path[96];
+    const char* names[] = { "input", "input.huf", "damaged.huf", "output" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", workDirectory, names[i]);
+        unlink(path);
+    }
+    rmdir(workDirectory);
+}
+
+/**
+ * Creates the work directory of the file-based engines on first use
+ * @return 0 on success, -1 on error
+ */
+static int createWorkDirectory(void) {
+    if (workDirectory[0]) return 0;
+
+    const char* base = getenv("TMPDIR");
+    snprintf(workDirectory, sizeof(workDirectory), "%s/huffman_fuzz.XXXXXX",
+             base && strlen(base) < 32 ? base : "/tmp");
+    if (!mkdtemp(workDirectory)) {
+        workDirectory[0] = '\0';
+        return -1;
+    }
+    atexit(removeWorkDirectory);
+    return 0;
+}
+
+/**
+ * Writes a buffer to a file
+ * @return 0 on success, -1 on error
+ */
+static int writeWholeFile(const char* path, const unsigned char* data, size_t size) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return -1;
+    int result = fwrite(data, 1, size, file) == size ? 0 : -1;
+    return fclose(file) == 0 ? result : -1;
+}
+
+/**
+ * Checks that a file holds exactly the given bytes
+ * @return 1 if it does, 0 otherwise
+ */
+static int fileEquals(const char* path, const unsigned char* data, size_t size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return 0;
+
+    unsigned char* contents = (unsigned char*)malloc(size + 1);
+    size_t read = contents ? fread(contents, 1, size + 1, file) : 0;
+    int equal = contents && read == size && memcmp(contents, data, size) == 0;
+    free(contents);
+    fclose(file);
+    return equal;
+}
+
+/**
+ * Reads a whole file, or stdin for "-"
+ * @param path File path
+ * @param size Receives the number of bytes
+ * @return Allocated contents, or NULL on error
+ */
+static unsigned char* readWholeFile(const char* path, size_t* size) {
+    FILE* file = isStdioPath(path) ? stdin : fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open input file '%s'\n", path);
+        return NULL;
+    }
+
+    size_t capacity = IO_BUFFER_SIZE;
+    unsigned char* data = (unsigned char*)malloc(capacity);
+    *size = 0;
+    while (data) {
+        *size += fread(data + *size, 1, capacity - *size, file);
+        if (*size < capacity) break;
+
+        unsigned char* grown = (unsigned char*)realloc(data, capacity * 2);
+        if (!grown) {
+            free(data);
+            data = NULL;
+            break;
+        }
+        data = grown;
+        capacity *= 2;
+    }
+    if (!data) {
+        fprintf(stderr, "Error: Memory allocation failed for '%s'\n", path);
+    }
+    if (file != stdin) fclose(file);
+    return data;
+}
+
+/**
+ * Round-trips an input through a canonical stream with sync points,
+ * decoded in parallel segments
+ * Goes through files, since sync points are a file-format feature.
+ * @param data Input bytes
+ * @param size Number of bytes (more than one sync interval)
+ * @return Number of failures
+ */
+static int checkSyncPoints(const unsigned char* data, size_t size) {
+    if (createWorkDirectory() != 0) {
+        return recordResult("sync-parallel", size, 0, 0, 0);
+    }
+
+    char input[96], compressed[96], output[96];
+    snprintf(input, sizeof(input), "%s/input", workDirectory);
+    snprintf(compressed, sizeof(compressed), "%s/input.huf", workDirectory);
+    snprintf(output, sizeof(output), "%s/output", workDirectory);
+
+    CompressOptions options;
+    initCompressOptions(&options);
+    options.format = FORMAT_CANONICAL;
+    options.syncInterval = MIN_SYNC_INTERVAL;
+    options.quiet = 1;
+    DecompressOptions decompressOptions;
+    initDecompressOptions(&decompressOptions);
+    decompressOptions.threads = 4;
+    decompressOptions.quiet = 1;
+
+    int ok = writeWholeFile(input, data, size) == 0;
+    double start = wallClockSeconds();
+    ok = ok && compressFileWithOptions(input, compressed, &options) == 0;
+    double encoded = wallClockSeconds();
+    ok = ok && decompressFileWithOptions(compressed, output, &decompressOptions) == 0;
+    double decoded = wallClockSeconds();
+    ok = ok && fileEquals(output, data, size);
+    return recordResult("sync-parallel", size, encoded - start, decoded - encoded, ok);
+}
+
+/**
+ * Checks that damaged single-stream files fail to decompress: one with the
+ * last payload byte cut off, and one whose header claims more symbols than
+ * the file has bits
+ * Goes through files, since the legacy and canonical formats have no
+ * in-memory decoder.
+ * @param data Input bytes
+ * @param size Number of bytes (at least 1)
+ * @return Number of failures
+ */
+static int checkDamagedStreams(const unsigned char* data, size_t size) {
+    static const struct {
+        const char* name;
+        OutputFormat format;
+    } formats[] = {
+        { "damaged-legacy", FORMAT_LEGACY },
+        { "damaged-canonical", FORMAT_CANONICAL }
+    };
+    size_t formatCount = sizeof(formats) / sizeof(formats[0]);
+    if (createWorkDirectory() != 0) {
+        return recordResult(formats[0].name, size, 0, 0, 0);
+    }
+
+    char input[96], compressed[96], damaged[96], output[96];
+    snprintf(input, sizeof(input), "%s/input", workDirectory);
+    snprintf(compressed, sizeof(compressed), "%s/input.huf", workDirectory);
+    snprintf(damaged, sizeof(damaged), "%s/damaged.huf", workDirectory);
+    snprintf(output, sizeof(output), "%s/output", workDirectory);
+
+    DecompressOptions decompressOptions;
+    initDecompressOptions(&decompressOptions);
+    decompressOptions.quiet = 1;
+    int written = writeWholeFile(input, data, size) == 0;
+    int failures = 0;
+
+    for (size_t f = 0; f < formatCount; f++) {
+        CompressOptions options;
+        initCompressOptions(&options);
+        options.format = formats[f].format;
+        options.quiet = 1;
+
+        double start = wallClockSeconds();
+        size_t fileSize = 0;
+        unsigned char* file = written && compressFileWithOptions(input, compressed, &options) == 0
+            ? readWholeFile(compressed, &fileSize) : NULL;
+        double encoded = wallClockSeconds();
+        uint32_t magic = 0;
+        if (file && fileSize >= sizeof(magic)) memcpy(&magic, file, sizeof(magic));
+
+        // The payload ends the file, so every byte carries at least one code bit
+        int ok = file != NULL &&
+                 writeWholeFile(damaged, file, fileSize - 1) == 0 &&
+                 decompressFileWithOptions(damaged, output, &decompressOptions) != 0;
+
+        // Legacy sizes are 32 bits at offset 4, versioned ones 64 bits at offset 8
+        uint64_t claimed = (uint64_t)fileSize * 8 + 1;
+        if (magic == MAGIC_VERSIONED) {
+            memcpy(file + 8, &claimed, sizeof(uint64_t));
+        } else if (file && fileSize >= 8) {
+            uint32_t claimed32 = (uint32_t)claimed;
+            memcpy(file + 4, &claimed32, sizeof(uint32_t));
+        }
+        ok = ok && writeWholeFile(damaged, file, fileSize) == 0 &&
+             decompressFileWithOptions(damaged, output, &decompressOptions) != 0;
+        double decoded = wallClockSeconds();
+
+        free(file);
+        failures += recordResult(formats[f].name, size, encoded - start, decoded - encoded, ok);
+    }
+    return failures;
+}
+
+#endif
+
+// =============================================================================
+// ADVERSARIAL DECODING
+// =============================================================================
+
+/**
+ * Feeds arbitrary bytes to the decoders; any status is fine, crashes and
+ * sanitizer reports are not
+ * The bytes are tried as they are and as a valid container with one byte
+ * replaced by a value taken from the input.
+ * @param data Input bytes
+ * @param size Number of bytes
+ */
+static void decodeArbitraryBytes(const unsigned char* data, size_t size) {
+    FuzzBuffer output = { (unsigned char*)malloc(FUZZ_DECODE_LIMIT), FUZZ_DECODE_LIMIT, 0 };
+    if (!output.data) return;
+
+    decompressBuffer(data, size, 1, &output);
+    huff_scan* scan = NULL;
+    uint64_t offset;
+    if (size > 0 && huff_scan_create(data, size, data, 1, 1, &scan) == HUFF_OK) {
+        while (huff_scan_next(scan, &offset) == 1) {}
+    }
+    huff_scan_destroy(scan);
+    size_t length = 4096;
+    huff_decompress_range(data, size, size > 0 ? data[0] : 0, output.data, &length);
+
+    size_t bound = huff_compress_bound(size);
+    unsigned char* compressed = (unsigned char*)malloc(bound);
+    size_t compressedSize = bound;
+    huff_params params;
+    huff_params_init(&params);
+    params.block_size = MIN_BLOCK_SIZE;
+    if (compressed && size > 0 &&
+        huff_compress_with(&params, data, size, compressed, &compressedSize) == HUFF_OK) {
+        uint64_t hash = 1469598103934665603ull;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ data[i]) * 1099511628211ull;
+        }
+        compressed[hash % compressedSize] ^= (unsigned char)(hash >> 56 | 1);
+        decompressBuffer(compressed, compressedSize, 2, &output);
+    }
+
+    free(compressed);
+    free(output.data);
+}
+
+// =============================================================================
+// DRIVER
+// =============================================================================
+
+#ifdef HUFFMAN_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+/**
+ * libFuzzer entry point: a mismatch aborts so the input is saved
+ * The first byte picks the kernel set and one check, so every run stays in
+ * memory and quick; the sync-point engine, which goes through files, is
+ * left to --diff.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size == 0) return 0;
+
+    const char* kernels[4];
+    int kernelCount = codecKernelNames(kernels);
+    unsigned selector = data[0];
+    selectCodecKernels(kernels[selector % (unsigned)kernelCount]);
+    size_t check = selector / (unsigned)kernelCount % (CONTAINER_ENGINES + 4);
+    data++;
+    size--;
+
+    int failures = 0;
+    if (check < CONTAINER_ENGINES) {
+        failures = checkContainer(&containerEngines[check], check == 0, data, size);
+    } else if (check == CONTAINER_ENGINES) {
+        failures = size > 0 ? checkSingleStreams(data, size) : 0;
+    } else if (check == CONTAINER_ENGINES + 1) {
+        failures = checkTable(data, size);
+    } else if (check == CONTAINER_ENGINES + 2) {
+        failures = checkContext(data, size);
+    } else {
+        decodeArbitraryBytes(data, size);
+    }
+
+    if (failures != 0) {
+        abort();
+    }
+    return 0;
+}
+
+#else
+
+/**
+ * Runs every engine under every kernel set on one input
+ * @param data Input bytes
+ * @param size Number of bytes
+ * @return Number of failures
+ */
+static int checkInput(const unsigned char* data, size_t size) {
+    const char* kernels[4];
+    int kernelCount = codecKernelNames(kernels);
+    int failures = 0;
+
+    for (int k = 0; k < kernelCount; k++) {
+        selectCodecKernels(kernels[k]);
+        if (size > 0) {
+            failures += checkSingleStreams(data, size);
+        }
+        for (size_t e = 0; e < CONTAINER_ENGINES; e++) {
+            failures += checkContainer(&containerEngines[e], e == 0, data, size);
+        }
+        failures += checkTable(data, size);
+        failures += checkContext(data, size);
+    }
+    selectCodecKernels(kernels[0]);
+
+    if (size > MIN_SYNC_INTERVAL) {
+        failures += checkSyncPoints(data, size);
+    }
+    if (size > 0) {
+        failures += checkDamagedStreams(data, size);
+    }
+    decodeArbitraryBytes(data, size);
+    return failures;
+}
+
+/**
+ * Prints the throughput of every engine as one DIFF line each
+ */
+static void printEngineRecords(void) {
+    for (int i = 0; i < recordCount; i++) {
+        const EngineRecord* record = &records[i];
+        double megabytes = (double)record->bytes / 1e6;
+        printf("DIFF engine=%s inputs=%llu bytes=%llu encode_mbps=%.1f decode_mbps=%.1f "
+               "failures=%llu\n", record->name, (unsigned long long)record->inputs,
+               (unsigned long long)record->bytes,
+               record->encodeSeconds > 0 ? megabytes / record->encodeSeconds : 0.0,
+               record->decodeSeconds > 0 ? megabytes / record->decodeSeconds : 0.0,
+               (unsigned long long)record->failures);
+    }
+}
+
+
+/**
+ * Advances a xorshift64* generator
+ * @param state Generator state (nonzero)
+ * @return Next pseudo-random value
+ */
+static uint64_t nextRandom(uint64_t* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ull;
+}
+
+/**
+ * Fills a buffer with one of the generated input shapes
+ * Shapes cover stored, RLE and context blocks, maximal code lengths,
+ * statistics that change mid-input and plain random bytes.
+ * @param data Buffer to fill
+ * @param size Number of bytes
+ * @param shape Shape number (any value; taken modulo the shape count)
+ * @param state Generator state
+ */
+static void generateInput(unsigned char* data, size_t size, unsigned shape, uint64_t* state) {
+    static const char* words[] = { "the ", "huffman ", "block ", "code ", "stream ", "table ",
+                                   "\n", "{\"id\": ", "42, ", "\"value\": " };
+    uint64_t a = 0, b = 1;
+
+    for (size_t i = 0; i < size; i++) {
+        uint64_t r = nextRandom(state);
+        switch (shape % 8) {
+            case 0: data[i] = (unsigned char)r; break;                     // Uniform: stored blocks
+            case 1: data[i] = (unsigned char)(shape >> 3); break;          // One symbol: RLE blocks
+            case 2: data[i] = (unsigned char)(r & 1 ? 'a' : 'b'); break;   // Two symbols
+            case 3: data[i] = (unsigned char)(__builtin_ctzll(r | 1ull << 40)); break;  // Geometric
+            case 4: {                                                      // Fibonacci counts
+                uint64_t next = a + b;
+                if (next > size) { a = 0; b = 1; next = 1; }
+                data[i] = (unsigned char)(i % 40);
+                if (r % (next + 1) == 0) data[i] = (unsigned char)(r >> 32);
+                a = b;
+                b = next;
+                break;
+            }
+            case 5: {                                                      // Words: context blocks
+                const char* word = words[r % (sizeof(words) / sizeof(words[0]))];
+                for (size_t j = 0; word[j] && i < size; j++) data[i++] = (unsigned char)word[j];
+                i--;
+                break;
+            }
+            case 6: data[i] = (unsigned char)(i < size / 2 ? r % 16 : 128 + r % 128); break;
+            default: data[i] = (unsigned char)((i / 997) & 1 ? r : i >> 10); break;  // Runs
+        }
+    }
+}
+
+/**
+ * Runs the generated corpora and prints the throughput of every engine
+ * @param seed Generator seed
+ * @param count Number of random inputs besides the fixed ones
+ * @return Number of failures
+ */
+static int runDifferentialTest(uint64_t seed, int count) {
+    static const size_t edgeSizes[] = {
+        0, 1, 2, 3, 7, 8, 63, 64, 255, 256, 1000,
+        MIN_BLOCK_SIZE - 1, MIN_BLOCK_SIZE, MIN_BLOCK_SIZE + 1,
+        MIN_SYNC_INTERVAL * 3 + 1, 4 * MIN_BLOCK_SIZE + 3
+    };
+    size_t edges = sizeof(edgeSizes) / sizeof(edgeSizes[0]);
+    uint64_t state = seed ? seed : 1;
+    unsigned char* data = (unsigned char*)malloc(THROUGHPUT_INPUT);
+    if (!data) {
+        fprintf(stderr, "Error: Memory allocation failed for test inputs\n");
+        return 1;
+    }
+
+    int failures = 0;
+    size_t inputs = 0;
+    for (unsigned shape = 0; shape < 8; shape++) {
+        for (size_t e = 0; e < edges; e++) {
+            generateInput(data, edgeSizes[e], shape, &state);
+            failures += checkInput(data, edgeSizes[e]);
+            inputs++;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        size_t size = (size_t)(nextRandom(&state) % MAX_RANDOM_INPUT) + 1;
+        generateInput(data, size, (unsigned)nextRandom(&state), &state);
+        failures += checkInput(data, size);
+        inputs++;
+    }
+    for (unsigned shape = 0; shape < 8; shape += 2) {
+        generateInput(data, THROUGHPUT_INPUT, shape + 3 * (shape == 0), &state);
+        failures += checkInput(data, THROUGHPUT_INPUT);
+        inputs++;
+    }
+
+    printEngineRecords();
+    printf("DIFF inputs=%zu failures=%d seed=%llu\n", inputs, failures,
+           (unsigned long long)seed);
+    free(data);
+    return failures;
+}
+
+/**
+ * Main function: --diff runs the generated corpora, otherwise each file
+ * argument is checked as one input
+ */
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s --diff [--seed N] [--inputs N] | FILE...\n", argv[0]);
+        return 2;
+    }
+
+    if (strcmp(argv[1], "--diff") == 0) {
+        uint64_t seed = 1;
+        int count = DEFAULT_DIFF_INPUTS;
+        for (int i = 2; i + 1 < argc; i += 2) {
+            if (strcmp(argv[i], "--seed") == 0) {
+                seed = strtoull(argv[i + 1], NULL, 10);
+            } else if (strcmp(argv[i], "--inputs") == 0) {
+                count = atoi(argv[i + 1]);
+            } else {
+                fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+                return 2;
+            }
+        }
+        return runDifferentialTest(seed, count) == 0 ? 0 : 1;
+    }
+
+    int failures = 0;
+    for (int i = 1; i < argc; i++) {
+        size_t size;
+        unsigned char* data = readWholeFile(argv[i], &size);
+        if (!data) return 2;
+        failures += checkInput(data, size);
+        free(data);
+    }
+    if (failures > 0) {
+        printEngineRecords();
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+#endif
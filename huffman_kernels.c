@@ -0,0 +1,903 @@
+#include "huffman.h"
+
+// x86 kernels are compiled with per-function target attributes, so the
+// library itself still builds for the baseline instruction set
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HUFFMAN_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+// NEON is part of the AArch64 baseline and needs no runtime check
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define HUFFMAN_NEON_KERNELS
+#include <arm_neon.h>
+#ifdef __ARM_FEATURE_CRC32
+#include <arm_acle.h>
+#endif
+#endif
+
+// Kernel bodies are inlined into each instruction-set variant
+#ifdef __GNUC__
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+#else
+#define KERNEL_INLINE static inline
+#endif
+
+// =============================================================================
+// SHARED KERNEL BODIES
+// =============================================================================
+
+/**
+ * Counts 16 bytes into the sub-tables of countFrequencies
+ * Two 64-bit loads, four bytes of each into every sub-table pair.
+ * @param tables HISTOGRAM_TABLES sub-tables of ASCII_SIZE counts
+ * @param data Pointer to 16 readable bytes
+ */
+KERNEL_INLINE void countSixteen(uint32_t tables[HISTOGRAM_TABLES][ASCII_SIZE],
+                                const unsigned char* data) {
+    uint64_t first, second;
+    memcpy(&first, data, sizeof(uint64_t));
+    memcpy(&second, data + 8, sizeof(uint64_t));
+
+    tables[0][first & 0xff]++;
+    tables[1][(first >> 8) & 0xff]++;
+    tables[2][(first >> 16) & 0xff]++;
+    tables[3][(first >> 24) & 0xff]++;
+    tables[0][(first >> 32) & 0xff]++;
+    tables[1][(first >> 40) & 0xff]++;
+    tables[2][(first >> 48) & 0xff]++;
+    tables[3][first >> 56]++;
+
+    tables[0][second & 0xff]++;
+    tables[1][(second >> 8) & 0xff]++;
+    tables[2][(second >> 16) & 0xff]++;
+    tables[3][(second >> 24) & 0xff]++;
+    tables[0][(second >> 32) & 0xff]++;
+    tables[1][(second >> 40) & 0xff]++;
+    tables[2][(second >> 48) & 0xff]++;
+    tables[3][second >> 56]++;
+}
+
+/**
+ * Counts the bytes of a chunk after the last whole 16 bytes and merges the sub-tables
+ * @param tables Sub-tables holding the counts of the chunk so far
+ * @param data Start of the chunk
+ * @param position First byte not yet counted
+ * @param chunk Size of the chunk
+ * @param frequencies Histogram to update (size ASCII_SIZE)
+ */
+KERNEL_INLINE void finishHistogramChunk(uint32_t tables[HISTOGRAM_TABLES][ASCII_SIZE],
+                                        const unsigned char* data, size_t position, size_t chunk,
+                                        uint64_t frequencies[ASCII_SIZE]) {
+    for (size_t i = position; i < chunk; i++) {
+        tables[i % HISTOGRAM_TABLES][data[i]]++;
+    }
+
+    for (int c = 0; c < ASCII_SIZE; c++) {
+        frequencies[c] += (uint64_t)tables[0][c] + tables[1][c] + tables[2][c] + tables[3][c];
+    }
+}
+
+/**
+ * Adds the byte counts of a span to a histogram
+ * Consecutive bytes go to HISTOGRAM_TABLES different sub-tables, so runs
+ * of one byte value do not serialize on a single counter; the sub-tables
+ * are merged after each chunk.
+ * @param data Bytes to count
+ * @param size Number of bytes
+ * @param frequencies Histogram to update (size ASCII_SIZE)
+ */
+KERNEL_INLINE void countFrequenciesBody(const unsigned char* data, size_t size,
+                                        uint64_t frequencies[ASCII_SIZE]) {
+    uint32_t tables[HISTOGRAM_TABLES][ASCII_SIZE];
+
+    while (size > 0) {
+        size_t chunk = size < HISTOGRAM_CHUNK ? size : HISTOGRAM_CHUNK;
+        memset(tables, 0, sizeof(tables));
+
+        size_t i = 0;
+        for (; i + 16 <= chunk; i += 16) {
+            countSixteen(tables, data + i);
+        }
+        finishHistogramChunk(tables, data, i, chunk, frequencies);
+
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+/**
+ * Encodes a run of bytes with packed codes
+ * Codes are appended at the low end of the accumulator, so consecutive
+ * codes depend only on each other's lengths, and the accumulator is
+ * written out after every group of codes that is sure to fit into it.
+ * @param writer Bit writer receiving the codes
+ * @param codes Array of Huffman codes with packed bits
+ * @param input Bytes to encode
+ * @param count Number of bytes
+ * @return 0 on success, -1 if a byte has no code
+ */
+KERNEL_INLINE int encodeSymbolsBody(BitWriter* writer, const CodeEntry codes[ASCII_SIZE],
+                                    const unsigned char* input, size_t count) {
+    // Compact copy of the codes; the CodeEntry table spans 68 KiB
+    uint64_t codeBits[ASCII_SIZE];
+    uint8_t codeLengths[ASCII_SIZE];
+    int maxLength = 1;
+    for (int c = 0; c < ASCII_SIZE; c++) {
+        codeBits[c] = codes[c].bits;
+        codeLengths[c] = (uint8_t)codes[c].length;
+        if (codes[c].length > maxLength) maxLength = codes[c].length;
+    }
+
+    // After a drain at most 7 bits are pending
+    const size_t group = (size_t)((64 - 7) / maxLength);
+    if (writer->bitCount >= 8) {
+        drainBits(writer);
+    }
+    int bitCount = writer->bitCount;
+    uint64_t bits = bitCount > 0 ? writer->bits >> (64 - bitCount) : 0;
+    size_t position = writer->position;
+    int result = 0;
+
+    size_t i = 0;
+    while (i < count) {
+        size_t end = count - i < group ? count : i + group;
+        for (; i < end; i++) {
+            int length = codeLengths[input[i]];
+            if (length == 0) {
+                reportError("No code found for character %d", input[i]);
+                result = -1;
+                break;
+            }
+            bits = (bits << length) | codeBits[input[i]];
+            bitCount += length;
+        }
+        if (result != 0) break;
+
+        store64BE(writer->buffer + position, bits << (64 - bitCount));
+        position += (size_t)(bitCount >> 3);
+        bitCount &= 7;
+
+        // Pending bits stay in the accumulator, so only whole bytes are written out
+        if (writer->file && position > writer->capacity - 8) {
+            fwrite(writer->buffer, 1, position, writer->file);
+            writer->flushed += position;
+            position = 0;
+        }
+    }
+
+    writer->position = position;
+    writer->bits = bitCount > 0 ? bits << (64 - bitCount) : 0;
+    writer->bitCount = bitCount;
+    return result;
+}
+
+/**
+ * Decodes a fixed number of symbols into memory
+ * @param reader Bit reader positioned at the next code
+ * @param table Decode table for the stream
+ * @param output Buffer receiving the symbols (at least count bytes)
+ * @param count Number of symbols to decode
+ * @return 0 on success, -1 on an invalid bit sequence or once the reader has run
+ *         more than MAX_OVERRUN_BYTES past the end of its input
+ */
+KERNEL_INLINE int decodeSymbolsBody(BitReader* reader, const DecodeTable* table,
+                                    unsigned char* output, size_t count) {
+    const DecodeEntry* entries = table->entries;
+    const int shift = 64 - table->primaryBits;
+    size_t outputPos = 0;
+    uint64_t lookups = 0;
+    uint64_t longCodes = 0;
+
+    while (outputPos < count) {
+        refillBits(reader);
+        if (reader->overrunBytes > MAX_OVERRUN_BYTES) {
+            reportError("Compressed data is truncated");
+            return -1;
+        }
+
+        // Fast path: a refill holds enough bits for several primary lookups
+        while (reader->bitCount >= table->primaryBits && outputPos + 2 <= count) {
+            const DecodeEntry* entry = &entries[reader->bits >> shift];
+            if (entry->count == 0) break;
+
+            output[outputPos] = entry->symbols[0];
+            output[outputPos + 1] = entry->symbols[1];
+            outputPos += entry->count;
+            reader->bits <<= entry->length;
+            reader->bitCount -= entry->length;
+            lookups++;
+        }
+
+        if (outputPos == count) break;
+
+        // Slow path: long codes through subtables, or the final symbol
+        refillBits(reader);
+        const DecodeEntry* entry = &entries[reader->bits >> shift];
+        lookups++;
+        if (entry->count == 0 && entry->length > 0) {
+            longCodes++;
+        }
+        while (entry->count == 0 && entry->length > 0) {
+            reader->bits <<= entry->length;
+            reader->bitCount -= entry->length;
+            refillBits(reader);
+            entry = &entries[entry->next + (reader->bits >> (64 - entry->subBits))];
+        }
+
+        if (entry->count == 0) {
+            reportError("Invalid bit sequence encountered during decoding");
+            return -1;
+        }
+
+        output[outputPos++] = entry->symbols[0];
+        reader->bits <<= entry->firstLength;
+        reader->bitCount -= entry->firstLength;
+    }
+
+    reader->lookups += lookups;
+    reader->longCodes += longCodes;
+    return 0;
+}
+
+// Resolves one primary entry (one or two symbols) or one subtable code,
+// counted in 'longCodes'; an invalid code sets 'invalid' and consumes nothing
+#define DECODE_LANE(r, out) \
+    do { \
+        const DecodeEntry* entry = &entries[(r).bits >> shift]; \
+        if (entry->count > 0) { \
+            (out)[0] = entry->symbols[0]; \
+            (out)[1] = entry->symbols[1]; \
+            (out) += entry->count; \
+            (r).bits <<= entry->length; \
+            (r).bitCount -= entry->length; \
+        } else { \
+            const DecodeEntry* sub = entry->length == 0 ? entry : \
+                &entries[entry->next + (((r).bits << entry->length) >> (64 - entry->subBits))]; \
+            longCodes++; \
+            if (sub->count > 0) { \
+                *(out)++ = sub->symbols[0]; \
+                (r).bits <<= entry->length + sub->firstLength; \
+                (r).bitCount -= entry->length + sub->firstLength; \
+            } else { \
+                invalid = 1; \
+            } \
+        } \
+    } while (0)
+
+/**
+ * Splits a block's output into the segments of its interleaved sub-streams
+ * @param output Buffer receiving all symbols of the block
+ * @param size Number of symbols in the block
+ * @param out Receives the start of each segment
+ * @param end Receives the end of each segment
+ */
+KERNEL_INLINE void splitInterleavedOutput(unsigned char* output, size_t size,
+                                          unsigned char* out[INTERLEAVED_STREAMS],
+                                          unsigned char* end[INTERLEAVED_STREAMS]) {
+    size_t segment = interleavedSegmentSize(size);
+    for (int k = 0; k < INTERLEAVED_STREAMS; k++) {
+        size_t start = (size_t)k * segment < size ? (size_t)k * segment : size;
+        out[k] = output + start;
+        end[k] = output + (size - start < segment ? size : start + segment);
+    }
+}
+
+/**
+ * Decodes INTERLEAVED_STREAMS sub-streams in lockstep
+ * Each round refills every reservoir once and resolves three codes per
+ * stream, so the four independent lookup chains overlap. Codes are at
+ * most 15 bits, so three fit in the 56 bits a refill guarantees. Streams
+ * close to the end of their input or output finish on decodeSymbolsBody.
+ * @param readers Bit readers, one per sub-stream
+ * @param table Decode table for the block (codes of at most 15 bits)
+ * @param output Buffer receiving all symbols of the block
+ * @param size Number of symbols in the block
+ * @return 0 on success, -1 on an invalid bit sequence
+ */
+KERNEL_INLINE int decodeInterleavedBody(BitReader readers[INTERLEAVED_STREAMS],
+                                        const DecodeTable* table,
+                                        unsigned char* output, size_t size) {
+    const DecodeEntry* entries = table->entries;
+    const int shift = 64 - table->primaryBits;
+    const size_t slack = 6;  // Three lookups of up to two symbols each
+
+    unsigned char* out[INTERLEAVED_STREAMS];
+    unsigned char* end[INTERLEAVED_STREAMS];
+    splitInterleavedOutput(output, size, out, end);
+
+    BitReader r0 = readers[0], r1 = readers[1], r2 = readers[2], r3 = readers[3];
+    unsigned char* o0 = out[0];
+    unsigned char* o1 = out[1];
+    unsigned char* o2 = out[2];
+    unsigned char* o3 = out[3];
+    int invalid = 0;
+    uint64_t rounds = 0;
+    uint64_t longCodes = 0;
+
+    while (!invalid &&
+           (size_t)(end[0] - o0) >= slack && (size_t)(end[1] - o1) >= slack &&
+           (size_t)(end[2] - o2) >= slack && (size_t)(end[3] - o3) >= slack &&
+           r0.length - r0.position >= 8 && r1.length - r1.position >= 8 &&
+           r2.length - r2.position >= 8 && r3.length - r3.position >= 8) {
+        REFILL_LANE(r0);
+        REFILL_LANE(r1);
+        REFILL_LANE(r2);
+        REFILL_LANE(r3);
+
+        for (int step = 0; step < 3; step++) {
+            DECODE_LANE(r0, o0);
+            DECODE_LANE(r1, o1);
+            DECODE_LANE(r2, o2);
+            DECODE_LANE(r3, o3);
+        }
+        rounds++;
+    }
+
+    if (invalid) {
+        reportError("Invalid bit sequence encountered during decoding");
+        return -1;
+    }
+
+    readers[0] = r0;
+    readers[1] = r1;
+    readers[2] = r2;
+    readers[3] = r3;
+    out[0] = o0;
+    out[1] = o1;
+    out[2] = o2;
+    out[3] = o3;
+
+    // Every round made three lookups per stream
+    for (int k = 0; k < INTERLEAVED_STREAMS; k++) {
+        readers[k].lookups += 3 * rounds;
+    }
+    readers[0].longCodes += longCodes;
+
+    for (int k = 0; k < INTERLEAVED_STREAMS; k++) {
+        if (decodeSymbolsBody(&readers[k], table, out[k], (size_t)(end[k] - out[k])) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// =============================================================================
+// CRC32C
+// =============================================================================
+
+#define CRC32C_POLY 0x82f63b78u   // Castagnoli polynomial, bit-reflected
+#define CRC_LONG_LANE 8192        // Bytes per lane of the three-way hardware CRC
+#define CRC_SHORT_LANE 256
+
+// Slicing-by-8 tables for the software CRC
+static uint32_t crcTables[8][ASCII_SIZE];
+
+// Operators that advance a CRC over a lane of zero bytes, one table per CRC byte
+static uint32_t crcLongShift[4][ASCII_SIZE];
+static uint32_t crcShortShift[4][ASCII_SIZE];
+
+/**
+ * Multiplies a GF(2) matrix by a vector
+ * @param matrix 32 columns, one per bit of vector
+ * @param vector Bit vector
+ * @return Product
+ */
+static uint32_t gf2MatrixTimes(const uint32_t* matrix, uint32_t vector) {
+    uint32_t sum = 0;
+    for (; vector; vector >>= 1, matrix++) {
+        if (vector & 1) sum ^= *matrix;
+    }
+    return sum;
+}
+
+/**
+ * Squares a GF(2) matrix
+ * @param square Receives the 32 columns of matrix * matrix
+ * @param matrix 32 columns
+ */
+static void gf2MatrixSquare(uint32_t* square, const uint32_t* matrix) {
+    for (int n = 0; n < 32; n++) {
+        square[n] = gf2MatrixTimes(matrix, matrix[n]);
+    }
+}
+
+/**
+ * Builds the tables that advance a CRC over a run of zero bytes
+ * Appending 'length' bytes B to data with CRC register c gives the
+ * register shift(c) ^ crc(B), which lets independent lanes be combined.
+ * @param tables Receives one table per byte of the CRC register
+ * @param length Number of zero bytes (a power of two)
+ */
+static void buildCrcShift(uint32_t tables[4][ASCII_SIZE], size_t length) {
+    uint32_t odd[32];
+    uint32_t even[32];
+
+    // Operator for one zero bit, then squared up to one zero byte and beyond
+    odd[0] = CRC32C_POLY;
+    for (int n = 1; n < 32; n++) {
+        odd[n] = 1u << (n - 1);
+    }
+    gf2MatrixSquare(even, odd);   // Two zero bits
+    gf2MatrixSquare(odd, even);   // Four zero bits
+
+    uint32_t* result = even;
+    while (1) {
+        gf2MatrixSquare(even, odd);
+        result = even;
+        length >>= 1;
+        if (length == 0) break;
+        gf2MatrixSquare(odd, even);
+        result = odd;
+        length >>= 1;
+        if (length == 0) break;
+    }
+
+    for (uint32_t n = 0; n < ASCII_SIZE; n++) {
+        tables[0][n] = gf2MatrixTimes(result, n);
+        tables[1][n] = gf2MatrixTimes(result, n << 8);
+        tables[2][n] = gf2MatrixTimes(result, n << 16);
+        tables[3][n] = gf2MatrixTimes(result, n << 24);
+    }
+}
+
+// Fills the CRC tables; runs once, with the kernel detection
+static void initCrcTables(void) {
+    for (uint32_t n = 0; n < ASCII_SIZE; n++) {
+        uint32_t crc = n;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crcTables[0][n] = crc;
+    }
+    for (int n = 0; n < ASCII_SIZE; n++) {
+        for (int k = 1; k < 8; k++) {
+            crcTables[k][n] = (crcTables[k - 1][n] >> 8) ^ crcTables[0][crcTables[k - 1][n] & 0xff];
+        }
+    }
+
+    buildCrcShift(crcLongShift, CRC_LONG_LANE);
+    buildCrcShift(crcShortShift, CRC_SHORT_LANE);
+}
+
+/**
+ * Advances a CRC register over a lane of zero bytes
+ * @param tables crcLongShift or crcShortShift
+ * @param crc CRC register
+ * @return Register after the zero bytes
+ */
+KERNEL_INLINE uint32_t shiftCrc(const uint32_t tables[4][ASCII_SIZE], uint32_t crc) {
+    return tables[0][crc & 0xff] ^ tables[1][(crc >> 8) & 0xff] ^
+           tables[2][(crc >> 16) & 0xff] ^ tables[3][crc >> 24];
+}
+
+/**
+ * Reads 4 bytes as a little-endian 32-bit value
+ * @param bytes Pointer to at least 4 readable bytes
+ * @return The loaded value, first byte in the least significant position
+ */
+KERNEL_INLINE uint32_t load32LE(const unsigned char* bytes) {
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) |
+           ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+/**
+ * Extends a CRC32C with slicing-by-8 tables
+ * @param crc CRC of the preceding bytes (0 to start)
+ * @param data Bytes to add
+ * @param size Number of bytes
+ * @return CRC32C of the preceding bytes followed by data
+ */
+static uint32_t crc32cScalar(uint32_t crc, const unsigned char* data, size_t size) {
+    crc = ~crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint32_t low = crc ^ load32LE(data);
+        uint32_t high = load32LE(data + 4);
+        crc = crcTables[7][low & 0xff] ^ crcTables[6][(low >> 8) & 0xff] ^
+              crcTables[5][(low >> 16) & 0xff] ^ crcTables[4][low >> 24] ^
+              crcTables[3][high & 0xff] ^ crcTables[2][(high >> 8) & 0xff] ^
+              crcTables[1][(high >> 16) & 0xff] ^ crcTables[0][high >> 24];
+    }
+    for (; size > 0; data++, size--) {
+        crc = (crc >> 8) ^ crcTables[0][(crc ^ *data) & 0xff];
+    }
+    return ~crc;
+}
+
+// =============================================================================
+// SCALAR KERNELS
+// =============================================================================
+
+static void countFrequenciesScalar(const unsigned char* data, size_t size,
+                                   uint64_t frequencies[ASCII_SIZE]) {
+    countFrequenciesBody(data, size, frequencies);
+}
+
+static int encodeSymbolsScalar(BitWriter* writer, const CodeEntry codes[ASCII_SIZE],
+                               const unsigned char* input, size_t count) {
+    return encodeSymbolsBody(writer, codes, input, count);
+}
+
+static int decodeSymbolsScalar(BitReader* reader, const DecodeTable* table,
+                               unsigned char* output, size_t count) {
+    return decodeSymbolsBody(reader, table, output, count);
+}
+
+static int decodeInterleavedScalar(BitReader readers[INTERLEAVED_STREAMS],
+                                   const DecodeTable* table, unsigned char* output, size_t size) {
+    return decodeInterleavedBody(readers, table, output, size);
+}
+
+static const CodecKernels scalarKernels = {
+    "scalar", countFrequenciesScalar, encodeSymbolsScalar,
+    decodeSymbolsScalar, decodeInterleavedScalar, crc32cScalar
+};
+
+// =============================================================================
+// SSE4.2 KERNELS
+// =============================================================================
+
+#ifdef HUFFMAN_X86_KERNELS
+
+/**
+ * Runs the crc32 instruction over whole 8-byte words
+ * @param crc CRC register
+ * @param data First word
+ * @param words Number of words
+ * @return Register after the words
+ */
+__attribute__((target("sse4.2")))
+KERNEL_INLINE uint64_t crcWords(uint64_t crc, const unsigned char* data, size_t words) {
+    for (size_t i = 0; i < words; i++) {
+        uint64_t word;
+        memcpy(&word, data + i * 8, sizeof(word));
+        crc = _mm_crc32_u64(crc, word);
+    }
+    return crc;
+}
+
+/**
+ * Extends a CRC32C with the SSE4.2 crc32 instruction
+ * The instruction has a latency of three cycles and a throughput of one,
+ * so long inputs run as three lanes whose CRCs are combined with
+ * shiftCrc at the end of each round.
+ * @param crc CRC of the preceding bytes (0 to start)
+ * @param data Bytes to add
+ * @param size Number of bytes
+ * @return CRC32C of the preceding bytes followed by data
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32cSse42(uint32_t crc, const unsigned char* data, size_t size) {
+    uint64_t crc0 = ~crc;
+
+    while (size >= 3 * CRC_LONG_LANE) {
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        for (size_t i = 0; i < CRC_LONG_LANE; i += 8) {
+            uint64_t words[3];
+            memcpy(&words[0], data + i, sizeof(uint64_t));
+            memcpy(&words[1], data + CRC_LONG_LANE + i, sizeof(uint64_t));
+            memcpy(&words[2], data + 2 * CRC_LONG_LANE + i, sizeof(uint64_t));
+            crc0 = _mm_crc32_u64(crc0, words[0]);
+            crc1 = _mm_crc32_u64(crc1, words[1]);
+            crc2 = _mm_crc32_u64(crc2, words[2]);
+        }
+        crc0 = shiftCrc(crcLongShift, (uint32_t)crc0) ^ crc1;
+        crc0 = shiftCrc(crcLongShift, (uint32_t)crc0) ^ crc2;
+        data += 3 * CRC_LONG_LANE;
+        size -= 3 * CRC_LONG_LANE;
+    }
+
+    while (size >= 3 * CRC_SHORT_LANE) {
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        for (size_t i = 0; i < CRC_SHORT_LANE; i += 8) {
+            uint64_t words[3];
+            memcpy(&words[0], data + i, sizeof(uint64_t));
+            memcpy(&words[1], data + CRC_SHORT_LANE + i, sizeof(uint64_t));
+            memcpy(&words[2], data + 2 * CRC_SHORT_LANE + i, sizeof(uint64_t));
+            crc0 = _mm_crc32_u64(crc0, words[0]);
+            crc1 = _mm_crc32_u64(crc1, words[1]);
+            crc2 = _mm_crc32_u64(crc2, words[2]);
+        }
+        crc0 = shiftCrc(crcShortShift, (uint32_t)crc0) ^ crc1;
+        crc0 = shiftCrc(crcShortShift, (uint32_t)crc0) ^ crc2;
+        data += 3 * CRC_SHORT_LANE;
+        size -= 3 * CRC_SHORT_LANE;
+    }
+
+    crc0 = crcWords(crc0, data, size / 8);
+    data += size & ~(size_t)7;
+    for (size &= 7; size > 0; data++, size--) {
+        crc0 = _mm_crc32_u8((uint32_t)crc0, *data);
+    }
+    return ~(uint32_t)crc0;
+}
+
+static const CodecKernels sse42Kernels = {
+    "sse42", countFrequenciesScalar, encodeSymbolsScalar,
+    decodeSymbolsScalar, decodeInterleavedScalar, crc32cSse42
+};
+
+#endif
+
+// =============================================================================
+// BMI2 KERNELS
+// =============================================================================
+
+#ifdef HUFFMAN_X86_KERNELS
+
+// The coders shift by variable amounts on every symbol; BMI2 turns each
+// shift into one shlx/shrx instead of a flag-merging shift through cl
+
+__attribute__((target("bmi2")))
+static int encodeSymbolsBmi2(BitWriter* writer, const CodeEntry codes[ASCII_SIZE],
+                             const unsigned char* input, size_t count) {
+    return encodeSymbolsBody(writer, codes, input, count);
+}
+
+__attribute__((target("bmi2")))
+static int decodeSymbolsBmi2(BitReader* reader, const DecodeTable* table,
+                             unsigned char* output, size_t count) {
+    return decodeSymbolsBody(reader, table, output, count);
+}
+
+__attribute__((target("bmi2")))
+static int decodeInterleavedBmi2(BitReader readers[INTERLEAVED_STREAMS],
+                                 const DecodeTable* table, unsigned char* output, size_t size) {
+    return decodeInterleavedBody(readers, table, output, size);
+}
+
+static const CodecKernels bmi2Kernels = {
+    "bmi2", countFrequenciesScalar, encodeSymbolsBmi2,
+    decodeSymbolsBmi2, decodeInterleavedBmi2, crc32cSse42
+};
+
+// =============================================================================
+// AVX2 KERNELS
+// =============================================================================
+
+/**
+ * Adds the byte counts of a span to a histogram, skipping over runs
+ * Each 32 bytes are first compared with their first byte; a run of one
+ * value is added with one increment instead of 32.
+ * @param data Bytes to count
+ * @param size Number of bytes
+ * @param frequencies Histogram to update (size ASCII_SIZE)
+ */
+__attribute__((target("avx2,bmi2")))
+static void countFrequenciesAvx2(const unsigned char* data, size_t size,
+                                 uint64_t frequencies[ASCII_SIZE]) {
+    uint32_t tables[HISTOGRAM_TABLES][ASCII_SIZE];
+
+    while (size > 0) {
+        size_t chunk = size < HISTOGRAM_CHUNK ? size : HISTOGRAM_CHUNK;
+        memset(tables, 0, sizeof(tables));
+
+        size_t i = 0;
+        for (; i + 32 <= chunk; i += 32) {
+            __m256i bytes = _mm256_loadu_si256((const __m256i*)(data + i));
+            __m256i first = _mm256_set1_epi8((char)data[i]);
+            if ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, first)) == 0xffffffffu) {
+                tables[0][data[i]] += 32;
+            } else {
+                countSixteen(tables, data + i);
+                countSixteen(tables, data + i + 16);
+            }
+        }
+        finishHistogramChunk(tables, data, i, chunk, frequencies);
+
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+static const CodecKernels avx2Kernels = {
+    "avx2", countFrequenciesAvx2, encodeSymbolsBmi2,
+    decodeSymbolsBmi2, decodeInterleavedBmi2, crc32cSse42
+};
+
+#endif
+
+// =============================================================================
+// NEON KERNELS
+// =============================================================================
+
+#ifdef HUFFMAN_NEON_KERNELS
+
+/**
+ * Adds the byte counts of a span to a histogram, skipping over runs
+ * Each 32 bytes are first compared with their first byte; a run of one
+ * value is added with one increment instead of 32.
+ * @param data Bytes to count
+ * @param size Number of bytes
+ * @param frequencies Histogram to update (size ASCII_SIZE)
+ */
+static void countFrequenciesNeon(const unsigned char* data, size_t size,
+                                 uint64_t frequencies[ASCII_SIZE]) {
+    uint32_t tables[HISTOGRAM_TABLES][ASCII_SIZE];
+
+    while (size > 0) {
+        size_t chunk = size < HISTOGRAM_CHUNK ? size : HISTOGRAM_CHUNK;
+        memset(tables, 0, sizeof(tables));
+
+        size_t i = 0;
+        for (; i + 32 <= chunk; i += 32) {
+            uint8x16_t first = vdupq_n_u8(data[i]);
+            uint8x16_t same = vandq_u8(vceqq_u8(vld1q_u8(data + i), first),
+                                       vceqq_u8(vld1q_u8(data + i + 16), first));
+            if (vminvq_u8(same) == 0xff) {
+                tables[0][data[i]] += 32;
+            } else {
+                countSixteen(tables, data + i);
+                countSixteen(tables, data + i + 16);
+            }
+        }
+        finishHistogramChunk(tables, data, i, chunk, frequencies);
+
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+#ifdef __ARM_FEATURE_CRC32
+
+/**
+ * Extends a CRC32C with the ARMv8 CRC instructions (built with +crc)
+ * @param crc CRC of the preceding bytes (0 to start)
+ * @param data Bytes to add
+ * @param size Number of bytes
+ * @return CRC32C of the preceding bytes followed by data
+ */
+static uint32_t crc32cArm(uint32_t crc, const unsigned char* data, size_t size) {
+    crc = ~crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; size > 0; data++, size--) {
+        crc = __crc32cb(crc, *data);
+    }
+    return ~crc;
+}
+
+#define NEON_CRC32C crc32cArm
+#else
+#define NEON_CRC32C crc32cScalar
+#endif
+
+// AArch64 shifts by a register in one instruction, so the scalar coders
+// are already what a dedicated variant would be
+static const CodecKernels neonKernels = {
+    "neon", countFrequenciesNeon, encodeSymbolsScalar,
+    decodeSymbolsScalar, decodeInterleavedScalar, NEON_CRC32C
+};
+
+#endif
+
+// =============================================================================
+// KERNEL DISPATCH
+// =============================================================================
+
+static pthread_once_t kernelsOnce = PTHREAD_ONCE_INIT;
+static const CodecKernels* activeKernels = &scalarKernels;
+
+/**
+ * Lists the kernel sets this CPU can run, fastest first
+ * @param sets Receives up to four kernel sets
+ * @return Number of kernel sets
+ */
+static int availableKernels(const CodecKernels* sets[4]) {
+    int count = 0;
+
+#ifdef HUFFMAN_X86_KERNELS
+    __builtin_cpu_init();
+    int sse42 = __builtin_cpu_supports("sse4.2");
+    int bmi2 = sse42 && __builtin_cpu_supports("bmi2");
+    if (bmi2 && __builtin_cpu_supports("avx2")) sets[count++] = &avx2Kernels;
+    if (bmi2) sets[count++] = &bmi2Kernels;
+    if (sse42) sets[count++] = &sse42Kernels;
+#endif
+#ifdef HUFFMAN_NEON_KERNELS
+    sets[count++] = &neonKernels;
+#endif
+
+    sets[count++] = &scalarKernels;
+    return count;
+}
+
+// Picks the fastest kernel set on first use
+static void detectCodecKernels(void) {
+    const CodecKernels* sets[4];
+    availableKernels(sets);
+    activeKernels = sets[0];
+    initCrcTables();
+}
+
+/**
+ * Returns the kernel set used by the coders
+ * The set is chosen from the CPU features the first time it is needed.
+ * @return Active kernel set
+ */
+const CodecKernels* codecKernels(void) {
+    pthread_once(&kernelsOnce, detectCodecKernels);
+    return activeKernels;
+}
+
+/**
+ * Forces a kernel set by name, before any coding starts
+ * @param name "scalar", "sse42", "bmi2", "avx2" or "neon"
+ * @return 0 on success, -1 if this CPU cannot run that set
+ */
+int selectCodecKernels(const char* name) {
+    const CodecKernels* sets[4];
+    int count = availableKernels(sets);
+    codecKernels();
+
+    for (int i = 0; i < count; i++) {
+        if (strcmp(sets[i]->name, name) == 0) {
+            activeKernels = sets[i];
+            return 0;
+        }
+    }
+
+    reportError("Kernel set '%s' is not available on this CPU", name);
+    return -1;
+}
+
+/**
+ * Prints the names of the kernel sets this CPU can run, fastest first,
+ * separated by spaces and without a newline
+ * @param file Output stream
+ */
+void listCodecKernels(FILE* file) {
+    const CodecKernels* sets[4];
+    int count = availableKernels(sets);
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "%s%s", i > 0 ? " " : "", sets[i]->name);
+    }
+}
+
+/**
+ * Returns the names of the kernel sets this CPU can run, fastest first
+ * @param names Receives up to four names
+ * @return Number of names
+ */
+int codecKernelNames(const char* names[4]) {
+    const CodecKernels* sets[4];
+    int count = availableKernels(sets);
+    for (int i = 0; i < count; i++) {
+        names[i] = sets[i]->name;
+    }
+    return count;
+}
+
+void countFrequencies(const unsigned char* data, size_t size, uint64_t frequencies[ASCII_SIZE]) {
+    codecKernels()->countFrequencies(data, size, frequencies);
+}
+
+int encodeSymbols(BitWriter* writer, const CodeEntry codes[ASCII_SIZE],
+                  const unsigned char* input, size_t count) {
+    return codecKernels()->encodeSymbols(writer, codes, input, count);
+}
+
+int decodeSymbols(BitReader* reader, const DecodeTable* table,
+                  unsigned char* output, size_t count) {
+    return codecKernels()->decodeSymbols(reader, table, output, count);
+}
+
+int decodeInterleaved(BitReader readers[INTERLEAVED_STREAMS], const DecodeTable* table,
+                      unsigned char* output, size_t size) {
+    return codecKernels()->decodeInterleaved(readers, table, output, size);
+}
+
+/**
+ * Computes the CRC32C (Castagnoli) of a span
+ * @param data Bytes to check
+ * @param size Number of bytes
+ * @return CRC32C, as stored in container blocks
+ */
+uint32_t computeCrc32c(const unsigned char* data, size_t size) {
+    return codecKernels()->crc32c(0, data, size);
+}
@@ -0,0 +1,231 @@
+#define _POSIX_C_SOURCE 200809L  // posix_madvise
+#define _FILE_OFFSET_BITS 64      // Match the library's off_t
+#include "huffman.h"
+
+// =============================================================================
+// COMPRESSED SCAN
+// =============================================================================
+
+/**
+ * Finds the first occurrence of a pattern
+ * memchr skips to each candidate first byte; the rest is compared in place.
+ * @param data Bytes to search
+ * @param size Number of bytes
+ * @param pattern Pattern bytes
+ * @param patternSize Pattern length (at least 1)
+ * @return First match, or NULL if the pattern does not occur
+ */
+static const unsigned char* findPattern(const unsigned char* data, size_t size,
+                                        const unsigned char* pattern, size_t patternSize) {
+    if (size < patternSize) {
+        return NULL;
+    }
+
+    const unsigned char* last = data + (size - patternSize);
+    for (const unsigned char* p = data; p <= last; p++) {
+        p = (const unsigned char*)memchr(p, pattern[0], (size_t)(last - p) + 1);
+        if (!p) {
+            return NULL;
+        }
+        if (memcmp(p + 1, pattern + 1, patternSize - 1) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Prepares a scan of a container held in memory
+ * Only the blocks covering [start, start + length) are decoded, a few per
+ * thread at a time; matches must lie entirely inside the range.
+ * @param scan Scan to initialize (release with closeContainerScan)
+ * @param data Container bytes (must outlive the scan)
+ * @param size Number of bytes
+ * @param pattern Bytes to search for (copied)
+ * @param patternSize Pattern length (at least 1)
+ * @param start First uncompressed byte to scan
+ * @param length Number of bytes to scan (clipped to the end of the data)
+ * @param threads Threads decoding blocks (0 = all cores)
+ * @param stats Receives the blocks' work and compressed bytes read, or NULL
+ * @return 0 on success, -1 on invalid data, a bad range or allocation failure
+ */
+int openContainerScan(ContainerScan* scan, const unsigned char* data, size_t size,
+                      const unsigned char* pattern, size_t patternSize, uint64_t start,
+                      uint64_t length, int threads, CodecStats* stats) {
+    memset(scan, 0, sizeof(*scan));
+    initContainerIndex(&scan->index);
+    if (patternSize == 0) {
+        reportError("Scan pattern is empty");
+        return -1;
+    }
+    if (readContainerIndex(data, size, &scan->header, &scan->index) != 0) {
+        return -1;
+    }
+    if (start > scan->index.rawOffset) {
+        reportError("Scan starts at %llu, past the end of the data (%llu bytes)",
+                    (unsigned long long)start, (unsigned long long)scan->index.rawOffset);
+        destroyContainerIndex(&scan->index);
+        return -1;
+    }
+    if (length > scan->index.rawOffset - start) {
+        length = scan->index.rawOffset - start;
+    }
+
+    threads = resolveThreadCount(threads);
+    scan->piece = (size_t)threads * BLOCKS_PER_THREAD * scan->header.block_size;
+    if (scan->piece > length) {
+        scan->piece = (size_t)length;
+    }
+
+    scan->data = data;
+    scan->patternSize = patternSize;
+    scan->bufferOffset = start;
+    scan->next = start;
+    scan->end = start + length;
+    scan->stats = stats;
+    scan->pool = createThreadPool(threads);
+    scan->pattern = (unsigned char*)malloc(patternSize);
+    scan->buffer = (unsigned char*)malloc(scan->piece + patternSize);
+    if (!scan->pool || !scan->pattern || !scan->buffer) {
+        reportError("Memory allocation failed for scan buffer");
+        closeContainerScan(scan);
+        return -1;
+    }
+    memcpy(scan->pattern, pattern, patternSize);
+    return 0;
+}
+
+/**
+ * Finds the next match of a scan
+ * Matches are reported in order, overlapping ones included. When the
+ * buffered bytes are exhausted, the bytes a match could still start at are
+ * moved to the front and the next piece is decoded behind them.
+ * @param scan Scan from openContainerScan
+ * @param offset Receives the uncompressed offset of the match
+ * @return 1 if a match was found, 0 at the end of the range, -1 on corrupted data
+ */
+int nextScanMatch(ContainerScan* scan, uint64_t* offset) {
+    while (1) {
+        const unsigned char* match = findPattern(scan->buffer + scan->position,
+                                                 scan->filled - scan->position,
+                                                 scan->pattern, scan->patternSize);
+        if (match) {
+            size_t position = (size_t)(match - scan->buffer);
+            scan->position = position + 1;
+            scan->matches++;
+            *offset = scan->bufferOffset + position;
+            return 1;
+        }
+
+        if (scan->next == scan->end) {
+            scan->position = scan->filled;
+            return 0;
+        }
+
+        // Fewer than patternSize bytes are kept, so the piece always fits
+        size_t keep = scan->filled - scan->position;
+        if (keep >= scan->patternSize) {
+            keep = scan->patternSize - 1;
+        }
+        memmove(scan->buffer, scan->buffer + (scan->filled - keep), keep);
+        scan->bufferOffset += scan->filled - keep;
+        scan->position = 0;
+        scan->filled = keep;
+
+        uint64_t remaining = scan->end - scan->next;
+        size_t count = remaining < scan->piece ? (size_t)remaining : scan->piece;
+        if (decodeContainerRange(scan->data, &scan->header, &scan->index, scan->pool,
+                                 scan->next, count, scan->buffer + keep, scan->stats) != 0) {
+            return -1;
+        }
+        scan->filled += count;
+        scan->next += count;
+        if (scan->stats) {
+            scan->stats->bytesOut += count;
+        }
+    }
+}
+
+/**
+ * Frees the buffers, pool and index of a scan
+ * @param scan Scan from openContainerScan (may have failed)
+ */
+void closeContainerScan(ContainerScan* scan) {
+    if (scan->pool && scan->stats) {
+        collectPoolStats(scan->stats, scan->pool);
+    }
+    destroyThreadPool(scan->pool);
+    destroyContainerIndex(&scan->index);
+    free(scan->pattern);
+    free(scan->buffer);
+    scan->pool = NULL;
+    scan->pattern = NULL;
+    scan->buffer = NULL;
+}
+
+/**
+ * Prints the uncompressed offset of every match of a pattern in a container file
+ * The file is mapped and its blocks decoded into one reused buffer, so
+ * nothing is written to disk. Offsets go to stdout, one per line.
+ * @param inputFile Path to a compressed regular file
+ * @param pattern Bytes to search for
+ * @param patternSize Pattern length (at least 1)
+ * @param start First uncompressed byte to scan
+ * @param length Number of bytes to scan (clipped to the end of the data)
+ * @param options Decompression options (threads, quiet, stats)
+ * @param matches Receives the number of matches
+ * @return 0 on success, -1 on error
+ */
+int scanFile(const char* inputFile, const unsigned char* pattern, size_t patternSize,
+             uint64_t start, uint64_t length, const DecompressOptions* options,
+             uint64_t* matches) {
+    beginCodecStats(options->stats);
+    *matches = 0;
+
+    // The index is read in place, so the input is always mapped
+    InputSource source;
+    if (openInputSource(&source, inputFile, IO_BACKEND_MMAP) != 0) {
+        return -1;
+    }
+    if (!source.map) {
+        reportError("Scanning needs a compressed regular file");
+        closeInputSource(&source);
+        return -1;
+    }
+    posix_madvise((void*)source.map, (size_t)source.size, POSIX_MADV_SEQUENTIAL);
+
+    ContainerScan scan;
+    if (openContainerScan(&scan, source.map, (size_t)source.size, pattern, patternSize,
+                          start, length, options->threads, options->stats) != 0) {
+        closeInputSource(&source);
+        return -1;
+    }
+    if (!options->quiet) {
+        printf("\n=== SCAN STARTED ===\n");
+        printf("Input file: %s\n", inputFile);
+        printf("Pattern: %zu bytes, range: %llu bytes at offset %llu\n", patternSize,
+               (unsigned long long)(scan.end - start), (unsigned long long)start);
+    }
+
+    uint64_t offset;
+    int found;
+    while ((found = nextScanMatch(&scan, &offset)) == 1) {
+        printf("%llu\n", (unsigned long long)offset);
+    }
+    *matches = scan.matches;
+    uint64_t scanned = scan.next - start;
+
+    closeContainerScan(&scan);
+    closeInputSource(&source);
+    endCodecStats(options->stats);
+    if (found != 0) {
+        return -1;
+    }
+
+    if (!options->quiet) {
+        printf("Matches: %llu in %llu bytes\n", (unsigned long long)*matches,
+               (unsigned long long)scanned);
+        printf("=== SCAN COMPLETED ===\n");
+    }
+    return 0;
+}
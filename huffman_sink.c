@@ -0,0 +1,544 @@
+#define _GNU_SOURCE               // vmsplice, splice and O_DIRECT
+#define _FILE_OFFSET_BITS 64      // Match the library's off_t
+#include "huffman.h"
+
+// =============================================================================
+// ZERO-COPY OUTPUT
+// =============================================================================
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define SLOT_GRANULE (1u << 16)  // Slot sizes are rounded up to this
+
+// Buffer of a sink, handed out by a reservation and returned by its commit
+typedef struct SinkSlot {
+    unsigned char* data;      // Anonymous mapping (page aligned), NULL = not mapped yet
+    size_t capacity;
+    const unsigned char* reservation;  // Destination handed out, NULL = free
+} SinkSlot;
+
+// Pipe or stream socket fed from the sink's own pages
+struct SpliceOutput {
+    int fd;
+    int pipe[2];              // Private pipe in front of a socket ({-1, -1} for a pipe)
+    int fallback;             // vmsplice was refused: plain writes from here on
+    pthread_mutex_t lock;     // Reservations and commits may run on different threads
+    SinkSlot slots[SINK_SLOTS];
+};
+
+// Regular file written with O_DIRECT
+// Each reservation starts at the offset its first byte has within an
+// aligned unit of the file; the unit's earlier bytes (the carry left by the
+// previous commit) are copied in front before the aligned part is written.
+struct DirectOutput {
+    int fd;                   // O_DIRECT descriptor
+    int tailFd;               // Buffered descriptor for the final partial unit
+    uint64_t offset;          // File offset of carry[0]; everything before is written
+    uint64_t reservedBytes;   // Bytes reserved so far (gives the next reservation's phase)
+    size_t carried;           // Bytes of the current unit not yet written
+    unsigned char* carry;     // DIRECT_ALIGNMENT bytes
+    unsigned char* bounce;    // DIRECT_BOUNCE_SIZE + DIRECT_ALIGNMENT bytes, mapped on first use
+    pthread_mutex_t lock;
+    SinkSlot slots[SINK_SLOTS];
+};
+
+/**
+ * Takes a free slot of at least size bytes, mapping or growing one if needed
+ * @param slots Slot array (SINK_SLOTS entries; caller holds the sink's lock)
+ * @param size Bytes needed
+ * @return Slot, or NULL if every slot is in use or mapping fails
+ */
+static SinkSlot* takeSlot(SinkSlot* slots, size_t size) {
+    SinkSlot* slot = NULL;
+    for (int i = 0; i < SINK_SLOTS; i++) {
+        SinkSlot* candidate = &slots[i];
+        if (candidate->reservation) continue;
+        if (candidate->capacity >= size) {
+            return candidate;  // Reused as is
+        }
+        if (!slot || candidate->capacity > slot->capacity) {
+            slot = candidate;  // Largest free slot is grown
+        }
+    }
+    if (!slot) {
+        return NULL;
+    }
+
+    size_t capacity = (size + SLOT_GRANULE - 1) / SLOT_GRANULE * SLOT_GRANULE;
+    void* data = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    if (slot->data) {
+        munmap(slot->data, slot->capacity);
+    }
+    slot->data = (unsigned char*)data;
+    slot->capacity = capacity;
+    return slot;
+}
+
+/**
+ * Finds the slot a committed destination was handed out from
+ * @param slots Slot array (caller holds the sink's lock)
+ * @param data Destination returned by a reservation
+ * @return Slot, or NULL if the data came from elsewhere
+ */
+static SinkSlot* findSlot(SinkSlot* slots, const unsigned char* data) {
+    for (int i = 0; i < SINK_SLOTS; i++) {
+        if (slots[i].reservation && slots[i].reservation == data) {
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Unmaps every slot
+ * Pages a pipe or socket still holds stay valid: the kernel keeps its own
+ * references, and nothing of this process can write them any more.
+ * @param slots Slot array
+ */
+static void unmapSlots(SinkSlot* slots) {
+    for (int i = 0; i < SINK_SLOTS; i++) {
+        if (slots[i].data) {
+            munmap(slots[i].data, slots[i].capacity);
+        }
+    }
+}
+
+/**
+ * Waits until a descriptor in non-blocking mode can take more data
+ * @param fd Descriptor
+ * @return 0 when writable, -1 on error
+ */
+static int waitWritable(int fd) {
+    struct pollfd entry = { fd, POLLOUT, 0 };
+    while (poll(&entry, 1, -1) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return 0;
+}
+
+/**
+ * Writes all bytes to a descriptor at its current position
+ * @param fd Descriptor
+ * @param data Bytes
+ * @param size Number of bytes
+ * @return 0 on success, -1 on error
+ */
+static int writeAll(int fd, const unsigned char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN && waitWritable(fd) == 0) continue;
+            return -1;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * Creates the splice path for a pipe or stream socket
+ * @param fd Output descriptor
+ * @return Splice output, or NULL if fd is neither (or on allocation failure)
+ */
+SpliceOutput* createSpliceOutput(int fd) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        return NULL;
+    }
+
+    int socketType = 0;
+    socklen_t length = sizeof(socketType);
+    if (S_ISSOCK(info.st_mode) &&
+        (getsockopt(fd, SOL_SOCKET, SO_TYPE, &socketType, &length) != 0 ||
+         socketType != SOCK_STREAM)) {
+        return NULL;
+    }
+    if (!S_ISFIFO(info.st_mode) && !S_ISSOCK(info.st_mode)) {
+        return NULL;
+    }
+
+    SpliceOutput* output = (SpliceOutput*)calloc(1, sizeof(SpliceOutput));
+    if (!output) {
+        return NULL;
+    }
+    output->fd = fd;
+    output->pipe[0] = output->pipe[1] = -1;
+    if (S_ISSOCK(info.st_mode)) {
+        if (pipe(output->pipe) != 0) {
+            free(output);
+            return NULL;
+        }
+        fcntl(output->pipe[1], F_SETPIPE_SZ, (int)DEFAULT_BLOCK_SIZE);  // Best effort
+    }
+    pthread_mutex_init(&output->lock, NULL);
+    return output;
+}
+
+/**
+ * Hands out a buffer for the next size bytes of output
+ * @param output Splice output
+ * @param size Number of bytes
+ * @return Destination, or NULL to decode into the caller's buffer instead
+ */
+unsigned char* reserveSpliceOutput(SpliceOutput* output, size_t size) {
+    if (output->fallback || size == 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&output->lock);
+    SinkSlot* slot = takeSlot(output->slots, size);
+    if (slot) {
+        slot->reservation = slot->data;
+    }
+    pthread_mutex_unlock(&output->lock);
+    return slot ? slot->data : NULL;
+}
+
+/**
+ * Moves bytes of this process into a pipe, all of them
+ * @param pipeFd Write end of a pipe
+ * @param data Bytes
+ * @param size Number of bytes
+ * @param flags vmsplice flags
+ * @param done Receives the bytes moved (short only on error)
+ * @return 0 on success, -1 on error
+ */
+static int spliceToPipe(int pipeFd, const unsigned char* data, size_t size, unsigned flags,
+                        size_t* done) {
+    *done = 0;
+    while (*done < size) {
+        struct iovec span = { (void*)(data + *done), size - *done };
+        ssize_t moved = vmsplice(pipeFd, &span, 1, flags);
+        if (moved < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN && !(flags & SPLICE_F_NONBLOCK) && waitWritable(pipeFd) == 0) {
+                continue;
+            }
+            return -1;
+        }
+        *done += (size_t)moved;
+        if (flags & SPLICE_F_NONBLOCK) break;  // Private pipe full: drain it first
+    }
+    return 0;
+}
+
+/**
+ * Moves bytes into a stream socket through the private pipe
+ * @param output Splice output of a socket
+ * @param data Bytes
+ * @param size Number of bytes
+ * @param done Receives the bytes that reached the socket
+ * @return 0 on success, -1 on error
+ */
+static int spliceToSocket(SpliceOutput* output, const unsigned char* data, size_t size,
+                          size_t* done) {
+    *done = 0;
+    while (*done < size) {
+        size_t queued;
+        if (spliceToPipe(output->pipe[1], data + *done, size - *done, SPLICE_F_NONBLOCK,
+                         &queued) != 0) {
+            return -1;
+        }
+        while (queued > 0) {
+            ssize_t sent = splice(output->pipe[0], NULL, output->fd, NULL, queued,
+                                  SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN && waitWritable(output->fd) == 0) continue;
+                return -1;  // Queued bytes are lost; the output has failed anyway
+            }
+            queued -= (size_t)sent;
+            *done += (size_t)sent;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Writes committed output to the pipe or socket
+ * Bytes from a slot are spliced, and the slot's pages are then dropped
+ * with MADV_DONTNEED: the kernel keeps the pages it references until the
+ * reader is done, and the slot gets fresh ones, so output already sent is
+ * never overwritten, whatever the reader does with it. Bytes from anywhere
+ * else are written.
+ * @param output Splice output
+ * @param data Destination returned by reserveSpliceOutput, or any other bytes
+ * @param size Number of bytes
+ * @return 0 on success, -1 on write error
+ */
+int writeSpliceOutput(SpliceOutput* output, const unsigned char* data, size_t size) {
+    pthread_mutex_lock(&output->lock);
+    SinkSlot* slot = findSlot(output->slots, data);
+    pthread_mutex_unlock(&output->lock);
+
+    int result = 0;
+    size_t done = 0;
+    if (slot && !output->fallback) {
+        result = output->pipe[1] >= 0
+            ? spliceToSocket(output, data, size, &done)
+            : spliceToPipe(output->fd, data, size, 0, &done);
+        if (result != 0 && done == 0 && (errno == EINVAL || errno == ENOSYS ||
+                                         errno == EPERM)) {
+            output->fallback = 1;  // Kernel or sandbox refuses splicing
+            result = 0;
+        }
+    }
+    if (result == 0 && done < size) {
+        result = writeAll(output->fd, data + done, size - done);
+    }
+
+    if (slot) {
+        madvise(slot->data, slot->capacity, MADV_DONTNEED);
+        pthread_mutex_lock(&output->lock);
+        slot->reservation = NULL;
+        pthread_mutex_unlock(&output->lock);
+    }
+    return result;
+}
+
+/**
+ * Frees a splice output (its descriptor stays open)
+ * @param output Splice output (may be NULL)
+ */
+void destroySpliceOutput(SpliceOutput* output) {
+    if (!output) return;
+
+    unmapSlots(output->slots);
+    if (output->pipe[0] >= 0) {
+        close(output->pipe[0]);
+        close(output->pipe[1]);
+    }
+    pthread_mutex_destroy(&output->lock);
+    free(output);
+}
+
+/**
+ * Opens a second, O_DIRECT descriptor of an output file
+ * @param path Output path, already created
+ * @param fd Buffered descriptor of the same file (stays owned by the caller)
+ * @return Direct output, or NULL if the file system does not support O_DIRECT
+ */
+DirectOutput* createDirectOutput(const char* path, int fd) {
+    int directFd = open(path, O_WRONLY | O_DIRECT);
+    if (directFd < 0) {
+        return NULL;
+    }
+
+    DirectOutput* output = (DirectOutput*)calloc(1, sizeof(DirectOutput));
+    void* carry = mmap(NULL, DIRECT_ALIGNMENT, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (!output || carry == MAP_FAILED) {
+        if (carry != MAP_FAILED) munmap(carry, DIRECT_ALIGNMENT);
+        free(output);
+        close(directFd);
+        return NULL;
+    }
+    output->fd = directFd;
+    output->tailFd = fd;
+    output->carry = (unsigned char*)carry;
+    pthread_mutex_init(&output->lock, NULL);
+    return output;
+}
+
+/**
+ * Hands out an aligned buffer for the next size bytes of output
+ * The destination sits at the offset the bytes will have within their
+ * aligned unit, leaving room in front for the carried bytes.
+ * @param output Direct output
+ * @param size Number of bytes
+ * @return Destination, or NULL to decode into the caller's buffer instead
+ */
+unsigned char* reserveDirectOutput(DirectOutput* output, size_t size) {
+    pthread_mutex_lock(&output->lock);
+    size_t phase = (size_t)(output->reservedBytes % DIRECT_ALIGNMENT);
+    output->reservedBytes += size;
+    SinkSlot* slot = size > 0 ? takeSlot(output->slots, phase + size) : NULL;
+    if (slot) {
+        slot->reservation = slot->data + phase;
+    }
+    pthread_mutex_unlock(&output->lock);
+    return slot ? slot->data + phase : NULL;
+}
+
+/**
+ * Writes the aligned part of carried bytes followed by new ones
+ * @param output Direct output
+ * @param unit Aligned buffer holding the new bytes at offset output->carried
+ * @param size Number of new bytes
+ * @return 0 on success, -1 on write error
+ */
+static int writeAlignedUnits(DirectOutput* output, unsigned char* unit, size_t size) {
+    memcpy(unit, output->carry, output->carried);
+    size_t total = output->carried + size;
+    size_t aligned = total - total % DIRECT_ALIGNMENT;
+
+    for (size_t done = 0; done < aligned; ) {
+        ssize_t written = pwrite(output->fd, unit + done, aligned - done,
+                                 (off_t)(output->offset + done));
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            return -1;
+        }
+        done += (size_t)written;
+    }
+
+    output->offset += aligned;
+    output->carried = total - aligned;
+    memcpy(output->carry, unit + aligned, output->carried);
+    return 0;
+}
+
+/**
+ * Writes committed output
+ * Slot data is written in place; other bytes are copied through the
+ * bounce buffer.
+ * @param output Direct output
+ * @param data Destination returned by reserveDirectOutput, or any other bytes
+ * @param size Number of bytes
+ * @return 0 on success, -1 on write error
+ */
+int writeDirectOutput(DirectOutput* output, const unsigned char* data, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&output->lock);
+    SinkSlot* slot = findSlot(output->slots, data);
+    pthread_mutex_unlock(&output->lock);
+
+    int result = 0;
+    if (slot) {
+        // Reservations are committed in order, so the carry fills the gap exactly
+        if ((size_t)(data - slot->data) != output->carried) {
+            reportError("Direct output committed out of order");
+            result = -1;
+        } else {
+            result = writeAlignedUnits(output, slot->data, size);
+        }
+        pthread_mutex_lock(&output->lock);
+        slot->reservation = NULL;
+        pthread_mutex_unlock(&output->lock);
+        return result;
+    }
+
+    if (!output->bounce) {
+        void* bounce = mmap(NULL, DIRECT_BOUNCE_SIZE + DIRECT_ALIGNMENT,
+                            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (bounce == MAP_FAILED) {
+            reportError("Memory allocation failed for direct output");
+            return -1;
+        }
+        output->bounce = (unsigned char*)bounce;
+    }
+    while (size > 0 && result == 0) {
+        size_t count = size < DIRECT_BOUNCE_SIZE ? size : DIRECT_BOUNCE_SIZE;
+        memcpy(output->bounce + output->carried, data, count);
+        result = writeAlignedUnits(output, output->bounce, count);
+        data += count;
+        size -= count;
+    }
+    return result;
+}
+
+/**
+ * Writes the final partial unit through the buffered descriptor and frees
+ * the direct output
+ * @param output Direct output (may be NULL)
+ * @return 0 on success, -1 on write error
+ */
+int destroyDirectOutput(DirectOutput* output) {
+    if (!output) return 0;
+
+    int result = 0;
+    for (size_t done = 0; done < output->carried; ) {
+        ssize_t written = pwrite(output->tailFd, output->carry + done, output->carried - done,
+                                 (off_t)(output->offset + done));
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            reportError("Failed to write decompressed data");
+            result = -1;
+            break;
+        }
+        done += (size_t)written;
+    }
+
+    unmapSlots(output->slots);
+    munmap(output->carry, DIRECT_ALIGNMENT);
+    if (output->bounce) {
+        munmap(output->bounce, DIRECT_BOUNCE_SIZE + DIRECT_ALIGNMENT);
+    }
+    if (close(output->fd) != 0) {
+        result = -1;
+    }
+    pthread_mutex_destroy(&output->lock);
+    free(output);
+    return result;
+}
+
+/**
+ * Reports whether O_DIRECT output is built in
+ * @return 1 on Linux
+ */
+int directOutputAvailable(void) {
+    return 1;
+}
+
+#else
+
+// Not on Linux: pipes and sockets are written, and O_DIRECT is never available
+
+SpliceOutput* createSpliceOutput(int fd) {
+    (void)fd;
+    return NULL;
+}
+
+unsigned char* reserveSpliceOutput(SpliceOutput* output, size_t size) {
+    (void)output; (void)size;
+    return NULL;
+}
+
+int writeSpliceOutput(SpliceOutput* output, const unsigned char* data, size_t size) {
+    (void)output; (void)data; (void)size;
+    return -1;
+}
+
+void destroySpliceOutput(SpliceOutput* output) {
+    (void)output;
+}
+
+DirectOutput* createDirectOutput(const char* path, int fd) {
+    (void)path; (void)fd;
+    return NULL;
+}
+
+unsigned char* reserveDirectOutput(DirectOutput* output, size_t size) {
+    (void)output; (void)size;
+    return NULL;
+}
+
+int writeDirectOutput(DirectOutput* output, const unsigned char* data, size_t size) {
+    (void)output; (void)data; (void)size;
+    return -1;
+}
+
+int destroyDirectOutput(DirectOutput* output) {
+    (void)output;
+    return 0;
+}
+
+int directOutputAvailable(void) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,156 @@
+#include "huffman.h"
+
+// =============================================================================
+// CODEC STATISTICS
+// =============================================================================
+
+/**
+ * Clears the counters and starts the wall clock of one operation
+ * @param stats Statistics to reset (may be NULL)
+ */
+void beginCodecStats(CodecStats* stats) {
+    if (!stats) return;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->threads = 1;
+    stats->wallSeconds = wallClockSeconds();
+}
+
+/**
+ * Stops the wall clock started by beginCodecStats
+ * @param stats Statistics (may be NULL)
+ */
+void endCodecStats(CodecStats* stats) {
+    if (!stats) return;
+
+    stats->wallSeconds = wallClockSeconds() - stats->wallSeconds;
+}
+
+/**
+ * Adds the work of one block (or one thread) to a total
+ * @param total Accumulated work
+ * @param part Work to add
+ */
+void addBlockStats(BlockStats* total, const BlockStats* part) {
+    total->blocks += part->blocks;
+    total->histogramSeconds += part->histogramSeconds;
+    total->treeSeconds += part->treeSeconds;
+    total->encodeSeconds += part->encodeSeconds;
+    total->tableSeconds += part->tableSeconds;
+    total->decodeSeconds += part->decodeSeconds;
+    total->checksumSeconds += part->checksumSeconds;
+    total->symbols += part->symbols;
+    total->lookups += part->lookups;
+    total->longCodes += part->longCodes;
+    total->cachedTables += part->cachedTables;
+}
+
+/**
+ * Adds the work recorded in a batch of finished block jobs
+ * @param stats Statistics receiving the work
+ * @param jobs Jobs run with BlockBatch.stats set
+ * @param count Number of jobs
+ */
+void collectBlockStats(CodecStats* stats, const BlockJob* jobs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        addBlockStats(&stats->work, &jobs[i].stats);
+    }
+}
+
+/**
+ * Clears the per-thread task counts of a pool
+ * @param pool Thread pool (idle)
+ */
+void resetPoolStats(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->mutex);
+    memset(pool->tasksRun, 0, ((size_t)pool->threadCount + 1) * sizeof(uint64_t));
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * Adds the block jobs each pool thread ran since resetPoolStats
+ * Threads past MAX_STATS_THREADS are counted in the last slot.
+ * @param stats Statistics receiving the counts
+ * @param pool Thread pool (idle)
+ */
+void collectPoolStats(CodecStats* stats, ThreadPool* pool) {
+    pthread_mutex_lock(&pool->mutex);
+    int threads = pool->threadCount + 1;
+    for (int i = 0; i < threads; i++) {
+        int slot = i < MAX_STATS_THREADS ? i : MAX_STATS_THREADS - 1;
+        stats->threadBlocks[slot] += pool->tasksRun[i];
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (threads > MAX_STATS_THREADS) threads = MAX_STATS_THREADS;
+    if (threads > stats->threads) stats->threads = threads;
+}
+
+// =============================================================================
+// JSON OUTPUT
+// =============================================================================
+
+/**
+ * Writes a string as a JSON string literal
+ * @param file Output file
+ * @param text String to quote
+ */
+static void writeJsonString(FILE* file, const char* text) {
+    fputc('"', file);
+    for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(file, "\\u%04x", *c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+/**
+ * Writes the statistics of one operation as a single line of JSON
+ * Phase times are summed over all threads; io_wait_seconds is the time the
+ * coders spent waiting for blocks to be read or written.
+ * @param file Output file
+ * @param operation "compress" or "decompress"
+ * @param inputFile Input path
+ * @param outputFile Output path
+ * @param result Result of the operation (0 on success)
+ * @param stats Statistics collected by the operation
+ */
+void writeStatsJson(FILE* file, const char* operation, const char* inputFile,
+                    const char* outputFile, int result, const CodecStats* stats) {
+    const BlockStats* work = &stats->work;
+
+    fprintf(file, "{\"operation\":");
+    writeJsonString(file, operation);
+    fprintf(file, ",\"input\":");
+    writeJsonString(file, inputFile);
+    fprintf(file, ",\"output\":");
+    writeJsonString(file, outputFile);
+    fprintf(file, ",\"status\":\"%s\"", result == 0 ? "ok" : "error");
+
+    fprintf(file, ",\"bytes_in\":%llu,\"bytes_out\":%llu",
+            (unsigned long long)stats->bytesIn, (unsigned long long)stats->bytesOut);
+    fprintf(file, ",\"wall_seconds\":%.6f,\"io_wait_seconds\":%.6f",
+            stats->wallSeconds, stats->ioWaitSeconds);
+    fprintf(file, ",\"phase_seconds\":{\"histogram\":%.6f,\"tree\":%.6f,\"table\":%.6f,"
+            "\"encode\":%.6f,\"decode\":%.6f,\"checksum\":%.6f}",
+            work->histogramSeconds, work->treeSeconds, work->tableSeconds,
+            work->encodeSeconds, work->decodeSeconds, work->checksumSeconds);
+
+    fprintf(file, ",\"blocks\":%llu,\"symbols\":%llu,\"lookups\":%llu",
+            (unsigned long long)work->blocks, (unsigned long long)work->symbols,
+            (unsigned long long)work->lookups);
+    fprintf(file, ",\"symbols_per_lookup\":%.4f,\"long_codes\":%llu,\"cached_tables\":%llu",
+            work->lookups ? (double)work->symbols / (double)work->lookups : 0.0,
+            (unsigned long long)work->longCodes, (unsigned long long)work->cachedTables);
+
+    fprintf(file, ",\"threads\":%d,\"thread_blocks\":[", stats->threads);
+    for (int i = 0; i < stats->threads; i++) {
+        fprintf(file, "%s%llu", i ? "," : "", (unsigned long long)stats->threadBlocks[i]);
+    }
+    fprintf(file, "]}\n");
+}
@@ -0,0 +1,645 @@
+#define _POSIX_C_SOURCE 200809L  // fseeko, opendir
+#define _FILE_OFFSET_BITS 64      // Match the library's off_t
+#include <dirent.h>
+#include "huffman.h"
+
+// =============================================================================
+// TRAINED CODE TABLES
+// =============================================================================
+
+/**
+ * Hashes code lengths into a table ID (32-bit FNV-1a)
+ * @param lengths Code length per character
+ * @return Table ID
+ */
+static uint32_t hashCodeLengths(const uint8_t lengths[ASCII_SIZE]) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        hash = (hash ^ lengths[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Initializes a code table from code lengths and builds its decoder
+ * @param table Table to initialize
+ * @param lengths Code length per character; every character needs a code
+ * @return 0 on success, -1 on invalid lengths or allocation failure
+ */
+static int initCodeTable(CodeTable* table, const uint8_t lengths[ASCII_SIZE]) {
+    memset(table, 0, sizeof(CodeTable));
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        if (lengths[i] == 0 || lengths[i] > MAX_CANONICAL_CODE_LENGTH) {
+            reportError("Code table does not cover every byte");
+            return -1;
+        }
+    }
+
+    memcpy(table->lengths, lengths, ASCII_SIZE);
+    if (assignCanonicalCodes(table->lengths, table->codes) != 0) {
+        return -1;
+    }
+
+    table->decoder = createCanonicalDecodeTable(table->lengths);
+    if (!table->decoder) {
+        return -1;
+    }
+    table->id = hashCodeLengths(table->lengths);
+    return 0;
+}
+
+/**
+ * Builds a code table from sample byte counts
+ * Every byte value gets a code, so messages unlike the samples still encode.
+ * @param table Table to initialize
+ * @param frequencies Byte counts of the samples
+ * @param maxCodeLength Length limit for the codes (8 to MAX_CANONICAL_CODE_LENGTH)
+ * @return 0 on success, -1 on error
+ */
+int createCodeTable(CodeTable* table, const uint64_t frequencies[ASCII_SIZE],
+                    int maxCodeLength) {
+    uint64_t smoothed[ASCII_SIZE];
+    for (int i = 0; i < ASCII_SIZE; i++) {
+        smoothed[i] = frequencies[i] + 1;
+    }
+
+    uint8_t lengths[ASCII_SIZE];
+    if (computeLimitedCodeLengths(smoothed, maxCodeLength, lengths) != 0) {
+        reportError("Failed to build the code table");
+        return -1;
+    }
+    return initCodeTable(table, lengths);
+}
+
+/**
+ * Releases a code table's decoder
+ * @param table Table to destroy
+ */
+void destroyCodeTable(CodeTable* table) {
+    destroyDecodeTable(table->decoder);
+    table->decoder = NULL;
+}
+
+/**
+ * Serializes a code table
+ * Layout: magic, version (1 byte), reserved (3 bytes), table ID, then the
+ * packed code lengths of all 256 characters.
+ * @param table Code table
+ * @param output Buffer of CODE_TABLE_FILE_SIZE bytes
+ */
+void serializeCodeTable(const CodeTable* table, unsigned char* output) {
+    uint32_t magic = MAGIC_TABLE;
+    memcpy(output, &magic, sizeof(uint32_t));
+    output[4] = CODE_TABLE_VERSION;
+    output[5] = output[6] = output[7] = 0;
+    memcpy(output + 8, &table->id, sizeof(uint32_t));
+    packCodeLengths(table->lengths, output + 12);
+}
+
+/**
+ * Loads a code table serialized by serializeCodeTable
+ * @param table Table to initialize
+ * @param data Serialized table
+ * @param size Number of bytes available
+ * @return 0 on success, -1 on invalid data
+ */
+int parseCodeTable(CodeTable* table, const unsigned char* data, size_t size) {
+    uint32_t magic;
+    uint32_t id;
+    if (size < CODE_TABLE_FILE_SIZE) {
+        reportError("Code table is truncated");
+        return -1;
+    }
+    memcpy(&magic, data, sizeof(uint32_t));
+    memcpy(&id, data + 8, sizeof(uint32_t));
+    if (magic != MAGIC_TABLE || data[4] != CODE_TABLE_VERSION) {
+        reportError("Not a code table");
+        return -1;
+    }
+
+    uint8_t lengths[ASCII_SIZE];
+    size_t consumed;
+    if (unpackCodeLengths(data + 12, size - 12, lengths, &consumed) != 0 ||
+        initCodeTable(table, lengths) != 0) {
+        return -1;
+    }
+
+    if (table->id != id) {
+        reportError("Code table ID does not match its code lengths");
+        destroyCodeTable(table);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Adds the byte counts of one sample file
+ * @param path Sample file
+ * @param frequencies Histogram to update
+ * @return Number of bytes counted, or -1 on error
+ */
+static int64_t countSampleFile(const char* path, uint64_t frequencies[ASCII_SIZE]) {
+    InputSource source;
+    if (openInputSource(&source, path, IO_BACKEND_MMAP) != 0) {
+        return -1;
+    }
+
+    unsigned char* buffer = (unsigned char*)malloc(IO_BUFFER_SIZE);
+    if (!buffer) {
+        reportError("Memory allocation failed for sample buffer");
+        closeInputSource(&source);
+        return -1;
+    }
+
+    int64_t total = 0;
+    size_t count;
+    do {
+        const unsigned char* span = readInputSpan(&source, buffer, IO_BUFFER_SIZE, &count);
+        countFrequencies(span, count, frequencies);
+        total += (int64_t)count;
+    } while (count == IO_BUFFER_SIZE);
+
+    if (ferror(source.file)) {
+        reportError("Failed to read sample '%s'", path);
+        total = -1;
+    }
+
+    free(buffer);
+    closeInputSource(&source);
+    return total;
+}
+
+/**
+ * Trains a code table on sample data
+ * @param path A sample file, or a directory whose regular files (not
+ *        hidden, not in subdirectories) are the samples
+ * @param maxCodeLength Length limit for the codes
+ * @param quiet Nonzero to skip the summary of the samples
+ * @param table Table to initialize
+ * @return 0 on success, -1 on error
+ */
+int trainCodeTable(const char* path, int maxCodeLength, int quiet, CodeTable* table) {
+    uint64_t frequencies[ASCII_SIZE] = {0};
+    uint64_t totalBytes = 0;
+    size_t files = 0;
+
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        reportError("Cannot open samples '%s'", path);
+        return -1;
+    }
+
+    if (S_ISDIR(info.st_mode)) {
+        DIR* directory = opendir(path);
+        if (!directory) {
+            reportError("Cannot open sample directory '%s'", path);
+            return -1;
+        }
+
+        struct dirent* entry;
+        while ((entry = readdir(directory)) != NULL) {
+            if (entry->d_name[0] == '.') continue;
+
+            size_t length = strlen(path) + strlen(entry->d_name) + 2;
+            char* file = (char*)malloc(length);
+            if (!file) {
+                reportError("Memory allocation failed for sample path");
+                closedir(directory);
+                return -1;
+            }
+            snprintf(file, length, "%s/%s", path, entry->d_name);
+
+            int64_t bytes = 0;
+            if (stat(file, &info) == 0 && S_ISREG(info.st_mode)) {
+                bytes = countSampleFile(file, frequencies);
+                files++;
+            }
+            free(file);
+            if (bytes < 0) {
+                closedir(directory);
+                return -1;
+            }
+            totalBytes += (uint64_t)bytes;
+        }
+        closedir(directory);
+    } else {
+        int64_t bytes = countSampleFile(path, frequencies);
+        if (bytes < 0) {
+            return -1;
+        }
+        totalBytes = (uint64_t)bytes;
+        files = 1;
+    }
+
+    if (totalBytes == 0) {
+        reportError("No sample data in '%s'", path);
+        return -1;
+    }
+    if (!quiet) printf("Samples: %zu files, %llu bytes\n", files, (unsigned long long)totalBytes);
+
+    return createCodeTable(table, frequencies, maxCodeLength);
+}
+
+/**
+ * Writes a code table file
+ * @param table Code table
+ * @param path Output path, or "-" for stdout
+ * @return 0 on success, -1 on error
+ */
+int saveCodeTable(const CodeTable* table, const char* path) {
+    FILE* file = openOutputStream(path);
+    if (!file) {
+        return -1;
+    }
+
+    unsigned char data[CODE_TABLE_FILE_SIZE];
+    serializeCodeTable(table, data);
+    fwrite(data, 1, sizeof(data), file);
+    if (closeStream(file) != 0) {
+        reportError("Failed to write code table '%s'", path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Reads a code table file
+ * @param table Table to initialize
+ * @param path Table file
+ * @return 0 on success, -1 on error
+ */
+int loadCodeTable(CodeTable* table, const char* path) {
+    FILE* file = openInputStream(path);
+    if (!file) {
+        return -1;
+    }
+
+    unsigned char data[CODE_TABLE_FILE_SIZE];
+    size_t size = fread(data, 1, sizeof(data), file);
+    closeStream(file);
+    return parseCodeTable(table, data, size);
+}
+
+
+// =============================================================================
+// TABLE-CODED MESSAGES
+// =============================================================================
+
+/**
+ * Largest encoding of a message
+ * @param size Uncompressed size in bytes
+ * @return Output buffer size for encodeTableMessage
+ */
+size_t tableMessageBound(size_t size) {
+    return TABLE_MESSAGE_HEADER_MAX + size + 8;
+}
+
+/**
+ * Encodes a message with a trained table
+ * Layout: magic, table ID, original size (LEB128), a BlockType byte, then
+ * one bit stream, the raw bytes or the repeated byte.
+ * @param table Code table
+ * @param input Message bytes
+ * @param size Number of bytes
+ * @param output Buffer of at least tableMessageBound(size) bytes
+ * @param written Receives the encoded size
+ * @return 0 on success, -1 on error
+ */
+int encodeTableMessage(const CodeTable* table, const unsigned char* input, size_t size,
+                       unsigned char* output, size_t* written) {
+    uint32_t magic = MAGIC_TABLE_MESSAGE;
+    memcpy(output, &magic, sizeof(uint32_t));
+    memcpy(output + 4, &table->id, sizeof(uint32_t));
+    size_t position = 8;
+    uint64_t remaining = size;
+    do {
+        unsigned char byte = (unsigned char)(remaining & 0x7f);
+        remaining >>= 7;
+        output[position++] = (unsigned char)(byte | (remaining ? 0x80 : 0));
+    } while (remaining);
+
+    // The table's code lengths give the exact coded size up front
+    uint64_t bits = 0;
+    int repeated = size > 1;
+    for (size_t i = 0; i < size; i++) {
+        bits += table->lengths[input[i]];
+        repeated &= input[i] == input[0];
+    }
+
+    if (repeated) {
+        output[position++] = BLOCK_TYPE_RLE;
+        output[position++] = input[0];
+    } else if ((bits + 7) / 8 < size) {
+        output[position++] = BLOCK_TYPE_HUFFMAN;
+        size_t streamSize;
+        if (encodeStreams(table->codes, input, size, 1, output + position,
+                          tableMessageBound(size) - position, &streamSize) != 0) {
+            return -1;
+        }
+        position += streamSize;
+    } else {
+        output[position++] = BLOCK_TYPE_STORED;
+        memcpy(output + position, input, size);
+        position += size;
+    }
+
+    *written = position;
+    return 0;
+}
+
+/**
+ * Reads the table ID and original size that follow the magic number
+ * @param input Message bytes after the magic number
+ * @param size Number of bytes
+ * @param id Receives the table ID
+ * @param originalSize Receives the decoded size
+ * @param consumed Receives the number of bytes read
+ * @return 0 on success, -1 on invalid or truncated data
+ */
+int readTableMessageFields(const unsigned char* input, size_t size, uint32_t* id,
+                           uint64_t* originalSize, size_t* consumed) {
+    if (size < sizeof(uint32_t) + 1) {
+        reportError("Compressed data is truncated");
+        return -1;
+    }
+    memcpy(id, input, sizeof(uint32_t));
+
+    uint64_t value = 0;
+    size_t position = sizeof(uint32_t);
+    for (int shift = 0; ; shift += 7) {
+        if (position >= size || shift > 63) {
+            reportError("Invalid message size");
+            return -1;
+        }
+        unsigned char byte = input[position++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) break;
+    }
+
+    *originalSize = value;
+    *consumed = position;
+    return 0;
+}
+
+/**
+ * Decodes the payload of a table-coded message
+ * @param table Code table
+ * @param payload BlockType byte and the data that follows it
+ * @param size Number of payload bytes
+ * @param output Buffer receiving count bytes
+ * @param count Decoded size from the message header
+ * @param stats Receives decode times and lookup counts, or NULL
+ * @return 0 on success, -1 on corrupted or truncated data
+ */
+static int decodeTablePayload(const CodeTable* table, const unsigned char* payload,
+                              size_t size, unsigned char* output, size_t count,
+                              BlockStats* stats) {
+    if (size == 0) {
+        reportError("Compressed data is truncated");
+        return -1;
+    }
+
+    int type = payload[0];
+    payload++;
+    size--;
+
+    if (type == BLOCK_TYPE_HUFFMAN) {
+        double mark = stats ? wallClockSeconds() : 0;
+        int result = decodeStreams(table->decoder, payload, size, 1, output, count, stats);
+        CHARGE_PHASE(stats, decodeSeconds, mark);
+        return result;
+    }
+    if (type == BLOCK_TYPE_STORED && size == count) {
+        memcpy(output, payload, count);
+        return 0;
+    }
+    if (type == BLOCK_TYPE_RLE && size == 1) {
+        memset(output, payload[0], count);
+        return 0;
+    }
+
+    reportError("Invalid message payload");
+    return -1;
+}
+
+/**
+ * Checks that a message was coded with the given table
+ * @param table Code table
+ * @param id Table ID from the message
+ * @return 0 if they match, -1 otherwise
+ */
+static int checkTableId(const CodeTable* table, uint32_t id) {
+    if (id != table->id) {
+        reportError("Input was coded with table %08x, not %08x", (unsigned)id, (unsigned)table->id);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Decodes a table-coded message
+ * @param table Code table the message was encoded with
+ * @param input Message bytes
+ * @param size Number of bytes
+ * @param output Buffer receiving the decoded bytes
+ * @param capacity Size of the output buffer
+ * @param decoded Receives the decoded size
+ * @return 0 on success, -1 on error
+ */
+int decodeTableMessage(const CodeTable* table, const unsigned char* input, size_t size,
+                       unsigned char* output, size_t capacity, size_t* decoded) {
+    uint32_t magic;
+    if (size < sizeof(uint32_t)) {
+        reportError("Compressed data is truncated");
+        return -1;
+    }
+    memcpy(&magic, input, sizeof(uint32_t));
+    if (magic != MAGIC_TABLE_MESSAGE) {
+        reportError("Not a table-coded message");
+        return -1;
+    }
+
+    uint32_t id;
+    uint64_t originalSize;
+    size_t consumed;
+    input += sizeof(uint32_t);
+    size -= sizeof(uint32_t);
+    if (readTableMessageFields(input, size, &id, &originalSize, &consumed) != 0 ||
+        checkTableId(table, id) != 0) {
+        return -1;
+    }
+    if (originalSize > capacity) {
+        reportError("Message does not fit the output buffer");
+        return -1;
+    }
+
+    *decoded = (size_t)originalSize;
+    return decodeTablePayload(table, input + consumed, size - consumed, output,
+                              (size_t)originalSize, NULL);
+}
+
+/**
+ * Reads the rest of an input source into memory
+ * Mapped sources are returned in place.
+ * @param source Input source
+ * @param size Receives the number of bytes
+ * @param owned Receives the buffer to free (NULL for mapped sources)
+ * @return Pointer to the bytes, or NULL on error
+ */
+static const unsigned char* readRemainingInput(InputSource* source, size_t* size,
+                                               unsigned char** owned) {
+    *owned = NULL;
+    if (source->map) {
+        return readInputSpan(source, NULL, SIZE_MAX, size);
+    }
+
+    size_t length = 0;
+    size_t capacity = 0;
+    unsigned char* buffer = NULL;
+    size_t count;
+    do {
+        if (capacity - length < IO_BUFFER_SIZE) {
+            size_t newCapacity = capacity ? capacity * 2 : IO_BUFFER_SIZE;
+            unsigned char* grown = (unsigned char*)realloc(buffer, newCapacity);
+            if (!grown) {
+                reportError("Memory allocation failed for input buffer");
+                free(buffer);
+                return NULL;
+            }
+            buffer = grown;
+            capacity = newCapacity;
+        }
+        readInputSpan(source, buffer + length, IO_BUFFER_SIZE, &count);
+        length += count;
+    } while (count == IO_BUFFER_SIZE);
+
+    if (ferror(source->file)) {
+        reportError("Failed to read input data");
+        free(buffer);
+        return NULL;
+    }
+
+    *owned = buffer;
+    *size = length;
+    return buffer;
+}
+
+/**
+ * Compresses a whole input as one table-coded message
+ * @param input Input source (pipes are read into memory)
+ * @param outputFile Output file pointer
+ * @param options Compression options (table, quiet, stats)
+ * @return 0 on success, -1 on error
+ */
+int compressWithCodeTable(InputSource* input, FILE* outputFile, const CompressOptions* options) {
+    const CodeTable* table = options->table;
+    unsigned char* owned;
+    size_t size;
+    const unsigned char* data = readRemainingInput(input, &size, &owned);
+    if (!data) {
+        return -1;
+    }
+
+    unsigned char* message = (unsigned char*)malloc(tableMessageBound(size));
+    if (!message) {
+        reportError("Memory allocation failed for message buffer");
+        free(owned);
+        return -1;
+    }
+
+    CodecStats* stats = options->stats;
+    double mark = stats ? wallClockSeconds() : 0;
+    size_t written;
+    int result = encodeTableMessage(table, data, size, message, &written);
+    if (stats) {
+        stats->work.encodeSeconds += wallClockSeconds() - mark;
+    }
+    if (result == 0) {
+        fwrite(message, 1, written, outputFile);
+        if (!options->quiet) printf("Table %08x: %zu bytes -> %zu bytes\n", (unsigned)table->id, size, written);
+        if (stats) {
+            stats->bytesIn += size;
+            stats->bytesOut += written;
+            stats->work.blocks++;
+            stats->threadBlocks[0]++;
+        }
+    }
+
+    free(message);
+    free(owned);
+    return result;
+}
+
+/**
+ * Decompresses a table-coded message whose magic number has already been read
+ * @param input Input source positioned after the magic number
+ * @param output Output sink
+ * @param options Decompression options (table, or NULL if none was given; quiet; stats)
+ * @return 0 on success, -1 on error
+ */
+int decompressWithCodeTable(InputSource* input, OutputSink* output,
+                            const DecompressOptions* options) {
+    const CodeTable* table = options->table;
+    if (!table) {
+        reportError("Input was coded with a trained table; pass it with --table");
+        return -1;
+    }
+
+    unsigned char* owned;
+    size_t size;
+    const unsigned char* data = readRemainingInput(input, &size, &owned);
+    if (!data) {
+        return -1;
+    }
+
+    uint32_t id;
+    uint64_t originalSize;
+    size_t consumed;
+    if (readTableMessageFields(data, size, &id, &originalSize, &consumed) != 0 ||
+        checkTableId(table, id) != 0) {
+        free(owned);
+        return -1;
+    }
+    if (!options->quiet) {
+        printf("Original size: %llu bytes\n", (unsigned long long)originalSize);
+    }
+
+    // Stored and RLE payloads bound the size a valid message can claim
+    if (originalSize > (uint64_t)SIZE_MAX / 2 ||
+        (consumed < size && data[consumed] == BLOCK_TYPE_HUFFMAN &&
+         originalSize > (uint64_t)(size - consumed) * 8)) {
+        reportError("Invalid message size");
+        free(owned);
+        return -1;
+    }
+
+    preallocateOutput(output, originalSize);
+    unsigned char* buffer = NULL;
+    if (!output->map) {
+        buffer = (unsigned char*)malloc(originalSize ? (size_t)originalSize : 1);
+        if (!buffer) {
+            reportError("Memory allocation failed for output buffer");
+            free(owned);
+            return -1;
+        }
+    }
+
+    CodecStats* stats = options->stats;
+    int result = -1;
+    unsigned char* destination = reserveOutput(output, buffer, (size_t)originalSize);
+    if (destination &&
+        decodeTablePayload(table, data + consumed, size - consumed, destination,
+                           (size_t)originalSize, stats ? &stats->work : NULL) == 0) {
+        result = commitOutput(output, destination, (size_t)originalSize);
+    }
+    if (result == 0 && stats) {
+        stats->bytesIn += sizeof(uint32_t) + size;
+        stats->bytesOut += originalSize;
+        stats->work.blocks++;
+        stats->threadBlocks[0]++;
+    }
+
+    free(buffer);
+    free(owned);
+    return result;
+}
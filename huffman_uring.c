@@ -0,0 +1,250 @@
+#define _GNU_SOURCE               // syscall() for the io_uring system calls
+#define _FILE_OFFSET_BITS 64      // Match the library's off_t
+#include "huffman.h"
+
+// =============================================================================
+// IO_URING QUEUE
+// =============================================================================
+
+#ifdef HUFFMAN_IO_URING
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+
+// Submission and completion rings shared with the kernel
+struct IoRing {
+    int fd;
+    unsigned entries;
+    unsigned unsubmitted;        // Queued SQEs not yet passed to io_uring_enter
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    struct io_uring_sqe* sqes;
+
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    size_t sqesSize;
+};
+
+/**
+ * Creates an io_uring instance
+ * @param entries Submission queue size (the most operations in flight)
+ * @return Ring, or NULL if the kernel does not provide io_uring
+ */
+IoRing* createIoRing(unsigned entries) {
+    IoRing* ring = (IoRing*)calloc(1, sizeof(IoRing));
+    if (!ring) {
+        reportError("Memory allocation failed for io_uring");
+        return NULL;
+    }
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        free(ring);
+        return NULL;
+    }
+    ring->entries = params.sq_entries;
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqRingSize > ring->sqRingSize) ring->sqRingSize = ring->cqRingSize;
+        ring->cqRingSize = ring->sqRingSize;
+    }
+
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        ring->fd, IORING_OFF_SQ_RING);
+    ring->cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring->sqRing
+        : mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+               ring->fd, IORING_OFF_CQ_RING);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED, ring->fd, IORING_OFF_SQES);
+    if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        destroyIoRing(ring);
+        return NULL;
+    }
+
+    unsigned char* sq = (unsigned char*)ring->sqRing;
+    ring->sqHead = (unsigned*)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned*)(sq + params.sq_off.array);
+
+    unsigned char* cq = (unsigned char*)ring->cqRing;
+    ring->cqHead = (unsigned*)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return ring;
+}
+
+/**
+ * Queues one read or write; it is submitted by the next waitRingCompletion
+ * @param ring Ring
+ * @param opcode IORING_OP_READ or IORING_OP_WRITE
+ * @param fd File descriptor
+ * @param buffer Data buffer, valid until the completion arrives
+ * @param size Number of bytes
+ * @param offset File offset
+ * @param tag Value returned with the completion
+ * @return 0 on success, -1 if the submission queue is full
+ */
+static int queueRingOperation(IoRing* ring, int opcode, int fd, const void* buffer,
+                              size_t size, uint64_t offset, uint64_t tag) {
+    unsigned tail = *ring->sqTail;
+    unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    if (tail - head >= ring->entries) {
+        reportError("io_uring submission queue is full");
+        return -1;
+    }
+
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (uint8_t)opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = (uint32_t)size;
+    sqe->off = offset;
+    sqe->user_data = tag;
+
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->unsubmitted++;
+    return 0;
+}
+
+/**
+ * Queues a read of size bytes at offset
+ * @param ring Ring
+ * @param fd File descriptor
+ * @param buffer Destination
+ * @param size Number of bytes (at most 2 GiB)
+ * @param offset File offset
+ * @param tag Value returned with the completion
+ * @return 0 on success, -1 on error
+ */
+int submitRingRead(IoRing* ring, int fd, void* buffer, size_t size, uint64_t offset,
+                   uint64_t tag) {
+    return queueRingOperation(ring, IORING_OP_READ, fd, buffer, size, offset, tag);
+}
+
+/**
+ * Queues a write of size bytes at offset
+ * @param ring Ring
+ * @param fd File descriptor
+ * @param buffer Source, valid until the completion arrives
+ * @param size Number of bytes (at most 2 GiB)
+ * @param offset File offset
+ * @param tag Value returned with the completion
+ * @return 0 on success, -1 on error
+ */
+int submitRingWrite(IoRing* ring, int fd, const void* buffer, size_t size, uint64_t offset,
+                    uint64_t tag) {
+    return queueRingOperation(ring, IORING_OP_WRITE, fd, buffer, size, offset, tag);
+}
+
+/**
+ * Submits queued operations and waits for the next completion
+ * A signal interrupting the wait submits nothing, so the call is repeated.
+ * @param ring Ring
+ * @param tag Receives the tag of the completed operation
+ * @param result Receives its result: bytes transferred or a negative errno
+ * @return 0 on success, -1 if the kernel rejected the submission
+ */
+int waitRingCompletion(IoRing* ring, uint64_t* tag, int64_t* result) {
+    while (1) {
+        unsigned head = *ring->cqHead;
+        if (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+            const struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+            *tag = cqe->user_data;
+            *result = cqe->res;
+            __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+            return 0;
+        }
+
+        long submitted = syscall(__NR_io_uring_enter, ring->fd, ring->unsubmitted, 1,
+                                 IORING_ENTER_GETEVENTS, NULL, 0);
+        if (submitted < 0 && errno == EINTR) {
+            continue;
+        }
+        if (submitted < 0) {
+            reportError("io_uring_enter failed");
+            return -1;
+        }
+        ring->unsubmitted -= (unsigned)submitted;
+    }
+}
+
+/**
+ * Destroys a ring; operations still in flight are abandoned
+ * @param ring Ring to destroy (may be NULL)
+ */
+void destroyIoRing(IoRing* ring) {
+    if (!ring) return;
+
+    if (ring->sqes && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing && ring->cqRing != MAP_FAILED && ring->cqRing != ring->sqRing) {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if (ring->sqRing && ring->sqRing != MAP_FAILED) munmap(ring->sqRing, ring->sqRingSize);
+    close(ring->fd);
+    free(ring);
+}
+
+#else
+
+// Built without io_uring: the backend is never available
+
+IoRing* createIoRing(unsigned entries) {
+    (void)entries;
+    return NULL;
+}
+
+int submitRingRead(IoRing* ring, int fd, void* buffer, size_t size, uint64_t offset,
+                   uint64_t tag) {
+    (void)ring; (void)fd; (void)buffer; (void)size; (void)offset; (void)tag;
+    return -1;
+}
+
+int submitRingWrite(IoRing* ring, int fd, const void* buffer, size_t size, uint64_t offset,
+                    uint64_t tag) {
+    (void)ring; (void)fd; (void)buffer; (void)size; (void)offset; (void)tag;
+    return -1;
+}
+
+int waitRingCompletion(IoRing* ring, uint64_t* tag, int64_t* result) {
+    (void)ring; (void)tag; (void)result;
+    return -1;
+}
+
+void destroyIoRing(IoRing* ring) {
+    (void)ring;
+}
+
+#endif
+
+/**
+ * Reports whether the io_uring backend can be used on this system
+ * @return 1 if a ring can be created, 0 otherwise
+ */
+int ioRingAvailable(void) {
+    IoRing* ring = createIoRing(1);
+    if (!ring) return 0;
+    destroyIoRing(ring);
+    return 1;
+}
@@ -0,0 +1,1262 @@
+#define _POSIX_C_SOURCE 200809L  // pthreads, fseeko
+#define _FILE_OFFSET_BITS 64      // Match the library's off_t
+#include "huffman.h"
+#include "libhuffman.h"
+
+// =============================================================================
+// STREAM STATE
+// =============================================================================
+
+// Parser states of a decompression stream
+typedef enum StreamState {
+    STREAM_CONTAINER_HEADER,
+    STREAM_BLOCK_HEADER,
+    STREAM_PAYLOAD,
+    STREAM_INDEX,
+    STREAM_TRAILER,
+    STREAM_DONE
+} StreamState;
+
+struct huff_stream {
+    int compressing;
+    huff_write_fn write;
+    void* user;
+    int status;                  // First error, sticky
+
+    int threads;
+    ThreadPool* pool;
+    BlockJob* jobs;
+    ContainerWorkspace* workspace;  // Pool and jobs borrowed from a huff_context, or NULL
+    size_t window;
+    size_t jobCount;             // Complete jobs waiting for the next batch
+    BlockBatch batch;
+
+    ContainerIndex index;        // Blocks written or read so far
+
+    // Statistics, collected when a callback was installed at creation
+    huff_stats_fn statsFn;
+    void* statsUser;
+    CodecStats stats;
+
+    // Compression
+    uint32_t blockSize;
+    uint64_t originalSize;       // STREAM_SIZE_UNKNOWN for open-ended streams
+    size_t pending;              // Bytes buffered in jobs[jobCount].inputBuffer
+    int borrowed;                // Some queued job reads the caller's buffer
+    int headerWritten;
+
+    // Decompression
+    StreamState state;
+    ContainerHeader header;
+    unsigned char stage[CONTAINER_HEADER_SIZE];
+    size_t staged;
+    size_t needed;               // Bytes the current state still waits for
+    size_t indexChecked;
+    uint64_t decodedSize;
+    OutputSink* sink;            // Caller buffer blocks are decoded into in place, or NULL
+};
+
+// Process-wide statistics callback (huff_set_stats_callback)
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+static huff_stats_fn statsCallback;
+static void* statsCallbackUser;
+
+void huff_set_stats_callback(huff_stats_fn fn, void* user) {
+    pthread_mutex_lock(&statsLock);
+    statsCallback = fn;
+    statsCallbackUser = user;
+    pthread_mutex_unlock(&statsLock);
+}
+
+void huff_set_log_callback(huff_log_fn fn, void* user) {
+    setLogHandler(fn, user);
+}
+
+/**
+ * Reads the installed statistics callback
+ * @param user Receives the callback's user pointer
+ * @return Callback, or NULL if none is installed
+ */
+static huff_stats_fn currentStatsCallback(void** user) {
+    pthread_mutex_lock(&statsLock);
+    huff_stats_fn fn = statsCallback;
+    *user = statsCallbackUser;
+    pthread_mutex_unlock(&statsLock);
+    return fn;
+}
+
+/**
+ * Hands finished statistics to a callback
+ * @param fn Callback
+ * @param user Pointer passed to fn
+ * @param stats Statistics, with the wall clock stopped
+ * @param compressing 1 for compression
+ * @param status Final status
+ */
+static void reportStats(huff_stats_fn fn, void* user, const CodecStats* stats,
+                        int compressing, int status) {
+    const BlockStats* work = &stats->work;
+    huff_stats report = {
+        .compressing = compressing,
+        .status = status,
+        .bytes_in = stats->bytesIn,
+        .bytes_out = stats->bytesOut,
+        .wall_seconds = stats->wallSeconds,
+        .histogram_seconds = work->histogramSeconds,
+        .tree_seconds = work->treeSeconds,
+        .table_seconds = work->tableSeconds,
+        .encode_seconds = work->encodeSeconds,
+        .decode_seconds = work->decodeSeconds,
+        .checksum_seconds = work->checksumSeconds,
+        .blocks = work->blocks,
+        .symbols = work->symbols,
+        .lookups = work->lookups,
+        .long_codes = work->longCodes,
+        .cached_tables = work->cachedTables,
+        .threads = stats->threads,
+        .thread_blocks = stats->threadBlocks
+    };
+    fn(user, &report);
+}
+
+/**
+ * Starts collecting statistics if a callback is installed
+ * @param stream Newly created stream
+ */
+static void startStreamStats(huff_stream* stream) {
+    stream->statsFn = currentStatsCallback(&stream->statsUser);
+    if (stream->statsFn) {
+        beginCodecStats(&stream->stats);
+        stream->batch.stats = 1;
+    }
+}
+
+/**
+ * Reports a stream's statistics once, when it is finished or destroyed
+ * @param stream Stream
+ * @param status Final status
+ */
+static void finishStreamStats(huff_stream* stream, int status) {
+    if (!stream->statsFn) return;
+
+    if (stream->pool) {
+        collectPoolStats(&stream->stats, stream->pool);
+    }
+    endCodecStats(&stream->stats);
+    reportStats(stream->statsFn, stream->statsUser, &stream->stats, stream->compressing,
+                status);
+    stream->statsFn = NULL;
+}
+
+/**
+ * Records the first error of a stream
+ * @param stream Stream
+ * @param status Status code
+ * @return The stream's sticky status
+ */
+static int failStream(huff_stream* stream, int status) {
+    if (stream->status == HUFF_OK) {
+        stream->status = status;
+    }
+    return stream->status;
+}
+
+/**
+ * Hands bytes to the stream's write function
+ * @param stream Stream
+ * @param data Bytes to emit
+ * @param size Number of bytes
+ * @return HUFF_OK or HUFF_ERROR_CALLBACK
+ */
+static int emit(huff_stream* stream, const void* data, size_t size) {
+    if (stream->status == HUFF_OK && size > 0) {
+        if (stream->write(stream->user, data, size) != 0) {
+            failStream(stream, HUFF_ERROR_CALLBACK);
+        } else {
+            stream->stats.bytesOut += size;
+        }
+    }
+    return stream->status;
+}
+
+/**
+ * Allocates the worker pool and job window shared by both directions
+ * A stream of a context borrows the context's pool and jobs instead, so
+ * their buffers and cached decode tables carry over between calls.
+ * @param stream Stream with threads (or workspace) set
+ * @param inputCapacity Input buffer size per job
+ * @param outputCapacity Output buffer size per job
+ * @return HUFF_OK or HUFF_ERROR_OUT_OF_MEMORY
+ */
+static int allocateStreamJobs(huff_stream* stream, size_t inputCapacity, size_t outputCapacity) {
+    ContainerWorkspace* workspace = stream->workspace;
+    if (workspace) {
+        stream->threads = workspace->threads;
+        stream->window = (size_t)stream->threads * BLOCKS_PER_THREAD;
+        stream->pool = workspace->pool;
+        stream->jobs = acquireWorkspaceJobs(workspace, stream->window, inputCapacity,
+                                            outputCapacity);
+        if (!stream->jobs) {
+            return HUFF_ERROR_OUT_OF_MEMORY;
+        }
+        resetPoolStats(stream->pool);
+        stream->batch.jobs = stream->jobs;
+        return HUFF_OK;
+    }
+
+    stream->threads = resolveThreadCount(stream->threads);
+    stream->window = (size_t)stream->threads * BLOCKS_PER_THREAD;
+    stream->pool = createThreadPool(stream->threads);
+    stream->jobs = createBlockJobs(stream->window, inputCapacity, outputCapacity);
+    if (!stream->pool || !stream->jobs) {
+        return HUFF_ERROR_OUT_OF_MEMORY;
+    }
+
+    stream->batch.jobs = stream->jobs;
+    return HUFF_OK;
+}
+
+// Native-endian field encoders matching the fwrite-based file writers
+static unsigned char* put8(unsigned char* p, uint8_t v) { *p = v; return p + 1; }
+static unsigned char* put16(unsigned char* p, uint16_t v) { memcpy(p, &v, 2); return p + 2; }
+static unsigned char* put32(unsigned char* p, uint32_t v) { memcpy(p, &v, 4); return p + 4; }
+static unsigned char* put64(unsigned char* p, uint64_t v) { memcpy(p, &v, 8); return p + 8; }
+static uint32_t get32(const unsigned char* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static uint64_t get64(const unsigned char* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+// =============================================================================
+// COMPRESSION STREAM
+// =============================================================================
+
+/**
+ * Checks compression parameters against the supported ranges
+ * @param params Parameters to check
+ * @return 1 if valid, 0 otherwise
+ */
+static int validParams(const huff_params* params) {
+    return params->threads >= 0 &&
+           (params->streams == 1 || params->streams == INTERLEAVED_STREAMS) &&
+           params->split_level >= 0 && params->split_level <= MAX_SPLIT_LEVEL &&
+           (params->context_model == 0 || params->context_model == 1) &&
+           (params->checksums == 0 || params->checksums == 1) &&
+           params->max_code_length >= 8 && params->max_code_length <= MAX_CANONICAL_CODE_LENGTH &&
+           params->block_size >= MIN_BLOCK_SIZE && params->block_size <= MAX_BLOCK_SIZE;
+}
+
+/**
+ * Creates a compression stream
+ * @param params Compression parameters, or NULL for defaults
+ * @param originalSize Total input size, or STREAM_SIZE_UNKNOWN for a streamed container
+ * @param workspace Context workspace to borrow (its threads replace params->threads),
+ *        or NULL
+ * @param write Output function
+ * @param user Pointer passed to write
+ * @return Stream, or NULL on invalid parameters or allocation failure
+ */
+static huff_stream* createCompressStream(const huff_params* params, uint64_t originalSize,
+                                         ContainerWorkspace* workspace, huff_write_fn write,
+                                         void* user) {
+    huff_params defaults;
+    if (!params) {
+        huff_params_init(&defaults);
+        params = &defaults;
+    }
+
+    if (!write || !validParams(params)) {
+        return NULL;
+    }
+
+    huff_stream* stream = (huff_stream*)calloc(1, sizeof(huff_stream));
+    if (!stream) {
+        return NULL;
+    }
+
+    stream->compressing = 1;
+    stream->write = write;
+    stream->user = user;
+    stream->threads = params->threads;
+    stream->workspace = workspace;
+    stream->blockSize = params->block_size;
+    stream->originalSize = originalSize;
+    initContainerIndex(&stream->index);
+    startStreamStats(stream);
+
+    if (allocateStreamJobs(stream, params->block_size,
+                           blockJobOutputBound(params->block_size)) != HUFF_OK) {
+        huff_stream_destroy(stream);
+        return NULL;
+    }
+    stream->batch.maxCodeLength = params->max_code_length;
+    stream->batch.streams = params->streams;
+    stream->batch.blockTypes = 1;
+    stream->batch.splitLevel = params->split_level;
+    stream->batch.contextModel = params->context_model;
+    stream->batch.checksums = params->checksums;
+
+    return stream;
+}
+
+huff_stream* huff_compress_stream_create(const huff_params* params, huff_write_fn write,
+                                         void* user) {
+    return createCompressStream(params, STREAM_SIZE_UNKNOWN, NULL, write, user);
+}
+
+/**
+ * Emits the container header once, before the first block
+ * @param stream Compression stream
+ * @return Stream status
+ */
+static int writeStreamHeader(huff_stream* stream) {
+    if (stream->headerWritten) {
+        return stream->status;
+    }
+    stream->headerWritten = 1;
+
+    int streamed = stream->originalSize == STREAM_SIZE_UNKNOWN;
+    unsigned char header[CONTAINER_HEADER_SIZE];
+    unsigned char* p = put32(header, MAGIC_BLOCKS);
+    p = put8(p, BLOCK_FORMAT_VERSION);
+    p = put8(p, (streamed ? CONTAINER_FLAG_STREAMED : 0) |
+                (stream->batch.streams > 1 ? CONTAINER_FLAG_INTERLEAVED : 0) |
+                (stream->batch.checksums ? CONTAINER_FLAG_CHECKSUMS : 0) |
+                CONTAINER_FLAG_BLOCK_TYPES | CONTAINER_FLAG_RAW_OFFSETS);
+    p = put16(p, 0);
+    p = put32(p, stream->blockSize);
+    put64(p, streamed ? 0 : stream->originalSize);
+
+    return emit(stream, header, sizeof(header));
+}
+
+/**
+ * Compresses the queued jobs in parallel and emits them in order
+ * A partially filled block stays buffered and moves to the first job.
+ * @param stream Compression stream
+ * @return Stream status
+ */
+static int flushCompressBatch(huff_stream* stream) {
+    if (writeStreamHeader(stream) != HUFF_OK || stream->jobCount == 0) {
+        return stream->status;
+    }
+
+    runParallel(stream->pool, compressBlockTask, &stream->batch, stream->jobCount);
+    if (stream->batch.stats) {
+        collectBlockStats(&stream->stats, stream->jobs, stream->jobCount);
+    }
+
+    for (size_t i = 0; i < stream->jobCount && stream->status == HUFF_OK; i++) {
+        BlockJob* job = &stream->jobs[i];
+        if (job->result != 0) {
+            return failStream(stream, HUFF_ERROR_OUT_OF_MEMORY);
+        }
+        for (size_t part = 0; part < job->parts; part++) {
+            if (appendIndexEntry(&stream->index, job->partSizes[part],
+                                 job->partRawSizes[part]) != 0) {
+                return failStream(stream, HUFF_ERROR_OUT_OF_MEMORY);
+            }
+        }
+        emit(stream, job->output, job->outputSize);
+    }
+
+    if (stream->pending > 0 && stream->jobCount > 0) {
+        unsigned char* buffer = stream->jobs[0].inputBuffer;
+        stream->jobs[0].inputBuffer = stream->jobs[stream->jobCount].inputBuffer;
+        stream->jobs[stream->jobCount].inputBuffer = buffer;
+    }
+
+    stream->jobCount = 0;
+    stream->borrowed = 0;
+    return stream->status;
+}
+
+/**
+ * Adds input to a compression stream
+ * Whole blocks are compressed straight from the caller's buffer; only
+ * partial blocks are copied.
+ * @param stream Compression stream
+ * @param data Input bytes
+ * @param size Number of input bytes
+ * @return Stream status
+ */
+static int writeCompressStream(huff_stream* stream, const unsigned char* data, size_t size) {
+    while (size > 0 && stream->status == HUFF_OK) {
+        BlockJob* job = &stream->jobs[stream->jobCount];
+
+        if (stream->pending == 0 && size >= stream->blockSize) {
+            job->input = data;
+            job->inputSize = stream->blockSize;
+            stream->borrowed = 1;
+            data += stream->blockSize;
+            size -= stream->blockSize;
+        } else {
+            size_t room = stream->blockSize - stream->pending;
+            size_t count = size < room ? size : room;
+            memcpy(job->inputBuffer + stream->pending, data, count);
+            stream->pending += count;
+            data += count;
+            size -= count;
+
+            if (stream->pending < stream->blockSize) break;
+
+            job->input = job->inputBuffer;
+            job->inputSize = stream->blockSize;
+            stream->pending = 0;
+        }
+
+        if (++stream->jobCount == stream->window) {
+            flushCompressBatch(stream);
+        }
+    }
+
+    // Borrowed input is only valid until this call returns
+    if (stream->borrowed) {
+        flushCompressBatch(stream);
+    }
+    return stream->status;
+}
+
+/**
+ * Flushes the last block, then writes the end marker, index and trailer
+ * @param stream Compression stream
+ * @return Stream status
+ */
+static int finishCompressStream(huff_stream* stream) {
+    if (stream->pending > 0) {
+        BlockJob* job = &stream->jobs[stream->jobCount++];
+        job->input = job->inputBuffer;
+        job->inputSize = stream->pending;
+        stream->pending = 0;
+    }
+    if (flushCompressBatch(stream) != HUFF_OK) {
+        return stream->status;
+    }
+
+    unsigned char end[BLOCK_HEADER_SIZE] = {0};
+    emit(stream, end, sizeof(end));
+
+    const ContainerIndex* index = &stream->index;
+    for (size_t i = 0; i < 2 * index->count; i++) {
+        unsigned char entry[sizeof(uint64_t)];
+        put64(entry, i < index->count ? index->offsets[i] : index->rawOffsets[i - index->count]);
+        emit(stream, entry, sizeof(entry));
+    }
+
+    unsigned char trailer[INDEX_TRAILER_SIZE];
+    unsigned char* p = put64(trailer, index->offset + BLOCK_HEADER_SIZE);
+    p = put32(p, (uint32_t)index->count);
+    put32(p, MAGIC_BLOCK_INDEX);
+    return emit(stream, trailer, sizeof(trailer));
+}
+
+// =============================================================================
+// DECOMPRESSION STREAM
+// =============================================================================
+
+/**
+ * Creates a decompression stream
+ * @param threads Threads used to decode blocks (0 = all cores)
+ * @param workspace Context workspace to borrow (its threads replace threads), or NULL
+ * @param write Output function
+ * @param user Pointer passed to write
+ * @return Stream, or NULL on invalid arguments or allocation failure
+ */
+static huff_stream* createDecompressStream(int threads, ContainerWorkspace* workspace,
+                                           huff_write_fn write, void* user) {
+    if (!write || threads < 0) {
+        return NULL;
+    }
+
+    huff_stream* stream = (huff_stream*)calloc(1, sizeof(huff_stream));
+    if (!stream) {
+        return NULL;
+    }
+
+    stream->write = write;
+    stream->user = user;
+    stream->threads = threads;
+    stream->workspace = workspace;
+    stream->state = STREAM_CONTAINER_HEADER;
+    stream->needed = CONTAINER_HEADER_SIZE;
+    initContainerIndex(&stream->index);
+    startStreamStats(stream);
+    return stream;
+}
+
+huff_stream* huff_decompress_stream_create(int threads, huff_write_fn write, void* user) {
+    return createDecompressStream(threads, NULL, write, user);
+}
+
+/**
+ * Decodes the queued blocks in parallel and emits them in order
+ * @param stream Decompression stream
+ * @return Stream status
+ */
+static int flushDecompressBatch(huff_stream* stream) {
+    if (stream->jobCount == 0) {
+        return stream->status;
+    }
+
+    runParallel(stream->pool, decompressBlockTask, &stream->batch, stream->jobCount);
+    if (stream->batch.stats) {
+        collectBlockStats(&stream->stats, stream->jobs, stream->jobCount);
+    }
+
+    for (size_t i = 0; i < stream->jobCount && stream->status == HUFF_OK; i++) {
+        BlockJob* job = &stream->jobs[i];
+        if (job->result != 0) {
+            return failStream(stream, HUFF_ERROR_CORRUPT_INPUT);
+        }
+        emit(stream, job->output, job->outputSize);
+        stream->decodedSize += job->outputSize;
+    }
+
+    stream->jobCount = 0;
+    return stream->status;
+}
+
+/**
+ * Acts on a complete container header, block header, index entry or trailer
+ * @param stream Decompression stream whose stage holds the structure
+ * @return Stream status
+ */
+static int parseStagedStructure(huff_stream* stream) {
+    const unsigned char* stage = stream->stage;
+    stream->staged = 0;
+
+    switch (stream->state) {
+        case STREAM_CONTAINER_HEADER: {
+            if (get32(stage) != MAGIC_BLOCKS) {
+                return failStream(stream, HUFF_ERROR_UNSUPPORTED_FORMAT);
+            }
+            ContainerHeader* header = &stream->header;
+            header->magic = MAGIC_BLOCKS;
+            header->version = stage[4];
+            header->flags = stage[5];
+            header->block_size = get32(stage + 8);
+            header->original_size = get64(stage + 12);
+            if (validateContainerHeader(header) != 0) {
+                return failStream(stream, HUFF_ERROR_UNSUPPORTED_FORMAT);
+            }
+
+            int status = allocateStreamJobs(stream, blockPayloadBound(header->block_size),
+                                            header->block_size);
+            if (status != HUFF_OK) {
+                return failStream(stream, status);
+            }
+
+            stream->batch.streams =
+                (header->flags & CONTAINER_FLAG_INTERLEAVED) ? INTERLEAVED_STREAMS : 1;
+            stream->batch.blockTypes = (header->flags & CONTAINER_FLAG_BLOCK_TYPES) != 0;
+            stream->batch.checksums = (header->flags & CONTAINER_FLAG_CHECKSUMS) != 0;
+            stream->state = STREAM_BLOCK_HEADER;
+            stream->needed = BLOCK_HEADER_SIZE;
+            break;
+        }
+
+        case STREAM_BLOCK_HEADER: {
+            uint32_t rawSize = get32(stage);
+            uint32_t payloadSize = get32(stage + 4);
+
+            if (rawSize == 0) {
+                flushDecompressBatch(stream);
+                stream->state = stream->index.count > 0 ? STREAM_INDEX : STREAM_TRAILER;
+                stream->needed = stream->index.count > 0 ? sizeof(uint64_t) : INDEX_TRAILER_SIZE;
+                stream->index.offset += BLOCK_HEADER_SIZE;
+                break;
+            }
+
+            if (rawSize > stream->header.block_size ||
+                payloadSize > blockPayloadBound(rawSize) || payloadSize == 0) {
+                return failStream(stream, HUFF_ERROR_CORRUPT_INPUT);
+            }
+            if (appendIndexEntry(&stream->index, BLOCK_HEADER_SIZE + payloadSize, rawSize) != 0) {
+                return failStream(stream, HUFF_ERROR_OUT_OF_MEMORY);
+            }
+
+            // A block that does not fit the caller's buffer is decoded into the
+            // job and fails when emitted, as with any write function
+            BlockJob* job = &stream->jobs[stream->jobCount];
+            OutputSink* sink = stream->sink;
+            job->input = job->inputBuffer;
+            job->inputSize = payloadSize;
+            job->output = sink && rawSize <= sink->mapSize - sink->reserved
+                ? reserveOutput(sink, NULL, rawSize) : job->outputBuffer;
+            job->outputSize = rawSize;
+
+            stream->state = STREAM_PAYLOAD;
+            stream->needed = payloadSize;
+            break;
+        }
+
+        case STREAM_INDEX: {
+            // Block offsets, then (with CONTAINER_FLAG_RAW_OFFSETS) uncompressed offsets
+            const ContainerIndex* index = &stream->index;
+            size_t entries = index->count *
+                ((stream->header.flags & CONTAINER_FLAG_RAW_OFFSETS) ? 2 : 1);
+            size_t i = stream->indexChecked;
+            uint64_t expected = i < index->count ? index->offsets[i]
+                                                 : index->rawOffsets[i - index->count];
+            if (get64(stage) != expected) {
+                return failStream(stream, HUFF_ERROR_CORRUPT_INPUT);
+            }
+            if (++stream->indexChecked == entries) {
+                stream->state = STREAM_TRAILER;
+                stream->needed = INDEX_TRAILER_SIZE;
+            } else {
+                stream->needed = sizeof(uint64_t);
+            }
+            break;
+        }
+
+        case STREAM_TRAILER:
+            if (get64(stage) != stream->index.offset || get32(stage + 8) != stream->index.count ||
+                get32(stage + 12) != MAGIC_BLOCK_INDEX) {
+                return failStream(stream, HUFF_ERROR_CORRUPT_INPUT);
+            }
+            if (!(stream->header.flags & CONTAINER_FLAG_STREAMED) &&
+                stream->decodedSize != stream->header.original_size) {
+                return failStream(stream, HUFF_ERROR_CORRUPT_INPUT);
+            }
+            stream->state = STREAM_DONE;
+            stream->needed = 0;
+            break;
+
+        default:
+            break;
+    }
+
+    return stream->status;
+}
+
+/**
+ * Feeds compressed bytes through the container parser
+ * Fixed-size structures are staged; payloads go straight to their job.
+ * @param stream Decompression stream
+ * @param data Compressed bytes
+ * @param size Number of compressed bytes
+ * @return Stream status
+ */
+static int writeDecompressStream(huff_stream* stream, const unsigned char* data, size_t size) {
+    while (size > 0 && stream->status == HUFF_OK) {
+        if (stream->state == STREAM_DONE) {
+            return failStream(stream, HUFF_ERROR_CORRUPT_INPUT);  // Bytes after the trailer
+        }
+
+        size_t count = size < stream->needed ? size : stream->needed;
+
+        if (stream->state == STREAM_PAYLOAD) {
+            BlockJob* job = &stream->jobs[stream->jobCount];
+            memcpy(job->inputBuffer + (job->inputSize - stream->needed), data, count);
+            stream->needed -= count;
+            if (stream->needed == 0) {
+                stream->state = STREAM_BLOCK_HEADER;
+                stream->needed = BLOCK_HEADER_SIZE;
+                if (++stream->jobCount == stream->window) {
+                    flushDecompressBatch(stream);
+                }
+            }
+        } else {
+            memcpy(stream->stage + stream->staged, data, count);
+            stream->staged += count;
+            stream->needed -= count;
+            if (stream->needed == 0) {
+                parseStagedStructure(stream);
+            }
+        }
+
+        data += count;
+        size -= count;
+    }
+
+    return stream->status;
+}
+
+// =============================================================================
+// STREAM API
+// =============================================================================
+
+int huff_stream_write(huff_stream* stream, const void* data, size_t size) {
+    if (!stream || (!data && size > 0)) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+    if (stream->status != HUFF_OK) {
+        return stream->status;
+    }
+
+    stream->stats.bytesIn += size;
+    return stream->compressing
+        ? writeCompressStream(stream, (const unsigned char*)data, size)
+        : writeDecompressStream(stream, (const unsigned char*)data, size);
+}
+
+int huff_stream_finish(huff_stream* stream) {
+    if (!stream) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (stream->status == HUFF_OK) {
+        if (stream->compressing) {
+            finishCompressStream(stream);
+        } else if (stream->state != STREAM_DONE) {
+            failStream(stream, HUFF_ERROR_TRUNCATED_INPUT);
+        }
+    }
+
+    finishStreamStats(stream, stream->status);
+    return stream->status;
+}
+
+void huff_stream_destroy(huff_stream* stream) {
+    if (!stream) return;
+
+    finishStreamStats(stream, stream->status);
+    if (!stream->workspace) {
+        destroyThreadPool(stream->pool);
+        destroyBlockJobs(stream->jobs, stream->window);
+    }
+    destroyContainerIndex(&stream->index);
+    free(stream);
+}
+
+// =============================================================================
+// PARAMETERS AND BUFFER API
+// =============================================================================
+
+void huff_params_init(huff_params* params) {
+    params->max_code_length = DEFAULT_MAX_CODE_LENGTH;
+    params->block_size = DEFAULT_BLOCK_SIZE;
+    params->threads = 1;
+    params->streams = INTERLEAVED_STREAMS;
+    params->split_level = 0;
+    params->context_model = 0;
+    params->checksums = 0;
+}
+
+const char* huff_error_string(int status) {
+    switch (status) {
+        case HUFF_OK: return "success";
+        case HUFF_ERROR_INVALID_ARGUMENT: return "invalid argument";
+        case HUFF_ERROR_OUT_OF_MEMORY: return "out of memory";
+        case HUFF_ERROR_DESTINATION_TOO_SMALL: return "destination buffer too small";
+        case HUFF_ERROR_CORRUPT_INPUT: return "corrupt compressed data";
+        case HUFF_ERROR_TRUNCATED_INPUT: return "truncated compressed data";
+        case HUFF_ERROR_UNSUPPORTED_FORMAT: return "unsupported format";
+        case HUFF_ERROR_CALLBACK: return "write callback failed";
+        default: return "unknown error";
+    }
+}
+
+size_t huff_compress_bound(size_t size) {
+    return containerBound(size);
+}
+
+// Caller buffer filled by a stream's write function
+typedef struct BufferTarget {
+    unsigned char* data;
+    size_t capacity;
+    size_t size;
+} BufferTarget;
+
+/**
+ * Write function appending to a BufferTarget
+ * @param user BufferTarget
+ * @param data Bytes to append
+ * @param size Number of bytes
+ * @return 0 on success, -1 if the buffer is full
+ */
+static int writeToBuffer(void* user, const void* data, size_t size) {
+    BufferTarget* target = (BufferTarget*)user;
+    if (size > target->capacity - target->size) {
+        return -1;
+    }
+    memcpy(target->data + target->size, data, size);
+    target->size += size;
+    return 0;
+}
+
+int huff_compress(const void* src, size_t src_size, void* dst, size_t* dst_size) {
+    return huff_compress_with(NULL, src, src_size, dst, dst_size);
+}
+
+/**
+ * Compresses a buffer into a caller buffer through a stream
+ * @param params Compression parameters, or NULL for defaults
+ * @param workspace Context workspace to borrow, or NULL
+ * @param src Input bytes
+ * @param src_size Number of input bytes
+ * @param dst Destination buffer
+ * @param dst_size In: destination capacity; out: compressed size
+ * @return HUFF_OK or a negative status code
+ */
+static int compressToBuffer(const huff_params* params, ContainerWorkspace* workspace,
+                            const void* src, size_t src_size, void* dst, size_t* dst_size) {
+    if ((!src && src_size > 0) || !dst || !dst_size || (params && !validParams(params))) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+
+    BufferTarget target = { (unsigned char*)dst, *dst_size, 0 };
+    huff_stream* stream = createCompressStream(params, src_size, workspace, writeToBuffer,
+                                               &target);
+    if (!stream) {
+        return HUFF_ERROR_OUT_OF_MEMORY;
+    }
+
+    int status = huff_stream_write(stream, src, src_size);
+    if (status == HUFF_OK) {
+        status = huff_stream_finish(stream);
+    }
+    huff_stream_destroy(stream);
+
+    if (status == HUFF_ERROR_CALLBACK) {
+        return HUFF_ERROR_DESTINATION_TOO_SMALL;
+    }
+    *dst_size = target.size;
+    return status;
+}
+
+int huff_compress_with(const huff_params* params, const void* src, size_t src_size,
+                       void* dst, size_t* dst_size) {
+    return compressToBuffer(params, NULL, src, src_size, dst, dst_size);
+}
+
+int huff_decompressed_size(const void* src, size_t src_size, uint64_t* size) {
+    const unsigned char* bytes = (const unsigned char*)src;
+    if (!src || !size) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+    if (src_size >= sizeof(uint32_t) && get32(bytes) == MAGIC_TABLE_MESSAGE) {
+        uint32_t id;
+        size_t consumed;
+        return readTableMessageFields(bytes + 4, src_size - 4, &id, size, &consumed) == 0
+            ? HUFF_OK : HUFF_ERROR_TRUNCATED_INPUT;
+    }
+    if (src_size < CONTAINER_HEADER_SIZE) {
+        return HUFF_ERROR_TRUNCATED_INPUT;
+    }
+    if (get32(bytes) != MAGIC_BLOCKS) {
+        return HUFF_ERROR_UNSUPPORTED_FORMAT;
+    }
+
+    ContainerHeader header;
+    header.version = bytes[4];
+    header.flags = bytes[5];
+    header.block_size = get32(bytes + 8);
+    header.original_size = get64(bytes + 12);
+    if (validateContainerHeader(&header) != 0) {
+        return HUFF_ERROR_UNSUPPORTED_FORMAT;
+    }
+
+    if (!(header.flags & CONTAINER_FLAG_STREAMED)) {
+        *size = header.original_size;
+        return HUFF_OK;
+    }
+
+    // Streamed containers: add up the block headers
+    uint64_t total = 0;
+    size_t offset = CONTAINER_HEADER_SIZE;
+    while (1) {
+        if (src_size - offset < BLOCK_HEADER_SIZE) {
+            return HUFF_ERROR_TRUNCATED_INPUT;
+        }
+        uint32_t rawSize = get32(bytes + offset);
+        uint32_t payloadSize = get32(bytes + offset + 4);
+        offset += BLOCK_HEADER_SIZE;
+        if (rawSize == 0) break;
+        if (payloadSize > src_size - offset) {
+            return HUFF_ERROR_TRUNCATED_INPUT;
+        }
+        total += rawSize;
+        offset += payloadSize;
+    }
+
+    *size = total;
+    return HUFF_OK;
+}
+
+/**
+ * Write function committing to a buffer sink
+ * @param user OutputSink from openBufferSink
+ * @param data Bytes to append (in place when they were reserved in the sink)
+ * @param size Number of bytes
+ * @return 0 on success, -1 if the buffer is full
+ */
+static int writeToSink(void* user, const void* data, size_t size) {
+    OutputSink* sink = (OutputSink*)user;
+    if (size > sink->mapSize - sink->position) {
+        return -1;
+    }
+    return commitOutput(sink, (const unsigned char*)data, size);
+}
+
+/**
+ * Decompresses a container into a caller buffer through a stream
+ * Blocks are decoded straight into the destination.
+ * @param workspace Context workspace to borrow, or NULL for one thread
+ * @param src Compressed bytes
+ * @param src_size Number of compressed bytes
+ * @param dst Destination buffer
+ * @param dst_size In: destination capacity; out: decompressed size
+ * @return HUFF_OK or a negative status code
+ */
+static int decompressToBuffer(ContainerWorkspace* workspace, const void* src, size_t src_size,
+                              void* dst, size_t* dst_size) {
+    if (!src || !dst_size || (!dst && *dst_size > 0)) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+
+    OutputSink sink;
+    openBufferSink(&sink, (unsigned char*)dst, *dst_size);
+    huff_stream* stream = createDecompressStream(1, workspace, writeToSink, &sink);
+    if (!stream) {
+        return HUFF_ERROR_OUT_OF_MEMORY;
+    }
+    stream->sink = &sink;
+
+    int status = huff_stream_write(stream, src, src_size);
+    if (status == HUFF_OK) {
+        status = huff_stream_finish(stream);
+    }
+    huff_stream_destroy(stream);
+
+    if (status == HUFF_ERROR_CALLBACK) {
+        return HUFF_ERROR_DESTINATION_TOO_SMALL;
+    }
+    *dst_size = (size_t)sink.position;
+    return status;
+}
+
+int huff_decompress(const void* src, size_t src_size, void* dst, size_t* dst_size) {
+    return decompressToBuffer(NULL, src, src_size, dst, dst_size);
+}
+
+int huff_decompress_range(const void* src, size_t src_size, uint64_t offset, void* dst,
+                          size_t* dst_size) {
+    const unsigned char* bytes = (const unsigned char*)src;
+    if (!src || !dst_size || (!dst && *dst_size > 0)) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+    if (src_size >= sizeof(uint32_t) && get32(bytes) != MAGIC_BLOCKS) {
+        return HUFF_ERROR_UNSUPPORTED_FORMAT;
+    }
+
+    ContainerHeader header;
+    ContainerIndex index;
+    if (readContainerIndex(bytes, src_size, &header, &index) != 0) {
+        return src_size < CONTAINER_HEADER_SIZE + BLOCK_HEADER_SIZE + INDEX_TRAILER_SIZE
+            ? HUFF_ERROR_TRUNCATED_INPUT : HUFF_ERROR_CORRUPT_INPUT;
+    }
+    if (offset > index.rawOffset) {
+        destroyContainerIndex(&index);
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+
+    size_t length = *dst_size;
+    if (length > index.rawOffset - offset) {
+        length = (size_t)(index.rawOffset - offset);
+    }
+
+    void* statsUser;
+    huff_stats_fn statsFn = currentStatsCallback(&statsUser);
+    CodecStats stats;
+    beginCodecStats(statsFn ? &stats : NULL);
+
+    int status = HUFF_OK;
+    ThreadPool* pool = createThreadPool(1);
+    if (!pool) {
+        status = HUFF_ERROR_OUT_OF_MEMORY;
+    } else if (decodeContainerRange(bytes, &header, &index, pool, offset, length,
+                                    (unsigned char*)dst, statsFn ? &stats : NULL) != 0) {
+        status = HUFF_ERROR_CORRUPT_INPUT;
+    } else {
+        *dst_size = length;
+    }
+
+    if (statsFn) {
+        stats.bytesOut = status == HUFF_OK ? length : 0;
+        if (pool) {
+            collectPoolStats(&stats, pool);
+        }
+        endCodecStats(&stats);
+        reportStats(statsFn, statsUser, &stats, 0, status);
+    }
+
+    destroyThreadPool(pool);
+    destroyContainerIndex(&index);
+    return status;
+}
+
+// =============================================================================
+// CODEC CONTEXTS
+// =============================================================================
+
+struct huff_context {
+    ContainerWorkspace workspace;
+};
+
+huff_context* huff_context_create(int threads) {
+    if (threads < 0) {
+        return NULL;
+    }
+
+    huff_context* context = (huff_context*)calloc(1, sizeof(huff_context));
+    if (!context) {
+        return NULL;
+    }
+    if (initContainerWorkspace(&context->workspace, resolveThreadCount(threads)) != 0) {
+        free(context);
+        return NULL;
+    }
+    return context;
+}
+
+int huff_context_compress(huff_context* context, const huff_params* params, const void* src,
+                          size_t src_size, void* dst, size_t* dst_size) {
+    if (!context) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+    return compressToBuffer(params, &context->workspace, src, src_size, dst, dst_size);
+}
+
+int huff_context_decompress(huff_context* context, const void* src, size_t src_size,
+                            void* dst, size_t* dst_size) {
+    if (!context) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+    return decompressToBuffer(&context->workspace, src, src_size, dst, dst_size);
+}
+
+void huff_context_destroy(huff_context* context) {
+    if (!context) return;
+
+    destroyContainerWorkspace(&context->workspace);
+    free(context);
+}
+
+// =============================================================================
+// COMPRESSED SCAN
+// =============================================================================
+
+struct huff_scan {
+    ContainerScan scan;
+    int status;                  // First error, sticky
+    huff_stats_fn statsFn;
+    void* statsUser;
+    CodecStats stats;
+};
+
+int huff_scan_create(const void* src, size_t src_size, const void* pattern,
+                     size_t pattern_size, int threads, huff_scan** scan) {
+    const unsigned char* bytes = (const unsigned char*)src;
+    if (!scan) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+    *scan = NULL;
+    if (!src || !pattern || pattern_size == 0 || threads < 0) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+    if (src_size >= sizeof(uint32_t) && get32(bytes) != MAGIC_BLOCKS) {
+        return HUFF_ERROR_UNSUPPORTED_FORMAT;
+    }
+
+    huff_scan* created = (huff_scan*)calloc(1, sizeof(huff_scan));
+    if (!created) {
+        return HUFF_ERROR_OUT_OF_MEMORY;
+    }
+    created->statsFn = currentStatsCallback(&created->statsUser);
+    beginCodecStats(created->statsFn ? &created->stats : NULL);
+
+    if (openContainerScan(&created->scan, bytes, src_size, (const unsigned char*)pattern,
+                          pattern_size, 0, UINT64_MAX, threads,
+                          created->statsFn ? &created->stats : NULL) != 0) {
+        free(created);
+        return src_size < CONTAINER_HEADER_SIZE + BLOCK_HEADER_SIZE + INDEX_TRAILER_SIZE
+            ? HUFF_ERROR_TRUNCATED_INPUT : HUFF_ERROR_CORRUPT_INPUT;
+    }
+
+    *scan = created;
+    return HUFF_OK;
+}
+
+int huff_scan_next(huff_scan* scan, uint64_t* offset) {
+    if (!scan || !offset) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+    if (scan->status != HUFF_OK) {
+        return scan->status;
+    }
+
+    int found = nextScanMatch(&scan->scan, offset);
+    if (found < 0) {
+        scan->status = HUFF_ERROR_CORRUPT_INPUT;
+        return scan->status;
+    }
+    return found;
+}
+
+void huff_scan_destroy(huff_scan* scan) {
+    if (!scan) return;
+
+    // Pool counts are collected as the scan closes
+    closeContainerScan(&scan->scan);
+    if (scan->statsFn) {
+        endCodecStats(&scan->stats);
+        reportStats(scan->statsFn, scan->statsUser, &scan->stats, 0, scan->status);
+    }
+    free(scan);
+}
+
+// =============================================================================
+// TRAINED TABLES
+// =============================================================================
+
+struct huff_table {
+    CodeTable table;
+};
+
+int huff_table_train(const void* const* samples, const size_t* sizes, size_t count,
+                     int max_code_length, huff_table** table) {
+    if (!table || (count > 0 && (!samples || !sizes))) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+    if (max_code_length == 0) {
+        max_code_length = DEFAULT_MAX_CODE_LENGTH;
+    }
+    if (max_code_length < 8 || max_code_length > MAX_CANONICAL_CODE_LENGTH) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+
+    uint64_t frequencies[ASCII_SIZE] = {0};
+    for (size_t i = 0; i < count; i++) {
+        if (!samples[i] && sizes[i] > 0) {
+            return HUFF_ERROR_INVALID_ARGUMENT;
+        }
+        countFrequencies((const unsigned char*)samples[i], sizes[i], frequencies);
+    }
+
+    huff_table* result = (huff_table*)malloc(sizeof(huff_table));
+    if (!result) {
+        return HUFF_ERROR_OUT_OF_MEMORY;
+    }
+    if (createCodeTable(&result->table, frequencies, max_code_length) != 0) {
+        free(result);
+        return HUFF_ERROR_OUT_OF_MEMORY;
+    }
+
+    *table = result;
+    return HUFF_OK;
+}
+
+int huff_table_load(const void* data, size_t size, huff_table** table) {
+    if (!data || !table) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+    if (size < CODE_TABLE_FILE_SIZE) {
+        return HUFF_ERROR_TRUNCATED_INPUT;
+    }
+
+    huff_table* result = (huff_table*)malloc(sizeof(huff_table));
+    if (!result) {
+        return HUFF_ERROR_OUT_OF_MEMORY;
+    }
+    if (parseCodeTable(&result->table, (const unsigned char*)data, size) != 0) {
+        free(result);
+        return HUFF_ERROR_CORRUPT_INPUT;
+    }
+
+    *table = result;
+    return HUFF_OK;
+}
+
+int huff_table_save(const huff_table* table, void* dst, size_t* dst_size) {
+    if (!table || !dst || !dst_size) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+    if (*dst_size < CODE_TABLE_FILE_SIZE) {
+        return HUFF_ERROR_DESTINATION_TOO_SMALL;
+    }
+
+    serializeCodeTable(&table->table, (unsigned char*)dst);
+    *dst_size = CODE_TABLE_FILE_SIZE;
+    return HUFF_OK;
+}
+
+uint32_t huff_table_id(const huff_table* table) {
+    return table->table.id;
+}
+
+int huff_table_compress(const huff_table* table, const void* src, size_t src_size,
+                        void* dst, size_t* dst_size) {
+    if (!table || (!src && src_size > 0) || !dst || !dst_size) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+
+    // The bit writer needs slack past the message; small destinations get
+    // a scratch buffer and a copy
+    size_t bound = tableMessageBound(src_size);
+    unsigned char* output = (unsigned char*)dst;
+    if (*dst_size < bound) {
+        output = (unsigned char*)malloc(bound);
+        if (!output) {
+            return HUFF_ERROR_OUT_OF_MEMORY;
+        }
+    }
+
+    size_t written;
+    int status = HUFF_OK;
+    if (encodeTableMessage(&table->table, (const unsigned char*)src, src_size,
+                           output, &written) != 0) {
+        status = HUFF_ERROR_INVALID_ARGUMENT;
+    } else if (written > *dst_size) {
+        status = HUFF_ERROR_DESTINATION_TOO_SMALL;
+    } else {
+        if (output != dst) {
+            memcpy(dst, output, written);
+        }
+        *dst_size = written;
+    }
+
+    if (output != dst) {
+        free(output);
+    }
+    return status;
+}
+
+int huff_table_decompress(const huff_table* table, const void* src, size_t src_size,
+                          void* dst, size_t* dst_size) {
+    const unsigned char* bytes = (const unsigned char*)src;
+    if (!table || !src || !dst_size || (!dst && *dst_size > 0)) {
+        return HUFF_ERROR_INVALID_ARGUMENT;
+    }
+    if (src_size < sizeof(uint32_t)) {
+        return HUFF_ERROR_TRUNCATED_INPUT;
+    }
+    if (get32(bytes) != MAGIC_TABLE_MESSAGE) {
+        return HUFF_ERROR_UNSUPPORTED_FORMAT;
+    }
+
+    uint32_t id;
+    uint64_t originalSize;
+    size_t consumed;
+    if (readTableMessageFields(bytes + 4, src_size - 4, &id, &originalSize, &consumed) != 0) {
+        return HUFF_ERROR_TRUNCATED_INPUT;
+    }
+    if (id != table->table.id) {
+        return HUFF_ERROR_UNSUPPORTED_FORMAT;
+    }
+    if (originalSize > *dst_size) {
+        return HUFF_ERROR_DESTINATION_TOO_SMALL;
+    }
+
+    size_t decoded;
+    if (decodeTableMessage(&table->table, bytes, src_size, (unsigned char*)dst, *dst_size,
+                           &decoded) != 0) {
+        return HUFF_ERROR_CORRUPT_INPUT;
+    }
+    *dst_size = decoded;
+    return HUFF_OK;
+}
+
+void huff_table_destroy(huff_table* table) {
+    if (!table) return;
+    destroyCodeTable(&table->table);
+    free(table);
+}
@@ -0,0 +1,399 @@
+#ifndef LIBHUFFMAN_H
+#define LIBHUFFMAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// In-memory interface to the Huffman block container. Buffers produced
+// here are byte-identical to files written by `huffman -c` with the same
+// parameters, and either can be decoded by the other.
+
+// Entry points exported from libhuffman.so; the library is compiled with
+// -fvisibility=hidden, so its internal functions stay out of the dynamic
+// symbol table
+#if defined(__GNUC__) && __GNUC__ >= 4
+#define HUFF_API __attribute__((visibility("default")))
+#else
+#define HUFF_API
+#endif
+
+#define HUFF_VERSION_MAJOR 1
+#define HUFF_VERSION_MINOR 10
+
+// Status Codes (negative values are errors)
+#define HUFF_OK 0
+#define HUFF_ERROR_INVALID_ARGUMENT -1
+#define HUFF_ERROR_OUT_OF_MEMORY -2
+#define HUFF_ERROR_DESTINATION_TOO_SMALL -3
+#define HUFF_ERROR_CORRUPT_INPUT -4
+#define HUFF_ERROR_TRUNCATED_INPUT -5
+#define HUFF_ERROR_UNSUPPORTED_FORMAT -6
+#define HUFF_ERROR_CALLBACK -7     // The stream's write function reported a failure
+
+// Compression Parameters
+typedef struct huff_params {
+    int max_code_length;   // 8-15, default 12
+    uint32_t block_size;   // Uncompressed bytes per block, 4 KiB to 64 MiB, default 1 MiB
+    int threads;           // Threads per call or stream (0 = all cores), default 1
+    int streams;           // Bit streams per block, 1 or 4 (decoded in lockstep), default 4
+    int split_level;       // 0-3: split blocks where the statistics change (higher is
+                           // slower and smaller), default 0 (fixed blocks)
+    int context_model;     // 1: code blocks with tables chosen by the previous byte where
+                           // that is smaller (slower), default 0
+    int checksums;         // 1: store a CRC32C of every block, verified as it decodes,
+                           // default 0
+} huff_params;
+
+// Receives output from a stream, in order; returns 0 on success
+typedef int (*huff_write_fn)(void* user, const void* data, size_t size);
+
+// Counters and timers of one stream or buffer call (see huff_set_stats_callback)
+// Phase times add up every thread's time, so with several threads they
+// can exceed wall_seconds.
+typedef struct huff_stats {
+    int compressing;          // 1 for compression, 0 for decompression
+    int status;               // Final status of the call (a buffer call's full
+                              // destination shows as HUFF_ERROR_CALLBACK)
+    uint64_t bytes_in;        // Bytes passed in (for ranges: the blocks read)
+    uint64_t bytes_out;       // Bytes handed out
+    double wall_seconds;      // From creation to finish
+    double histogram_seconds;
+    double tree_seconds;      // Block types, code lengths and context models
+    double table_seconds;     // Decode tables
+    double encode_seconds;
+    double decode_seconds;
+    double checksum_seconds;
+    uint64_t blocks;          // Container blocks coded
+    uint64_t symbols;         // Symbols decoded through decode tables
+    uint64_t lookups;         // Decode table lookups (symbols / lookups > 1 with paired entries)
+    uint64_t long_codes;      // Codes resolved through a second-level table
+    uint64_t cached_tables;   // Decode tables reused from earlier blocks instead of built
+    int threads;              // Threads that coded blocks
+    const uint64_t* thread_blocks;  // Block jobs run by each thread (threads entries);
+                                    // only valid during the callback
+} huff_stats;
+
+// Receives the statistics of a finished call
+typedef void (*huff_stats_fn)(void* user, const huff_stats* stats);
+
+// Message Levels (see huff_set_log_callback)
+#define HUFF_LOG_ERROR 0           // The call failed; its status code says how
+#define HUFF_LOG_WARNING 1         // The call went on without something (fewer threads)
+
+// Receives one message, a single line without a trailing newline
+typedef void (*huff_log_fn)(void* user, int level, const char* message);
+
+// Streaming context (compression or decompression)
+typedef struct huff_stream huff_stream;
+
+// Trained code table for small messages (see huff_table_train)
+typedef struct huff_table huff_table;
+
+#define HUFF_TABLE_SIZE 142  // Bytes written by huff_table_save
+
+// Iterator over the matches of a pattern in a container (see huff_scan_create)
+typedef struct huff_scan huff_scan;
+
+// Reusable codec state: worker threads, block buffers and cached decode
+// tables kept between calls (see huff_context_create). A context serves
+// one call at a time.
+typedef struct huff_context huff_context;
+
+/**
+ * Initializes compression parameters with defaults
+ * @param params Parameters to initialize
+ */
+HUFF_API void huff_params_init(huff_params* params);
+
+/**
+ * Installs a process-wide statistics callback
+ * Streams created afterwards (and the buffer functions, which run on
+ * streams) collect counters and phase times, and report them once when
+ * finished or destroyed; huff_decompress_range reports as it returns and
+ * a scan when it is destroyed.
+ * Without a callback nothing is collected.
+ * @param fn Callback, or NULL to stop collecting
+ * @param user Pointer passed to fn
+ */
+HUFF_API void huff_set_stats_callback(huff_stats_fn fn, void* user);
+
+/**
+ * Installs a process-wide message callback
+ * Calls report failures through their status codes and write nothing to
+ * stderr; with a callback installed they also describe what went wrong
+ * (the invalid header, the failing allocation). Messages can arrive from
+ * worker threads while a call runs.
+ * @param fn Callback, or NULL to discard messages (the default)
+ * @param user Pointer passed to fn
+ */
+HUFF_API void huff_set_log_callback(huff_log_fn fn, void* user);
+
+/**
+ * Returns a human-readable description of a status code
+ * @param status Status code
+ * @return Static string
+ */
+HUFF_API const char* huff_error_string(int status);
+
+/**
+ * Upper bound on the compressed size of an input, for any parameters
+ * @param size Uncompressed size in bytes
+ * @return Destination capacity that huff_compress and huff_table_compress never exceed
+ */
+HUFF_API size_t huff_compress_bound(size_t size);
+
+/**
+ * Compresses a buffer with default parameters
+ * @param src Input bytes
+ * @param src_size Number of input bytes
+ * @param dst Destination buffer
+ * @param dst_size In: destination capacity; out: compressed size
+ * @return HUFF_OK or a negative status code
+ */
+HUFF_API int huff_compress(const void* src, size_t src_size, void* dst, size_t* dst_size);
+
+/**
+ * Compresses a buffer
+ * @param params Compression parameters, or NULL for defaults
+ * @param src Input bytes
+ * @param src_size Number of input bytes
+ * @param dst Destination buffer
+ * @param dst_size In: destination capacity; out: compressed size
+ * @return HUFF_OK or a negative status code
+ */
+HUFF_API int huff_compress_with(const huff_params* params, const void* src, size_t src_size,
+                                void* dst, size_t* dst_size);
+
+/**
+ * Reads the decompressed size of a compressed buffer without decoding it
+ * @param src Compressed bytes
+ * @param src_size Number of compressed bytes
+ * @param size Receives the decompressed size
+ * @return HUFF_OK or a negative status code
+ */
+HUFF_API int huff_decompressed_size(const void* src, size_t src_size, uint64_t* size);
+
+/**
+ * Decompresses a buffer
+ * @param src Compressed bytes
+ * @param src_size Number of compressed bytes
+ * @param dst Destination buffer
+ * @param dst_size In: destination capacity; out: decompressed size
+ * @return HUFF_OK or a negative status code
+ */
+HUFF_API int huff_decompress(const void* src, size_t src_size, void* dst, size_t* dst_size);
+
+/**
+ * Decompresses one byte range of a buffer
+ * The block index at the end of the buffer locates the blocks covering the
+ * range; only those are decoded. The range is clipped to the end of the data.
+ * @param src Compressed bytes (a complete container)
+ * @param src_size Number of compressed bytes
+ * @param offset First uncompressed byte
+ * @param dst Destination buffer
+ * @param dst_size In: bytes wanted (destination capacity); out: bytes decompressed
+ * @return HUFF_OK or a negative status code; HUFF_ERROR_INVALID_ARGUMENT if
+ *         offset is past the end of the data
+ */
+HUFF_API int huff_decompress_range(const void* src, size_t src_size, uint64_t offset, void* dst,
+                                   size_t* dst_size);
+
+/**
+ * Creates a codec context
+ * Calls through a context reuse its threads and block buffers, and
+ * decode tables built for earlier payloads: blocks whose code matches a
+ * recently seen one skip table construction.
+ * @param threads Threads used by every call (0 = all cores)
+ * @return Context, or NULL on invalid arguments or allocation failure
+ */
+HUFF_API huff_context* huff_context_create(int threads);
+
+/**
+ * Compresses a buffer with a context (huff_compress_with on reused state)
+ * @param context Context
+ * @param params Compression parameters (threads is ignored), or NULL for defaults
+ * @param src Input bytes
+ * @param src_size Number of input bytes
+ * @param dst Destination buffer
+ * @param dst_size In: destination capacity; out: compressed size
+ * @return HUFF_OK or a negative status code
+ */
+HUFF_API int huff_context_compress(huff_context* context, const huff_params* params,
+                                   const void* src, size_t src_size, void* dst,
+                                   size_t* dst_size);
+
+/**
+ * Decompresses a buffer with a context (huff_decompress on reused state)
+ * @param context Context
+ * @param src Compressed bytes
+ * @param src_size Number of compressed bytes
+ * @param dst Destination buffer
+ * @param dst_size In: destination capacity; out: decompressed size
+ * @return HUFF_OK or a negative status code
+ */
+HUFF_API int huff_context_decompress(huff_context* context, const void* src, size_t src_size,
+                                     void* dst, size_t* dst_size);
+
+/**
+ * Frees a context and everything it caches
+ * @param context Context to destroy (may be NULL)
+ */
+HUFF_API void huff_context_destroy(huff_context* context);
+
+/**
+ * Starts a search of a buffer's decompressed data for a byte pattern
+ * Blocks are decoded a few per thread at a time into one internal buffer
+ * and searched as they are produced; the decompressed data is never held
+ * in full.
+ * @param src Compressed bytes (a complete container; must outlive the scan)
+ * @param src_size Number of compressed bytes
+ * @param pattern Bytes to search for (copied)
+ * @param pattern_size Pattern length (at least 1)
+ * @param threads Threads used to decode blocks (0 = all cores)
+ * @param scan Receives the scan
+ * @return HUFF_OK or a negative status code
+ */
+HUFF_API int huff_scan_create(const void* src, size_t src_size, const void* pattern,
+                              size_t pattern_size, int threads, huff_scan** scan);
+
+/**
+ * Finds the next match of a scan
+ * Matches are returned in order of their offsets, overlapping ones included.
+ * @param scan Scan
+ * @param offset Receives the uncompressed offset of the match
+ * @return 1 if a match was found, 0 at the end of the data, or a negative
+ *         status code (sticky)
+ */
+HUFF_API int huff_scan_next(huff_scan* scan, uint64_t* offset);
+
+/**
+ * Frees a scan
+ * @param scan Scan to destroy (may be NULL)
+ */
+HUFF_API void huff_scan_destroy(huff_scan* scan);
+
+/**
+ * Creates a compression stream
+ * Input passed to huff_stream_write is cut into blocks; compressed
+ * output is handed to write as blocks complete.
+ * @param params Compression parameters, or NULL for defaults
+ * @param write Output function
+ * @param user Pointer passed to write
+ * @return Stream, or NULL on invalid parameters or allocation failure
+ */
+HUFF_API huff_stream* huff_compress_stream_create(const huff_params* params, huff_write_fn write,
+                                                  void* user);
+
+/**
+ * Creates a decompression stream
+ * Compressed input may be passed to huff_stream_write in pieces of any
+ * size; decompressed output is handed to write in order.
+ * @param threads Threads used to decode blocks (0 = all cores)
+ * @param write Output function
+ * @param user Pointer passed to write
+ * @return Stream, or NULL on allocation failure
+ */
+HUFF_API huff_stream* huff_decompress_stream_create(int threads, huff_write_fn write, void* user);
+
+/**
+ * Feeds input to a stream
+ * @param stream Stream
+ * @param data Input bytes (only read during the call)
+ * @param size Number of input bytes
+ * @return HUFF_OK or a negative status code; errors are sticky
+ */
+HUFF_API int huff_stream_write(huff_stream* stream, const void* data, size_t size);
+
+/**
+ * Ends a stream: flushes compression output, or checks that the
+ * compressed input was complete
+ * @param stream Stream
+ * @return HUFF_OK or a negative status code
+ */
+HUFF_API int huff_stream_finish(huff_stream* stream);
+
+/**
+ * Frees a stream
+ * @param stream Stream to destroy (may be NULL)
+ */
+HUFF_API void huff_stream_destroy(huff_stream* stream);
+
+/**
+ * Trains a code table on sample messages
+ * Messages coded with the table carry only its 32-bit ID instead of code
+ * lengths, and the table's decoder is built once for all of them.
+ * @param samples Sample buffers
+ * @param sizes Size of each sample
+ * @param count Number of samples
+ * @param max_code_length 8-15, or 0 for the default of 12
+ * @param table Receives the table
+ * @return HUFF_OK or a negative status code
+ */
+HUFF_API int huff_table_train(const void* const* samples, const size_t* sizes, size_t count,
+                              int max_code_length, huff_table** table);
+
+/**
+ * Loads a table written by huff_table_save (or `huffman --train`)
+ * @param data Serialized table
+ * @param size Number of bytes
+ * @param table Receives the table
+ * @return HUFF_OK or a negative status code
+ */
+HUFF_API int huff_table_load(const void* data, size_t size, huff_table** table);
+
+/**
+ * Serializes a table
+ * @param table Table
+ * @param dst Destination buffer
+ * @param dst_size In: destination capacity (at least HUFF_TABLE_SIZE); out: bytes written
+ * @return HUFF_OK or a negative status code
+ */
+HUFF_API int huff_table_save(const huff_table* table, void* dst, size_t* dst_size);
+
+/**
+ * Returns the ID that messages coded with a table reference
+ * @param table Table
+ * @return Table ID
+ */
+HUFF_API uint32_t huff_table_id(const huff_table* table);
+
+/**
+ * Compresses a message with a trained table
+ * @param table Table
+ * @param src Input bytes
+ * @param src_size Number of input bytes
+ * @param dst Destination buffer
+ * @param dst_size In: destination capacity; out: compressed size
+ * @return HUFF_OK or a negative status code
+ */
+HUFF_API int huff_table_compress(const huff_table* table, const void* src, size_t src_size,
+                                 void* dst, size_t* dst_size);
+
+/**
+ * Decompresses a message coded with huff_table_compress
+ * @param table Table the message was coded with
+ * @param src Compressed bytes
+ * @param src_size Number of compressed bytes
+ * @param dst Destination buffer
+ * @param dst_size In: destination capacity; out: decompressed size
+ * @return HUFF_OK, HUFF_ERROR_UNSUPPORTED_FORMAT if the message names another
+ *         table, or another negative status code
+ */
+HUFF_API int huff_table_decompress(const huff_table* table, const void* src, size_t src_size,
+                                   void* dst, size_t* dst_size);
+
+/**
+ * Frees a table
+ * @param table Table to destroy (may be NULL)
+ */
+HUFF_API void huff_table_destroy(huff_table* table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBHUFFMAN_H